@@ -0,0 +1,276 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define ATTENTION_MAX_TILE_C 4095
+// limit of the columns per channel of the matrix layout of okk_bdc_matmul
+#define ATTENTION_MAX_COLS_PER_CHANNEL 128
+// lower bound of the inputs of okk_bdc_exp
+#define ATTENTION_EXP_MIN -103.f
+// masked scores and the running max before the first block
+#define ATTENTION_MASKED -1e30f
+/*
+ * Attention, softmax(scale * Q x K^T) x V without the scores in DDR.
+ *
+ * query  [batch, heads, seq_q, dim] fp32
+ * key    [batch, heads, seq_k, dim] fp32
+ * value  [batch, heads, seq_k, dim] fp32
+ * output [batch, heads, seq_q, dim] fp32
+ * With causal, query i attends to the keys j <= i + seq_k - seq_q, the last
+ * seq_q positions of the keys as with a KV cache.
+ *
+ * A tile is tile_q queries of a head against blocks of tile_k keys. Scores
+ * are computed transposed, S^T = K x Q^T by okk_bdc_matmul, so the keys are
+ * on n and the queries on the columns of the matrix layout, across the NPUs
+ * and along w: the max and sum over the keys of a query are halving max
+ * and adds along n, and the per-query vectors of the online softmax are
+ * one row [1, c, 1, w] of the same layout, broadcast over n by a zero n
+ * stride. Q^T is scaled once per tile. Per block, m is the running max and
+ * l the running sum:
+ *
+ *   m' = max(m, max(S^T)), alpha = exp(m - m')
+ *   P^T = exp(S^T - m'), l = l * alpha + sum(P^T)
+ *   O^T = O^T * alpha + V^T x P^T, by okk_bdc_matmul with result_add
+ *
+ * and the output is O^T / l stored transposed. Q^T, V^T and O^T are moved
+ * by GDMA with the columns of a channel along h with unit stride, each a
+ * row of Q, V or the output, so GDMA keeps its unit w stride. K is in the
+ * matrix layout as it is. Each tile reads K and V once, so the traffic is
+ * O(seq_k) per tile of queries instead of the O(seq_q * seq_k) of the
+ * scores. With causal, blocks past the last query of a tile are skipped and
+ * the blocks on the diagonal get their masked scores set to
+ * ATTENTION_MASKED.
+ */
+typedef struct {
+    int batch, heads, seq_q, seq_k, dim;
+    int causal;
+    float scale;
+    unsigned long long output_addr;
+    unsigned long long query_addr;
+    unsigned long long key_addr;
+    unsigned long long value_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+// Columns per channel of a matrix of cols columns in the matrix layout.
+static int attention_cols_per_channel(int cols) {
+    return MIN(DIV_UP(cols, okk_npu_num()), ATTENTION_MAX_COLS_PER_CHANNEL);
+}
+
+static unsigned int attention_aligned_bytes(int n, int c, int h, int w) {
+    const dim4 shape = {.n = n, .c = c, .h = h, .w = w};
+    dim4 stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    return okk_arena_align_up(n * stride.n * sizeof(float), 128);
+}
+
+// Local memory per NPU of a tile.
+static unsigned int attention_tile_bytes(int dim, int tile_q, int tile_k) {
+    const int key_cpc = attention_cols_per_channel(dim);
+    const int query_cpc = attention_cols_per_channel(tile_q), value_cpc = attention_cols_per_channel(tile_k);
+    const int query_c = DIV_UP(tile_q, query_cpc);
+    // Q^T, K, V^T, S^T and work, O^T, m, m', alpha, l and the work of exp
+    return attention_aligned_bytes(dim, query_c, 1, query_cpc) +
+           attention_aligned_bytes(tile_k, DIV_UP(dim, key_cpc), 1, key_cpc) +
+           attention_aligned_bytes(dim, DIV_UP(tile_k, value_cpc), 1, value_cpc) +
+           2 * attention_aligned_bytes(tile_k, query_c, 1, query_cpc) +
+           attention_aligned_bytes(dim, query_c, 1, query_cpc) +
+           5 * attention_aligned_bytes(1, query_c, 1, query_cpc);
+}
+
+// Address of channel c of a tensor starting at addr in NPU 0.
+static local_addr_t attention_channel_addr(local_addr_t addr, int c, const dim4 *stride) {
+    const int npu_num = okk_npu_num();
+    return (c % npu_num) * LOCAL_MEM_SIZE + addr + c / npu_num * stride->c * sizeof(float);
+}
+
+// Copies the [cols, dim] rows at global_addr to the [dim, cols] matrix at
+// local_addr with cpc columns per channel, or back with store. The columns
+// of a channel are viewed along h with unit stride.
+static void attention_transpose(local_addr_t local_addr, system_addr_t global_addr, int cols, int dim, int cpc, const dim4 *stride, int store) {
+    const dim4 local_stride = {.n = stride->n, .c = stride->c, .h = 1, .w = 1};
+    const dim4 global_stride = {.n = 1, .c = cpc * dim, .h = dim, .w = 1};
+    // the full channels, then the columns of the last one
+    const int full = cols / cpc, rest = cols % cpc;
+    const dim4 shapes[2] = {{.n = dim, .c = full, .h = cpc, .w = 1}, {.n = dim, .c = 1, .h = rest, .w = 1}};
+    const local_addr_t local_addrs[2] = {local_addr, attention_channel_addr(local_addr, full, stride)};
+    const system_addr_t global_addrs[2] = {global_addr, global_addr + (unsigned long long)full * cpc * dim * sizeof(float)};
+    for (int i = 0; i < 2; ++i) {
+        if (shapes[i].c == 0 || shapes[i].h == 0)
+            continue;
+        if (store)
+            okk_gdma_32bit_cpy_L2S(global_addrs[i], local_addrs[i], &shapes[i], &global_stride, &local_stride);
+        else
+            okk_gdma_32bit_cpy_S2L(local_addrs[i], global_addrs[i], &shapes[i], &local_stride, &global_stride);
+    }
+}
+
+// Sets the first count columns of the row at addr with cpc columns per
+// channel to value.
+static void attention_set_cols(local_addr_t addr, x32 value, int count, int cpc, const dim4 *stride) {
+    const int full = count / cpc, rest = count % cpc;
+    if (full > 0)
+        okk_bdc_32bit_set_C(addr, value, &(dim4){.n = 1, .c = full, .h = 1, .w = cpc}, stride);
+    if (rest > 0)
+        okk_bdc_32bit_set_C(attention_channel_addr(addr, full, stride), value, &(dim4){.n = 1, .c = 1, .h = 1, .w = rest}, stride);
+}
+
+// work[0] = the max (or sum) of src over n, the rest of work is clobbered.
+static void attention_reduce_n(local_addr_t work_addr, local_addr_t src_addr, int keys, const dim4 *vector_shape, const dim4 *stride, int sum) {
+    int height = keys;
+    local_addr_t addr = src_addr;
+    if (height == 1)
+        okk_bdc_32bit_cpy(work_addr, src_addr, vector_shape, stride, stride);
+    while (height > 1) {
+        const int half = height / 2;
+        const dim4 shape = {.n = half, .c = vector_shape->c, .h = 1, .w = vector_shape->w};
+        const local_addr_t upper_addr = addr + (height - half) * stride->n * sizeof(float);
+        if (sum)
+            okk_bdc_add(work_addr, addr, upper_addr, &shape, stride, stride, stride);
+        else
+            okk_bdc_max(work_addr, addr, upper_addr, &shape, stride, stride, stride);
+        // the middle row of an odd height stays in src for the first halving
+        if (addr != work_addr && height - half > half)
+            okk_bdc_32bit_cpy(
+                work_addr + half * stride->n * sizeof(float),
+                addr + half * stride->n * sizeof(float),
+                vector_shape,
+                stride,
+                stride);
+        addr = work_addr;
+        height -= half;
+    }
+}
+
+void attention(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    const int B = param->batch * param->heads, Sq = param->seq_q, Sk = param->seq_k, D = param->dim;
+    OKKERNEL_ASSERT(B > 0 && Sq > 0 && Sk > 0 && D > 0 && param->scale > 0);
+    OKKERNEL_ASSERT(!param->causal || Sk >= Sq);
+    const int offset = Sk - Sq;
+    // Keys and queries in multiples of the NPUs, the larger first, then
+    // keys.
+    const int npu_num = okk_npu_num();
+    int tile_q = MIN(Sq, ATTENTION_MAX_TILE_C);
+    int tile_k = MIN(Sk, ATTENTION_MAX_TILE_C);
+    while (attention_tile_bytes(D, tile_q, tile_k) > LOCAL_MEM_SIZE) {
+        if (tile_k > npu_num && tile_k >= tile_q)
+            tile_k = DIV_UP(tile_k, 2 * npu_num) * npu_num;
+        else if (tile_q > npu_num)
+            tile_q = DIV_UP(tile_q, 2 * npu_num) * npu_num;
+        else if (tile_k > 1)
+            tile_k = DIV_UP(tile_k, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_q = okk_tune_tile(param->tune.tile_c, tile_q);
+    tile_k = okk_tune_tile(param->tune.tile_n, tile_k);
+    const int key_cpc = attention_cols_per_channel(D);
+    const int max_query_cpc = attention_cols_per_channel(tile_q), max_value_cpc = attention_cols_per_channel(tile_k);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    // the layouts of each tile are the aligned ones of its shape, these are
+    // the largest
+    const dim4 max_query_shape = {.n = D, .c = DIV_UP(tile_q, max_query_cpc), .h = 1, .w = max_query_cpc};
+    const dim4 max_key_shape = {.n = tile_k, .c = DIV_UP(D, key_cpc), .h = 1, .w = key_cpc};
+    const dim4 max_value_shape = {.n = D, .c = DIV_UP(tile_k, max_value_cpc), .h = 1, .w = max_value_cpc};
+    const dim4 max_score_shape = {.n = tile_k, .c = max_query_shape.c, .h = 1, .w = max_query_cpc};
+    const dim4 max_vector_shape = {.n = 1, .c = max_query_shape.c, .h = 1, .w = max_query_cpc};
+    dim4 stride;
+    local_addr_t query_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_query_shape, OKK_ARENA_ANY);
+    local_addr_t key_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_key_shape, OKK_ARENA_ANY);
+    local_addr_t value_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_value_shape, OKK_ARENA_ANY);
+    local_addr_t score_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_score_shape, OKK_ARENA_ANY);
+    local_addr_t work_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_score_shape, OKK_ARENA_ANY);
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_query_shape, OKK_ARENA_ANY);
+    local_addr_t max_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t new_max_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t alpha_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t sum_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t exp_work_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_vector_shape, OKK_ARENA_ANY);
+    const x32 zero = {.fp32 = 0.f}, masked = {.fp32 = ATTENTION_MASKED};
+    int tile = 0;
+    for (int b = 0; b < B; ++b) {
+        for (int q = 0; q < Sq; q += tile_q) {
+            const int queries = MIN(tile_q, Sq - q);
+            const int query_cpc = attention_cols_per_channel(queries);
+            // columns past queries in the last channel are computed and not stored
+            const dim4 query_shape = {.n = D, .c = DIV_UP(queries, query_cpc), .h = 1, .w = query_cpc};
+            const dim4 vector_shape = {.n = 1, .c = query_shape.c, .h = 1, .w = query_cpc};
+            dim4 query_stride, vector_stride;
+            okk_128_byte_aligned_stride_for_32bit(&query_stride, 0, &query_shape);
+            okk_128_byte_aligned_stride_for_32bit(&vector_stride, 0, &vector_shape);
+            // a vector of the tile repeated for every row of a matrix of it
+            const dim4 broadcast_stride = {.n = 0, .c = vector_stride.c, .h = vector_stride.h, .w = 1};
+            const unsigned long long query_offset = ((unsigned long long)b * Sq + q) * D * sizeof(float);
+            // stages: 0 load, 1 scores, 2 softmax, 3 accumulate, 4 store
+            OKK_TIMER_TILE(0, tile);
+            attention_transpose(query_addr, param->query_addr + query_offset, queries, D, query_cpc, &query_stride, 0);
+            okk_bdc_mul_C(query_addr, query_addr, param->scale, &query_shape, &query_stride, &query_stride);
+            okk_bdc_32bit_set_C(max_addr, masked, &vector_shape, &vector_stride);
+            okk_bdc_32bit_set_C(sum_addr, zero, &vector_shape, &vector_stride);
+            // keys past the last query of the tile are all masked
+            const int key_end = param->causal ? MIN(Sk, q + queries + offset) : Sk;
+            for (int k = 0; k < key_end; k += tile_k) {
+                const int keys = MIN(tile_k, key_end - k);
+                const int value_cpc = attention_cols_per_channel(keys);
+                const dim4 score_shape = {.n = keys, .c = query_shape.c, .h = 1, .w = query_cpc};
+                const dim4 value_shape = {.n = D, .c = DIV_UP(keys, value_cpc), .h = 1, .w = value_cpc};
+                dim4 score_stride, value_stride;
+                okk_128_byte_aligned_stride_for_32bit(&score_stride, 0, &score_shape);
+                okk_128_byte_aligned_stride_for_32bit(&value_stride, 0, &value_shape);
+                const unsigned long long key_offset = ((unsigned long long)b * Sk + k) * D * sizeof(float);
+                OKK_TIMER_TILE(0, tile);
+                okk_gdma_32bit_matrix_S2L(key_addr, param->key_addr + key_offset, keys, D, key_cpc, D);
+                attention_transpose(value_addr, param->value_addr + key_offset, keys, D, value_cpc, &value_stride, 0);
+                OKK_TIMER_TILE(1, tile);
+                okk_bdc_matmul(score_addr, key_addr, query_addr, 0, keys, D, queries, key_cpc, query_cpc, false, false);
+                if (param->causal && k + keys - 1 > q + offset) {
+                    // key j masks the queries i < j - offset
+                    for (int j = MAX(k, q + offset + 1); j < k + keys; ++j)
+                        attention_set_cols(score_addr + (j - k) * score_stride.n * sizeof(float), masked, MIN(queries, j - offset - q), query_cpc, &score_stride);
+                }
+                OKK_TIMER_TILE(2, tile);
+                // m' = max(m, max(S^T)), alpha = exp(m - m')
+                attention_reduce_n(work_addr, score_addr, keys, &vector_shape, &score_stride, 0);
+                okk_bdc_max(new_max_addr, work_addr, max_addr, &vector_shape, &vector_stride, &score_stride, &vector_stride);
+                okk_bdc_sub(alpha_addr, max_addr, new_max_addr, &vector_shape, &vector_stride, &vector_stride, &vector_stride);
+                okk_bdc_max_C(alpha_addr, alpha_addr, ATTENTION_EXP_MIN, &vector_shape, &vector_stride, &vector_stride);
+                okk_bdc_exp(alpha_addr, alpha_addr, exp_work_addr, &vector_shape);
+                okk_bdc_32bit_cpy(max_addr, new_max_addr, &vector_shape, &vector_stride, &vector_stride);
+                // P^T = exp(S^T - m'), l = l * alpha + sum(P^T)
+                okk_bdc_sub(score_addr, score_addr, new_max_addr, &score_shape, &score_stride, &score_stride, &broadcast_stride);
+                okk_bdc_max_C(score_addr, score_addr, ATTENTION_EXP_MIN, &score_shape, &score_stride, &score_stride);
+                okk_bdc_exp(score_addr, score_addr, work_addr, &score_shape);
+                attention_reduce_n(work_addr, score_addr, keys, &vector_shape, &score_stride, 1);
+                okk_bdc_mul(sum_addr, sum_addr, alpha_addr, &vector_shape, &vector_stride, &vector_stride, &vector_stride);
+                okk_bdc_add(sum_addr, sum_addr, work_addr, &vector_shape, &vector_stride, &vector_stride, &score_stride);
+                OKK_TIMER_TILE(3, tile);
+                // O^T = O^T * alpha + V^T x P^T
+                if (k > 0)
+                    okk_bdc_mul(output_addr, output_addr, alpha_addr, &query_shape, &query_stride, &query_stride, &broadcast_stride);
+                okk_bdc_matmul(output_addr, value_addr, score_addr, 0, D, keys, queries, value_cpc, query_cpc, false, k > 0);
+                ++tile;
+            }
+            OKK_TIMER_TILE(4, tile);
+            okk_bdc_reciprocal(sum_addr, sum_addr, &vector_shape, &vector_stride, &vector_stride);
+            okk_bdc_mul(output_addr, output_addr, sum_addr, &query_shape, &query_stride, &query_stride, &broadcast_stride);
+            attention_transpose(output_addr, param->output_addr + query_offset, queries, D, query_cpc, &query_stride, 1);
+        }
+    }
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(attention);
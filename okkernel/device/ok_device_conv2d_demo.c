@@ -1,4 +1,6 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -30,17 +32,14 @@ void conv2d_demo(const void *args) {
     dim4 input_shape = {.n = param->N, .c = param->IC, .h = param->H, .w = param->W};
     dim4 kernel_shape = {.n = IC_new, .c = param->OC, .h = param->kernel_h, .w = param->kernel_w * 2};
     dim4 output_stride, input_stride, kernel_stride;
+    okk_arena_t arena;
+    okk_arena_init(&arena);
     // output is 64-byte aligned layout
-    local_addr_t output_addr = 0;
-    okk_128_byte_aligned_stride_for_32bit(&output_stride, 0, &output_shape);
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &output_shape, OKK_ARENA_ANY);
     // input is 64-byte aligned layout
-    local_addr_t input_addr = output_addr + output_shape.n * output_stride.n * sizeof(float);
-    okk_128_byte_aligned_stride_for_32bit(&input_stride, 0, &input_shape);
-    // kernel is compact layout
-    local_addr_t kernel_addr = input_addr + input_shape.n * input_stride.n * sizeof(float);
-    okk_compact_stride(&kernel_stride, 0, &kernel_shape);
-    // check local memory exceeded
-    OKKERNEL_ASSERT(kernel_addr + kernel_shape.n * kernel_stride.n * sizeof(float) <= LOCAL_MEM_SIZE);
+    local_addr_t input_addr = okk_arena_alloc_32bit_aligned(&arena, &input_stride, &input_shape, OKK_ARENA_ANY);
+    // kernel is compact layout, the arena asserts if local memory is exceeded
+    local_addr_t kernel_addr = okk_arena_alloc_32bit_compact(&arena, &kernel_stride, &kernel_shape, OKK_ARENA_ANY);
     // copy input from global memory to local memory
     okk_gdma_32bit_cpy_S2L(
         input_addr,
@@ -91,4 +90,4 @@ void conv2d_demo(const void *args) {
         NULL);
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(conv2d_demo);
+OKKERNEL_FUNC_REGISTER_ID(conv2d_demo);
@@ -0,0 +1,385 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define NO_USE 0
+/*
+ * Grouped convolution with an optional bias, the layers of param/conv.dat.
+ *
+ * input  [N, IC, H, W]
+ * kernel [group, (IC / group + 1) / 2, OC / group, kernel_h, kernel_w, 2],
+ *        the 2IC layout of conv2d_demo for the kernel of each group
+ * bias   [OC], read if using_bias
+ * output [N, OC, output_h, output_w]
+ *
+ * Each group is a slice of IC / group input channels and OC / group output
+ * channels. Groups of at most half the NPUs of output channels (and an even
+ * IC / group) are packed side by side on disjoint NPU slices, NPU_NUM /
+ * (OC / group) of them per conv with a block diagonal kernel, so one load,
+ * conv and store cover them. Larger groups are convolved one by one.
+ * Groups of one input channel (depthwise, possibly with a channel
+ * multiplier) instead put a tile of groups across the NPUs and run one
+ * depthwise2d per output channel of a group.
+ */
+typedef struct {
+    int N, IC, OC, H, W;
+    int group;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int dilation_h, dilation_w;
+    int using_bias;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long kernel_addr;
+    unsigned long long bias_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+typedef struct {
+    int output_h, output_w;
+    int kernel_h_ext;
+    // channels of a group
+    int IC, OC;
+} conv2d_group_dims_t;
+
+static unsigned int conv2d_group_aligned_bytes(int c, int h, int w) {
+    const dim4 shape = {.n = 1, .c = c, .h = h, .w = w};
+    dim4 stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    return okk_arena_align_up(stride.n * sizeof(float), 128);
+}
+
+static unsigned int conv2d_group_compact_bytes(int n, int c, int h, int w) {
+    const dim4 shape = {.n = n, .c = c, .h = h, .w = w};
+    dim4 stride;
+    okk_compact_stride(&stride, 0, &shape);
+    return okk_arena_align_up(n * stride.n * sizeof(float), 128);
+}
+
+// Input rows read by oh consecutive output rows.
+static int conv2d_group_input_rows(const param_t *param, const conv2d_group_dims_t *dims, int oh) {
+    return MIN(param->H, (oh - 1) * param->stride_h + dims->kernel_h_ext);
+}
+
+// Local memory per NPU of the tiles of the generic path.
+static unsigned int conv2d_group_tile_bytes(const param_t *param, const conv2d_group_dims_t *dims, int ic, int oc, int oh) {
+    return conv2d_group_aligned_bytes(oc, oh, dims->output_w) +
+           conv2d_group_aligned_bytes(ic, conv2d_group_input_rows(param, dims, oh), param->W) +
+           conv2d_group_compact_bytes(DIV_UP(ic, 2), oc, param->kernel_h, param->kernel_w * 2) +
+           conv2d_group_compact_bytes(1, oc, 1, 1);
+}
+
+// Local memory per NPU of the tiles of the depthwise path.
+static unsigned int conv2d_group_dw_tile_bytes(const param_t *param, const conv2d_group_dims_t *dims, int c, int oh) {
+    return conv2d_group_aligned_bytes(c, oh, dims->output_w) +
+           conv2d_group_aligned_bytes(c, conv2d_group_input_rows(param, dims, oh), param->W) +
+           conv2d_group_compact_bytes(1, c, param->kernel_h, param->kernel_w) +
+           conv2d_group_compact_bytes(1, c, 1, param->kernel_h * param->kernel_w * 2) +
+           conv2d_group_compact_bytes(1, c, 1, 1);
+}
+
+// Local address of channel c of a tensor at addr with stride.
+static local_addr_t conv2d_group_channel_addr(local_addr_t addr, int c, const dim4 *stride) {
+    const int npu_num = okk_npu_num();
+    return (c % npu_num) * LOCAL_MEM_SIZE + addr + c / npu_num * stride->c * sizeof(float);
+}
+
+// Padding and first input row of the output rows [oh0, oh0 + oh).
+static int conv2d_group_rows(const param_t *param, const conv2d_group_dims_t *dims, int oh0, int oh, Padding *pad, int *input_h) {
+    const int ih_start = oh0 * param->stride_h - param->pad_top;
+    const int ih_end = (oh0 + oh - 1) * param->stride_h - param->pad_top + dims->kernel_h_ext;
+    const int ih_lo = MAX(ih_start, 0), ih_hi = MIN(ih_end, param->H);
+    *input_h = ih_hi - ih_lo;
+    OKKERNEL_ASSERT(*input_h > 0);
+    pad->top = ih_lo - ih_start;
+    pad->bottom = ih_end - ih_hi;
+    pad->left = param->pad_left;
+    pad->right = param->pad_right;
+    return ih_lo;
+}
+
+static void conv2d_group_generic(const param_t *param, const conv2d_group_dims_t *dims) {
+    const int npu_num = okk_npu_num();
+    const int kernel_hw2 = param->kernel_h * param->kernel_w * 2;
+    const int output_h = dims->output_h, output_w = dims->output_w;
+    // Groups packed per conv, their output channels on disjoint NPUs and
+    // their 2IC kernels on disjoint rows of input channel pairs.
+    int pack = 1;
+    if (param->group > 1 && 2 * dims->OC <= npu_num && dims->IC % 2 == 0) {
+        pack = MIN(npu_num / dims->OC, param->group);
+        pack = MAX(1, okk_tune_tile(param->tune.tile_c, pack * dims->OC) / dims->OC);
+        while (pack > 1 && conv2d_group_tile_bytes(param, dims, pack * dims->IC, pack * dims->OC, 1) > LOCAL_MEM_SIZE)
+            --pack;
+    }
+    // Largest tiles of one output row that fit, then as many rows as fit.
+    int tile_ic = dims->IC, tile_oc = dims->OC;
+    while (pack == 1 && conv2d_group_tile_bytes(param, dims, tile_ic, tile_oc, 1) > LOCAL_MEM_SIZE) {
+        // input channel tiles but the last one stay even for the 2IC kernel
+        if (tile_ic > 2 * npu_num)
+            tile_ic = DIV_UP(tile_ic, 4) * 2;
+        else if (tile_oc > npu_num)
+            tile_oc = DIV_UP(tile_oc, 2 * npu_num) * npu_num;
+        else if (tile_ic > 2)
+            tile_ic = DIV_UP(tile_ic, 4) * 2;
+        else if (tile_oc > 1)
+            tile_oc = DIV_UP(tile_oc, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    if (pack == 1)
+        tile_oc = okk_tune_tile(param->tune.tile_c, tile_oc);
+    int lo = 1, hi = okk_tune_tile(param->tune.tile_h, output_h);
+    while (lo < hi) {
+        const int mid = (lo + hi + 1) / 2;
+        if (conv2d_group_tile_bytes(param, dims, pack * tile_ic, pack * tile_oc, mid) <= LOCAL_MEM_SIZE)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    const int tile_oh = lo;
+    const int input_h_max = conv2d_group_input_rows(param, dims, tile_oh);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    dim4 output_stride, input_stride, kernel_stride, bias_stride;
+    dim4 max_shape = {.n = 1, .c = pack * tile_oc, .h = tile_oh, .w = output_w};
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &max_shape, OKK_ARENA_ANY);
+    max_shape.c = pack * tile_ic;
+    max_shape.h = input_h_max;
+    max_shape.w = param->W;
+    local_addr_t input_addr = okk_arena_alloc_32bit_aligned(&arena, &input_stride, &max_shape, OKK_ARENA_ANY);
+    const dim4 max_kernel_shape = {.n = DIV_UP(pack * tile_ic, 2), .c = pack * tile_oc, .h = param->kernel_h, .w = param->kernel_w * 2};
+    local_addr_t kernel_addr = okk_arena_alloc_32bit_compact(&arena, &kernel_stride, &max_kernel_shape, OKK_ARENA_ANY);
+    const dim4 max_bias_shape = {.n = 1, .c = pack * tile_oc, .h = 1, .w = 1};
+    local_addr_t bias_addr = okk_arena_alloc_32bit_compact(&arena, &bias_stride, &max_bias_shape, OKK_ARENA_ANY);
+    const dim4 input_global_stride = {.n = 0, .c = param->H * param->W, .h = param->W, .w = 1};
+    const dim4 output_global_stride = {.n = 0, .c = output_h * output_w, .h = output_w, .w = 1};
+    const dim4 kernel_global_stride = {.n = dims->OC * kernel_hw2, .c = kernel_hw2, .h = param->kernel_w * 2, .w = 1};
+    const dim4 bias_global_stride = {.n = 0, .c = 1, .h = 1, .w = 1};
+    const dim2 stride = {.h = param->stride_h, .w = param->stride_w};
+    const dim2 dilation = {.h = param->dilation_h, .w = param->dilation_w};
+    const unsigned long long group_kernel_len = (unsigned long long)DIV_UP(dims->IC, 2) * dims->OC * kernel_hw2;
+    if (pack > 1) {
+        // the blocks off the diagonal stay zero, the loads only write the
+        // blocks of the packed groups
+        const x32 zero = {.fp32 = 0.f};
+        okk_bdc_32bit_set_C(kernel_addr, zero, &max_kernel_shape, &kernel_stride);
+    }
+    int tile = 0;
+    for (int g = 0; g < param->group; g += pack) {
+        const int groups = MIN(pack, param->group - g);
+        // packed groups are whole, so their channels are contiguous
+        for (int oc0 = 0; oc0 < dims->OC; oc0 += tile_oc) {
+            const int oc = MIN(tile_oc, dims->OC - oc0);
+            const int oc_start = g * dims->OC + oc0;
+            if (param->using_bias) {
+                const dim4 bias_shape = {.n = 1, .c = groups * oc, .h = 1, .w = 1};
+                okk_gdma_32bit_cpy_S2L(bias_addr, param->bias_addr + oc_start * sizeof(float), &bias_shape, &bias_stride, &bias_global_stride);
+            }
+            for (int n = 0; n < param->N; ++n) {
+                for (int oh0 = 0; oh0 < output_h; oh0 += tile_oh) {
+                    const dim4 output_shape = {.n = 1, .c = groups * oc, .h = MIN(tile_oh, output_h - oh0), .w = output_w};
+                    Padding pad;
+                    int input_h;
+                    const int ih_lo = conv2d_group_rows(param, dims, oh0, output_shape.h, &pad, &input_h);
+                    for (int ic0 = 0; ic0 < dims->IC; ic0 += tile_ic) {
+                        const int ic = MIN(tile_ic, dims->IC - ic0);
+                        const dim4 input_shape = {.n = 1, .c = groups * ic, .h = input_h, .w = param->W};
+                        const dim4 kernel_shape = {.n = DIV_UP(groups * ic, 2), .c = groups * oc, .h = param->kernel_h, .w = param->kernel_w * 2};
+                        // the kernel of one group, block p of the diagonal
+                        const dim4 block_shape = {.n = DIV_UP(ic, 2), .c = oc, .h = param->kernel_h, .w = param->kernel_w * 2};
+                        // view the data type of kernel as fp32x2
+                        const dim4 kernel_shape_2IC = {.n = kernel_shape.n, .c = kernel_shape.c, .h = param->kernel_h, .w = param->kernel_w};
+                        dim4 work_input_stride, work_kernel_stride, kernel_stride_2IC;
+                        okk_128_byte_aligned_stride_for_32bit(&work_input_stride, 0, &input_shape);
+                        okk_compact_stride(&work_kernel_stride, 0, &kernel_shape);
+                        okk_compact_stride(&kernel_stride_2IC, 0, &kernel_shape_2IC);
+                        // stages: 0 load, 1 conv, 2 store
+                        OKK_TIMER_TILE(0, tile);
+                        okk_gdma_32bit_cpy_S2L(
+                            input_addr,
+                            param->input_addr + (((unsigned long long)n * param->IC + g * dims->IC + ic0) * param->H + ih_lo) * param->W * sizeof(float),
+                            &input_shape,
+                            &work_input_stride,
+                            &input_global_stride);
+                        for (int p = 0; p < groups; ++p) {
+                            okk_gdma_32bit_cpy_S2L(
+                                conv2d_group_channel_addr(kernel_addr + p * (ic / 2) * work_kernel_stride.n * sizeof(float), p * oc, &work_kernel_stride),
+                                param->kernel_addr + ((g + p) * group_kernel_len + ((unsigned long long)(ic0 / 2) * dims->OC + oc0) * kernel_hw2) * sizeof(float),
+                                &block_shape,
+                                &work_kernel_stride,
+                                &kernel_global_stride);
+                        }
+                        OKK_TIMER_TILE(1, tile);
+                        // the bias is added by the first input channel tile, the others accumulate
+                        okk_bdc_conv2d(
+                            output_addr,
+                            input_addr,
+                            kernel_addr,
+                            param->using_bias ? bias_addr : NO_USE,
+                            &input_shape,
+                            groups * oc,
+                            param->kernel_h,
+                            param->kernel_w,
+                            &work_input_stride,
+                            &kernel_stride_2IC,
+                            param->using_bias && ic0 == 0,
+                            ic0 > 0,
+                            &pad,
+                            &stride,
+                            &dilation);
+                    }
+                    OKK_TIMER_TILE(2, tile);
+                    dim4 work_output_stride;
+                    okk_128_byte_aligned_stride_for_32bit(&work_output_stride, 0, &output_shape);
+                    okk_gdma_32bit_cpy_L2S(
+                        param->output_addr + (((unsigned long long)n * param->OC + oc_start) * output_h + oh0) * output_w * sizeof(float),
+                        output_addr,
+                        &output_shape,
+                        &output_global_stride,
+                        &work_output_stride);
+                    ++tile;
+                }
+            }
+        }
+    }
+}
+
+static void conv2d_group_depthwise(const param_t *param, const conv2d_group_dims_t *dims) {
+    const int npu_num = okk_npu_num();
+    // output channels per group
+    const int multiplier = dims->OC;
+    const int kernel_hw2 = param->kernel_h * param->kernel_w * 2;
+    const int output_h = dims->output_h, output_w = dims->output_w;
+    int tile_c = param->group;
+    while (conv2d_group_dw_tile_bytes(param, dims, tile_c, 1) > LOCAL_MEM_SIZE) {
+        OKKERNEL_ASSERT(tile_c > npu_num);
+        tile_c = DIV_UP(tile_c, 2 * npu_num) * npu_num;
+    }
+    tile_c = okk_tune_tile(param->tune.tile_c, tile_c);
+    int lo = 1, hi = okk_tune_tile(param->tune.tile_h, output_h);
+    while (lo < hi) {
+        const int mid = (lo + hi + 1) / 2;
+        if (conv2d_group_dw_tile_bytes(param, dims, tile_c, mid) <= LOCAL_MEM_SIZE)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    const int tile_oh = lo;
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    dim4 output_stride, input_stride, kernel_stride, bias_stride;
+    dim4 max_shape = {.n = 1, .c = tile_c, .h = tile_oh, .w = output_w};
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &max_shape, OKK_ARENA_ANY);
+    max_shape.h = conv2d_group_input_rows(param, dims, tile_oh);
+    max_shape.w = param->W;
+    local_addr_t input_addr = okk_arena_alloc_32bit_aligned(&arena, &input_stride, &max_shape, OKK_ARENA_ANY);
+    const dim4 max_kernel_shape = {.n = 1, .c = tile_c, .h = param->kernel_h, .w = param->kernel_w};
+    local_addr_t kernel_addr = okk_arena_alloc_32bit_compact(&arena, &kernel_stride, &max_kernel_shape, OKK_ARENA_ANY);
+    const dim4 max_kernel_2IC_shape = {.n = 1, .c = tile_c, .h = 1, .w = kernel_hw2};
+    dim4 kernel_2IC_stride;
+    local_addr_t kernel_2IC_addr = okk_arena_alloc_32bit_compact(&arena, &kernel_2IC_stride, &max_kernel_2IC_shape, OKK_ARENA_ANY);
+    const dim4 max_bias_shape = {.n = 1, .c = tile_c, .h = 1, .w = 1};
+    local_addr_t bias_addr = okk_arena_alloc_32bit_compact(&arena, &bias_stride, &max_bias_shape, OKK_ARENA_ANY);
+    const dim4 input_global_stride = {.n = 0, .c = param->H * param->W, .h = param->W, .w = 1};
+    // output channel g * multiplier + j of group g
+    const dim4 output_global_stride = {.n = 0, .c = multiplier * output_h * output_w, .h = output_w, .w = 1};
+    // the taps of one input channel are every other float of the 2IC layout,
+    // GDMA takes them with the padding lanes and BDC drops those
+    const dim4 kernel_global_stride = {.n = 0, .c = multiplier * kernel_hw2, .h = kernel_hw2, .w = 1};
+    const dim4 kernel_taps_stride = {.n = kernel_2IC_stride.n, .c = kernel_2IC_stride.c, .h = param->kernel_w * 2, .w = 2};
+    const dim4 bias_global_stride = {.n = 0, .c = multiplier, .h = 1, .w = 1};
+    const dim2 stride = {.h = param->stride_h, .w = param->stride_w};
+    const dim2 dilation = {.h = param->dilation_h, .w = param->dilation_w};
+    int tile = 0;
+    for (int c0 = 0; c0 < param->group; c0 += tile_c) {
+        const int c = MIN(tile_c, param->group - c0);
+        const dim4 kernel_shape = {.n = 1, .c = c, .h = param->kernel_h, .w = param->kernel_w};
+        const dim4 kernel_2IC_shape = {.n = 1, .c = c, .h = 1, .w = kernel_hw2};
+        const dim4 bias_shape = {.n = 1, .c = c, .h = 1, .w = 1};
+        for (int n = 0; n < param->N; ++n) {
+            for (int oh0 = 0; oh0 < output_h; oh0 += tile_oh) {
+                const dim4 output_shape = {.n = 1, .c = c, .h = MIN(tile_oh, output_h - oh0), .w = output_w};
+                Padding pad;
+                int input_h;
+                const int ih_lo = conv2d_group_rows(param, dims, oh0, output_shape.h, &pad, &input_h);
+                const dim4 input_shape = {.n = 1, .c = c, .h = input_h, .w = param->W};
+                dim4 work_input_stride, work_output_stride;
+                okk_128_byte_aligned_stride_for_32bit(&work_input_stride, 0, &input_shape);
+                okk_128_byte_aligned_stride_for_32bit(&work_output_stride, 0, &output_shape);
+                // stages: 0 load, 1 conv, 2 store
+                OKK_TIMER_TILE(0, tile);
+                okk_gdma_32bit_cpy_S2L(
+                    input_addr,
+                    param->input_addr + (((unsigned long long)n * param->IC + c0) * param->H + ih_lo) * param->W * sizeof(float),
+                    &input_shape,
+                    &work_input_stride,
+                    &input_global_stride);
+                for (int j = 0; j < multiplier; ++j) {
+                    const int oc_start = c0 * multiplier + j;
+                    okk_gdma_32bit_cpy_S2L(
+                        kernel_2IC_addr,
+                        param->kernel_addr + (unsigned long long)oc_start * kernel_hw2 * sizeof(float),
+                        &kernel_2IC_shape,
+                        &kernel_2IC_stride,
+                        &kernel_global_stride);
+                    okk_bdc_32bit_cpy(kernel_addr, kernel_2IC_addr, &kernel_shape, &kernel_stride, &kernel_taps_stride);
+                    if (param->using_bias)
+                        okk_gdma_32bit_cpy_S2L(bias_addr, param->bias_addr + oc_start * sizeof(float), &bias_shape, &bias_stride, &bias_global_stride);
+                    OKK_TIMER_TILE(1, tile);
+                    okk_bdc_depthwise2d(
+                        output_addr,
+                        input_addr,
+                        kernel_addr,
+                        param->using_bias ? bias_addr : NO_USE,
+                        &input_shape,
+                        param->kernel_h,
+                        param->kernel_w,
+                        param->using_bias,
+                        &pad,
+                        &stride,
+                        &dilation);
+                    OKK_TIMER_TILE(2, tile);
+                    okk_gdma_32bit_cpy_L2S(
+                        param->output_addr + (((unsigned long long)n * param->OC + oc_start) * output_h + oh0) * output_w * sizeof(float),
+                        output_addr,
+                        &output_shape,
+                        &output_global_stride,
+                        &work_output_stride);
+                    ++tile;
+                }
+            }
+        }
+    }
+}
+
+void conv2d_group(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    OKKERNEL_ASSERT(param->group > 0 && param->IC % param->group == 0 && param->OC % param->group == 0);
+    conv2d_group_dims_t dims;
+    dims.kernel_h_ext = (param->kernel_h - 1) * param->dilation_h + 1;
+    const int kernel_w_ext = (param->kernel_w - 1) * param->dilation_w + 1;
+    dims.output_h = (param->H + param->pad_top + param->pad_bottom - dims.kernel_h_ext) / param->stride_h + 1;
+    dims.output_w = (param->W + param->pad_left + param->pad_right - kernel_w_ext) / param->stride_w + 1;
+    dims.IC = param->IC / param->group;
+    dims.OC = param->OC / param->group;
+    if (dims.IC == 1 && param->group > 1)
+        conv2d_group_depthwise(param, &dims);
+    else
+        conv2d_group_generic(param, &dims);
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(conv2d_group);
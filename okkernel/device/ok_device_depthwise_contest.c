@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -26,4 +27,4 @@ void depthwise_contest(const void *args) {
     // TODO
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(depthwise_contest);
+OKKERNEL_FUNC_REGISTER_ID(depthwise_contest);
@@ -0,0 +1,243 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define EMBEDDING_MAX_TILE_C 4095
+#define EMBEDDING_MAX_TILE_HW 65535
+// pooling of the lookups of a bag
+#define EMBEDDING_NONE 0
+#define EMBEDDING_SUM 1
+#define EMBEDDING_MEAN 2
+/*
+ * Embedding lookup with optional pooling per bag.
+ *
+ * table  [rows, dim] fp32, in DDR
+ * index  [batch, bag] int32, rows of the table, rows out of [0, rows) look
+ *        up zeros (padding of shorter bags)
+ * output [batch, bag, dim] fp32 the looked up rows, or [batch, dim] their
+ *        sum or mean over each bag, the mean over the rows in range and
+ *        zeros for a bag without any
+ *
+ * A tile is tile_b bags across the NPUs by their bag lookups on h by
+ * tile_w columns on w, so the columns of a row are contiguous in one NPU
+ * and the lookups of a bag are summed by halving adds along h. The ARM
+ * reads the indices of a tile from L2 SRAM and issues one GDMA per row,
+ * counting the rows in range of each bag for the scale of its mean.
+ * Tiles are pipelined in steps of OKK_TIMER_PARALLEL_START() regions like
+ * plus_one_2: step i gathers tile i and stages the indices of tile i + 1
+ * in L2 SRAM, pools tile i - 1 and stores tile i - 2 (i - 1 without
+ * pooling), with double buffered gathers, outputs and indices. The poll
+ * ending a step makes the staged indices readable by the ARM.
+ */
+typedef struct {
+    int batch, bag, rows, dim;
+    int pooling;
+    unsigned long long output_addr;
+    unsigned long long index_addr;
+    unsigned long long table_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+// Local memory per NPU of the double buffered tiles.
+static unsigned int embedding_tile_bytes(int bag, int tile_b, int tile_w) {
+    const dim4 shape = {.n = 1, .c = tile_b, .h = bag, .w = tile_w};
+    const dim4 output_shape = {.n = 1, .c = tile_b, .h = 1, .w = tile_w};
+    const dim4 scale_shape = {.n = 1, .c = tile_b, .h = 1, .w = 1};
+    dim4 stride, output_stride, scale_stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    okk_128_byte_aligned_stride_for_32bit(&output_stride, 0, &output_shape);
+    okk_compact_stride(&scale_stride, 0, &scale_shape);
+    const unsigned int bank_size = LOCAL_MEM_SIZE / okk_local_mem_bank_per_npu();
+    // the scales of the means, then gathered rows and outputs in banks of their own
+    return okk_arena_align_up(2 * okk_arena_align_up(scale_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN), bank_size) +
+           2 * okk_arena_align_up(stride.n * sizeof(float), bank_size) +
+           2 * okk_arena_align_up(output_stride.n * sizeof(float), bank_size);
+}
+
+// Address of channel c of a tensor starting at addr in NPU 0.
+static local_addr_t embedding_channel_addr(local_addr_t addr, int c, const dim4 *stride) {
+    const int npu_num = okk_npu_num();
+    return (c % npu_num) * LOCAL_MEM_SIZE + addr + c / npu_num * stride->c * sizeof(float);
+}
+
+typedef struct {
+    int b, d, bags, cols;
+} embedding_tile_t;
+
+static embedding_tile_t embedding_tile(const param_t *param, int tile_b, int tile_w, int index) {
+    const int col_tiles = DIV_UP(param->dim, tile_w);
+    embedding_tile_t tile;
+    tile.b = index / col_tiles * tile_b;
+    tile.d = index % col_tiles * tile_w;
+    tile.bags = MIN(tile_b, param->batch - tile.b);
+    tile.cols = MIN(tile_w, param->dim - tile.d);
+    return tile;
+}
+
+// Stages the indices of the bags of a tile at l2_addr.
+static void embedding_stage_index(const param_t *param, const embedding_tile_t *tile, unsigned int l2_addr) {
+    const dim4 shape = {.n = 1, .c = 1, .h = tile->bags, .w = param->bag};
+    const dim4 stride = {.n = tile->bags * param->bag, .c = tile->bags * param->bag, .h = param->bag, .w = 1};
+    okk_gdma_32bit_cpy_S2S(l2_addr, param->index_addr + (unsigned long long)tile->b * param->bag * sizeof(int), &shape, &stride, &stride);
+}
+
+// One GDMA per looked up row of a tile, or a fill with zeros. With MEAN,
+// the scale of each bag is 1 / its rows in range, 0 without any.
+static void embedding_gather(const param_t *param, const embedding_tile_t *tile, const int *index, local_addr_t addr, const dim4 *stride,
+                             local_addr_t scale_addr, const dim4 *scale_stride) {
+    const dim4 row_shape = {.n = 1, .c = 1, .h = 1, .w = tile->cols};
+    const dim4 row_stride = {.n = tile->cols, .c = tile->cols, .h = tile->cols, .w = 1};
+    const dim4 scale_shape = {.n = 1, .c = 1, .h = 1, .w = 1};
+    const x32 zero = {.fp32 = 0.f};
+    for (int b = 0; b < tile->bags; ++b) {
+        const local_addr_t bag_addr = embedding_channel_addr(addr, b, stride);
+        int count = 0;
+        for (int l = 0; l < param->bag; ++l) {
+            const int row = index[b * param->bag + l];
+            const local_addr_t row_addr = bag_addr + l * stride->h * sizeof(float);
+            if (row >= 0 && row < param->rows) {
+                okk_gdma_32bit_cpy_S2L(
+                    row_addr,
+                    param->table_addr + ((unsigned long long)row * param->dim + tile->d) * sizeof(float),
+                    &row_shape,
+                    stride,
+                    &row_stride);
+                ++count;
+            } else
+                okk_gdma_32bit_set_C_local(row_addr, zero, &row_shape, stride);
+        }
+        if (param->pooling == EMBEDDING_MEAN) {
+            const x32 scale = {.fp32 = count > 0 ? 1.f / count : 0.f};
+            okk_bdc_32bit_set_C(embedding_channel_addr(scale_addr, b, scale_stride), scale, &scale_shape, scale_stride);
+        }
+    }
+}
+
+// output = the sum or mean of the lookups of each bag, gathered is clobbered.
+static void embedding_pool(const param_t *param, const embedding_tile_t *tile, local_addr_t output_addr, local_addr_t gathered_addr,
+                           local_addr_t scale_addr, const dim4 *output_stride, const dim4 *stride) {
+    int height = param->bag;
+    while (height > 1) {
+        const int half = height / 2;
+        const dim4 shape = {.n = 1, .c = tile->bags, .h = half, .w = tile->cols};
+        okk_bdc_add(gathered_addr, gathered_addr, gathered_addr + (height - half) * stride->h * sizeof(float), &shape, stride, stride, stride);
+        height -= half;
+    }
+    const dim4 output_shape = {.n = 1, .c = tile->bags, .h = 1, .w = tile->cols};
+    if (param->pooling == EMBEDDING_MEAN)
+        okk_bdc_scale(output_addr, gathered_addr, scale_addr, &output_shape, output_stride, stride);
+    else
+        okk_bdc_32bit_cpy(output_addr, gathered_addr, &output_shape, output_stride, stride);
+}
+
+static void embedding_store(const param_t *param, const embedding_tile_t *tile, local_addr_t addr, const dim4 *stride) {
+    const int pooled = param->pooling != EMBEDDING_NONE;
+    const int height = pooled ? 1 : param->bag;
+    const dim4 shape = {.n = 1, .c = tile->bags, .h = height, .w = tile->cols};
+    const dim4 global_stride = {.n = param->batch * height * param->dim, .c = height * param->dim, .h = param->dim, .w = 1};
+    okk_gdma_32bit_cpy_L2S(
+        param->output_addr + ((unsigned long long)tile->b * height * param->dim + tile->d) * sizeof(float),
+        addr,
+        &shape,
+        &global_stride,
+        stride);
+}
+
+void embedding(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    OKKERNEL_ASSERT(param->batch > 0 && param->dim > 0);
+    OKKERNEL_ASSERT(param->bag > 0 && param->bag <= EMBEDDING_MAX_TILE_HW);
+    OKKERNEL_ASSERT(param->pooling >= EMBEDDING_NONE && param->pooling <= EMBEDDING_MEAN);
+    const int pooled = param->pooling != EMBEDDING_NONE;
+    // The indices of two tiles fit in L2 SRAM. Bags in multiples of the
+    // NPUs first, then columns.
+    const int npu_num = okk_npu_num();
+    int tile_b = MIN(param->batch, EMBEDDING_MAX_TILE_C);
+    tile_b = MIN(tile_b, (int)(okk_l2_sram_size() / (2 * param->bag * sizeof(int))));
+    OKKERNEL_ASSERT(tile_b > 0);
+    int tile_w = MIN(param->dim, EMBEDDING_MAX_TILE_HW);
+    while (embedding_tile_bytes(param->bag, tile_b, tile_w) > LOCAL_MEM_SIZE) {
+        if (tile_b > npu_num)
+            tile_b = DIV_UP(tile_b, 2 * npu_num) * npu_num;
+        else if (tile_w > 1)
+            tile_w = DIV_UP(tile_w, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_b = okk_tune_tile(param->tune.tile_c, tile_b);
+    tile_w = okk_tune_tile(param->tune.tile_w, tile_w);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_shape = {.n = 1, .c = tile_b, .h = param->bag, .w = tile_w};
+    const dim4 max_output_shape = {.n = 1, .c = tile_b, .h = 1, .w = tile_w};
+    const dim4 max_scale_shape = {.n = 1, .c = tile_b, .h = 1, .w = 1};
+    dim4 stride, output_stride, scale_stride;
+    local_addr_t gathered_addr[2], output_addr[2], scale_addr[2];
+    // GDMA gathers into and stores from one half of each double buffer while
+    // BDC pools the other half, so each half has banks of its own. Only BDC
+    // touches the scales.
+    for (int i = 0; i < 2; ++i)
+        scale_addr[i] = okk_arena_alloc_32bit_compact(&arena, &scale_stride, &max_scale_shape, OKK_ARENA_ANY);
+    for (int i = 0; i < 2; ++i) {
+        gathered_addr[i] = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_NEW_BANK);
+        output_addr[i] = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &max_output_shape, OKK_ARENA_NEW_BANK);
+    }
+    // indices of two tiles in L2 SRAM
+    const unsigned int index_bytes = tile_b * param->bag * sizeof(int);
+    const unsigned int index_addr[2] = {okk_l2_sram_start_addr(), okk_l2_sram_start_addr() + index_bytes};
+    const int tiles = DIV_UP(param->batch, tile_b) * DIV_UP(param->dim, tile_w);
+    embedding_tile_t first = embedding_tile(param, tile_b, tile_w, 0);
+    embedding_stage_index(param, &first, index_addr[0]);
+    okk_poll();
+    const int store_lag = pooled ? 2 : 1;
+    for (int i = 0; i < tiles + store_lag; ++i) {
+        // stages: 0 gather tile i, 1 pool tile i - 1, 2 store
+        OKK_TIMER_PARALLEL_START(0, i);
+        if (i < tiles) {
+            embedding_tile_t tile = embedding_tile(param, tile_b, tile_w, i);
+            OKK_TIMER_TILE(0, i);
+            if (i + 1 < tiles) {
+                embedding_tile_t next = embedding_tile(param, tile_b, tile_w, i + 1);
+                embedding_stage_index(param, &next, index_addr[(i + 1) % 2]);
+            }
+            embedding_gather(
+                param,
+                &tile,
+                (const int *)okk_l2_sram_addr(index_addr[i % 2]),
+                gathered_addr[i % 2],
+                &stride,
+                scale_addr[i % 2],
+                &scale_stride);
+        }
+        if (pooled && i > 0 && i <= tiles) {
+            embedding_tile_t tile = embedding_tile(param, tile_b, tile_w, i - 1);
+            OKK_TIMER_TILE(1, i - 1);
+            embedding_pool(param, &tile, output_addr[(i - 1) % 2], gathered_addr[(i - 1) % 2], scale_addr[(i - 1) % 2], &output_stride, &stride);
+        }
+        if (i >= store_lag) {
+            const int s = i - store_lag;
+            embedding_tile_t tile = embedding_tile(param, tile_b, tile_w, s);
+            OKK_TIMER_TILE(2, s);
+            if (pooled)
+                embedding_store(param, &tile, output_addr[s % 2], &output_stride);
+            else
+                embedding_store(param, &tile, gathered_addr[s % 2], &stride);
+        }
+        OKK_TIMER_PARALLEL_END(0, i);
+        okk_poll();
+    }
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(embedding);
@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 #define DIV_UP(a, b) (((a) - 1) / (b) + 1)
 
 typedef struct {
@@ -14,4 +15,4 @@ void get_local_memory(const void *args) {
     okk_poll();
 }
 
-OKKERNEL_FUNC_REGISTER(get_local_memory);
+OKKERNEL_FUNC_REGISTER_ID(get_local_memory);
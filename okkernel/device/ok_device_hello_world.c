@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 typedef struct {
     int year;
     int month;
@@ -10,4 +11,4 @@ void hello_world(const void *args) {
     OKKERNEL_LOG("Hello World! Today is %d/%d/%d.\n", param->month, param->day, param->year);
 }
 
-OKKERNEL_FUNC_REGISTER(hello_world);
+OKKERNEL_FUNC_REGISTER_ID(hello_world);
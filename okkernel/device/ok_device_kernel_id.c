@@ -0,0 +1,60 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#ifndef NULL
+#define NULL 0
+#endif
+
+typedef struct {
+    unsigned int id;
+    const char *name;
+    okk_kernel_func_t func;
+} okk_kernel_id_entry_t;
+
+static okk_kernel_id_entry_t okk_kernel_id_table[OKK_KERNEL_ID_SLOTS];
+
+// The slot of an ID, or the empty slot where it would go, linear probing.
+static okk_kernel_id_entry_t *okk_kernel_id_find(unsigned int id) {
+    unsigned int slot = id % OKK_KERNEL_ID_SLOTS;
+    for (int probe = 0; probe < OKK_KERNEL_ID_SLOTS; ++probe) {
+        okk_kernel_id_entry_t *entry = &okk_kernel_id_table[slot];
+        if (entry->id == id || entry->id == 0)
+            return entry;
+        slot = (slot + 1) % OKK_KERNEL_ID_SLOTS;
+    }
+    return NULL;
+}
+
+void okk_register_kernel_id(const char *name, okk_kernel_func_t func) {
+    okk_kernel_id_entry_t *entry = okk_kernel_id_find(okk_kernel_id_of(name));
+    // the table is full or two names have the same ID
+    OKKERNEL_ASSERT(entry != NULL && entry->id == 0);
+    if (entry == NULL || entry->id != 0)
+        return;
+    entry->id = okk_kernel_id_of(name);
+    entry->name = name;
+    entry->func = func;
+}
+
+const char *okk_kernel_id_name(unsigned int id) {
+    const okk_kernel_id_entry_t *entry = okk_kernel_id_find(id);
+    return entry != NULL && entry->id == id ? entry->name : NULL;
+}
+
+void okk_id(const void *args) {
+    const okk_kernel_id_header_t *header = (const okk_kernel_id_header_t *)args;
+    const okk_kernel_id_entry_t *entry = okk_kernel_id_find(header->id);
+    // an unknown ID is a kernel name misspelled on the host or a kernel not
+    // registered with OKKERNEL_FUNC_REGISTER_ID, never a launch to skip
+    if (entry == NULL || entry->id != header->id) {
+        OKKERNEL_LOG("okk_id: no kernel of ID 0x%08x\n", header->id);
+        OKKERNEL_ASSERT(0);
+        return;
+    }
+    entry->func((const char *)args + sizeof(okk_kernel_id_header_t));
+}
+
+// Registered ahead of the constructors of default priority, so okk_id is the
+// first entry of the name table of the firmware.
+__attribute__((constructor(101))) void okk_kernel_register_okk_id() {
+    okk_register_kernel_func(OKK_KERNEL_ID_DISPATCHER, okk_id);
+}
@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -22,4 +23,4 @@ void matmul_contest(const void *args) {
     // TODO
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(matmul_contest);
+OKKERNEL_FUNC_REGISTER_ID(matmul_contest);
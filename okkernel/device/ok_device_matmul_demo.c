@@ -1,4 +1,6 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -25,29 +27,27 @@ void matmul_demo(const void *args) {
     int right_cols_per_channel = DIV_UP(param->right_cols, NPU_NUM);
     if (right_cols_per_channel > 128)
         right_cols_per_channel = 128;
+    okk_arena_t arena;
+    okk_arena_init(&arena);
     // Local left matrix tensor.
-    local_addr_t left_addr = 0;
     dim4 left_shape = {
         .n = param->left_rows, .c = DIV_UP(param->left_cols, left_cols_per_channel),
         .h = 1, .w = left_cols_per_channel
     };
-    okk_128_byte_aligned_stride_for_32bit(&left_stride, 0, &left_shape);
+    local_addr_t left_addr = okk_arena_alloc_32bit_aligned(&arena, &left_stride, &left_shape, OKK_ARENA_ANY);
     // Local right matrix tensor.
-    local_addr_t right_addr = left_addr + left_stride.n * left_shape.n * sizeof(float);
     dim4 right_shape = {
         .n = param->left_cols, .c = DIV_UP(param->right_cols, right_cols_per_channel),
         .h = 1, .w = right_cols_per_channel
     };
-    okk_128_byte_aligned_stride_for_32bit(&right_stride, 0, &right_shape);
+    local_addr_t right_addr = okk_arena_alloc_32bit_aligned(&arena, &right_stride, &right_shape, OKK_ARENA_ANY);
     // Local output matrix tensor.
-    local_addr_t output_addr = right_addr + right_stride.n * right_shape.n * sizeof(float);
     dim4 output_shape = {
         .n = param->left_rows, .c = DIV_UP(param->right_cols, right_cols_per_channel),
         .h = 1, .w = right_cols_per_channel
     };
-    okk_128_byte_aligned_stride_for_32bit(&output_stride, 0, &output_shape);
-    // Safe checking.
-    OKKERNEL_ASSERT(output_addr + output_stride.n * output_shape.n * sizeof(float) <= LOCAL_MEM_SIZE);
+    // Safe checking is done by the arena.
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &output_shape, OKK_ARENA_ANY);
     // Copy global left matrix tensor to local left matrix tensor.
     okk_gdma_32bit_matrix_S2L(
         left_addr,
@@ -87,4 +87,4 @@ void matmul_demo(const void *args) {
         param->right_cols);
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(matmul_demo);
+OKKERNEL_FUNC_REGISTER_ID(matmul_demo);
@@ -1,10 +1,15 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
 #ifndef NULL
 #define NULL 0
 #endif
 #define DIV_UP(a, b) (((a) - 1) / (b) + 1)
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
 
 typedef struct {
     unsigned long long output_addr;
@@ -15,9 +20,19 @@ typedef struct {
     int pad_top, pad_bottom, pad_left, pad_right;
     int stride_h, stride_w;
     int ceil_mode;
+    tune_t tune;
+    unsigned long long timer_addr;
 } __attribute__((packed)) param_t;
 
+// Local memory per NPU of a tile in the aligned layout.
+static unsigned int max_pool_tile_bytes(const dim4 *shape) {
+    dim4 stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, shape);
+    return okk_arena_align_up(shape->n * stride.n * sizeof(float), 128);
+}
+
 void max_pool_0(const void *args) {
+    OKK_TIMER_KERNEL_START();
     okk_initialize();
     param_t *param = (param_t *)args;
     dim2 pool_stride = {.h = param->stride_h, .w = param->stride_w};
@@ -32,41 +47,32 @@ void max_pool_0(const void *args) {
         output_w = output_w / param->stride_w + 1;
     }
     const dim4 output_shape = {.n = 1, .c = param->C * param->N, .h = output_h, .w = output_w};
-    local_addr_t output_addr = 0, input_addr;
+    // Largest tiles that fit local memory, fewer rows first, then fewer channels.
     dim4 max_output_shape = output_shape, max_input_shape = input_shape;
-    for (;;) {
-        bool done = false;
-        for (;;) {
-            dim4 output_stride, input_stride;
-            okk_128_byte_aligned_stride_for_32bit(&output_stride, 0, &max_output_shape);
-            unsigned int output_size = output_stride.n * sizeof(float);
-            input_addr = output_addr + output_size;
-            if (input_addr >= okk_local_mem_size_per_npu())
-                break;
-            okk_128_byte_aligned_stride_for_32bit(&input_stride, 0, &max_input_shape);
-            unsigned int input_size = input_stride.n * sizeof(float);
-            if (input_addr + input_size > okk_local_mem_size_per_npu())
-                break;
-            done = true;
-            break;
-        }
-        if (!done) {
-            if (max_output_shape.h > 1) {
-                --max_output_shape.h;
-                max_input_shape.h = MIN(input_shape.h, param->kernel_h + (max_output_shape.h - 1) * param->stride_h);
-            } else if (max_output_shape.c > okk_npu_num()) {
-                if (max_output_shape.c % okk_npu_num() == 0)
-                    max_output_shape.c -= okk_npu_num();
-                else
-                    max_output_shape.c -= max_output_shape.c % okk_npu_num();
-                max_input_shape.c = max_output_shape.c;
-            } else
-                OKKERNEL_ASSERT(0);
+    while (max_pool_tile_bytes(&max_output_shape) + max_pool_tile_bytes(&max_input_shape) > LOCAL_MEM_SIZE) {
+        if (max_output_shape.h > 1) {
+            --max_output_shape.h;
+            max_input_shape.h = MIN(input_shape.h, param->kernel_h + (max_output_shape.h - 1) * param->stride_h);
+        } else if (max_output_shape.c > okk_npu_num()) {
+            if (max_output_shape.c % okk_npu_num() == 0)
+                max_output_shape.c -= okk_npu_num();
+            else
+                max_output_shape.c -= max_output_shape.c % okk_npu_num();
+            max_input_shape.c = max_output_shape.c;
         } else
-            break;
+            OKKERNEL_ASSERT(0);
     }
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    dim4 output_stride, input_stride;
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &output_stride, &max_output_shape, OKK_ARENA_ANY);
+    local_addr_t input_addr = okk_arena_alloc_32bit_aligned(&arena, &input_stride, &max_input_shape, OKK_ARENA_ANY);
+    // Tuned tiles can only shrink the largest ones that fit local memory.
+    max_output_shape.c = okk_tune_tile(param->tune.tile_c, max_output_shape.c);
+    max_output_shape.h = okk_tune_tile(param->tune.tile_h, max_output_shape.h);
     int remained_output_c = output_shape.c;
     int done_output_c = 0;
+    int tile = 0;
     dim4 work_input_shape = {.n = 1, .w = input_shape.w};
     dim4 work_output_shape = {.n = 1, .w = output_shape.w};
     dim4 input_global_stride = {.n = 0, .c = input_shape.h * input_shape.w, .h = input_shape.w, .w = 1};
@@ -87,6 +93,8 @@ void max_pool_0(const void *args) {
             int input_h_end = input_h_start + param->kernel_h + (work_output_shape.h - 1) * param->stride_h;
             work_input_shape.h = MIN(input_shape.h + param->pad_top, input_h_end) - MAX(param->pad_top, input_h_start);
             OKKERNEL_ASSERT(work_input_shape.h > 0);
+            // stages: 0 load, 1 pool, 2 store
+            OKK_TIMER_TILE(0, tile);
             okk_gdma_32bit_cpy_S2L(
                 input_addr,
                 param->input_addr + (done_output_c * input_shape.h * input_shape.w + MAX(0, input_h_start - param->pad_top) * input_shape.w) * sizeof(float),
@@ -95,6 +103,7 @@ void max_pool_0(const void *args) {
                 &input_global_stride);
             pad.top = MAX(param->pad_top - input_h_start, 0);
             pad.bottom = MAX(input_h_end - input_shape.h - param->pad_top, 0);
+            OKK_TIMER_TILE(1, tile);
             okk_bdc_max_pool2d(
                 output_addr,
                 input_addr,
@@ -103,6 +112,7 @@ void max_pool_0(const void *args) {
                 param->kernel_w,
                 &pad,
                 &pool_stride);
+            OKK_TIMER_TILE(2, tile);
             okk_gdma_32bit_cpy_L2S(
                 param->output_addr + (done_output_c * output_shape.h * output_shape.w + done_output_h * output_shape.w) * sizeof(float),
                 output_addr,
@@ -111,11 +121,13 @@ void max_pool_0(const void *args) {
                 NULL);
             remained_output_h -= work_output_shape.h;
             done_output_h += work_output_shape.h;
+            ++tile;
         }
         remained_output_c -= work_output_shape.c;
         done_output_c += work_output_shape.c;
     }
     okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
 }
 
-OKKERNEL_FUNC_REGISTER(max_pool_0);
+OKKERNEL_FUNC_REGISTER_ID(max_pool_0);
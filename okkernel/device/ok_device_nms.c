@@ -0,0 +1,275 @@
+#include "okk.h"
+#include "bm_atomic.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+// x1, y1, x2, y2, score, the face_rect_t of bmcv
+#define NMS_BOX_LEN 5
+#define NMS_MAX_INPUT 16383
+// candidates kept by the score sort, the suppression mask is their square
+#define NMS_MAX_CANDIDATES 1024
+#define NMS_MAX_TILE_C 4095
+#define NMS_MAX_TILE_W 65535
+/*
+ * Greedy non-maximum suppression of detections.
+ *
+ * input  [num, 5] fp32 boxes (x1, y1, x2, y2, score)
+ * output [1 + max_output] int32, the number of kept boxes, then their
+ *        indices in the input by descending score
+ *
+ * Box i suppresses box j if j has a lower score and IoU(i, j) >
+ * iou_threshold, unless i is itself suppressed. Boxes with a score not
+ * above score_threshold are dropped, as are all but the
+ * NMS_MAX_CANDIDATES best.
+ *
+ * Everything but the output stays in L2 SRAM. One GDMA splits the boxes
+ * from the scores, bm_atomic_sort sorts the scores with their indices and
+ * bm_atomic_gather_data gathers the boxes (128 bits each) in that order,
+ * one more GDMA transposes them to the corners [4, boxes]. The mask of
+ * IoU(i, j) > iou_threshold is then computed for all pairs of candidates
+ * j > i in tiles of tile_i candidates i across the NPUs by tile_j
+ * candidates j on w. The corners of j are loaded contiguously on w and
+ * broadcast to every channel by the GDMA, the ones of i are loaded as
+ * per-channel vectors and broadcast on w by bias: max/min of the corners,
+ * mul for the areas, and (1 + t) * inter against t * (area_i + area_j),
+ * which needs no division. greater_select_value flags four columns j at a
+ * time into the bytes of a word, their or is stored to row i of a byte
+ * matrix of rows of mask_pitch bytes. The ARM finally walks the
+ * candidates in score order, keeping a candidate not yet suppressed and
+ * suppressing the ones of its row, and stores the kept indices.
+ */
+typedef struct {
+    int num;
+    int max_output;
+    float iou_threshold;
+    float score_threshold;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+static unsigned char nms_removed[NMS_MAX_CANDIDATES];
+
+// Local memory per NPU of a tile.
+static unsigned int nms_tile_bytes(int tile_i, int tile_j) {
+    const dim4 box_shape = {.n = 1, .c = tile_i, .h = 4, .w = tile_j};
+    const dim4 shape = {.n = 1, .c = tile_i, .h = 1, .w = tile_j};
+    const dim4 vector_shape = {.n = 1, .c = tile_i, .h = 1, .w = 1};
+    dim4 box_stride, stride, vector_stride;
+    okk_128_byte_aligned_stride_for_32bit(&box_stride, 0, &box_shape);
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    okk_compact_stride(&vector_stride, 0, &vector_shape);
+    // boxes i and j, four temporaries, the corners of i
+    return 2 * okk_arena_align_up(box_stride.n * sizeof(float), 128) +
+           4 * okk_arena_align_up(stride.n * sizeof(float), 128) +
+           4 * okk_arena_align_up(vector_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+// word_addr = the flags IoU(i, j) > threshold of the tile, four columns j
+// per word, one byte each in column order. i_addr and j_addr hold the
+// corners of boxes i and j on h, temp_addr four tensors of the tile,
+// word_addr may be temp_addr[2].
+static void nms_iou_mask(local_addr_t word_addr, const local_addr_t temp_addr[4], local_addr_t i_addr, local_addr_t j_addr,
+                         float threshold, const dim4 *shape, const dim4 *stride, const dim4 *box_stride) {
+    const unsigned int corner = box_stride->h * sizeof(float);
+    const local_addr_t t0 = temp_addr[0], t1 = temp_addr[1], t2 = temp_addr[2], t3 = temp_addr[3];
+    // width and height of the intersection
+    okk_bdc_max(t0, j_addr, i_addr, shape, stride, box_stride, box_stride);
+    okk_bdc_min(t1, j_addr + 2 * corner, i_addr + 2 * corner, shape, stride, box_stride, box_stride);
+    okk_bdc_sub(t1, t1, t0, shape, stride, stride, stride);
+    okk_bdc_max_C(t1, t1, 0.f, shape, stride, stride);
+    okk_bdc_max(t0, j_addr + corner, i_addr + corner, shape, stride, box_stride, box_stride);
+    okk_bdc_min(t2, j_addr + 3 * corner, i_addr + 3 * corner, shape, stride, box_stride, box_stride);
+    okk_bdc_sub(t2, t2, t0, shape, stride, stride, stride);
+    okk_bdc_max_C(t2, t2, 0.f, shape, stride, stride);
+    okk_bdc_mul(t1, t1, t2, shape, stride, stride, stride);
+    // area_i + area_j
+    okk_bdc_sub(t0, j_addr + 2 * corner, j_addr, shape, stride, box_stride, box_stride);
+    okk_bdc_sub(t2, j_addr + 3 * corner, j_addr + corner, shape, stride, box_stride, box_stride);
+    okk_bdc_mul(t0, t0, t2, shape, stride, stride, stride);
+    okk_bdc_sub(t2, i_addr + 2 * corner, i_addr, shape, stride, box_stride, box_stride);
+    okk_bdc_sub(t3, i_addr + 3 * corner, i_addr + corner, shape, stride, box_stride, box_stride);
+    okk_bdc_mul(t2, t2, t3, shape, stride, stride, stride);
+    okk_bdc_add(t0, t0, t2, shape, stride, stride, stride);
+    // inter / (area_i + area_j - inter) > t  <=>  (1 + t) * inter > t * (area_i + area_j)
+    okk_bdc_mul_C(t1, t1, 1.f + threshold, shape, stride, stride);
+    okk_bdc_mul_C(t0, t0, threshold, shape, stride, stride);
+    // byte b of word q flags column 4 * q + b, the columns past the tile
+    // only reach the bytes past it
+    const dim4 word_shape = {.n = shape->n, .c = shape->c, .h = 1, .w = DIV_UP(shape->w, 4)};
+    const dim4 quad_stride = {.n = stride->n, .c = stride->c, .h = stride->h, .w = 4};
+    for (int b = 0; b < 4; ++b) {
+        const x32 flag = {.u32 = 1u << (8 * b)};
+        const local_addr_t dst = b == 0 ? word_addr : t3;
+        okk_bdc_greater_select_value(dst, t1 + b * sizeof(float), t0 + b * sizeof(float), flag, &word_shape, stride, &quad_stride, &quad_stride);
+        if (b > 0)
+            okk_bdc_32bit_or(word_addr, word_addr, t3, &word_shape, stride, stride, stride);
+    }
+}
+
+void nms(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    const int num = param->num;
+    OKKERNEL_ASSERT(num > 0 && num <= NMS_MAX_INPUT);
+    OKKERNEL_ASSERT(param->max_output > 0);
+    const int candidates = MIN(num, NMS_MAX_CANDIDATES);
+    // L2 SRAM: boxes [num, 4], scores [num], sorted scores and indices
+    // [candidates], sorted boxes [candidates, 4] and their corners [4,
+    // candidates], output [1 + candidates], mask [candidates, rows of
+    // candidates bytes rounded up to words]
+    const unsigned int boxes_addr = okk_l2_sram_start_addr();
+    const unsigned int scores_addr = boxes_addr + num * 4 * sizeof(float);
+    const unsigned int sorted_scores_addr = scores_addr + num * sizeof(float);
+    const unsigned int sorted_index_addr = sorted_scores_addr + candidates * sizeof(float);
+    const unsigned int sorted_boxes_addr = okk_arena_align_up(sorted_index_addr + candidates * sizeof(int), 16);
+    const unsigned int corners_addr = sorted_boxes_addr + candidates * 4 * sizeof(float);
+    const unsigned int keep_addr = corners_addr + 4 * candidates * sizeof(float);
+    const unsigned int mask_addr = keep_addr + (1 + candidates) * sizeof(int);
+    OKKERNEL_ASSERT(mask_addr + candidates * okk_arena_align_up(candidates, 4) - boxes_addr <= okk_l2_sram_size());
+    // stages: 0 split and sort, 1 gather and transpose, then per tile 2 load, 3 IoU, 4 store, then 5 scan
+    OKK_TIMER_TILE(0, 0);
+    const dim4 split_shape = {.n = 1, .c = 1, .h = num, .w = 4};
+    const dim4 input_stride = {.n = num * NMS_BOX_LEN, .c = num * NMS_BOX_LEN, .h = NMS_BOX_LEN, .w = 1};
+    const dim4 boxes_stride = {.n = num * 4, .c = num * 4, .h = 4, .w = 1};
+    okk_gdma_32bit_cpy_S2S(boxes_addr, param->input_addr, &split_shape, &boxes_stride, &input_stride);
+    const dim4 score_shape = {.n = 1, .c = 1, .h = num, .w = 1};
+    const dim4 scores_stride = {.n = num, .c = num, .h = 1, .w = 1};
+    okk_gdma_32bit_cpy_S2S(scores_addr, param->input_addr + 4 * sizeof(float), &score_shape, &scores_stride, &input_stride);
+    // the atomic operations are not ordered against the okk ones
+    okk_poll();
+    SortParam sort = {
+        .input_data_addr = scores_addr,
+        .input_index_addr = 0,
+        .output_data_addr = sorted_scores_addr,
+        .output_index_addr = sorted_index_addr,
+        .input_len = num,
+        .output_len = candidates,
+        .order = BM_DESCEND,
+        .index_enable = true,
+        .index_auto = true
+    };
+    bm_atomic_sort(&sort);
+    okk_poll();
+    // the scores are descending, the boxes above the threshold lead
+    const float *sorted_scores = (const float *)okk_l2_sram_addr(sorted_scores_addr);
+    int boxes = 0;
+    while (boxes < candidates && sorted_scores[boxes] > param->score_threshold)
+        ++boxes;
+    OKK_TIMER_TILE(1, 0);
+    if (boxes > 0) {
+        GatherDataParam gather = {
+            .data_addr = boxes_addr,
+            .index_addr = sorted_index_addr,
+            .output_addr = sorted_boxes_addr,
+            .length = boxes,
+            .type = BM_GD_128BIT
+        };
+        bm_atomic_gather_data(&gather);
+        okk_poll();
+        // corner k of box b at corners[k * boxes + b]
+        const dim4 transpose_shape = {.n = 1, .c = 4, .h = boxes, .w = 1};
+        const dim4 sorted_boxes_stride = {.n = boxes * 4, .c = 1, .h = 4, .w = 1};
+        const dim4 corners_stride = {.n = boxes * 4, .c = boxes, .h = 1, .w = 1};
+        okk_gdma_32bit_cpy_S2S(corners_addr, sorted_boxes_addr, &transpose_shape, &corners_stride, &sorted_boxes_stride);
+        okk_poll();
+    }
+    // Candidates j on w first, in words of four, then candidates i in
+    // multiples of the NPUs.
+    const int npu_num = okk_npu_num();
+    const int mask_pitch = okk_arena_align_up(MAX(boxes, 1), 4);
+    int tile_i = MIN(MAX(boxes, 1), NMS_MAX_TILE_C);
+    int tile_j = MIN(mask_pitch, NMS_MAX_TILE_W / 4 * 4);
+    while (nms_tile_bytes(tile_i, tile_j) > LOCAL_MEM_SIZE) {
+        if (tile_j > 4)
+            tile_j = okk_arena_align_up(DIV_UP(tile_j, 2), 4);
+        else if (tile_i > npu_num)
+            tile_i = DIV_UP(tile_i, 2 * npu_num) * npu_num;
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_i = okk_tune_tile(param->tune.tile_c, tile_i);
+    tile_j = MAX(okk_tune_tile(param->tune.tile_w, tile_j) / 4 * 4, 4);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_box_shape = {.n = 1, .c = tile_i, .h = 4, .w = tile_j};
+    const dim4 max_shape = {.n = 1, .c = tile_i, .h = 1, .w = tile_j};
+    const dim4 max_vector_shape = {.n = 1, .c = tile_i, .h = 1, .w = 1};
+    dim4 stride, vector_stride;
+    local_addr_t j_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_box_shape, OKK_ARENA_ANY);
+    local_addr_t i_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_box_shape, OKK_ARENA_ANY);
+    local_addr_t temp_addr[4];
+    for (int t = 0; t < 4; ++t)
+        temp_addr[t] = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_ANY);
+    local_addr_t corner_addr[4];
+    for (int k = 0; k < 4; ++k)
+        corner_addr[k] = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    // box j + w on every channel, box i + c as vectors of each corner
+    const dim4 row_global_stride = {.n = 0, .c = 0, .h = boxes, .w = 1};
+    const dim4 corner_global_stride = {.n = 0, .c = 1, .h = 1, .w = 1};
+    const dim4 mask_global_stride = {.n = 0, .c = mask_pitch / 4, .h = 0, .w = 1};
+    int tile = 0;
+    for (int i = 0; i < boxes; i += tile_i) {
+        for (int j = 0; j < boxes; j += tile_j) {
+            const int bi = MIN(tile_i, boxes - i), bj = MIN(tile_j, boxes - j);
+            // only mask[i][j] with j > i is read
+            if (j + bj - 1 <= i)
+                continue;
+            const dim4 box_shape = {.n = 1, .c = bi, .h = 4, .w = bj};
+            const dim4 shape = {.n = 1, .c = bi, .h = 1, .w = bj};
+            const dim4 vector_shape = {.n = 1, .c = bi, .h = 1, .w = 1};
+            const dim4 word_shape = {.n = 1, .c = bi, .h = 1, .w = DIV_UP(bj, 4)};
+            dim4 box_stride, flag_stride;
+            okk_128_byte_aligned_stride_for_32bit(&box_stride, 0, &box_shape);
+            okk_128_byte_aligned_stride_for_32bit(&flag_stride, 0, &shape);
+            OKK_TIMER_TILE(2, tile);
+            okk_gdma_32bit_cpy_S2L(j_addr, corners_addr + j * sizeof(float), &box_shape, &box_stride, &row_global_stride);
+            for (int k = 0; k < 4; ++k)
+                okk_gdma_32bit_cpy_S2L(corner_addr[k], corners_addr + (k * boxes + i) * sizeof(float), &vector_shape, &vector_stride, &corner_global_stride);
+            OKK_TIMER_TILE(3, tile);
+            // 0 + corner k of box i on every column
+            const x32 zero = {.fp32 = 0.f};
+            okk_bdc_32bit_set_C(temp_addr[0], zero, &shape, &flag_stride);
+            for (int k = 0; k < 4; ++k)
+                okk_bdc_bias(i_addr + k * box_stride.h * sizeof(float), temp_addr[0], corner_addr[k], &shape, &box_stride, &flag_stride);
+            nms_iou_mask(temp_addr[2], temp_addr, j_addr, i_addr, param->iou_threshold, &shape, &flag_stride, &box_stride);
+            OKK_TIMER_TILE(4, tile);
+            okk_gdma_32bit_cpy_L2S(mask_addr + i * mask_pitch + j, temp_addr[2], &word_shape, &mask_global_stride, &flag_stride);
+            ++tile;
+        }
+    }
+    okk_poll();
+    OKK_TIMER_TILE(5, 0);
+    const unsigned char *mask = okk_l2_sram_addr(mask_addr);
+    const int *sorted_index = (const int *)okk_l2_sram_addr(sorted_index_addr);
+    int *keep = (int *)okk_l2_sram_addr(keep_addr);
+    int kept = 0;
+    for (int i = 0; i < boxes; ++i)
+        nms_removed[i] = 0;
+    for (int i = 0; i < boxes && kept < param->max_output; ++i) {
+        if (nms_removed[i])
+            continue;
+        keep[1 + kept++] = sorted_index[i];
+        const unsigned char *row = mask + i * mask_pitch;
+        for (int j = i + 1; j < boxes; ++j)
+            nms_removed[j] |= row[j];
+    }
+    keep[0] = kept;
+    const dim4 keep_shape = {.n = 1, .c = 1, .h = 1, .w = 1 + kept};
+    const dim4 keep_stride = {.n = 1 + kept, .c = 1 + kept, .h = 1 + kept, .w = 1};
+    okk_gdma_32bit_cpy_S2S(param->output_addr, keep_addr, &keep_shape, &keep_stride, &keep_stride);
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(nms);
@@ -0,0 +1,450 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define NORM_MAX_TILE_C 4095
+#define NORM_MAX_TILE_NHW 65535
+// limit of the columns per channel of the matrix layout of okk_bdc_matmul
+#define NORM_MAX_COLS_PER_CHANNEL 128
+// normalization
+#define NORM_BATCH 0
+#define NORM_LAYER 1
+#define NORM_RMS 2
+/*
+ * BatchNorm inference per channel, LayerNorm and RMSNorm per row,
+ * optionally as the epilogue of a matmul.
+ *
+ * input  [N, C, H, W] fp32, or [N * C * H, left_cols] if left_cols > 0
+ * right  [left_cols, W] fp32 if left_cols > 0, the rows normalized are then
+ *        those of input x right
+ * output [N, C, H, W] fp32
+ * NORM_BATCH  weight, bias, mean and var [C] fp32, output = (x - mean) /
+ *             sqrt(var + eps) * weight + bias
+ * NORM_LAYER  weight and bias [W] fp32, output = (x - mean(x)) /
+ *             sqrt(var(x) + eps) * weight + bias over each row of W
+ * NORM_RMS    weight [W] fp32, output = x / sqrt(mean(x^2) + eps) * weight
+ * A weight or bias at address 0 is left out.
+ *
+ * BatchNorm folds the statistics into per-channel scale and bias vectors
+ * once per tile of channels, then each tile of tile_n images by tile_c
+ * channels across the NPUs by tile_w of H * W takes one scale_bias.
+ *
+ * LayerNorm and RMSNorm tile tile_r rows across the NPUs by chunks of
+ * tile_w columns. The statistics take one streaming pass: per chunk,
+ * scale_bias shifts the values by the first of their row (LayerNorm, so that
+ * sum(x^2) - sum(x)^2 / W does not cancel), mul stacks their squares under
+ * them on h and halving adds along w reduce both into per-row sums. One
+ * scale_bias with per-row rstd and -mean * rstd then normalizes the rows,
+ * times weight and plus bias, broadcast to every row by the GDMA. Rows that
+ * fit in a chunk stay in local memory, longer ones are loaded again.
+ *
+ * With left_cols > 0, a tile of tile_m rows is computed by okk_bdc_matmul
+ * over chunks of tile_k of left_cols accumulated by result_add. The matrix
+ * layout spreads the columns of a row across the NPUs, so the product goes
+ * to the row layout through L2 SRAM rather than through DDR. right stays in
+ * local memory across the tiles of rows if it fits.
+ */
+typedef struct {
+    int N, C, H, W;
+    int mode;
+    int left_cols;
+    float eps;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long right_addr;
+    unsigned long long weight_addr;
+    unsigned long long bias_addr;
+    unsigned long long mean_addr;
+    unsigned long long var_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+// Local memory per NPU of a BatchNorm tile.
+static unsigned int norm_batch_tile_bytes(int tile_n, int tile_c, int tile_w) {
+    const dim4 shape = {.n = tile_n, .c = tile_c, .h = 1, .w = tile_w};
+    const dim4 vector_shape = {.n = 1, .c = tile_c, .h = 1, .w = 1};
+    dim4 stride, vector_stride, compact_stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    okk_128_byte_aligned_stride_for_32bit(&vector_stride, 0, &vector_shape);
+    okk_compact_stride(&compact_stride, 0, &vector_shape);
+    // values, var, mean, weight and bias, folded scale and bias
+    return okk_arena_align_up(tile_n * stride.n * sizeof(float), 128) +
+           okk_arena_align_up(vector_stride.n * sizeof(float), 128) +
+           5 * okk_arena_align_up(compact_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+// Local memory per NPU of a tile of rows.
+static unsigned int norm_rows_tile_bytes(int tile_r, int tile_w) {
+    const dim4 shape = {.n = 1, .c = tile_r, .h = 1, .w = tile_w};
+    const dim4 work_shape = {.n = 1, .c = tile_r, .h = 2, .w = tile_w};
+    const dim4 vector_shape = {.n = 1, .c = tile_r, .h = 1, .w = 1};
+    const dim4 sums_shape = {.n = 1, .c = tile_r, .h = 2, .w = 1};
+    dim4 stride, work_stride, vector_stride, compact_stride, sums_stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    okk_128_byte_aligned_stride_for_32bit(&work_stride, 0, &work_shape);
+    okk_128_byte_aligned_stride_for_32bit(&vector_stride, 0, &vector_shape);
+    okk_compact_stride(&compact_stride, 0, &vector_shape);
+    okk_compact_stride(&sums_stride, 0, &sums_shape);
+    // values, weight and bias, shifted values and squares, rstd, one, -shift,
+    // mean, scale and bias of the rows, sums
+    return 3 * okk_arena_align_up(stride.n * sizeof(float), 128) +
+           okk_arena_align_up(work_stride.n * sizeof(float), 128) +
+           okk_arena_align_up(vector_stride.n * sizeof(float), 128) +
+           5 * okk_arena_align_up(compact_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN) +
+           okk_arena_align_up(sums_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+// Columns per channel of a matrix of cols columns in the matrix layout.
+static int norm_cols_per_channel(int cols) {
+    return MIN(DIV_UP(cols, okk_npu_num()), NORM_MAX_COLS_PER_CHANNEL);
+}
+
+// Local memory per NPU of a matmul tile and of the tile of its rows.
+static unsigned int norm_matmul_tile_bytes(int tile_m, int tile_k, int cols) {
+    const int left_cpc = norm_cols_per_channel(tile_k), right_cpc = norm_cols_per_channel(cols);
+    const dim4 left_shape = {.n = tile_m, .c = DIV_UP(tile_k, left_cpc), .h = 1, .w = left_cpc};
+    const dim4 right_shape = {.n = tile_k, .c = DIV_UP(cols, right_cpc), .h = 1, .w = right_cpc};
+    const dim4 product_shape = {.n = tile_m, .c = DIV_UP(cols, right_cpc), .h = 1, .w = right_cpc};
+    dim4 left_stride, right_stride, product_stride;
+    okk_128_byte_aligned_stride_for_32bit(&left_stride, 0, &left_shape);
+    okk_128_byte_aligned_stride_for_32bit(&right_stride, 0, &right_shape);
+    okk_128_byte_aligned_stride_for_32bit(&product_stride, 0, &product_shape);
+    return okk_arena_align_up(tile_m * left_stride.n * sizeof(float), 128) +
+           okk_arena_align_up(tile_k * right_stride.n * sizeof(float), 128) +
+           okk_arena_align_up(tile_m * product_stride.n * sizeof(float), 128) +
+           norm_rows_tile_bytes(tile_m, cols);
+}
+
+static void norm_batch(const param_t *param) {
+    const int N = param->N, C = param->C, HW = param->H * param->W;
+    OKKERNEL_ASSERT(param->left_cols == 0 && param->mean_addr != 0 && param->var_addr != 0);
+    // Whole planes first, then images, then channels in multiples of the
+    // NPUs, then columns.
+    const int npu_num = okk_npu_num();
+    int tile_n = MIN(N, NORM_MAX_TILE_NHW);
+    int tile_c = MIN(C, NORM_MAX_TILE_C);
+    int tile_w = MIN(HW, NORM_MAX_TILE_NHW);
+    while (norm_batch_tile_bytes(tile_n, tile_c, tile_w) > LOCAL_MEM_SIZE) {
+        if (tile_n > 1)
+            tile_n = DIV_UP(tile_n, 2);
+        else if (tile_c > npu_num)
+            tile_c = DIV_UP(tile_c, 2 * npu_num) * npu_num;
+        else if (tile_w > 1)
+            tile_w = DIV_UP(tile_w, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_n = okk_tune_tile(param->tune.tile_n, tile_n);
+    tile_c = okk_tune_tile(param->tune.tile_c, tile_c);
+    tile_w = okk_tune_tile(param->tune.tile_w, tile_w);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_shape = {.n = tile_n, .c = tile_c, .h = 1, .w = tile_w};
+    const dim4 max_vector_shape = {.n = 1, .c = tile_c, .h = 1, .w = 1};
+    dim4 stride, vector_stride, compact_stride;
+    local_addr_t value_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_ANY);
+    // rsqrt takes the aligned layout, scale_bias the compact one, a GDMA
+    // moves rsqrt(var + eps) to the compact layout where the rest is folded
+    local_addr_t var_addr = okk_arena_alloc_32bit_aligned(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t mean_addr = okk_arena_alloc_32bit_compact(&arena, &compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t weight_addr = okk_arena_alloc_32bit_compact(&arena, &compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t bias_addr = okk_arena_alloc_32bit_compact(&arena, &compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t scale_addr = okk_arena_alloc_32bit_compact(&arena, &compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t shift_addr = okk_arena_alloc_32bit_compact(&arena, &compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    const dim4 global_stride = {.n = C * HW, .c = HW, .h = HW, .w = 1};
+    const dim4 vector_global_stride = {.n = C, .c = 1, .h = 1, .w = 1};
+    int tile = 0;
+    for (int c = 0; c < C; c += tile_c) {
+        const dim4 vector_shape = {.n = 1, .c = MIN(tile_c, C - c), .h = 1, .w = 1};
+        // stages: 0 fold, 1 load, 2 normalize, 3 store
+        OKK_TIMER_TILE(0, tile);
+        // scale = weight / sqrt(var + eps), shift = bias - mean * scale
+        okk_gdma_32bit_cpy_S2L(var_addr, param->var_addr + c * sizeof(float), &vector_shape, &vector_stride, &vector_global_stride);
+        okk_bdc_add_C(var_addr, var_addr, param->eps, &vector_shape, &vector_stride, &vector_stride);
+        okk_bdc_rsqrt(var_addr, var_addr, &vector_shape);
+        okk_gdma_32bit_cpy_L2L(scale_addr, var_addr, &vector_shape, &compact_stride, &vector_stride);
+        if (param->weight_addr != 0) {
+            okk_gdma_32bit_cpy_S2L(weight_addr, param->weight_addr + c * sizeof(float), &vector_shape, &compact_stride, &vector_global_stride);
+            okk_bdc_mul(scale_addr, scale_addr, weight_addr, &vector_shape, &compact_stride, &compact_stride, &compact_stride);
+        }
+        okk_gdma_32bit_cpy_S2L(mean_addr, param->mean_addr + c * sizeof(float), &vector_shape, &compact_stride, &vector_global_stride);
+        okk_bdc_mul(mean_addr, mean_addr, scale_addr, &vector_shape, &compact_stride, &compact_stride, &compact_stride);
+        if (param->bias_addr != 0) {
+            okk_gdma_32bit_cpy_S2L(bias_addr, param->bias_addr + c * sizeof(float), &vector_shape, &compact_stride, &vector_global_stride);
+            okk_bdc_sub(shift_addr, bias_addr, mean_addr, &vector_shape, &compact_stride, &compact_stride, &compact_stride);
+        } else
+            okk_bdc_neg(shift_addr, mean_addr, &vector_shape, &compact_stride, &compact_stride);
+        for (int n = 0; n < N; n += tile_n) {
+            for (int w = 0; w < HW; w += tile_w) {
+                const dim4 shape = {.n = MIN(tile_n, N - n), .c = vector_shape.c, .h = 1, .w = MIN(tile_w, HW - w)};
+                const unsigned long long offset = ((unsigned long long)n * C * HW + (unsigned long long)c * HW + w) * sizeof(float);
+                OKK_TIMER_TILE(1, tile);
+                okk_gdma_32bit_cpy_S2L(value_addr, param->input_addr + offset, &shape, &stride, &global_stride);
+                OKK_TIMER_TILE(2, tile);
+                okk_bdc_scale_bias(value_addr, value_addr, scale_addr, shift_addr, &shape, &stride, &stride);
+                OKK_TIMER_TILE(3, tile);
+                okk_gdma_32bit_cpy_L2S(param->output_addr + offset, value_addr, &shape, &global_stride, &stride);
+                ++tile;
+            }
+        }
+    }
+}
+
+// Local tensors of a tile of rows.
+typedef struct {
+    int tile_r, tile_w;
+    // tile_w columns of weight and bias loaded, -1 if none
+    int weight_w;
+    local_addr_t value_addr, weight_addr, bias_addr, work_addr;
+    local_addr_t rstd_addr, one_addr, neg_shift_addr, mean_addr, scale_addr, shift_addr, sums_addr;
+    dim4 stride, work_stride, vector_stride, compact_stride, sums_stride;
+} norm_rows_t;
+
+static void norm_rows_alloc(norm_rows_t *rows, okk_arena_t *arena, int tile_r, int tile_w) {
+    const dim4 max_shape = {.n = 1, .c = tile_r, .h = 1, .w = tile_w};
+    const dim4 max_work_shape = {.n = 1, .c = tile_r, .h = 2, .w = tile_w};
+    const dim4 max_vector_shape = {.n = 1, .c = tile_r, .h = 1, .w = 1};
+    const dim4 max_sums_shape = {.n = 1, .c = tile_r, .h = 2, .w = 1};
+    rows->tile_r = tile_r;
+    rows->tile_w = tile_w;
+    rows->weight_w = -1;
+    rows->value_addr = okk_arena_alloc_32bit_aligned(arena, &rows->stride, &max_shape, OKK_ARENA_ANY);
+    rows->weight_addr = okk_arena_alloc_32bit_aligned(arena, &rows->stride, &max_shape, OKK_ARENA_ANY);
+    rows->bias_addr = okk_arena_alloc_32bit_aligned(arena, &rows->stride, &max_shape, OKK_ARENA_ANY);
+    rows->work_addr = okk_arena_alloc_32bit_aligned(arena, &rows->work_stride, &max_work_shape, OKK_ARENA_ANY);
+    rows->rstd_addr = okk_arena_alloc_32bit_aligned(arena, &rows->vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->one_addr = okk_arena_alloc_32bit_compact(arena, &rows->compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->neg_shift_addr = okk_arena_alloc_32bit_compact(arena, &rows->compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->mean_addr = okk_arena_alloc_32bit_compact(arena, &rows->compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->scale_addr = okk_arena_alloc_32bit_compact(arena, &rows->compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->shift_addr = okk_arena_alloc_32bit_compact(arena, &rows->compact_stride, &max_vector_shape, OKK_ARENA_ANY);
+    rows->sums_addr = okk_arena_alloc_32bit_compact(arena, &rows->sums_stride, &max_sums_shape, OKK_ARENA_ANY);
+    x32 one = {.fp32 = 1.f};
+    okk_bdc_32bit_set_C(rows->one_addr, one, &max_vector_shape, &rows->compact_stride);
+}
+
+// Adds the sums of x - shift and of its squares over the columns of the
+// values to the sums of their rows.
+static void norm_rows_accumulate(const norm_rows_t *rows, int count, int cols) {
+    const dim4 shape = {.n = 1, .c = count, .h = 1, .w = cols};
+    const local_addr_t square_addr = rows->work_addr + rows->work_stride.h * sizeof(float);
+    okk_bdc_scale_bias(rows->work_addr, rows->value_addr, rows->one_addr, rows->neg_shift_addr, &shape, &rows->work_stride, &rows->stride);
+    okk_bdc_mul(square_addr, rows->work_addr, rows->work_addr, &shape, &rows->work_stride, &rows->work_stride, &rows->work_stride);
+    int width = cols;
+    while (width > 1) {
+        const int half = width / 2;
+        const dim4 half_shape = {.n = 1, .c = count, .h = 2, .w = half};
+        okk_bdc_add(
+            rows->work_addr,
+            rows->work_addr,
+            rows->work_addr + (width - half) * rows->work_stride.w * sizeof(float),
+            &half_shape,
+            &rows->work_stride,
+            &rows->work_stride,
+            &rows->work_stride);
+        width -= half;
+    }
+    const dim4 sums_shape = {.n = 1, .c = count, .h = 2, .w = 1};
+    okk_bdc_add(rows->sums_addr, rows->sums_addr, rows->work_addr, &sums_shape, &rows->sums_stride, &rows->sums_stride, &rows->work_stride);
+}
+
+// scale = 1 / sqrt(var + eps) and shift = -mean * scale of each row from
+// its sums, var = mean(x^2) for RMSNorm.
+static void norm_rows_fold(const param_t *param, const norm_rows_t *rows, int count) {
+    const dim4 shape = {.n = 1, .c = count, .h = 1, .w = 1};
+    const float inv_cols = 1.f / param->W;
+    const local_addr_t sum_squares_addr = rows->sums_addr + rows->sums_stride.h * sizeof(float);
+    okk_bdc_mul_C(rows->scale_addr, sum_squares_addr, inv_cols, &shape, &rows->compact_stride, &rows->sums_stride);
+    if (param->mode == NORM_LAYER) {
+        // var = mean((x - shift)^2) - mean(x - shift)^2
+        okk_bdc_mul_C(rows->mean_addr, rows->sums_addr, inv_cols, &shape, &rows->compact_stride, &rows->sums_stride);
+        okk_bdc_mul(rows->shift_addr, rows->mean_addr, rows->mean_addr, &shape, &rows->compact_stride, &rows->compact_stride, &rows->compact_stride);
+        okk_bdc_sub(rows->scale_addr, rows->scale_addr, rows->shift_addr, &shape, &rows->compact_stride, &rows->compact_stride, &rows->compact_stride);
+        okk_bdc_max_C(rows->scale_addr, rows->scale_addr, 0.f, &shape, &rows->compact_stride, &rows->compact_stride);
+    }
+    okk_bdc_add_C(rows->scale_addr, rows->scale_addr, param->eps, &shape, &rows->compact_stride, &rows->compact_stride);
+    // rsqrt takes the aligned layout, GDMA moves between the two
+    okk_gdma_32bit_cpy_L2L(rows->rstd_addr, rows->scale_addr, &shape, &rows->vector_stride, &rows->compact_stride);
+    okk_bdc_rsqrt(rows->rstd_addr, rows->rstd_addr, &shape);
+    okk_gdma_32bit_cpy_L2L(rows->scale_addr, rows->rstd_addr, &shape, &rows->compact_stride, &rows->vector_stride);
+    if (param->mode == NORM_LAYER) {
+        okk_bdc_sub(rows->mean_addr, rows->mean_addr, rows->neg_shift_addr, &shape, &rows->compact_stride, &rows->compact_stride, &rows->compact_stride);
+        okk_bdc_mul(rows->shift_addr, rows->mean_addr, rows->scale_addr, &shape, &rows->compact_stride, &rows->compact_stride, &rows->compact_stride);
+        okk_bdc_neg(rows->shift_addr, rows->shift_addr, &shape, &rows->compact_stride, &rows->compact_stride);
+    } else {
+        x32 zero = {.fp32 = 0.f};
+        okk_bdc_32bit_set_C(rows->shift_addr, zero, &shape, &rows->compact_stride);
+    }
+}
+
+// Normalizes the values, columns w to w + cols of their rows.
+static void norm_rows_apply(const param_t *param, norm_rows_t *rows, int count, int w, int cols) {
+    const dim4 shape = {.n = 1, .c = count, .h = 1, .w = cols};
+    okk_bdc_scale_bias(rows->value_addr, rows->value_addr, rows->scale_addr, rows->shift_addr, &shape, &rows->stride, &rows->stride);
+    if (rows->weight_w != w) {
+        // the same columns on every row
+        const dim4 broadcast_shape = {.n = 1, .c = rows->tile_r, .h = 1, .w = cols};
+        const dim4 broadcast_stride = {.n = 0, .c = 0, .h = 0, .w = 1};
+        if (param->weight_addr != 0)
+            okk_gdma_32bit_cpy_S2L(rows->weight_addr, param->weight_addr + w * sizeof(float), &broadcast_shape, &rows->stride, &broadcast_stride);
+        if (param->mode == NORM_LAYER && param->bias_addr != 0)
+            okk_gdma_32bit_cpy_S2L(rows->bias_addr, param->bias_addr + w * sizeof(float), &broadcast_shape, &rows->stride, &broadcast_stride);
+        rows->weight_w = w;
+    }
+    if (param->weight_addr != 0)
+        okk_bdc_mul(rows->value_addr, rows->value_addr, rows->weight_addr, &shape, &rows->stride, &rows->stride, &rows->stride);
+    if (param->mode == NORM_LAYER && param->bias_addr != 0)
+        okk_bdc_add(rows->value_addr, rows->value_addr, rows->bias_addr, &shape, &rows->stride, &rows->stride, &rows->stride);
+}
+
+// Normalizes count rows of W columns from input_addr, in DDR or L2 SRAM,
+// to output_addr.
+static void norm_rows(const param_t *param, norm_rows_t *rows, int count, unsigned long long input_addr, unsigned long long output_addr, int *tile) {
+    const int W = param->W;
+    const dim4 global_stride = {.n = count * W, .c = W, .h = W, .w = 1};
+    const dim4 vector_shape = {.n = 1, .c = count, .h = 1, .w = 1};
+    const dim4 sums_shape = {.n = 1, .c = count, .h = 2, .w = 1};
+    const x32 zero = {.fp32 = 0.f};
+    // stages: 0 load, 1 statistics, 2 normalize, 3 store
+    OKK_TIMER_TILE(0, *tile);
+    if (param->mode == NORM_LAYER) {
+        okk_gdma_32bit_cpy_S2L(rows->neg_shift_addr, input_addr, &vector_shape, &rows->compact_stride, &global_stride);
+        okk_bdc_neg(rows->neg_shift_addr, rows->neg_shift_addr, &vector_shape, &rows->compact_stride, &rows->compact_stride);
+    } else
+        okk_bdc_32bit_set_C(rows->neg_shift_addr, zero, &vector_shape, &rows->compact_stride);
+    okk_bdc_32bit_set_C(rows->sums_addr, zero, &sums_shape, &rows->sums_stride);
+    for (int w = 0; w < W; w += rows->tile_w) {
+        const dim4 shape = {.n = 1, .c = count, .h = 1, .w = MIN(rows->tile_w, W - w)};
+        OKK_TIMER_TILE(0, *tile);
+        okk_gdma_32bit_cpy_S2L(rows->value_addr, input_addr + w * sizeof(float), &shape, &rows->stride, &global_stride);
+        OKK_TIMER_TILE(1, *tile);
+        norm_rows_accumulate(rows, count, shape.w);
+        ++*tile;
+    }
+    norm_rows_fold(param, rows, count);
+    for (int w = 0; w < W; w += rows->tile_w) {
+        const dim4 shape = {.n = 1, .c = count, .h = 1, .w = MIN(rows->tile_w, W - w)};
+        if (rows->tile_w < W) {
+            OKK_TIMER_TILE(0, *tile);
+            okk_gdma_32bit_cpy_S2L(rows->value_addr, input_addr + w * sizeof(float), &shape, &rows->stride, &global_stride);
+        }
+        OKK_TIMER_TILE(2, *tile);
+        norm_rows_apply(param, rows, count, w, shape.w);
+        OKK_TIMER_TILE(3, *tile);
+        okk_gdma_32bit_cpy_L2S(output_addr + w * sizeof(float), rows->value_addr, &shape, &global_stride, &rows->stride);
+        ++*tile;
+    }
+}
+
+static void norm_layer(const param_t *param) {
+    const int R = param->N * param->C * param->H, W = param->W;
+    // Rows in multiples of the NPUs first, then columns.
+    const int npu_num = okk_npu_num();
+    int tile_r = MIN(R, NORM_MAX_TILE_C);
+    int tile_w = MIN(W, NORM_MAX_TILE_NHW);
+    while (norm_rows_tile_bytes(tile_r, tile_w) > LOCAL_MEM_SIZE) {
+        if (tile_r > npu_num)
+            tile_r = DIV_UP(tile_r, 2 * npu_num) * npu_num;
+        else if (tile_w > 1)
+            tile_w = DIV_UP(tile_w, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_r = okk_tune_tile(param->tune.tile_c, tile_r);
+    tile_w = okk_tune_tile(param->tune.tile_w, tile_w);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    norm_rows_t rows;
+    norm_rows_alloc(&rows, &arena, tile_r, tile_w);
+    int tile = 0;
+    for (int r = 0; r < R; r += tile_r) {
+        const unsigned long long offset = (unsigned long long)r * W * sizeof(float);
+        norm_rows(param, &rows, MIN(tile_r, R - r), param->input_addr + offset, param->output_addr + offset, &tile);
+    }
+}
+
+static void norm_matmul(const param_t *param) {
+    const int M = param->N * param->C * param->H, K = param->left_cols, W = param->W;
+    const int right_cpc = norm_cols_per_channel(W);
+    // whole rows in the row layout and the matrix layout
+    OKKERNEL_ASSERT(W <= NORM_MAX_TILE_NHW && DIV_UP(W, right_cpc) <= NORM_MAX_TILE_C);
+    // The product of a tile fits in L2 SRAM. Rows in multiples of the NPUs
+    // first, then chunks of left_cols, then rows.
+    const int npu_num = okk_npu_num();
+    int tile_m = MIN(M, NORM_MAX_TILE_C);
+    tile_m = MIN(tile_m, (int)(okk_l2_sram_size() / (W * sizeof(float))));
+    OKKERNEL_ASSERT(tile_m > 0);
+    int tile_k = K;
+    while (norm_matmul_tile_bytes(tile_m, tile_k, W) > LOCAL_MEM_SIZE) {
+        if (tile_m > npu_num)
+            tile_m = DIV_UP(tile_m, 2 * npu_num) * npu_num;
+        else if (tile_k > 1)
+            tile_k = DIV_UP(tile_k, 2);
+        else if (tile_m > 1)
+            tile_m = DIV_UP(tile_m, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_m = okk_tune_tile(param->tune.tile_c, tile_m);
+    tile_k = okk_tune_tile(param->tune.tile_h, tile_k);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const int left_cpc = norm_cols_per_channel(tile_k);
+    const dim4 left_shape = {.n = tile_m, .c = DIV_UP(tile_k, left_cpc), .h = 1, .w = left_cpc};
+    const dim4 right_shape = {.n = tile_k, .c = DIV_UP(W, right_cpc), .h = 1, .w = right_cpc};
+    const dim4 product_shape = {.n = tile_m, .c = DIV_UP(W, right_cpc), .h = 1, .w = right_cpc};
+    dim4 left_stride, right_stride, product_stride;
+    local_addr_t left_addr = okk_arena_alloc_32bit_aligned(&arena, &left_stride, &left_shape, OKK_ARENA_ANY);
+    local_addr_t right_addr = okk_arena_alloc_32bit_aligned(&arena, &right_stride, &right_shape, OKK_ARENA_ANY);
+    local_addr_t product_addr = okk_arena_alloc_32bit_aligned(&arena, &product_stride, &product_shape, OKK_ARENA_ANY);
+    norm_rows_t rows;
+    norm_rows_alloc(&rows, &arena, tile_m, W);
+    const unsigned int product_l2_addr = okk_l2_sram_start_addr();
+    const int right_resident = tile_k == K;
+    if (right_resident)
+        okk_gdma_32bit_matrix_S2L(right_addr, param->right_addr, K, W, right_cpc, W);
+    int tile = 0;
+    for (int m = 0; m < M; m += tile_m) {
+        const int count = MIN(tile_m, M - m);
+        for (int k = 0; k < K; k += tile_k) {
+            const int cols = MIN(tile_k, K - k), cpc = norm_cols_per_channel(cols);
+            // stage 4 matmul
+            OKK_TIMER_TILE(4, tile);
+            if (!right_resident)
+                okk_gdma_32bit_matrix_S2L(right_addr, param->right_addr + (unsigned long long)k * W * sizeof(float), cols, W, right_cpc, W);
+            okk_gdma_32bit_matrix_S2L(left_addr, param->input_addr + ((unsigned long long)m * K + k) * sizeof(float), count, cols, cpc, K);
+            okk_bdc_matmul(product_addr, left_addr, right_addr, 0, count, cols, W, cpc, right_cpc, false, k > 0);
+        }
+        okk_gdma_32bit_matrix_L2S(product_l2_addr, product_addr, count, W, right_cpc, W);
+        norm_rows(param, &rows, count, product_l2_addr, param->output_addr + (unsigned long long)m * W * sizeof(float), &tile);
+    }
+}
+
+void norm(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    OKKERNEL_ASSERT(param->N > 0 && param->C > 0 && param->H > 0 && param->W > 0 && param->left_cols >= 0);
+    if (param->mode == NORM_BATCH)
+        norm_batch(param);
+    else if (param->mode == NORM_LAYER || param->mode == NORM_RMS) {
+        if (param->left_cols > 0)
+            norm_matmul(param);
+        else
+            norm_layer(param);
+    } else
+        OKKERNEL_ASSERT(0);
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(norm);
@@ -1,4 +1,7 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -8,6 +11,9 @@ typedef struct {
     unsigned long long output_addr;
     unsigned long long input_addr;
     int N, C, H, W;
+    // only read by plus_one_2, which records its regions to timer_addr
+    tune_t tune;
+    unsigned long long timer_addr;
 } __attribute__((packed)) param_t;
 
 void plus_one_0(const void *args) {
@@ -32,7 +38,7 @@ void plus_one_0(const void *args) {
     // Synchronize.
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(plus_one_0);
+OKKERNEL_FUNC_REGISTER_ID(plus_one_0);
 
 void plus_one_1(const void *args) {
     param_t *param = (param_t *)args;
@@ -80,9 +86,10 @@ void plus_one_1(const void *args) {
     okk_poll();
 }
 
-OKKERNEL_FUNC_REGISTER(plus_one_1);
+OKKERNEL_FUNC_REGISTER_ID(plus_one_1);
 
 void plus_one_2(const void *args) {
+    OKK_TIMER_KERNEL_START();
     param_t *param = (param_t *)args;
     dim4 shape_one_batch = {.n = 1, .c = param->C, .h = param->H, .w = param->W};
     dim4 stride_one_batch, stride;
@@ -107,7 +114,7 @@ void plus_one_2(const void *args) {
     // Step 0 ~ Step S + 1
     for (int i = 0; i < S + 2; ++i) {
         // Start parallel.
-        okk_parallel_start();
+        OKK_TIMER_PARALLEL_START(0, i);
         // Copy part i of input from global to local.
         if (i < S)
             okk_gdma_32bit_cpy_S2L(input_addr[i % 2], param->input_addr + i * tensor_size_global, i == S - 1 ? &shape_last : &shape, NULL, NULL);
@@ -118,13 +125,14 @@ void plus_one_2(const void *args) {
         if (i > 1)
             okk_gdma_32bit_cpy_L2S(param->output_addr + (i - 2) * tensor_size_global, output_addr[(i - 2) % 2], i - 2 == S - 1 ? &shape_last : &shape, NULL, NULL);
         // End parallel.
-        okk_parallel_end();
+        OKK_TIMER_PARALLEL_END(0, i);
     }
     // Synchronize.
     okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
 }
 
-OKKERNEL_FUNC_REGISTER(plus_one_2);
+OKKERNEL_FUNC_REGISTER_ID(plus_one_2);
 
 void plus_one_3(const void *args) {
     param_t *param = (param_t *)args;
@@ -157,4 +165,4 @@ void plus_one_3(const void *args) {
     }
 }
 
-OKKERNEL_FUNC_REGISTER(plus_one_3);
+OKKERNEL_FUNC_REGISTER_ID(plus_one_3);
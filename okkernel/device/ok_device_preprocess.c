@@ -0,0 +1,162 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define PREPROCESS_MAX_C 4
+// limits of the shape of okk_bdc_int8_to_fp32
+#define PREPROCESS_MAX_TILE_C 4095
+#define PREPROCESS_MAX_TILE_NHW 65535
+/*
+ * Image preprocessing, packed uint8 frames to the input of the first conv.
+ *
+ * input  [N, H, W, C] uint8, C <= 4 interleaved channels (BGR, gray, ...),
+ *        rows of pitch bytes (W * C if 0) as in the planes of bm_image
+ * output [N, C, H, W] fp32, output[n][c] = (x - mean[c]) * scale[c], x is
+ *        input channel c, or C - 1 - c if reverse_channels (BGR to RGB)
+ *
+ * A tile is tile_n images of tile_h rows of tile_w pixels, the rows across
+ * the NPUs. One 8-bit GDMA loads the interleaved bytes of its rows as they
+ * are, [tile_n, tile_h, 1, tile_w * C], one int8_to_fp32 converts them,
+ * one scale_bias per channel reads the channel with the w stride C, so
+ * de-interleaves it to [tile_n, tile_h, C, tile_w], and normalizes it (and
+ * reverses the channels) with per-NPU vectors of scale[c] and -mean[c] *
+ * scale[c], and one GDMA stores the C planes.
+ */
+typedef struct {
+    int N, H, W, C;
+    int pitch;
+    int reverse_channels;
+    float mean[PREPROCESS_MAX_C];
+    float scale[PREPROCESS_MAX_C];
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+// Local memory per NPU of a tile.
+static unsigned int preprocess_tile_bytes(int C, int n, int h, int w) {
+    const dim4 row_shape = {.n = n, .c = h, .h = 1, .w = w * C};
+    const dim4 shape = {.n = n, .c = h, .h = C, .w = w};
+    const dim4 vector_shape = {.n = 1, .c = h, .h = 1, .w = 1};
+    dim4 row_stride_8bit, row_stride_32bit, stride_32bit, vector_stride;
+    okk_128_byte_aligned_stride_for_8bit(&row_stride_8bit, 0, &row_shape);
+    okk_128_byte_aligned_stride_for_32bit(&row_stride_32bit, 0, &row_shape);
+    okk_128_byte_aligned_stride_for_32bit(&stride_32bit, 0, &shape);
+    okk_compact_stride(&vector_stride, 0, &vector_shape);
+    // input and work, converted, normalized, scale and bias of each channel
+    return 2 * okk_arena_align_up(n * row_stride_8bit.n, 128) +
+           okk_arena_align_up(n * row_stride_32bit.n * sizeof(float), 128) +
+           okk_arena_align_up(n * stride_32bit.n * sizeof(float), 128) +
+           2 * C * okk_arena_align_up(vector_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+void preprocess(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    const int C = param->C;
+    OKKERNEL_ASSERT(C > 0 && C <= PREPROCESS_MAX_C);
+    const int npu_num = okk_npu_num();
+    // Whole images first, then rows in multiples of the NPUs, then columns,
+    // the bytes of a row of the tile are the w of int8_to_fp32.
+    int tile_n = MIN(param->N, PREPROCESS_MAX_TILE_NHW);
+    int tile_h = MIN(param->H, PREPROCESS_MAX_TILE_C);
+    int tile_w = MIN(param->W, PREPROCESS_MAX_TILE_NHW / C);
+    while (preprocess_tile_bytes(C, tile_n, tile_h, tile_w) > LOCAL_MEM_SIZE) {
+        if (tile_n > 1)
+            tile_n = DIV_UP(tile_n, 2);
+        else if (tile_h > npu_num)
+            tile_h = DIV_UP(tile_h, 2 * npu_num) * npu_num;
+        else if (tile_w > 1)
+            tile_w = DIV_UP(tile_w, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_n = okk_tune_tile(param->tune.tile_n, tile_n);
+    tile_h = okk_tune_tile(param->tune.tile_c, tile_h);
+    tile_w = okk_tune_tile(param->tune.tile_w, tile_w);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_row_shape = {.n = tile_n, .c = tile_h, .h = 1, .w = tile_w * C};
+    const dim4 max_shape = {.n = tile_n, .c = tile_h, .h = C, .w = tile_w};
+    dim4 stride;
+    local_addr_t input_addr = okk_arena_alloc_8bit_aligned(&arena, &stride, &max_row_shape, OKK_ARENA_ANY);
+    local_addr_t work_addr = okk_arena_alloc_8bit_aligned(&arena, &stride, &max_row_shape, OKK_ARENA_ANY);
+    local_addr_t value_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_row_shape, OKK_ARENA_ANY);
+    local_addr_t output_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_ANY);
+    // scale and bias of output channel c, the same on every row
+    const dim4 vector_shape = {.n = 1, .c = tile_h, .h = 1, .w = 1};
+    dim4 vector_stride;
+    local_addr_t scale_addr[PREPROCESS_MAX_C], bias_addr[PREPROCESS_MAX_C];
+    for (int c = 0; c < C; ++c) {
+        x32 scale = {.fp32 = param->scale[c]}, bias = {.fp32 = -param->mean[c] * param->scale[c]};
+        scale_addr[c] = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &vector_shape, OKK_ARENA_ANY);
+        bias_addr[c] = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &vector_shape, OKK_ARENA_ANY);
+        okk_bdc_32bit_set_C(scale_addr[c], scale, &vector_shape, &vector_stride);
+        okk_bdc_32bit_set_C(bias_addr[c], bias, &vector_shape, &vector_stride);
+    }
+    const int pitch = param->pitch > 0 ? param->pitch : param->W * C;
+    OKKERNEL_ASSERT(pitch >= param->W * C);
+    const long long image_len = (long long)param->H * param->W * C;
+    const dim4 input_global_stride = {.n = param->H * pitch, .c = pitch, .h = pitch, .w = 1};
+    const dim4 output_global_stride = {.n = image_len, .c = param->W, .h = param->H * param->W, .w = 1};
+    int tile = 0;
+    for (int n = 0; n < param->N; n += tile_n) {
+        for (int h = 0; h < param->H; h += tile_h) {
+            for (int w = 0; w < param->W; w += tile_w) {
+                const dim4 shape = {.n = MIN(tile_n, param->N - n), .c = MIN(tile_h, param->H - h), .h = C, .w = MIN(tile_w, param->W - w)};
+                const dim4 row_shape = {.n = shape.n, .c = shape.c, .h = 1, .w = shape.w * C};
+                // int8_to_fp32 takes the aligned layout of the shape of the rows
+                dim4 input_stride, value_stride, output_stride;
+                okk_128_byte_aligned_stride_for_8bit(&input_stride, 0, &row_shape);
+                okk_128_byte_aligned_stride_for_32bit(&value_stride, 0, &row_shape);
+                okk_128_byte_aligned_stride_for_32bit(&output_stride, 0, &shape);
+                // a channel of the converted rows
+                const dim4 channel_stride = {.n = value_stride.n, .c = value_stride.c, .h = value_stride.h, .w = C};
+                // stages: 0 load, 1 convert and normalize, 2 store
+                OKK_TIMER_TILE(0, tile);
+                okk_gdma_8bit_cpy_S2L(
+                    input_addr,
+                    param->input_addr + ((long long)n * param->H + h) * pitch + w * C,
+                    &row_shape,
+                    &input_stride,
+                    &input_global_stride);
+                OKK_TIMER_TILE(1, tile);
+                okk_bdc_int8_to_fp32(value_addr, input_addr, work_addr, &row_shape, false, true);
+                const dim4 plane_shape = {.n = shape.n, .c = shape.c, .h = 1, .w = shape.w};
+                for (int c = 0; c < C; ++c) {
+                    const int x = param->reverse_channels ? C - 1 - c : c;
+                    okk_bdc_scale_bias(
+                        output_addr + c * output_stride.h * sizeof(float),
+                        value_addr + x * sizeof(float),
+                        scale_addr[c],
+                        bias_addr[c],
+                        &plane_shape,
+                        &output_stride,
+                        &channel_stride);
+                }
+                OKK_TIMER_TILE(2, tile);
+                okk_gdma_32bit_cpy_L2S(
+                    param->output_addr + (n * image_len + (long long)h * param->W + w) * sizeof(float),
+                    output_addr,
+                    &shape,
+                    &output_global_stride,
+                    &output_stride);
+                ++tile;
+            }
+        }
+    }
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(preprocess);
@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 #define DIV_UP(a, b) (((a) - 1) / (b) + 1)
 
 typedef struct {
@@ -15,4 +16,4 @@ void set_local_memory_C(const void *args) {
     okk_poll();
 }
 
-OKKERNEL_FUNC_REGISTER(set_local_memory_C);
+OKKERNEL_FUNC_REGISTER_ID(set_local_memory_C);
@@ -1,4 +1,5 @@
 #include "okk.h"
+#include "okk_kernel_id.h"
 #ifndef NULL
 #define NULL 0
 #endif
@@ -21,4 +22,4 @@ void softmax_contest(const void *args) {
     // TODO
     okk_poll();
 }
-OKKERNEL_FUNC_REGISTER(softmax_contest);
+OKKERNEL_FUNC_REGISTER_ID(softmax_contest);
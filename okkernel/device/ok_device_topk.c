@@ -0,0 +1,201 @@
+#include "okk.h"
+#include "bm_atomic.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#include "okk_timer.h"
+#include "okk_tune.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define TOPK_MAX_TILE_C 4095
+#define TOPK_MAX_TILE_W 65535
+// lower bound of the inputs of okk_bdc_exp
+#define TOPK_EXP_MIN -103.f
+/*
+ * Top k of each row, optionally of its softmax.
+ *
+ * input  [N, C] fp32
+ * output [N, K] fp32, the K largest values of each row in descending order,
+ *        or their softmax over the whole row if softmax
+ * index  [N, K] int32, their columns
+ *
+ * bm_atomic_sort works in L2 SRAM: as many rows as fit with their sorted
+ * values and indices are staged there by one GDMA, each row is sorted with
+ * its indices keeping the first K, and two GDMAs store the values and
+ * indices of the staged rows to output and index. The softmax is monotonic, so the top k of
+ * the probabilities are the probabilities of the top k, and the first
+ * value of a row is its max: exp(x - max) / sum(exp(row - max)) only needs
+ * the sum. It is taken in tiles of tile_n rows across the NPUs by chunks of
+ * tile_w columns: scale_bias subtracts the per-row max, exp, halving adds
+ * along w reduce the chunk to one column, added to the sum. The K values
+ * are then reloaded and mapped the same way, times the reciprocal of the
+ * sum.
+ */
+typedef struct {
+    int N, C, K;
+    int softmax;
+    unsigned long long output_addr;
+    unsigned long long index_addr;
+    unsigned long long input_addr;
+    tune_t tune;
+    unsigned long long timer_addr;
+} __attribute__((packed)) param_t;
+
+// Local memory per NPU of a tile.
+static unsigned int topk_tile_bytes(int tile_n, int tile_w) {
+    const dim4 shape = {.n = 1, .c = tile_n, .h = 1, .w = tile_w};
+    const dim4 vector_shape = {.n = 1, .c = tile_n, .h = 1, .w = 1};
+    dim4 stride, vector_stride;
+    okk_128_byte_aligned_stride_for_32bit(&stride, 0, &shape);
+    okk_compact_stride(&vector_stride, 0, &vector_shape);
+    // values and work, one, -max, sum and zero
+    return 2 * okk_arena_align_up(stride.n * sizeof(float), 128) +
+           4 * okk_arena_align_up(vector_stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+// value_addr[..., 0] = sum of value_addr over w, the rest is clobbered.
+static void topk_sum_w(local_addr_t value_addr, int rows, int width, const dim4 *stride) {
+    while (width > 1) {
+        const int half = width / 2;
+        const dim4 shape = {.n = 1, .c = rows, .h = 1, .w = half};
+        okk_bdc_add(value_addr, value_addr, value_addr + (width - half) * stride->w * sizeof(float), &shape, stride, stride, stride);
+        width -= half;
+    }
+}
+
+// value_addr = exp(src - max) of a chunk in the aligned layout of shape.
+static void topk_exp(local_addr_t value_addr, local_addr_t work_addr, local_addr_t one_addr, local_addr_t neg_max_addr,
+                     const dim4 *shape, const dim4 *stride) {
+    okk_bdc_scale_bias(value_addr, value_addr, one_addr, neg_max_addr, shape, stride, stride);
+    okk_bdc_max_C(value_addr, value_addr, TOPK_EXP_MIN, shape, stride, stride);
+    okk_bdc_exp(value_addr, value_addr, work_addr, shape);
+}
+
+void topk(const void *args) {
+    OKK_TIMER_KERNEL_START();
+    okk_initialize();
+    param_t *param = (param_t *)args;
+    const int N = param->N, C = param->C, K = param->K;
+    OKKERNEL_ASSERT(K > 0 && K <= C);
+    // L2 SRAM: rows [sort_rows, C], their sorted values and indices
+    // [sort_rows, K]
+    const unsigned int row_bytes = (C + 2 * K) * sizeof(float);
+    OKKERNEL_ASSERT(row_bytes <= okk_l2_sram_size());
+    const int sort_rows = MIN(N, (int)(okk_l2_sram_size() / row_bytes));
+    const unsigned long long rows_addr = okk_l2_sram_start_addr();
+    const unsigned long long values_addr = rows_addr + (unsigned long long)sort_rows * C * sizeof(float);
+    const unsigned long long indices_addr = values_addr + (unsigned long long)sort_rows * K * sizeof(float);
+    // stages: 0 sort, then per tile 1 load, 2 sum, 3 map the top k
+    OKK_TIMER_TILE(0, 0);
+    for (int n = 0; n < N; n += sort_rows) {
+        const int rows = MIN(sort_rows, N - n);
+        const dim4 row_shape = {.n = 1, .c = 1, .h = rows, .w = C};
+        const dim4 row_stride = {.n = rows * C, .c = rows * C, .h = C, .w = 1};
+        okk_gdma_32bit_cpy_S2S(rows_addr, param->input_addr + (unsigned long long)n * C * sizeof(float), &row_shape, &row_stride, &row_stride);
+        // the atomic operations are not ordered against the okk ones
+        okk_poll();
+        for (int r = 0; r < rows; ++r) {
+            SortParam sort = {
+                .input_data_addr = rows_addr + (unsigned long long)r * C * sizeof(float),
+                .input_index_addr = 0,
+                .output_data_addr = values_addr + (unsigned long long)r * K * sizeof(float),
+                .output_index_addr = indices_addr + (unsigned long long)r * K * sizeof(int),
+                .input_len = C,
+                .output_len = K,
+                .order = BM_DESCEND,
+                .index_enable = true,
+                .index_auto = true
+            };
+            bm_atomic_sort(&sort);
+        }
+        okk_poll();
+        const dim4 top_shape = {.n = 1, .c = 1, .h = rows, .w = K};
+        const dim4 top_stride = {.n = rows * K, .c = rows * K, .h = K, .w = 1};
+        okk_gdma_32bit_cpy_S2S(param->output_addr + (unsigned long long)n * K * sizeof(float), values_addr, &top_shape, &top_stride, &top_stride);
+        okk_gdma_32bit_cpy_S2S(param->index_addr + (unsigned long long)n * K * sizeof(int), indices_addr, &top_shape, &top_stride, &top_stride);
+    }
+    okk_poll();
+    if (!param->softmax) {
+        OKK_TIMER_KERNEL_END(param->timer_addr);
+        return;
+    }
+    // Rows in multiples of the NPUs first, then columns.
+    const int npu_num = okk_npu_num();
+    int tile_n = MIN(N, TOPK_MAX_TILE_C);
+    int tile_w = MIN(C, TOPK_MAX_TILE_W);
+    while (topk_tile_bytes(tile_n, tile_w) > LOCAL_MEM_SIZE) {
+        if (tile_n > npu_num)
+            tile_n = DIV_UP(tile_n, 2 * npu_num) * npu_num;
+        else if (tile_w > 1)
+            tile_w = DIV_UP(tile_w, 2);
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    tile_n = okk_tune_tile(param->tune.tile_c, tile_n);
+    tile_w = okk_tune_tile(param->tune.tile_w, tile_w);
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_shape = {.n = 1, .c = tile_n, .h = 1, .w = tile_w};
+    const dim4 max_vector_shape = {.n = 1, .c = tile_n, .h = 1, .w = 1};
+    dim4 stride, vector_stride;
+    local_addr_t value_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_ANY);
+    local_addr_t work_addr = okk_arena_alloc_32bit_aligned(&arena, &stride, &max_shape, OKK_ARENA_ANY);
+    local_addr_t one_addr = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t neg_max_addr = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t sum_addr = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    local_addr_t zero_addr = okk_arena_alloc_32bit_compact(&arena, &vector_stride, &max_vector_shape, OKK_ARENA_ANY);
+    x32 one = {.fp32 = 1.f}, zero = {.fp32 = 0.f};
+    okk_bdc_32bit_set_C(one_addr, one, &max_vector_shape, &vector_stride);
+    okk_bdc_32bit_set_C(zero_addr, zero, &max_vector_shape, &vector_stride);
+    const dim4 input_global_stride = {.n = N * C, .c = C, .h = C, .w = 1};
+    const dim4 output_global_stride = {.n = N * K, .c = K, .h = K, .w = 1};
+    int tile = 0;
+    for (int n = 0; n < N; n += tile_n) {
+        const int rows = MIN(tile_n, N - n);
+        const dim4 vector_shape = {.n = 1, .c = rows, .h = 1, .w = 1};
+        OKK_TIMER_TILE(1, tile);
+        // the first value of each sorted row is its max
+        okk_gdma_32bit_cpy_S2L(neg_max_addr, param->output_addr + (unsigned long long)n * K * sizeof(float), &vector_shape, &vector_stride, &output_global_stride);
+        okk_bdc_neg(neg_max_addr, neg_max_addr, &vector_shape, &vector_stride, &vector_stride);
+        okk_bdc_32bit_set_C(sum_addr, zero, &vector_shape, &vector_stride);
+        for (int w = 0; w < C; w += tile_w) {
+            const dim4 shape = {.n = 1, .c = rows, .h = 1, .w = MIN(tile_w, C - w)};
+            // exp takes the aligned layout of the shape of the chunk
+            dim4 value_stride;
+            okk_128_byte_aligned_stride_for_32bit(&value_stride, 0, &shape);
+            OKK_TIMER_TILE(1, tile);
+            okk_gdma_32bit_cpy_S2L(
+                value_addr,
+                param->input_addr + ((unsigned long long)n * C + w) * sizeof(float),
+                &shape,
+                &value_stride,
+                &input_global_stride);
+            OKK_TIMER_TILE(2, tile);
+            topk_exp(value_addr, work_addr, one_addr, neg_max_addr, &shape, &value_stride);
+            topk_sum_w(value_addr, rows, shape.w, &value_stride);
+            okk_bdc_add(sum_addr, sum_addr, value_addr, &vector_shape, &vector_stride, &vector_stride, &value_stride);
+            ++tile;
+        }
+        okk_bdc_reciprocal(sum_addr, sum_addr, &vector_shape, &vector_stride, &vector_stride);
+        for (int k = 0; k < K; k += tile_w) {
+            const dim4 shape = {.n = 1, .c = rows, .h = 1, .w = MIN(tile_w, K - k)};
+            dim4 value_stride;
+            okk_128_byte_aligned_stride_for_32bit(&value_stride, 0, &shape);
+            const unsigned long long output_addr = param->output_addr + ((unsigned long long)n * K + k) * sizeof(float);
+            OKK_TIMER_TILE(3, tile);
+            okk_gdma_32bit_cpy_S2L(value_addr, output_addr, &shape, &value_stride, &output_global_stride);
+            topk_exp(value_addr, work_addr, one_addr, neg_max_addr, &shape, &value_stride);
+            okk_bdc_scale_bias(value_addr, value_addr, sum_addr, zero_addr, &shape, &value_stride, &value_stride);
+            okk_gdma_32bit_cpy_L2S(output_addr, value_addr, &shape, &output_global_stride, &value_stride);
+            ++tile;
+        }
+    }
+    okk_poll();
+    OKK_TIMER_KERNEL_END(param->timer_addr);
+}
+
+OKKERNEL_FUNC_REGISTER_ID(topk);
@@ -0,0 +1,130 @@
+#include "okk.h"
+#include "okk_kernel_id.h"
+#include "okk_arena.h"
+#ifndef NULL
+#define NULL 0
+#endif
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define LOCAL_MEM_SIZE okk_local_mem_size_per_npu()
+#define WEIGHT_PACK_MAX_TILE_C 4095
+/*
+ * Packs conv weights to the layouts of the conv kernels on the device.
+ *
+ * src [OC, IC / group, kernel_h, kernel_w] fp32
+ * dst [group, DIV_UP(IC / group, lanes), OC / group, kernel_h, kernel_w, lanes]
+ *
+ * lanes 2 is the 2IC layout of conv2d_demo, conv2d_contest and
+ * conv2d_group. GDMA only moves rows with a contiguous w, so the lanes are
+ * interleaved in local memory: a tile of packed rows of a tile of output
+ * channels (across the NPUs) is loaded as [rows, channels, lanes,
+ * kernel_len] as it is in src, a BDC copy swaps the last two dimensions
+ * and the tile is stored as [rows, channels, kernel_len * lanes] rows of
+ * dst. The lanes past the last input channel are set to 0 in local memory.
+ * When a group fits in one packed row, the output channels of all groups
+ * are contiguous in both layouts and are tiled together.
+ *
+ * BDC copies only 32-bit elements, host/okk_pack.h packs the 4N layout of
+ * int8 weights on the host.
+ */
+typedef struct {
+    int OC, IC, kernel_h, kernel_w;
+    int group;
+    int lanes;
+    // bytes per element, 4
+    int bytes;
+    unsigned long long dst_addr;
+    unsigned long long src_addr;
+} __attribute__((packed)) param_t;
+
+static unsigned int weight_pack_tile_bytes(int rows, int channels, int lanes, int kernel_len) {
+    const dim4 shape = {.n = rows, .c = channels, .h = lanes, .w = kernel_len};
+    dim4 stride;
+    okk_compact_stride(&stride, 0, &shape);
+    return 2 * okk_arena_align_up(rows * stride.n * sizeof(float), OKK_ARENA_DEFAULT_ALIGN);
+}
+
+void weight_pack(const void *args) {
+    okk_initialize();
+    const param_t *param = (const param_t *)args;
+    OKKERNEL_ASSERT(param->bytes == 4);
+    OKKERNEL_ASSERT(param->lanes > 0 && param->group > 0);
+    const int lanes = param->lanes;
+    const int group_IC = param->IC / param->group, group_OC = param->OC / param->group;
+    const int IC_new = DIV_UP(group_IC, lanes);
+    const int kernel_len = param->kernel_h * param->kernel_w;
+    // With one packed row per group the output channels of all groups are
+    // contiguous in both layouts.
+    const int groups_per_copy = IC_new == 1 ? param->group : 1;
+    const int channels = group_OC * groups_per_copy;
+    // Rows first, then channels in multiples of the NPUs.
+    const int npu_num = okk_npu_num();
+    int tile_n = IC_new, tile_c = MIN(channels, WEIGHT_PACK_MAX_TILE_C);
+    while (weight_pack_tile_bytes(tile_n, tile_c, lanes, kernel_len) > LOCAL_MEM_SIZE) {
+        if (tile_n > 1)
+            tile_n = DIV_UP(tile_n, 2);
+        else if (tile_c > npu_num)
+            tile_c = DIV_UP(tile_c, 2 * npu_num) * npu_num;
+        else
+            OKKERNEL_ASSERT(0);
+    }
+    okk_arena_t arena;
+    okk_arena_init(&arena);
+    const dim4 max_src_shape = {.n = tile_n, .c = tile_c, .h = lanes, .w = kernel_len};
+    const dim4 max_dst_shape = {.n = tile_n, .c = tile_c, .h = kernel_len, .w = lanes};
+    dim4 src_stride, dst_stride;
+    local_addr_t src_addr = okk_arena_alloc_32bit_compact(&arena, &src_stride, &max_src_shape, OKK_ARENA_ANY);
+    local_addr_t dst_addr = okk_arena_alloc_32bit_compact(&arena, &dst_stride, &max_dst_shape, OKK_ARENA_ANY);
+    const dim4 src_global_stride = {
+        .n = lanes * kernel_len,
+        .c = group_IC * kernel_len,
+        .h = kernel_len,
+        .w = 1
+    };
+    const dim4 dst_global_stride = {
+        .n = group_OC * kernel_len * lanes,
+        .c = kernel_len * lanes,
+        .h = 0,
+        .w = 1
+    };
+    // lane l, tap k of src is at k * lanes + l of dst
+    const dim4 transposed_stride = {.n = src_stride.n, .c = src_stride.c, .h = 1, .w = kernel_len};
+    const x32 zero = {.u32 = 0};
+    for (int g = 0; g < param->group; g += groups_per_copy) {
+        const unsigned long long src_offset = (unsigned long long)g * group_OC * group_IC * kernel_len;
+        const unsigned long long dst_offset = (unsigned long long)g * IC_new * group_OC * kernel_len * lanes;
+        for (int r0 = 0; r0 < IC_new; r0 += tile_n) {
+            const int rows = MIN(tile_n, IC_new - r0);
+            // input channels of the last row of the tile
+            const int last_lanes = MIN(lanes, group_IC - (r0 + rows - 1) * lanes);
+            for (int c0 = 0; c0 < channels; c0 += tile_c) {
+                const int c = MIN(tile_c, channels - c0);
+                const unsigned long long src_tile = src_offset + (unsigned long long)c0 * group_IC * kernel_len + (unsigned long long)r0 * lanes * kernel_len;
+                const unsigned long long dst_tile = dst_offset + ((unsigned long long)r0 * group_OC + c0) * kernel_len * lanes;
+                if (rows > 1) {
+                    const dim4 shape = {.n = rows - 1, .c = c, .h = lanes, .w = kernel_len};
+                    okk_gdma_32bit_cpy_S2L(src_addr, param->src_addr + src_tile * sizeof(float), &shape, &src_stride, &src_global_stride);
+                }
+                const local_addr_t last_addr = src_addr + (rows - 1) * src_stride.n * sizeof(float);
+                if (last_lanes < lanes) {
+                    const dim4 shape = {.n = 1, .c = c, .h = lanes, .w = kernel_len};
+                    okk_bdc_32bit_set_C(last_addr, zero, &shape, &src_stride);
+                }
+                const dim4 last_shape = {.n = 1, .c = c, .h = last_lanes, .w = kernel_len};
+                okk_gdma_32bit_cpy_S2L(
+                    last_addr,
+                    param->src_addr + (src_tile + (unsigned long long)(rows - 1) * lanes * kernel_len) * sizeof(float),
+                    &last_shape,
+                    &src_stride,
+                    &src_global_stride);
+                const dim4 dst_shape = {.n = rows, .c = c, .h = kernel_len, .w = lanes};
+                okk_bdc_32bit_cpy(dst_addr, src_addr, &dst_shape, &dst_stride, &transposed_stride);
+                // the rows of dst are contiguous in local memory too
+                const dim4 row_shape = {.n = rows, .c = c, .h = 1, .w = kernel_len * lanes};
+                okk_gdma_32bit_cpy_L2S(param->dst_addr + dst_tile * sizeof(float), dst_addr, &row_shape, &dst_global_stride, &dst_stride);
+            }
+        }
+    }
+    okk_poll();
+}
+OKKERNEL_FUNC_REGISTER_ID(weight_pack);
@@ -0,0 +1,124 @@
+#ifndef OKK_ARENA_H
+#define OKK_ARENA_H
+#include "okk.h"
+/*
+ * Local memory arena.
+ *
+ * Buffers are carved from the local memory of each NPU from low to high
+ * addresses. Allocations are released in scopes: okk_arena_mark() records
+ * the current top, okk_arena_release() frees everything allocated after it.
+ *
+ * Local memory is split into okk_local_mem_bank_per_npu() banks. Buffers
+ * touched by GDMA and BDC inside the same okk_parallel_start() region should
+ * not share a bank, so allocate them with OKK_ARENA_NEW_BANK.
+ */
+#define OKK_ARENA_DEFAULT_ALIGN 64
+
+typedef enum {
+    // Pack right after the previous allocation.
+    OKK_ARENA_ANY = 0,
+    // Start at a bank boundary and occupy whole banks only.
+    OKK_ARENA_NEW_BANK = 1
+} okk_arena_hint_t;
+
+typedef struct {
+    local_addr_t start;
+    local_addr_t end;
+    local_addr_t top;
+    local_addr_t peak;
+    unsigned int bank_size;
+} okk_arena_t;
+
+typedef local_addr_t okk_arena_mark_t;
+
+static inline unsigned int okk_arena_align_up(unsigned int val, unsigned int align) {
+    return (val + align - 1) / align * align;
+}
+
+static inline void okk_arena_init_range(okk_arena_t *arena, local_addr_t start, local_addr_t end) {
+    OKKERNEL_ASSERT(start <= end && end <= okk_local_mem_size_per_npu());
+    arena->start = start;
+    arena->end = end;
+    arena->top = start;
+    arena->peak = start;
+    arena->bank_size = okk_local_mem_size_per_npu() / okk_local_mem_bank_per_npu();
+}
+
+static inline void okk_arena_init(okk_arena_t *arena) {
+    okk_arena_init_range(arena, 0, okk_local_mem_size_per_npu());
+}
+
+// Returns the bank index of a local address.
+static inline unsigned int okk_arena_bank(const okk_arena_t *arena, local_addr_t addr) {
+    return addr / arena->bank_size;
+}
+
+// Returns the number of bytes still available for OKK_ARENA_ANY allocations.
+static inline unsigned int okk_arena_remained(const okk_arena_t *arena) {
+    return arena->end - arena->top;
+}
+
+// Returns true if a buffer of size bytes fits, without allocating it.
+static inline bool okk_arena_fits(const okk_arena_t *arena, unsigned int size, unsigned int align, okk_arena_hint_t hint) {
+    unsigned long long addr, end;
+    if (hint == OKK_ARENA_NEW_BANK) {
+        addr = okk_arena_align_up(arena->top, arena->bank_size);
+        end = addr + okk_arena_align_up(size, arena->bank_size);
+    } else {
+        addr = okk_arena_align_up(arena->top, align);
+        end = addr + size;
+    }
+    return end <= arena->end;
+}
+
+// Allocates size bytes aligned to align bytes, asserts on overflow.
+static inline local_addr_t okk_arena_alloc_aligned(okk_arena_t *arena, unsigned int size, unsigned int align, okk_arena_hint_t hint) {
+    local_addr_t addr;
+    unsigned int occupied = size;
+    OKKERNEL_ASSERT(okk_arena_fits(arena, size, align, hint));
+    if (hint == OKK_ARENA_NEW_BANK) {
+        addr = okk_arena_align_up(arena->top, arena->bank_size);
+        occupied = okk_arena_align_up(size, arena->bank_size);
+    } else
+        addr = okk_arena_align_up(arena->top, align);
+    arena->top = addr + occupied;
+    if (arena->top > arena->peak)
+        arena->peak = arena->top;
+    return addr;
+}
+
+static inline local_addr_t okk_arena_alloc(okk_arena_t *arena, unsigned int size, okk_arena_hint_t hint) {
+    return okk_arena_alloc_aligned(arena, size, OKK_ARENA_DEFAULT_ALIGN, hint);
+}
+
+// Allocates a 32-bit tensor in the 128-byte aligned layout and fills its stride.
+static inline local_addr_t okk_arena_alloc_32bit_aligned(okk_arena_t *arena, dim4 *stride, const dim4 *shape, okk_arena_hint_t hint) {
+    okk_128_byte_aligned_stride_for_32bit(stride, 0, shape);
+    return okk_arena_alloc_aligned(arena, shape->n * stride->n * sizeof(float), 128, hint);
+}
+
+// Allocates an 8-bit tensor in the 128-byte aligned layout and fills its stride.
+static inline local_addr_t okk_arena_alloc_8bit_aligned(okk_arena_t *arena, dim4 *stride, const dim4 *shape, okk_arena_hint_t hint) {
+    okk_128_byte_aligned_stride_for_8bit(stride, 0, shape);
+    return okk_arena_alloc_aligned(arena, shape->n * stride->n, 128, hint);
+}
+
+// Allocates a 32-bit tensor in the compact layout and fills its stride.
+static inline local_addr_t okk_arena_alloc_32bit_compact(okk_arena_t *arena, dim4 *stride, const dim4 *shape, okk_arena_hint_t hint) {
+    okk_compact_stride(stride, 0, shape);
+    return okk_arena_alloc(arena, shape->n * stride->n * sizeof(float), hint);
+}
+
+static inline okk_arena_mark_t okk_arena_mark(const okk_arena_t *arena) {
+    return arena->top;
+}
+
+static inline void okk_arena_release(okk_arena_t *arena, okk_arena_mark_t mark) {
+    OKKERNEL_ASSERT(mark >= arena->start && mark <= arena->top);
+    arena->top = mark;
+}
+
+static inline void okk_arena_reset(okk_arena_t *arena) {
+    arena->top = arena->start;
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef OKK_KERNEL_ID_H
+#define OKK_KERNEL_ID_H
+#include "okk.h"
+/*
+ * Numeric kernel IDs.
+ *
+ * The firmware finds the kernel of a launch by matching the name sent with
+ * it against the names registered by OKKERNEL_FUNC_REGISTER. Kernels
+ * registered by OKKERNEL_FUNC_REGISTER_ID also get the ID of their name,
+ * its 32-bit FNV-1a hash (host/okk_kernel_id.h computes the same), in the
+ * table of the dispatcher kernel okk_id. A launch of okk_id sends
+ * okk_kernel_id_header_t ahead of the param of the kernel and is
+ * dispatched by a hash table lookup. The firmware only matches the name of
+ * okk_id, which is registered before all the kernels.
+ */
+#define OKK_KERNEL_ID_DISPATCHER "okk_id"
+// slots of the ID table, a power of 2 above the number of kernels
+#define OKK_KERNEL_ID_SLOTS 128
+
+// Layout must match okk_kernel_id_header_t in host/okk_kernel_id.h.
+typedef struct {
+    unsigned int id;
+    // keeps the param 8-byte aligned
+    unsigned int reserved;
+} __attribute__((packed)) okk_kernel_id_header_t;
+
+// ID of a kernel name, never 0 (an empty slot).
+static inline unsigned int okk_kernel_id_of(const char *name) {
+    unsigned int hash = 2166136261U;
+    for (; *name; ++name) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619U;
+    }
+    return hash ? hash : 1;
+}
+
+void okk_register_kernel_id(const char *name, okk_kernel_func_t func);
+// Name of the kernel of an ID, NULL if none is registered.
+const char *okk_kernel_id_name(unsigned int id);
+
+#define OKKERNEL_FUNC_REGISTER_ID(func)                            \
+OKKERNEL_FUNC_REGISTER(func)                                       \
+__attribute__((constructor)) void okk_kernel_register_id_##func() { \
+    okk_register_kernel_id(#func, func);                           \
+}
+#endif
@@ -0,0 +1,303 @@
+/*
+ * Op trace of C-Model builds.
+ *
+ * Built with USING_CMODEL=1 OKK_OPTRACE=1, the GDMA and BDC functions used by
+ * the kernels are interposed: the kernels and the host program are linked
+ * into the same executable, so these definitions take precedence over the
+ * ones of the C-Model library, which are called through dlsym(RTLD_NEXT).
+ * Each call appends a line to the file named by the environment variable
+ * OKK_OPTRACE (default ./okk_optrace.txt):
+ *
+ *   launch <kernel_name>
+ *   op <func> <region> <n> <c> <h> <w> <inner> <bytes>
+ *
+ * region is the index of the okk_parallel_start() region of the launch, -1
+ * outside regions. n, c, h, w is the output (BDC) or transferred (GDMA)
+ * shape, inner the reduction length per output element and bytes the bytes
+ * moved by GDMA. host/costmodel turns a trace into estimated cycles.
+ * Functions that are not interposed are not traced.
+ */
+#if defined(USING_CMODEL) && defined(OKK_ENABLE_OPTRACE)
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmlib_runtime.h"
+#include "okk.h"
+#include "okk_kernel_id.h"
+
+static FILE *okk_optrace_file = NULL;
+static int okk_optrace_region = -1;
+static int okk_optrace_regions = 0;
+// Calls of the C-Model library into interposed functions are not traced.
+static __thread int okk_optrace_depth = 0;
+
+static FILE *okk_optrace_open() {
+    if (!okk_optrace_file) {
+        const char *path = getenv("OKK_OPTRACE");
+        okk_optrace_file = fopen(path ? path : "./okk_optrace.txt", "w");
+        OKKERNEL_ASSERT(okk_optrace_file);
+    }
+    return okk_optrace_file;
+}
+
+static void okk_optrace_op(const char *func, int n, int c, int h, int w, long long inner, long long bytes) {
+    if (okk_optrace_depth > 0)
+        return;
+    fprintf(okk_optrace_open(), "op %s %d %d %d %d %d %lld %lld\n", func, okk_optrace_region, n, c, h, w, inner, bytes);
+}
+
+static void okk_optrace_shape(const char *func, const dim4 *shape, long long inner, int bytes_per_element) {
+    long long bytes = bytes_per_element * (long long)shape->n * shape->c * shape->h * shape->w;
+    okk_optrace_op(func, shape->n, shape->c, shape->h, shape->w, inner, bytes);
+}
+
+#define OKK_OPTRACE_FORWARD(name, args) do {                          \
+    static __typeof__(&name) real = NULL;                             \
+    if (!real)                                                        \
+        real = (__typeof__(&name))dlsym(RTLD_NEXT, #name);            \
+    OKKERNEL_ASSERT(real);                                            \
+    ++okk_optrace_depth;                                              \
+    real args;                                                        \
+    --okk_optrace_depth;                                              \
+} while (0)
+
+////////////////////////////////////////////////////////////////////////
+// LAUNCH AND REGIONS
+////////////////////////////////////////////////////////////////////////
+// Launches of the dispatcher okk_id are traced by the name of the kernel of
+// the ID, so costmodel sees the same kernel names as for launches by name.
+static void okk_optrace_launch(const char *func_name, const void *args) {
+    if (strcmp(func_name, OKK_KERNEL_ID_DISPATCHER) == 0) {
+        const char *name = okk_kernel_id_name(((const okk_kernel_id_header_t *)args)->id);
+        if (name)
+            func_name = name;
+    }
+    fprintf(okk_optrace_open(), "launch %s\n", func_name);
+    fflush(okk_optrace_file);
+    okk_optrace_region = -1;
+    okk_optrace_regions = 0;
+}
+
+bm_status_t okkernel_launch_sync(bm_handle_t handle, const char *func_name, const void *args, unsigned int size) {
+    static __typeof__(&okkernel_launch_sync) real = NULL;
+    if (!real)
+        real = (__typeof__(&okkernel_launch_sync))dlsym(RTLD_NEXT, "okkernel_launch_sync");
+    OKKERNEL_ASSERT(real);
+    okk_optrace_launch(func_name, args);
+    bm_status_t ret = real(handle, func_name, args, size);
+    fflush(okk_optrace_file);
+    return ret;
+}
+
+bm_status_t okkernel_launch_async(bm_handle_t handle, const char *func_name, const void *args, unsigned int size) {
+    static __typeof__(&okkernel_launch_async) real = NULL;
+    if (!real)
+        real = (__typeof__(&okkernel_launch_async))dlsym(RTLD_NEXT, "okkernel_launch_async");
+    OKKERNEL_ASSERT(real);
+    okk_optrace_launch(func_name, args);
+    return real(handle, func_name, args, size);
+}
+
+void okk_parallel_start() {
+    if (okk_optrace_depth == 0)
+        okk_optrace_region = okk_optrace_regions++;
+    OKK_OPTRACE_FORWARD(okk_parallel_start, ());
+}
+
+void okk_parallel_end() {
+    OKK_OPTRACE_FORWARD(okk_parallel_end, ());
+    if (okk_optrace_depth == 0)
+        okk_optrace_region = -1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// GDMA
+////////////////////////////////////////////////////////////////////////
+#define OKK_OPTRACE_GDMA_CPY(name, dst_t, src_t, bytes_per_element)             \
+void name(dst_t dst_addr, src_t src_addr, const dim4 *shape,                    \
+          const dim4 *dst_stride, const dim4 *src_stride) {                     \
+    okk_optrace_shape(#name, shape, 1, bytes_per_element);                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, shape, dst_stride, src_stride)); \
+}
+
+OKK_OPTRACE_GDMA_CPY(okk_gdma_32bit_cpy_S2L, local_addr_t, system_addr_t, 4)
+OKK_OPTRACE_GDMA_CPY(okk_gdma_32bit_cpy_L2S, system_addr_t, local_addr_t, 4)
+OKK_OPTRACE_GDMA_CPY(okk_gdma_32bit_cpy_L2L, local_addr_t, local_addr_t, 4)
+OKK_OPTRACE_GDMA_CPY(okk_gdma_32bit_cpy_S2S, system_addr_t, system_addr_t, 4)
+OKK_OPTRACE_GDMA_CPY(okk_gdma_8bit_cpy_S2L, local_addr_t, system_addr_t, 1)
+
+#define OKK_OPTRACE_GDMA_MATRIX(name, dst_t, src_t)                             \
+void name(dst_t dst_addr, src_t src_addr, int rows, int cols,                   \
+          int cols_per_channel, int row_stride) {                               \
+    okk_optrace_op(#name, 1, (cols + cols_per_channel - 1) / cols_per_channel,  \
+                   rows, cols_per_channel, 1, 4LL * rows * cols);               \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, rows, cols, cols_per_channel, row_stride)); \
+}
+
+OKK_OPTRACE_GDMA_MATRIX(okk_gdma_32bit_matrix_S2L, local_addr_t, system_addr_t)
+OKK_OPTRACE_GDMA_MATRIX(okk_gdma_32bit_matrix_L2S, system_addr_t, local_addr_t)
+
+void okk_gdma_32bit_set_C_system(system_addr_t dst_addr, x32 C, const dim4 *shape, const dim4 *dst_stride) {
+    okk_optrace_shape(__func__, shape, 1, 4);
+    OKK_OPTRACE_FORWARD(okk_gdma_32bit_set_C_system, (dst_addr, C, shape, dst_stride));
+}
+
+void okk_gdma_32bit_set_C_local(local_addr_t dst_addr, x32 C, const dim4 *shape, const dim4 *dst_stride) {
+    okk_optrace_shape(__func__, shape, 1, 4);
+    OKK_OPTRACE_FORWARD(okk_gdma_32bit_set_C_local, (dst_addr, C, shape, dst_stride));
+}
+
+////////////////////////////////////////////////////////////////////////
+// BDC
+////////////////////////////////////////////////////////////////////////
+#define OKK_OPTRACE_BDC_UNARY(name)                                             \
+void name(local_addr_t dst_addr, local_addr_t src_addr, const dim4 *shape,      \
+          const dim4 *dst_stride, const dim4 *src_stride) {                     \
+    okk_optrace_shape(#name, shape, 1, 0);                                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, shape, dst_stride, src_stride)); \
+}
+
+#define OKK_OPTRACE_BDC_BINARY(name)                                            \
+void name(local_addr_t dst_addr, local_addr_t src0_addr, local_addr_t src1_addr,\
+          const dim4 *shape, const dim4 *dst_stride, const dim4 *src0_stride,   \
+          const dim4 *src1_stride) {                                            \
+    okk_optrace_shape(#name, shape, 1, 0);                                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src0_addr, src1_addr, shape,           \
+                               dst_stride, src0_stride, src1_stride));          \
+}
+
+#define OKK_OPTRACE_BDC_CONST(name)                                             \
+void name(local_addr_t dst_addr, local_addr_t src_addr, float C,                \
+          const dim4 *shape, const dim4 *dst_stride, const dim4 *src_stride) {  \
+    okk_optrace_shape(#name, shape, 1, 0);                                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, C, shape, dst_stride, src_stride)); \
+}
+
+#define OKK_OPTRACE_BDC_WORK(name)                                              \
+void name(local_addr_t dst_addr, local_addr_t src_addr, local_addr_t work_addr, \
+          const dim4 *shape) {                                                  \
+    okk_optrace_shape(#name, shape, 1, 0);                                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, work_addr, shape));          \
+}
+
+// ops of a [1, c, 1, 1] compact vector per channel
+#define OKK_OPTRACE_BDC_VECTOR(name)                                            \
+void name(local_addr_t dst_addr, local_addr_t src_addr, local_addr_t vec_addr,  \
+          const dim4 *shape, const dim4 *dst_stride, const dim4 *src_stride) {  \
+    okk_optrace_shape(#name, shape, 1, 0);                                      \
+    OKK_OPTRACE_FORWARD(name, (dst_addr, src_addr, vec_addr, shape, dst_stride, src_stride)); \
+}
+
+OKK_OPTRACE_BDC_UNARY(okk_bdc_32bit_cpy)
+OKK_OPTRACE_BDC_UNARY(okk_bdc_relu)
+OKK_OPTRACE_BDC_UNARY(okk_bdc_reciprocal)
+OKK_OPTRACE_BDC_UNARY(okk_bdc_neg)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_add)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_sub)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_mul)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_div)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_mac)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_max)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_min)
+OKK_OPTRACE_BDC_BINARY(okk_bdc_32bit_or)
+OKK_OPTRACE_BDC_CONST(okk_bdc_add_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_sub_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_C_sub)
+OKK_OPTRACE_BDC_CONST(okk_bdc_mul_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_div_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_C_div)
+OKK_OPTRACE_BDC_CONST(okk_bdc_mac_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_max_C)
+OKK_OPTRACE_BDC_CONST(okk_bdc_min_C)
+OKK_OPTRACE_BDC_WORK(okk_bdc_exp)
+OKK_OPTRACE_BDC_WORK(okk_bdc_sigmoid)
+OKK_OPTRACE_BDC_WORK(okk_bdc_tanh)
+OKK_OPTRACE_BDC_VECTOR(okk_bdc_scale)
+OKK_OPTRACE_BDC_VECTOR(okk_bdc_bias)
+
+void okk_bdc_32bit_set_C(local_addr_t dst_addr, x32 C, const dim4 *shape, const dim4 *dst_stride) {
+    okk_optrace_shape(__func__, shape, 1, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_32bit_set_C, (dst_addr, C, shape, dst_stride));
+}
+
+void okk_bdc_scale_bias(
+    local_addr_t dst_addr, local_addr_t src_addr, local_addr_t scale_addr, local_addr_t bias_addr,
+    const dim4 *shape, const dim4 *dst_stride, const dim4 *src_stride) {
+    okk_optrace_shape(__func__, shape, 1, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_scale_bias, (dst_addr, src_addr, scale_addr, bias_addr, shape, dst_stride, src_stride));
+}
+
+void okk_bdc_rsqrt(local_addr_t dst_addr, local_addr_t src_addr, const dim4 *shape) {
+    okk_optrace_shape(__func__, shape, 1, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_rsqrt, (dst_addr, src_addr, shape));
+}
+
+void okk_bdc_greater_select_value(
+    local_addr_t dst_addr, local_addr_t src0_addr, local_addr_t src1_addr, x32 select_val,
+    const dim4 *shape, const dim4 *dst_stride, const dim4 *src0_stride, const dim4 *src1_stride) {
+    okk_optrace_shape(__func__, shape, 1, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_greater_select_value, (dst_addr, src0_addr, src1_addr, select_val, shape,
+                                                       dst_stride, src0_stride, src1_stride));
+}
+
+void okk_bdc_int8_to_fp32(
+    local_addr_t dst_addr, local_addr_t src_addr, local_addr_t work_addr,
+    const dim4 *shape, bool is_signed, bool is_aligned_layout) {
+    okk_optrace_shape(__func__, shape, 1, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_int8_to_fp32, (dst_addr, src_addr, work_addr, shape, is_signed, is_aligned_layout));
+}
+
+static int okk_optrace_output_size(int input, int pad0, int pad1, int kernel, int stride, int dilation) {
+    return (input + pad0 + pad1 - dilation * (kernel - 1) - 1) / stride + 1;
+}
+
+void okk_bdc_conv2d(
+    local_addr_t output_addr, local_addr_t input_addr, local_addr_t weight_addr, local_addr_t bias_addr,
+    const dim4 *input_shape, int output_c, int kernel_h, int kernel_w,
+    const dim4 *input_stride, const dim4 *kernel_stride, bool using_bias, bool result_add,
+    const Padding *padding, const dim2 *stride, const dim2 *dilation) {
+    int output_h = okk_optrace_output_size(input_shape->h, padding->top, padding->bottom, kernel_h, stride->h, dilation->h);
+    int output_w = okk_optrace_output_size(input_shape->w, padding->left, padding->right, kernel_w, stride->w, dilation->w);
+    okk_optrace_op(__func__, input_shape->n, output_c, output_h, output_w, (long long)input_shape->c * kernel_h * kernel_w, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_conv2d, (output_addr, input_addr, weight_addr, bias_addr, input_shape, output_c,
+                                         kernel_h, kernel_w, input_stride, kernel_stride, using_bias, result_add,
+                                         padding, stride, dilation));
+}
+
+void okk_bdc_depthwise2d(
+    local_addr_t output_addr, local_addr_t input_addr, local_addr_t weight_addr, local_addr_t bias_addr,
+    const dim4 *input_shape, int kernel_h, int kernel_w, bool using_bias,
+    const Padding *padding, const dim2 *stride, const dim2 *dilation) {
+    int output_h = okk_optrace_output_size(input_shape->h, padding->top, padding->bottom, kernel_h, stride->h, dilation->h);
+    int output_w = okk_optrace_output_size(input_shape->w, padding->left, padding->right, kernel_w, stride->w, dilation->w);
+    okk_optrace_op(__func__, input_shape->n, input_shape->c, output_h, output_w, (long long)kernel_h * kernel_w, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_depthwise2d, (output_addr, input_addr, weight_addr, bias_addr, input_shape,
+                                              kernel_h, kernel_w, using_bias, padding, stride, dilation));
+}
+
+#define OKK_OPTRACE_BDC_POOL(name)                                              \
+void name(local_addr_t output_addr, local_addr_t input_addr,                    \
+          const dim4 *input_shape, int kernel_h, int kernel_w,                  \
+          const Padding *padding, const dim2 *stride) {                         \
+    int output_h = okk_optrace_output_size(input_shape->h, padding->top, padding->bottom, kernel_h, stride->h, 1); \
+    int output_w = okk_optrace_output_size(input_shape->w, padding->left, padding->right, kernel_w, stride->w, 1); \
+    okk_optrace_op(#name, input_shape->n, input_shape->c, output_h, output_w, (long long)kernel_h * kernel_w, 0); \
+    OKK_OPTRACE_FORWARD(name, (output_addr, input_addr, input_shape, kernel_h, kernel_w, padding, stride)); \
+}
+
+OKK_OPTRACE_BDC_POOL(okk_bdc_avg_pool2d)
+OKK_OPTRACE_BDC_POOL(okk_bdc_max_pool2d)
+
+void okk_bdc_matmul(
+    local_addr_t output_addr, local_addr_t left_addr, local_addr_t right_addr, local_addr_t bias_addr,
+    int left_rows, int left_cols, int right_cols, int left_cols_per_channel, int right_cols_per_channel,
+    bool using_bias, bool result_add) {
+    okk_optrace_op(__func__, 1, (right_cols + right_cols_per_channel - 1) / right_cols_per_channel,
+                   left_rows, right_cols_per_channel, left_cols, 0);
+    OKK_OPTRACE_FORWARD(okk_bdc_matmul, (output_addr, left_addr, right_addr, bias_addr, left_rows, left_cols,
+                                         right_cols, left_cols_per_channel, right_cols_per_channel,
+                                         using_bias, result_add));
+}
+#endif
@@ -0,0 +1,127 @@
+#ifndef OKK_TIMER_H
+#define OKK_TIMER_H
+#include "okk.h"
+/*
+ * Region timers.
+ *
+ * Built with OKK_TIMER=1 (which defines OKK_ENABLE_TIMER), the macros below
+ * append timestamped markers to a buffer at the start of DTCM while a kernel
+ * runs, and OKK_TIMER_KERNEL_END() copies the buffer to the global memory
+ * address sent by the host after tune_t (see host/okk_timer.h, which decodes
+ * it). Otherwise the markers compile to nothing and the parallel macros are
+ * plain okk_parallel_start()/okk_parallel_end().
+ *
+ * Timestamps are taken on the ARM side. Region markers bracket
+ * okk_parallel_start()/okk_parallel_end(), tile markers mark the points where
+ * the instructions of a stage are issued. The host attributes the time from a
+ * marker to the next one to the stage of the marker.
+ *
+ *   OKK_TIMER_KERNEL_START();
+ *   for (int i = 0; i < S; ++i) {
+ *       OKK_TIMER_PARALLEL_START(0, i);
+ *       ...
+ *       OKK_TIMER_PARALLEL_END(0, i);
+ *   }
+ *   okk_poll();
+ *   OKK_TIMER_KERNEL_END(param->timer_addr);
+ */
+typedef enum {
+    OKK_TIMER_KERNEL_BEGIN = 0,
+    OKK_TIMER_KERNEL_FINISH = 1,
+    OKK_TIMER_REGION_BEGIN = 2,
+    OKK_TIMER_REGION_FINISH = 3,
+    OKK_TIMER_TILE_BEGIN = 4
+} okk_timer_kind_t;
+
+// Layout must match timer_record_t in host/okk_timer.h.
+typedef struct {
+    unsigned short kind;
+    unsigned short stage;
+    unsigned int index;
+    unsigned long long time_ns;
+} __attribute__((packed)) okk_timer_record_t;
+
+#define OKK_TIMER_MAX_RECORDS 1024
+
+typedef struct {
+    unsigned int count;
+    unsigned int dropped;
+    okk_timer_record_t records[OKK_TIMER_MAX_RECORDS];
+} __attribute__((packed)) okk_timer_buffer_t;
+
+#ifdef OKK_ENABLE_TIMER
+#ifdef USING_CMODEL
+#include <time.h>
+static inline unsigned long long okk_timer_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#else
+// Provided by the firmware, the markers only keep their order without it.
+extern unsigned long long firmware_timer_get_time_us(void) __attribute__((weak));
+static inline unsigned long long okk_timer_now_ns() {
+    return firmware_timer_get_time_us ? firmware_timer_get_time_us() * 1000ULL : 0;
+}
+#endif
+
+static inline okk_timer_buffer_t *okk_timer_buffer() {
+    return (okk_timer_buffer_t *)okk_dtcm_addr(okk_dtcm_start_addr());
+}
+
+static inline void okk_timer_reset() {
+    OKKERNEL_ASSERT(sizeof(okk_timer_buffer_t) <= okk_dtcm_size());
+    okk_timer_buffer()->count = 0;
+    okk_timer_buffer()->dropped = 0;
+}
+
+static inline void okk_timer_mark(okk_timer_kind_t kind, int stage, int index) {
+    okk_timer_buffer_t *buffer = okk_timer_buffer();
+    if (buffer->count == OKK_TIMER_MAX_RECORDS) {
+        ++buffer->dropped;
+        return;
+    }
+    okk_timer_record_t *record = &buffer->records[buffer->count++];
+    record->kind = kind;
+    record->stage = stage;
+    record->index = index;
+    record->time_ns = okk_timer_now_ns();
+}
+
+// Copies the header and the used records, nothing if the host sent no buffer.
+static inline void okk_timer_flush(global_addr_t addr) {
+    if (addr == 0)
+        return;
+    const okk_timer_buffer_t *buffer = okk_timer_buffer();
+    const unsigned char *src = (const unsigned char *)buffer;
+    unsigned char *dst = okk_global_mem_addr(addr);
+    unsigned int size = sizeof(unsigned int) * 2 + buffer->count * sizeof(okk_timer_record_t);
+    for (unsigned int i = 0; i < size; ++i)
+        dst[i] = src[i];
+}
+
+#define OKK_TIMER_KERNEL_START() do {                    \
+    okk_timer_reset();                                   \
+    okk_timer_mark(OKK_TIMER_KERNEL_BEGIN, 0, 0);        \
+} while (0)
+#define OKK_TIMER_KERNEL_END(addr) do {                  \
+    okk_timer_mark(OKK_TIMER_KERNEL_FINISH, 0, 0);       \
+    okk_timer_flush(addr);                               \
+} while (0)
+#define OKK_TIMER_PARALLEL_START(stage, index) do {      \
+    okk_timer_mark(OKK_TIMER_REGION_BEGIN, stage, index);\
+    okk_parallel_start();                                \
+} while (0)
+#define OKK_TIMER_PARALLEL_END(stage, index) do {        \
+    okk_parallel_end();                                  \
+    okk_timer_mark(OKK_TIMER_REGION_FINISH, stage, index);\
+} while (0)
+#define OKK_TIMER_TILE(stage, index) okk_timer_mark(OKK_TIMER_TILE_BEGIN, stage, index)
+#else
+#define OKK_TIMER_KERNEL_START() do {} while (0)
+#define OKK_TIMER_KERNEL_END(addr) do {} while (0)
+#define OKK_TIMER_PARALLEL_START(stage, index) okk_parallel_start()
+#define OKK_TIMER_PARALLEL_END(stage, index) okk_parallel_end()
+#define OKK_TIMER_TILE(stage, index) do {} while (0)
+#endif
+#endif
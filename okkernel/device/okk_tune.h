@@ -0,0 +1,16 @@
+#ifndef OKK_TUNE_H
+#define OKK_TUNE_H
+/*
+ * Tile configuration appended by the host to the param of a tunable kernel,
+ * the layout must match tune_t in host/okk_tune.h. A field of 0 leaves the
+ * choice to the kernel, which is also what untuned launches send.
+ */
+typedef struct {
+    int tile_n, tile_c, tile_h, tile_w;
+} __attribute__((packed)) tune_t;
+
+// Returns the tuned tile if it is set and smaller than the limit, otherwise the limit.
+static inline int okk_tune_tile(int tuned, int limit) {
+    return tuned > 0 && tuned < limit ? tuned : limit;
+}
+#endif
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "attention"
+typedef attention_param_t param_t;
+// Runs attention over random queries, keys and values with the kernel
+// attention, checks the output against the host reference and reports the
+// time of the kernel against the time of the reference, with the DDR
+// traffic of the [seq_q, seq_k] scores and probabilities that separate
+// matmul and softmax launches would write and read back.
+//
+// Usage: attention [--filter pattern]...
+//   pattern  a glob over attention/case_index
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--filter pattern]..." << std::endl;
+}
+
+// Returns false if the case fails.
+static bool attention(bm_handle_t handle, int index, param_t param) {
+    const std::vector<long long> lens = tensor_lens(param);
+    // output, query, key and value
+    std::vector<std::vector<float>> host(lens.size());
+    for (size_t i = 0; i < lens.size(); ++i)
+        host[i].resize(lens[i]);
+    for (size_t i = 1; i < lens.size(); ++i)
+        random_uniform(host[i].data(), lens[i], -1.f, 1.f, golden_seed(), i);
+    std::vector<float> output_ref(lens[0]);
+    double start_time = bench_now_us();
+    attention_reference(output_ref.data(), host[1].data(), host[2].data(), host[3].data(), param);
+    const double host_us = bench_now_us() - start_time;
+    std::cout << KERNEL_NAME << " case " << index << " [" << shape_str(param) << "]: ";
+    device_tensors_t tensors;
+    bool pass = false;
+    bench_stats_t stats = bench_stats_none();
+    if (device_tensors_malloc(handle, param, tensors) == BM_SUCCESS) {
+        bm_status_t ret = BM_SUCCESS;
+        for (size_t i = 1; i < lens.size() && ret == BM_SUCCESS; ++i)
+            ret = bm_memcpy_s2d(handle, tensors.devs[i], host[i].data());
+        if (ret == BM_SUCCESS)
+            stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), 0, MAXIT);
+        if (stats.iterations == MAXIT && bm_memcpy_d2s(handle, host[0].data(), tensors.devs[0]) == BM_SUCCESS)
+            pass = compare_check(host[0].data(), output_ref.data(), lens[0], compare_options(1e-4, param.batch, param.heads, param.seq_q, param.dim));
+    }
+    device_tensors_free(handle, tensors);
+    // scores written and read by softmax, probabilities written and read by
+    // the second matmul
+    const long long scores = (long long)param.batch * param.heads * param.seq_q * param.seq_k;
+    if (pass)
+        std::cout << "device " << std::round(stats.mean) << " us (median " << stats.median << "), host " << std::round(host_us) << " us, "
+                  << 4 * scores * 4 << " B of DDR saved" << std::endl;
+    else
+        std::cout << "fail" << std::endl;
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(attention_cases); ++i) {
+        if (!bench_selected(options, KERNEL_NAME, i))
+            continue;
+        ++cases;
+        failed += !attention(handle, i, attention_cases[i]);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
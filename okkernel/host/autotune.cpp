@@ -0,0 +1,212 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <iostream>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (10)
+#endif
+// Sweeps the tile configs of a tunable kernel for each case and stores the
+// one with the lowest median time whose output matches the untuned output in the tuning cache.
+//
+// Usage: autotune kernel_name [case_index] [--iters N] [--cache path]
+//
+// Meaning of the tune_t fields, 0 is always the choice of the kernel:
+//   tile_n      batches (or keys of attention) per tile
+//   tile_c      channels (or output channels, rows, queries) per tile
+//   tile_h      rows per tile (or columns of the left matrix of norm)
+//   tile_w      columns per tile
+
+// {0} followed by the values smaller than limit.
+static inline std::vector<int> tile_values(int limit, const std::vector<int> &values) {
+    std::vector<int> res(1, 0);
+    for (size_t i = 0; i < values.size(); ++i)
+        if (values[i] < limit)
+            res.push_back(values[i]);
+    return res;
+}
+
+static inline std::vector<tune_t> candidates_of(const conv2d_group_param_t &param) {
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    return tune_candidates(
+        {0},
+        tile_values(param.OC, {64, 128, 256}),
+        tile_values(output_h, {4, 8, 16, 32, 64}),
+        {0});
+}
+
+template<class P>
+static inline std::vector<tune_t> pool_candidates_of(const P &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    return tune_candidates(
+        {0},
+        tile_values(param.N * param.C, {64, 128, 256, 512, 1024}),
+        tile_values(output_h, {1, 2, 4, 8, 16, 32, 64}),
+        {0});
+}
+
+static inline std::vector<tune_t> candidates_of(const max_pool_param_t &param) {
+    return pool_candidates_of(param);
+}
+
+static inline std::vector<tune_t> candidates_of(const avg_pool_param_t &param) {
+    return pool_candidates_of(param);
+}
+
+static inline std::vector<tune_t> candidates_of(const norm_param_t &param) {
+    if (param.mode == NORM_BATCH)
+        return tune_candidates(
+            tile_values(param.N, {1, 2}),
+            tile_values(param.C, {64, 256, 1024}),
+            {0},
+            tile_values(param.H * param.W, {1024, 4096, 16384}));
+    const long long rows = (long long)param.N * param.C * param.H;
+    return tune_candidates(
+        {0},
+        tile_values(std::min(rows, 65535LL), {64, 256, 1024}),
+        param.left_cols > 0 ? tile_values(param.left_cols, {256, 1024}) : std::vector<int>(1, 0),
+        param.left_cols > 0 ? std::vector<int>(1, 0) : tile_values(param.W, {1024, 4096, 16384}));
+}
+
+static inline std::vector<tune_t> candidates_of(const attention_param_t &param) {
+    return tune_candidates(
+        tile_values(param.seq_k, {64, 128, 256, 512}),
+        tile_values(param.seq_q, {64, 128, 256, 512}),
+        {0},
+        {0});
+}
+
+static inline bool same_output(const std::vector<float> &a, const std::vector<float> &b) {
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!std::isfinite(a[i]) && !std::isfinite(b[i]))
+            continue;
+        float max_val = std::max(std::fabs(a[i]), std::fabs(b[i]));
+        if (!(std::fabs(a[i] - b[i]) < 1e-4 * std::max(max_val, 1.f)))
+            return false;
+    }
+    return true;
+}
+
+template<class P>
+int autotune(bm_handle_t &handle, tune_cache_t &cache, const char *kernel_name, P param, int iterations) {
+    device_tensors_t tensors;
+    BMLIB_SAFE_CALL(device_tensors_alloc(handle, param, tensors));
+    // the untuned output is the reference of the candidates
+    std::vector<float> output_ref(tensors.lens[0]), output_host(tensors.lens[0]);
+    BMLIB_SAFE_CALL(okkernel_launch_tuned_sync(handle, kernel_name, param, TUNE_AUTO));
+    BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_ref.data(), tensors.devs[0]));
+    tune_t best = TUNE_AUTO;
+    double best_time = bench_launch(handle, kernel_name, param, TUNE_AUTO, 1, iterations).median;
+    std::cout << "  auto: " << best_time << "(us)" << std::endl;
+    std::vector<tune_t> candidates = candidates_of(param);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const tune_t &t = candidates[i];
+        if (tune_equal(t, TUNE_AUTO))
+            continue;
+        std::cout << "  [" << t.tile_n << ", " << t.tile_c << ", " << t.tile_h << ", " << t.tile_w << "]: ";
+        if (okkernel_launch_tuned_sync(handle, kernel_name, param, t) != BM_SUCCESS) {
+            std::cout << "launch failed" << std::endl;
+            continue;
+        }
+        BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host.data(), tensors.devs[0]));
+        if (!same_output(output_host, output_ref)) {
+            std::cout << "mismatch" << std::endl;
+            continue;
+        }
+        double elapsed_time = bench_launch(handle, kernel_name, param, t, 1, iterations).median;
+        std::cout << elapsed_time << "(us)" << std::endl;
+        if (elapsed_time >= 0 && elapsed_time < best_time) {
+            best = t;
+            best_time = elapsed_time;
+        }
+    }
+    tune_cache_store(cache, kernel_name, param, best, best_time);
+    std::cout << "  best: [" << best.tile_n << ", " << best.tile_c << ", " << best.tile_h << ", " << best.tile_w << "] "
+              << best_time << "(us)" << std::endl;
+    // free
+    device_tensors_free(handle, tensors);
+    return 0;
+}
+
+template<class P>
+static inline void autotune_cases(bm_handle_t &handle, tune_cache_t &cache, const char *kernel_name, const P *cases, int num, int index, int iterations) {
+    for (int i = 0; i < num; ++i) {
+        if (index >= 0 && i != index)
+            continue;
+        std::cout << kernel_name << " case " << i << std::endl;
+        autotune(handle, cache, kernel_name, cases[i], iterations);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *kernel_name = nullptr;
+    int index = -1, iterations = MAXIT;
+    std::string cache_path = tune_cache_path();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cache_path = argv[++i];
+        else if (!kernel_name)
+            kernel_name = argv[i];
+        else
+            index = atoi(argv[i]);
+    }
+    if (!kernel_name || iterations <= 0) {
+        std::cout << "Usage: autotune kernel_name [case_index] [--iters N] [--cache path]" << std::endl;
+        std::cout << "kernel_name: conv2d_group max_pool_0 avg_pool_0 norm attention" << std::endl;
+        return -1;
+    }
+    tune_cache_t cache;
+    tune_cache_load(cache_path, cache);
+    bm_handle_t handle;
+    // initialize
+    BMLIB_SAFE_CALL(bm_dev_request(&handle, 0));
+    if (strcmp(kernel_name, "conv2d_group") == 0) {
+        param_span_t<conv_t> params;
+        if (param_map("./param/conv.dat", params) != 0) {
+            bm_dev_free(handle);
+            return -1;
+        }
+        std::vector<conv2d_group_param_t> cases(params.size());
+        for (size_t i = 0; i < params.size(); ++i)
+            conv2d_group_param_from(cases[i], params[i]);
+        autotune_cases(handle, cache, kernel_name, cases.data(), cases.size(), index, iterations);
+        param_unmap(params);
+    } else if (strcmp(kernel_name, "norm") == 0)
+        autotune_cases(handle, cache, kernel_name, norm_cases, CASE_NUM(norm_cases), index, iterations);
+    else if (strcmp(kernel_name, "attention") == 0)
+        autotune_cases(handle, cache, kernel_name, attention_cases, CASE_NUM(attention_cases), index, iterations);
+    else if (strcmp(kernel_name, "max_pool_0") == 0 || strcmp(kernel_name, "avg_pool_0") == 0) {
+        param_span_t<pool_t> params;
+        if (param_map("./param/pool.dat", params) != 0) {
+            bm_dev_free(handle);
+            return -1;
+        }
+        if (strcmp(kernel_name, "avg_pool_0") == 0) {
+            std::vector<avg_pool_param_t> cases = avg_pool_cases(params);
+            autotune_cases(handle, cache, kernel_name, cases.data(), cases.size(), index, iterations);
+        } else {
+            std::vector<max_pool_param_t> cases = max_pool_cases(params);
+            autotune_cases(handle, cache, kernel_name, cases.data(), cases.size(), index, iterations);
+        }
+        param_unmap(params);
+    } else {
+        std::cout << "Unknown kernel " << kernel_name << std::endl;
+        bm_dev_free(handle);
+        return -1;
+    }
+    int ret = tune_cache_save(cache_path, cache);
+    if (ret == 0)
+        std::cout << "tuning cache saved to " << cache_path << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return ret;
+}
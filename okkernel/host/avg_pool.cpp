@@ -1,22 +1,14 @@
 #include <assert.h>
 #include <iostream>
-#include <random>
-#include <sys/time.h>
-#include "okk_param.h"
 #include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
 #define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
 #define DIV_UP(a, b) (((a) - 1) / (b) + 1)
 #define MAXIT (10)
-typedef struct {
-    unsigned long long output_addr;
-    unsigned long long input_addr;
-    int N, C, H, W;
-    int kernel_h, kernel_w;
-    int pad_top, pad_bottom, pad_left, pad_right;
-    int stride_h, stride_w;
-    int ceil_mode;
-    int count_include_pad;
-} __attribute__((packed)) param_t;
+typedef avg_pool_param_t param_t;
 
 static inline void avg_pool_reference(float *output, const float *input, const param_t &param) {
     int output_h = param.H + param.pad_top + param.pad_bottom - param.kernel_h;
@@ -58,10 +50,7 @@ static inline void avg_pool_reference(float *output, const float *input, const p
 }
 
 int avg_pool(bm_handle_t &handle, param_t &param, const char *device_func_name) {
-    std::mt19937 rng;
-    rng.seed(std::random_device()());
-    std::uniform_real_distribution<float> dist_value;
-    float *output_host = nullptr, *input_host = nullptr, *output_ref = nullptr;
+    float *output_host = nullptr;
     int output_h = param.H + param.pad_top + param.pad_bottom - param.kernel_h;
     int output_w = param.W + param.pad_left + param.pad_right - param.kernel_w;
     if (param.ceil_mode) {
@@ -73,47 +62,35 @@ int avg_pool(bm_handle_t &handle, param_t &param, const char *device_func_name)
     }
     int input_len = param.N * param.C * param.H * param.W;
     int output_len = param.N * param.C * output_h * output_w;
+    const unsigned long long seed = golden_seed();
+    golden_t golden;
+    if (golden_load(golden, device_func_name, param, seed, [&](float *const *tensors) {
+        random_uniform(tensors[1], input_len, 0.f, 1.f, seed, 1);
+        avg_pool_reference(tensors[0], tensors[1], param);
+    }) != 0)
+        return -1;
+    const float *output_ref = golden.tensors[0];
     bm_device_mem_t output_dev, input_dev;
     BMLIB_SAFE_CALL(bm_malloc_device_byte(handle, &input_dev, input_len * sizeof(float)));
     BMLIB_SAFE_CALL(bm_malloc_device_byte(handle, &output_dev, output_len * sizeof(float)));
     param.output_addr = bm_mem_get_device_addr(output_dev);
     param.input_addr = bm_mem_get_device_addr(input_dev);
     output_host = new float[output_len];
-    output_ref = new float[output_len];
-    input_host = new float[input_len];
-    for (int i = 0; i < input_len; ++i)
-        input_host[i] = dist_value(rng);
-    avg_pool_reference(output_ref, input_host, param);
-    BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, input_dev, input_host));
-    struct timeval start_time, end_time;
-    long long elapsed_time = 0;
-    for (int i = 0; i < MAXIT; ++i) {
-        gettimeofday(&start_time, NULL);
-        BMLIB_SAFE_CALL(okkernel_launch_sync(handle, device_func_name, &param, sizeof(param)));
-        gettimeofday(&end_time, NULL);
-        elapsed_time += (end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec);
-    }
+    BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, input_dev, golden.tensors[1]));
+    const tune_t tune = tune_lookup(device_func_name, param);
+    bench_stats_t stats = bench_launch(handle, device_func_name, param, tune, 0, MAXIT);
+    assert(stats.iterations == MAXIT);
     BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host, output_dev));
-    bool pass = true;
-    for (int i = 0; i < output_len; ++i) {
-        if (!std::isfinite(output_host[i]) && !std::isfinite(output_ref[i]))
-            continue;
-        float max_val = std::max(std::fabs(output_host[i]), std::fabs(output_ref[i]));
-        if (!(std::fabs(output_host[i] - output_ref[i]) < 1e-4 * std::max(max_val, 1.f))) {
-            pass = false;
-            break;
-        }
-    }
+    const bool pass = compare_check(output_host, output_ref, output_len, compare_options(1e-4, param.N, param.C, output_h, output_w));
     int res = -1;
     if (pass) {
-        res = std::round(elapsed_time / (double)MAXIT);
-        std::cout << "elapsed time: " << res << "(us)" << std::endl;
+        res = std::round(stats.mean);
+        bench_print(stats);
     }
     bm_free_device(handle, output_dev);
     bm_free_device(handle, input_dev);
     delete [] output_host;
-    delete [] output_ref;
-    delete [] input_host;
+    golden_free(golden);
     return res;
 }
 int main() {
@@ -121,30 +98,19 @@ int main() {
     // Initialize.
     BMLIB_SAFE_CALL(bm_dev_request(&handle, 0));
     param_t param;
-    std::vector<pool_t> params;
-    read_param("./param/pool.dat", params);
-    int param_size = params.size();
-    pool_t pm;
-    for (int i = 0; i < param_size; ++i) {
-        pm = params[i];
+    param_span_t<pool_t> params;
+    if (param_map("./param/pool.dat", params) != 0)
+        exit(-1);
+    // OKK_SHARD=i/n runs the i-th of n parts of pool.dat
+    for (const pool_t &pm : param_shard_env(params)) {
         if ((pm.is_gloabl_pool != 0) || (pm.is_avgpool == 0))
             continue;
+        pool_param_from(param, pm);
         param.N = 4;
-        param.C = pm.C;
-        param.H = pm.H;
-        param.W = pm.W;
-        param.kernel_h = pm.kh;
-        param.kernel_w = pm.kw;
-        param.pad_top = pm.pad_up_h;
-        param.pad_bottom = pm.pad_down_h;
-        param.pad_left = pm.pad_left_w;
-        param.pad_right = pm.pad_right_w;
-        param.stride_h = pm.stride_h;
-        param.stride_w = pm.stride_w;
-        param.ceil_mode = pm.out_ceil_mode;
         param.count_include_pad = rand() % 2;
         avg_pool(handle, param, "avg_pool_0");
     }
+    param_unmap(params);
     // Deinitialize.
     bm_dev_free(handle);
     return 0;
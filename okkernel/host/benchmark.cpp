@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <iostream>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_profile.h"
+#include "okk_timer.h"
+#define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
+#ifdef USING_CMODEL
+#define WARMUP (0)
+#define MAXIT (1)
+#else
+#define WARMUP (5)
+#define MAXIT (100)
+#endif
+// Times every case of the contest kernels, preprocess and the pool kernels with
+// random inputs and the tuned configs, and reports min/median/p99 with the achieved
+// GFLOP/s and GB/s. Outputs are not checked, run the per-kernel drivers for it.
+// With --profile, each case is launched once more with the perf monitors on
+// and the GDMA/BDC timelines are written as a Chrome trace. With --timers, the
+// region timers of the kernels built with OKK_TIMER=1 are printed per case.
+//
+// Usage: benchmark [--warmup N] [--iters N] [--filter pattern]... [--format text|csv|json] [--output path] [--profile trace.json] [--timers]
+
+template<class P>
+static inline void run_cases(bm_handle_t handle, const char *kernel_name, const P *cases, int num, const bench_options_t &options, std::vector<bench_record_t> &records, profile_trace_t &trace) {
+    bench_cases(handle, kernel_name, cases, num, options, records);
+    for (int i = 0; i < num; ++i) {
+        if (!bench_selected(options, kernel_name, i))
+            continue;
+        if (!options.profile.empty()) {
+            std::cerr << "profile " << kernel_name << " case " << i << std::endl;
+            profile_case(handle, kernel_name, i, cases[i], trace);
+        }
+        if (options.timers) {
+            std::cerr << "timers " << kernel_name << " case " << i << std::endl;
+            timer_case(handle, kernel_name, i, cases[i]);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    if (bench_parse_options(argc, argv, options, WARMUP, MAXIT) != 0) {
+        bench_usage(argv[0]);
+        return -1;
+    }
+    bm_handle_t handle;
+    // initialize
+    BMLIB_SAFE_CALL(bm_dev_request(&handle, 0));
+    std::vector<bench_record_t> records;
+    profile_trace_t trace;
+    run_cases(handle, "conv2d_contest", conv2d_contest_cases, CASE_NUM(conv2d_contest_cases), options, records, trace);
+    run_cases(handle, "depthwise_contest", depthwise_contest_cases, CASE_NUM(depthwise_contest_cases), options, records, trace);
+    run_cases(handle, "matmul_contest", matmul_contest_cases, CASE_NUM(matmul_contest_cases), options, records, trace);
+    run_cases(handle, "softmax_contest", softmax_contest_cases, CASE_NUM(softmax_contest_cases), options, records, trace);
+    run_cases(handle, "preprocess", preprocess_cases, CASE_NUM(preprocess_cases), options, records, trace);
+    param_span_t<pool_t> params;
+    if (param_map("./param/pool.dat", params) != 0) {
+        bm_dev_free(handle);
+        return -1;
+    }
+    std::vector<max_pool_param_t> max_pool_params = max_pool_cases(params);
+    std::vector<avg_pool_param_t> avg_pool_params = avg_pool_cases(params);
+    param_unmap(params);
+    run_cases(handle, "max_pool_0", max_pool_params.data(), max_pool_params.size(), options, records, trace);
+    run_cases(handle, "avg_pool_0", avg_pool_params.data(), avg_pool_params.size(), options, records, trace);
+    int ret = bench_report(records, options);
+    if (!options.profile.empty()) {
+        if (profile_trace_write(options.profile, trace) != 0)
+            ret = -1;
+        else
+            std::cerr << "trace saved to " << options.profile << ", open it in chrome://tracing" << std::endl;
+#ifdef USING_CMODEL
+        std::cerr << "cmodel has no perf monitor, the trace is synthetic" << std::endl;
+#endif
+    }
+    // deinitialize
+    bm_dev_free(handle);
+    return ret;
+}
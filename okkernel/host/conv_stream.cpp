@@ -0,0 +1,145 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_pack.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#include "okk_stripe.h"
+#define KERNEL_NAME "conv2d_group"
+typedef conv2d_group_param_t param_t;
+// Runs the conv2d_contest cases and 4K and 8K inspection images as stripe
+// convolutions with conv2d_group (see host/okk_stripe.h), checks the outputs against the
+// host reference and reports the stripes, the device memory of the slots
+// against the one of whole input and output tensors, and the time.
+//
+// Usage: conv_stream [--rows R] [--budget MiB] [--filter pattern]...
+//   --rows   output rows per stripe
+//   --budget input MiB per stripe, used if --rows is not given (16)
+//   pattern  a glob over conv2d_contest/case_index and inspection/case_index
+
+static const param_t inspection_cases[] = {
+    {.N = 1, .IC = 3, .OC = 16, .H = 2160, .W = 3840, .group = 1, .kernel_h = 3, .kernel_w = 3, .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 1, .stride_w = 1, .dilation_h = 1, .dilation_w = 1, .using_bias = 0}, // 4K
+    {.N = 1, .IC = 3, .OC = 16, .H = 4320, .W = 7680, .group = 1, .kernel_h = 3, .kernel_w = 3, .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 1, .stride_w = 1, .dilation_h = 1, .dilation_w = 1, .using_bias = 0}, // 8K
+};
+
+// A conv2d_contest case as a conv2d_group one of a single group without
+// bias.
+static inline param_t group_param_of(const conv2d_param_t &conv) {
+    param_t param = param_t();
+    param.N = conv.N;
+    param.IC = conv.IC;
+    param.OC = conv.OC;
+    param.H = conv.H;
+    param.W = conv.W;
+    param.group = 1;
+    param.kernel_h = conv.kernel_h;
+    param.kernel_w = conv.kernel_w;
+    param.pad_top = conv.pad_top;
+    param.pad_bottom = conv.pad_bottom;
+    param.pad_left = conv.pad_left;
+    param.pad_right = conv.pad_right;
+    param.stride_h = conv.stride_h;
+    param.stride_w = conv.stride_w;
+    param.dilation_h = conv.dilation_h;
+    param.dilation_w = conv.dilation_w;
+    param.using_bias = 0;
+    return param;
+}
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--rows R] [--budget MiB] [--filter pattern]..." << std::endl;
+}
+
+// Returns false if the case fails.
+static bool stream_case(bm_handle_t handle, const char *name, int index, param_t param, int rows, long long budget) {
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    const std::vector<long long> lens = tensor_lens(param);
+    const long long kernel_len = (long long)param.OC * param.IC * param.kernel_h * param.kernel_w;
+    // the golden tensors of conv2d_group
+    const unsigned long long seed = golden_seed();
+    golden_t golden;
+    if (golden_load(golden, KERNEL_NAME, param, seed, [&](float *const *tensors) {
+        random_uniform(tensors[1], lens[1], -1.f, 1.f, seed, 1);
+        random_uniform(tensors[2], kernel_len, -1.f, 1.f, seed, 2);
+        conv2d_group_reference(tensors[0], tensors[1], tensors[2], nullptr, param);
+    }) != 0)
+        return false;
+    std::cout << name << " case " << index << " [" << shape_str(param) << "]: ";
+    const pack_layout_t kernel_layout = pack_layout_2IC(param.OC, param.IC, param.kernel_h, param.kernel_w, param.group);
+    bm_device_mem_t kernel_dev;
+    bool pass = false;
+    stripe_result_t result;
+    if (bm_malloc_device_byte(handle, &kernel_dev, pack_dst_bytes(kernel_layout)) == BM_SUCCESS) {
+        std::vector<float> output(lens[0]);
+        param.kernel_addr = bm_mem_get_device_addr(kernel_dev);
+        if (pack_weights(handle, kernel_layout, golden.tensors[2], kernel_dev) == BM_SUCCESS &&
+            stripe_conv(handle, KERNEL_NAME, param, golden.tensors[1], output.data(), rows > 0 ? rows : stripe_rows(param, budget), result) == BM_SUCCESS)
+            pass = compare_check(output.data(), golden.tensors[0], lens[0], compare_options(1e-4, param.N, param.OC, output_h, output_w));
+        bm_free_device(handle, kernel_dev);
+    }
+    if (pass) {
+        const long long whole_bytes = (lens[0] + lens[1]) * sizeof(float);
+        std::cout << result.stripes << " stripes of " << result.rows << " rows, device " << result.device_bytes / 1048576.0
+                  << " MiB (whole " << whole_bytes / 1048576.0 << " MiB), " << result.us << " us" << std::endl;
+    } else
+        std::cout << "fail" << std::endl;
+    golden_free(golden);
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    int rows = 0;
+    long long budget = STRIPE_BUDGET;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        if (arg == "--rows")
+            rows = atoi(argv[++i]);
+        else if (arg == "--budget")
+            budget = atoll(argv[++i]) << 20;
+        else if (arg == "--filter")
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (rows < 0 || budget <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(conv2d_contest_cases); ++i) {
+        if (!bench_selected(options, "conv2d_contest", i))
+            continue;
+        ++cases;
+        failed += !stream_case(handle, "conv2d_contest", i, group_param_of(conv2d_contest_cases[i]), rows, budget);
+    }
+    for (int i = 0; i < CASE_NUM(inspection_cases); ++i) {
+        if (!bench_selected(options, "inspection", i))
+            continue;
+        ++cases;
+        failed += !stream_case(handle, "inspection", i, inspection_cases[i], rows, budget);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <iostream>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_pack.h"
+#include "okk_profile.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#include "okk_timer.h"
+#define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
+#ifdef USING_CMODEL
+#define WARMUP (0)
+#define MAXIT (1)
+#else
+#define WARMUP (5)
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "conv2d_group"
+typedef conv2d_group_param_t param_t;
+// Runs every layer of param/conv.dat with conv2d_group, checks its output
+// against the host reference and reports min/median/p99 of the launch time
+// with the achieved GFLOP/s and GB/s of each layer, then the totals on
+// stderr. The case index of a layer is its record index in conv.dat, and
+// OKK_SHARD=i/n runs only the i-th of n parts of the file. --profile and
+// --timers work as in benchmark.
+//
+// Usage: conv_sweep [--warmup N] [--iters N] [--filter pattern]... [--format text|csv|json] [--output path] [--profile trace.json] [--timers]
+
+// Runs and checks one layer, pass is false if the launch fails or the
+// output mismatches.
+static bench_record_t sweep_layer(bm_handle_t handle, int index, param_t param, const bench_options_t &options, bool &pass) {
+    bench_record_t record;
+    record.kernel_name = KERNEL_NAME;
+    record.case_index = index;
+    record.shape = shape_str(param);
+    record.stats = bench_stats_none();
+    record.gflops = record.gbps = 0;
+    pass = false;
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    const std::vector<long long> lens = tensor_lens(param);
+    const long long kernel_len = (long long)param.OC * (param.IC / param.group) * param.kernel_h * param.kernel_w;
+    // inputs and reference output, from the golden cache or generated
+    const unsigned long long seed = golden_seed();
+    golden_t golden;
+    if (golden_load(golden, KERNEL_NAME, param, seed, [&](float *const *tensors) {
+        // the kernel is packed to the 2IC layout of each group on the device
+        random_uniform(tensors[1], lens[1], -1.f, 1.f, seed, 1);
+        random_uniform(tensors[2], kernel_len, -1.f, 1.f, seed, 2);
+        if (param.using_bias)
+            random_uniform(tensors[3], lens[3], -1.f, 1.f, seed, 3);
+        conv2d_group_reference(tensors[0], tensors[1], tensors[2], tensors[3], param);
+    }) != 0)
+        return record;
+    device_tensors_t tensors;
+    if (device_tensors_malloc(handle, param, tensors) != BM_SUCCESS) {
+        std::cout << "Failed to allocate the device tensors of layer " << index << std::endl;
+        device_tensors_free(handle, tensors);
+        golden_free(golden);
+        return record;
+    }
+    for (size_t i = 1; i < lens.size(); ++i)
+        if (lens[i] != 0 && i != 2)
+            BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, tensors.devs[i], golden.tensors[i]));
+    const pack_layout_t kernel_layout = pack_layout_2IC(param.OC, param.IC, param.kernel_h, param.kernel_w, param.group);
+    BMLIB_SAFE_CALL(pack_weights(handle, kernel_layout, golden.tensors[2], tensors.devs[2]));
+    record.stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), options.warmup, options.iterations);
+    if (record.stats.iterations > 0) {
+        record.gflops = bench_flops(param) / record.stats.median * 1e-3;
+        record.gbps = bench_bytes(param) / record.stats.median * 1e-3;
+        std::vector<float> output_host(lens[0]);
+        BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host.data(), tensors.devs[0]));
+        pass = compare_check(output_host.data(), golden.tensors[0], lens[0], compare_options(1e-4, param.N, param.OC, output_h, output_w));
+    }
+    device_tensors_free(handle, tensors);
+    golden_free(golden);
+    return record;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    if (bench_parse_options(argc, argv, options, WARMUP, MAXIT) != 0) {
+        bench_usage(argv[0]);
+        return -1;
+    }
+    bm_handle_t handle;
+    // initialize
+    BMLIB_SAFE_CALL(bm_dev_request(&handle, 0));
+    param_span_t<conv_t> params;
+    if (param_map("./param/conv.dat", params) != 0) {
+        bm_dev_free(handle);
+        return -1;
+    }
+    std::vector<bench_record_t> records;
+    profile_trace_t trace;
+    int failed = 0;
+    double total_us = 0, total_flops = 0;
+    // OKK_SHARD=i/n runs the i-th of n parts of conv.dat
+    for (const conv_t &pm : param_shard_env(params)) {
+        const int index = &pm - params.data;
+        if (!bench_selected(options, KERNEL_NAME, index))
+            continue;
+        param_t param;
+        conv2d_group_param_from(param, pm);
+        std::cerr << KERNEL_NAME << " layer " << index << std::endl;
+        bool pass;
+        records.push_back(sweep_layer(handle, index, param, options, pass));
+        if (!pass) {
+            std::cerr << "layer " << index << " fail" << std::endl;
+            ++failed;
+            continue;
+        }
+        total_us += records.back().stats.median;
+        total_flops += bench_flops(param);
+        if (!options.profile.empty())
+            profile_case(handle, KERNEL_NAME, index, param, trace);
+        if (options.timers)
+            timer_case(handle, KERNEL_NAME, index, param);
+    }
+    param_unmap(params);
+    int ret = bench_report(records, options);
+    std::cerr << records.size() - failed << " of " << records.size() << " layers pass, " << total_us
+              << " us in total (median per layer), " << (total_us > 0 ? total_flops / total_us * 1e-3 : 0) << " GFLOP/s" << std::endl;
+    if (!options.profile.empty()) {
+        if (profile_trace_write(options.profile, trace) != 0)
+            ret = -1;
+        else
+            std::cerr << "trace saved to " << options.profile << ", open it in chrome://tracing" << std::endl;
+    }
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : ret;
+}
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "okk_cost.h"
+// Estimates the cycles of each launch of an op trace recorded by a C-Model
+// build with OKK_OPTRACE=1, and optionally compares them with a baseline.
+//
+// Usage: costmodel trace_file [--baseline path] [--tolerance percent] [--save path]
+//
+// Returns 1 if a launch is slower than its baseline by more than the
+// tolerance (default 2%), so it can gate changes without a TPU:
+//   $ OKK_OPTRACE=trace.txt ./build/cmodel/conv2d
+//   $ ./build/cmodel/costmodel trace.txt --baseline cost.baseline
+int main(int argc, char *argv[]) {
+    const char *trace_path = nullptr;
+    std::string baseline_path, save_path;
+    double tolerance = 2;
+    bool bad_args = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+            save_path = argv[++i];
+        else if (!trace_path)
+            trace_path = argv[i];
+        else
+            bad_args = true;
+    }
+    if (!trace_path || bad_args || tolerance < 0) {
+        std::cout << "Usage: costmodel trace_file [--baseline path] [--tolerance percent] [--save path]" << std::endl;
+        return -1;
+    }
+    std::vector<cost_launch_t> launches;
+    if (cost_trace_load(trace_path, launches) != 0) {
+        std::cout << "Failed to open file " << trace_path << std::endl;
+        return -1;
+    }
+    cost_baseline_t baseline, current;
+    if (!baseline_path.empty() && cost_baseline_load(baseline_path, baseline) != 0) {
+        std::cout << "Failed to open file " << baseline_path << std::endl;
+        return -1;
+    }
+    std::vector<std::string> keys = cost_launch_keys(launches);
+    int regressions = 0;
+    for (size_t i = 0; i < launches.size(); ++i) {
+        cost_estimate_t estimate = cost_estimate(launches[i]);
+        current[keys[i]] = estimate.cycles;
+        std::cout << keys[i] << ": " << launches[i].ops.size() << " ops, " << estimate.cycles << " cycles ("
+                  << estimate.cycles / COST_CLOCK_MHZ << "us), GDMA " << estimate.gdma_cycles << " cycles "
+                  << estimate.gdma_bytes << " bytes, BDC " << estimate.bdc_cycles << " cycles, hidden "
+                  << estimate.hidden_cycles << " cycles";
+        cost_baseline_t::const_iterator it = baseline.find(keys[i]);
+        if (it != baseline.end() && it->second > 0) {
+            double change = 100. * (estimate.cycles - it->second) / it->second;
+            std::cout << ", " << (change >= 0 ? "+" : "") << change << "% vs baseline";
+            if (change > tolerance) {
+                std::cout << " REGRESSION";
+                ++regressions;
+            }
+        } else if (!baseline.empty())
+            std::cout << ", not in baseline";
+        std::cout << std::endl;
+    }
+    if (!save_path.empty() && cost_baseline_save(save_path, current) != 0)
+        return -1;
+    if (regressions > 0) {
+        std::cout << regressions << " launches regressed by more than " << tolerance << "%" << std::endl;
+        return 1;
+    }
+    return 0;
+}
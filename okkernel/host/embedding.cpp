@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#include "okk_timer.h"
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "embedding"
+typedef embedding_param_t param_t;
+// Looks up random bags of rows of a table resident on the device with the
+// kernel embedding, checks the output against the host reference and
+// reports the time of the upload of the indices and of the kernel against
+// the time of the reference and of the upload of its dense output, the
+// host path it replaces. With --timers, the region timers of the kernel
+// built with OKK_TIMER=1 are printed per case.
+//
+// Usage: embedding [--filter pattern]... [--timers]
+//   pattern  a glob over embedding/case_index
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--filter pattern]... [--timers]" << std::endl;
+}
+
+// Uniform rows, bag b ends with b % 4 padding lookups of -1, all of them
+// for bags shorter than that.
+static void random_index(int *index, const param_t &param) {
+    const long long lookups = (long long)param.batch * param.bag;
+    std::vector<float> u(lookups);
+    random_uniform(u.data(), lookups, 0.f, 1.f, golden_seed(), 1);
+    for (long long i = 0; i < lookups; ++i) {
+        const int b = i / param.bag, l = i % param.bag;
+        index[i] = l >= param.bag - b % 4 ? -1 : std::min((int)(u[i] * param.rows), param.rows - 1);
+    }
+}
+
+// Returns false if the case fails.
+static bool embedding(bm_handle_t handle, int index, param_t param, bool timers) {
+    const std::vector<long long> lens = tensor_lens(param);
+    std::vector<float> table(lens[2]), output(lens[0]), output_ref(lens[0]);
+    std::vector<int> indices(lens[1]);
+    random_uniform(table.data(), lens[2], -1.f, 1.f, golden_seed(), 2);
+    random_index(indices.data(), param);
+    double start_time = bench_now_us();
+    embedding_reference(output_ref.data(), indices.data(), table.data(), param);
+    const double host_us = bench_now_us() - start_time;
+    std::cout << KERNEL_NAME << " case " << index << " [" << shape_str(param) << "]: ";
+    device_tensors_t tensors;
+    bool pass = false;
+    bench_stats_t stats = bench_stats_none();
+    double index_us = 0, dense_us = 0;
+    if (device_tensors_malloc(handle, param, tensors) == BM_SUCCESS &&
+        bm_memcpy_s2d(handle, tensors.devs[2], table.data()) == BM_SUCCESS) {
+        // what the host path uploads after its lookups, overwritten by the kernel
+        start_time = bench_now_us();
+        bm_status_t ret = bm_memcpy_s2d(handle, tensors.devs[0], output_ref.data());
+        dense_us = bench_now_us() - start_time;
+        start_time = bench_now_us();
+        if (ret == BM_SUCCESS)
+            ret = bm_memcpy_s2d(handle, tensors.devs[1], indices.data());
+        index_us = bench_now_us() - start_time;
+        if (ret == BM_SUCCESS)
+            stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), 0, MAXIT);
+        if (stats.iterations == MAXIT && bm_memcpy_d2s(handle, output.data(), tensors.devs[0]) == BM_SUCCESS)
+            pass = compare_check(output.data(), output_ref.data(), lens[0], compare_options(1e-5, 1, lens[0] / param.dim, 1, param.dim));
+    }
+    std::vector<timer_record_t> records;
+    unsigned int dropped = 0;
+    const bool timed = pass && timers && timer_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), records, dropped) == BM_SUCCESS;
+    device_tensors_free(handle, tensors);
+    if (pass)
+        std::cout << "device " << std::round(index_us) << " us for " << lens[1] * 4 << " B + " << std::round(stats.mean)
+                  << " us (median " << stats.median << "), host " << std::round(host_us) << " us + " << std::round(dense_us)
+                  << " us for " << lens[0] * 4 << " B" << std::endl;
+    else
+        std::cout << "fail" << std::endl;
+    if (timed)
+        timer_print(records, dropped);
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.filters.push_back(argv[++i]);
+        else if (arg == "--timers")
+            options.timers = true;
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(embedding_cases); ++i) {
+        if (!bench_selected(options, KERNEL_NAME, i))
+            continue;
+        ++cases;
+        failed += !embedding(handle, i, embedding_cases[i], options.timers);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#ifdef OKK_ENABLE_BMCV
+#include "bmcv_api_ext.h"
+#endif
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_pack.h"
+#include "okk_pipeline.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#include "okk_stages.h"
+#ifdef USING_CMODEL
+#define BATCHES (2)
+#else
+#define BATCHES (100)
+#endif
+// row pitch of the resized frames, VPP writes aligned rows
+#define FRAME_PITCH_ALIGN (64)
+// Runs batches of frames through the front of an image classifier, one
+// thread per stage with bounded queues between them (see host/okk_stages.h):
+//   decode    bmcv_image_jpeg_dec of the JPEG files, taken in turn
+//   resize    bmcv_image_vpp_convert to BGR_PACKED at the network size
+//   normalize the kernel preprocess to ImageNet normalized RGB fp32
+//   conv      the 7x7 stride 2 stem with 64 outputs, conv2d_group
+//   pool      the 3x3 stride 2 max_pool_0
+//   head      a global avg_pool_0 and topk of the softmax over the 64
+//             features, the 5 most probable of each image
+// and reports the latency and throughput of each stage and of the chain.
+// decode and resize need a build with BMCV=1 (not in C-Model mode) and
+// JPEG files, otherwise an upload stage copies random frames at the
+// network size instead. The outputs of the last batch of slot 0 are then
+// checked against the host references of the chain on its frames.
+//
+// Usage: image_pipeline [--batch N] [--batches M] [--size H W] [--depth D] [--slots S] [jpeg]...
+//   --batch   images per batch (4)
+//   --batches batches (100, 2 in C-Model mode)
+//   --size    network input (224 224)
+//   --depth   batches in each queue between two stages (2)
+//   --slots   batches in flight (the stages + 1)
+
+// classes reported by the head
+#define HEAD_TOP_K (5)
+
+typedef struct {
+    int batch, H, W, pitch;
+    conv2d_group_param_t conv;
+    max_pool_param_t pool;
+    avg_pool_param_t feature;
+    topk_param_t top;
+    preprocess_param_t normalize;
+} network_t;
+
+// The buffers of one batch, from the frames to the probabilities.
+typedef struct {
+    // [batch, H, pitch] BGR_PACKED
+    bm_device_mem_t frames;
+    bm_device_mem_t input, conv, pool, feature, prob, index;
+#ifdef OKK_ENABLE_BMCV
+    std::vector<bm_image> decoded, resized;
+#endif
+} slot_t;
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--batch N] [--batches M] [--size H W] [--depth D] [--slots S] [jpeg]..." << std::endl;
+}
+
+static inline network_t network_make(int batch, int H, int W) {
+    network_t net;
+    net.batch = batch;
+    net.H = H;
+    net.W = W;
+    net.pitch = (W * 3 + FRAME_PITCH_ALIGN - 1) / FRAME_PITCH_ALIGN * FRAME_PITCH_ALIGN;
+    const preprocess_param_t normalize = {.N = batch, .H = H, .W = W, .C = 3, .pitch = net.pitch, .reverse_channels = 1, .mean = {123.675f, 116.28f, 103.53f}, .scale = {1 / 58.395f, 1 / 57.12f, 1 / 57.375f}};
+    net.normalize = normalize;
+    const conv2d_group_param_t conv = {.N = batch, .IC = 3, .OC = 64, .H = H, .W = W, .group = 1, .kernel_h = 7, .kernel_w = 7, .pad_top = 3, .pad_bottom = 3, .pad_left = 3, .pad_right = 3, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1, .using_bias = 0};
+    net.conv = conv;
+    int conv_h, conv_w;
+    conv2d_group_output_hw(net.conv, conv_h, conv_w);
+    memset(&net.pool, 0, sizeof(net.pool));
+    net.pool.N = batch;
+    net.pool.C = net.conv.OC;
+    net.pool.H = conv_h;
+    net.pool.W = conv_w;
+    net.pool.kernel_h = net.pool.kernel_w = 3;
+    net.pool.pad_top = net.pool.pad_bottom = net.pool.pad_left = net.pool.pad_right = 1;
+    net.pool.stride_h = net.pool.stride_w = 2;
+    int pool_h, pool_w;
+    pool_output_hw(net.pool, pool_h, pool_w);
+    // global average of each channel
+    memset(&net.feature, 0, sizeof(net.feature));
+    net.feature.N = batch;
+    net.feature.C = net.conv.OC;
+    net.feature.H = net.feature.kernel_h = pool_h;
+    net.feature.W = net.feature.kernel_w = pool_w;
+    net.feature.stride_h = net.feature.stride_w = 1;
+    const topk_param_t top = {.N = batch, .C = net.conv.OC, .K = HEAD_TOP_K, .softmax = 1};
+    net.top = top;
+    return net;
+}
+
+static inline void slot_init(slot_t &slot) {
+    slot.frames.size = slot.input.size = slot.conv.size = slot.pool.size = 0;
+    slot.feature.size = slot.prob.size = slot.index.size = 0;
+}
+
+static inline bm_status_t slot_alloc(bm_handle_t handle, const network_t &net, slot_t &slot) {
+    const long long bytes[] = {
+        (long long)net.batch * net.H * net.pitch,
+        tensor_lens(net.normalize)[0] * (long long)sizeof(float),
+        tensor_lens(net.conv)[0] * (long long)sizeof(float),
+        tensor_lens(net.pool)[0] * (long long)sizeof(float),
+        tensor_lens(net.feature)[0] * (long long)sizeof(float),
+        tensor_lens(net.top)[0] * (long long)sizeof(float),
+        tensor_lens(net.top)[1] * (long long)sizeof(int)
+    };
+    bm_device_mem_t *mems[] = {&slot.frames, &slot.input, &slot.conv, &slot.pool, &slot.feature, &slot.prob, &slot.index};
+    for (int i = 0; i < 7; ++i) {
+        bm_status_t ret = bm_malloc_device_byte(handle, mems[i], bytes[i]);
+        if (ret != BM_SUCCESS) {
+            mems[i]->size = 0;
+            std::cout << "Failed to allocate " << bytes[i] << " bytes for a batch" << std::endl;
+            return ret;
+        }
+    }
+#ifdef OKK_ENABLE_BMCV
+    slot.resized.resize(net.batch);
+    for (int i = 0; i < net.batch; ++i) {
+        int stride = net.pitch;
+        bm_status_t ret = bm_image_create(handle, net.H, net.W, FORMAT_BGR_PACKED, DATA_TYPE_EXT_1N_BYTE, &slot.resized[i], &stride);
+        if (ret != BM_SUCCESS) {
+            slot.resized.resize(i);
+            return ret;
+        }
+    }
+    return bm_image_attach_contiguous_mem(net.batch, slot.resized.data(), slot.frames);
+#else
+    return BM_SUCCESS;
+#endif
+}
+
+static inline void slot_free(bm_handle_t handle, slot_t &slot) {
+#ifdef OKK_ENABLE_BMCV
+    if (!slot.resized.empty() && bm_image_is_attached(slot.resized[0]))
+        bm_image_dettach_contiguous_mem(slot.resized.size(), slot.resized.data());
+    for (size_t i = 0; i < slot.resized.size(); ++i)
+        bm_image_destroy(slot.resized[i]);
+    slot.resized.clear();
+#endif
+    bm_device_mem_t *mems[] = {&slot.frames, &slot.input, &slot.conv, &slot.pool, &slot.feature, &slot.prob, &slot.index};
+    for (int i = 0; i < 7; ++i)
+        if (mems[i]->size != 0)
+            bm_free_device(handle, *mems[i]);
+}
+
+// Checks the probabilities and classes in slot against the host references
+// of the chain on the frames in slot. Returns -1 if they differ.
+static inline int network_check(bm_handle_t handle, const network_t &net, const slot_t &slot, const float *kernel) {
+    std::vector<unsigned char> frames((long long)net.batch * net.H * net.pitch);
+    std::vector<float> prob(tensor_lens(net.top)[0]);
+    std::vector<int> index(tensor_lens(net.top)[1]);
+    if (bm_memcpy_d2s(handle, frames.data(), slot.frames) != BM_SUCCESS ||
+        bm_memcpy_d2s(handle, prob.data(), slot.prob) != BM_SUCCESS ||
+        bm_memcpy_d2s(handle, index.data(), slot.index) != BM_SUCCESS) {
+        std::cout << "Failed to download the outputs of a batch" << std::endl;
+        return -1;
+    }
+    std::vector<float> input(tensor_lens(net.normalize)[0]), conv(tensor_lens(net.conv)[0]), pool(tensor_lens(net.pool)[0]);
+    std::vector<float> feature(tensor_lens(net.feature)[0]), prob_ref(prob.size());
+    std::vector<int> index_ref(index.size());
+    preprocess_reference(input.data(), frames.data(), net.normalize);
+    conv2d_group_reference(conv.data(), input.data(), kernel, nullptr, net.conv);
+    max_pool_reference(pool.data(), conv.data(), net.pool);
+    avg_pool_reference(feature.data(), pool.data(), net.feature);
+    topk_reference(prob_ref.data(), index_ref.data(), feature.data(), net.top);
+    const bool pass = compare_check(prob.data(), prob_ref.data(), prob.size(), compare_options(1e-4, net.batch, net.top.K, 1, 1)) && index == index_ref;
+    std::cout << "outputs of the last batch of slot 0 " << (pass ? "pass" : "fail") << std::endl;
+    return pass ? 0 : -1;
+}
+
+static inline bool read_file(const char *path, std::vector<char> &data) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        std::cout << "Failed to open " << path << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int batch = 4, H = 224, W = 224, depth = 2, slots = 0;
+    long long batches = BATCHES;
+    std::vector<std::vector<char> > jpegs;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc)
+            batch = atoi(argv[++i]);
+        else if (arg == "--batches" && i + 1 < argc)
+            batches = atoll(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc) {
+            H = atoi(argv[++i]);
+            W = atoi(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc)
+            depth = atoi(argv[++i]);
+        else if (arg == "--slots" && i + 1 < argc)
+            slots = atoi(argv[++i]);
+        else if (arg.compare(0, 2, "--") == 0) {
+            usage(argv[0]);
+            return -1;
+        } else {
+            jpegs.push_back(std::vector<char>());
+            if (!read_file(argv[i], jpegs.back()))
+                return -1;
+        }
+    }
+    if (batch <= 0 || batches <= 0 || H <= 0 || W <= 0 || depth <= 0 || slots < 0) {
+        usage(argv[0]);
+        return -1;
+    }
+#ifndef OKK_ENABLE_BMCV
+    if (!jpegs.empty()) {
+        std::cout << "Failed to decode the JPEG files, build with BMCV=1 outside C-Model mode" << std::endl;
+        return -1;
+    }
+#endif
+    const bool decode = !jpegs.empty();
+    const network_t net = network_make(batch, H, W);
+    // one handle per stage, so that the launches and syncs of a stage do
+    // not wait on the ones of the others
+    const int stage_num = decode ? 6 : 5;
+    std::vector<bm_handle_t> handles(stage_num + 1);
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (bm_dev_request(&handles[i], 0) != BM_SUCCESS) {
+            std::cout << "Failed to request device 0" << std::endl;
+            handles.resize(i);
+            for (size_t j = 0; j < handles.size(); ++j)
+                bm_dev_free(handles[j]);
+            return -1;
+        }
+    }
+    bm_handle_t handle = handles[stage_num];
+    if (slots == 0)
+        slots = stage_num + 1;
+    std::vector<slot_t> slot_bufs(slots);
+    bm_device_mem_t kernel_dev;
+    kernel_dev.size = 0;
+    for (int s = 0; s < slots; ++s)
+        slot_init(slot_bufs[s]);
+    int ret = 0;
+    for (int s = 0; s < slots && ret == 0; ++s)
+        ret = slot_alloc(handle, net, slot_bufs[s]) == BM_SUCCESS ? 0 : -1;
+    // stem weights, packed once and shared by the batches
+    const unsigned long long seed = golden_seed();
+    const pack_layout_t kernel_layout = pack_layout_2IC(net.conv.OC, net.conv.IC, net.conv.kernel_h, net.conv.kernel_w, net.conv.group);
+    std::vector<float> kernel(pack_src_bytes(kernel_layout) / sizeof(float));
+    random_uniform(kernel.data(), kernel.size(), -1.f, 1.f, seed, 2);
+    if (ret == 0 && bm_malloc_device_byte(handle, &kernel_dev, pack_dst_bytes(kernel_layout)) == BM_SUCCESS)
+        ret = pack_weights(handle, kernel_layout, kernel.data(), kernel_dev) == BM_SUCCESS ? 0 : -1;
+    else
+        ret = -1;
+    // random frames for the upload stage
+    std::vector<unsigned char> frames;
+    if (!decode) {
+        frames.resize(slot_bufs.empty() ? 0 : slot_bufs[0].frames.size);
+        random_bytes(frames.data(), frames.size(), seed, 1);
+    }
+    const pipeline_layer_t normalize = pipeline_layer("preprocess", net.normalize);
+    const pipeline_layer_t conv = pipeline_layer("conv2d_group", net.conv);
+    const pipeline_layer_t pool = pipeline_layer("max_pool_0", net.pool);
+    const pipeline_layer_t feature = pipeline_layer("avg_pool_0", net.feature);
+    const pipeline_layer_t top = pipeline_layer("topk", net.top);
+    auto addr = [](const bm_device_mem_t &mem) { return bm_mem_get_device_addr(mem); };
+    const unsigned long long kernel_addr = kernel_dev.size != 0 ? addr(kernel_dev) : 0;
+    std::vector<stage_t> stages;
+    int h = 0;
+#ifdef OKK_ENABLE_BMCV
+    // the next file of the decode stage, in scope until stages_run returns
+    long long next = 0;
+#endif
+    if (decode) {
+#ifdef OKK_ENABLE_BMCV
+        stages.push_back(stage_make("decode", [&, h](int s) -> bm_status_t {
+            std::vector<void *> data(net.batch);
+            std::vector<size_t> sizes(net.batch);
+            for (int i = 0; i < net.batch; ++i, ++next) {
+                std::vector<char> &jpeg = jpegs[next % jpegs.size()];
+                data[i] = jpeg.data();
+                sizes[i] = jpeg.size();
+            }
+            // created by the decoder in the format of the files
+            slot_bufs[s].decoded.assign(net.batch, bm_image());
+            return bmcv_image_jpeg_dec(handles[h], data.data(), sizes.data(), net.batch, slot_bufs[s].decoded.data());
+        }));
+        ++h;
+        stages.push_back(stage_make("resize", [&, h](int s) -> bm_status_t {
+            slot_t &slot = slot_bufs[s];
+            bm_status_t status = BM_SUCCESS;
+            for (int i = 0; i < net.batch && status == BM_SUCCESS; ++i)
+                status = bmcv_image_vpp_convert(handles[h], 1, slot.decoded[i], &slot.resized[i]);
+            for (int i = 0; i < net.batch; ++i)
+                bm_image_destroy(slot.decoded[i]);
+            return status;
+        }));
+        ++h;
+#endif
+    } else {
+        stages.push_back(stage_make("upload", [&, h](int s) -> bm_status_t {
+            return bm_memcpy_s2d(handles[h], slot_bufs[s].frames, frames.data());
+        }));
+        ++h;
+    }
+    stages.push_back(stage_make("normalize", [&, h](int s) -> bm_status_t {
+        return normalize.launch(handles[h], {addr(slot_bufs[s].input), addr(slot_bufs[s].frames)});
+    }));
+    ++h;
+    stages.push_back(stage_make("conv", [&, h](int s) -> bm_status_t {
+        return conv.launch(handles[h], {addr(slot_bufs[s].conv), addr(slot_bufs[s].input), kernel_addr, 0});
+    }));
+    ++h;
+    stages.push_back(stage_make("pool", [&, h](int s) -> bm_status_t {
+        return pool.launch(handles[h], {addr(slot_bufs[s].pool), 0, addr(slot_bufs[s].conv)});
+    }));
+    ++h;
+    stages.push_back(stage_make("head", [&, h](int s) -> bm_status_t {
+        const slot_t &slot = slot_bufs[s];
+        const bm_status_t status = feature.launch(handles[h], {addr(slot.feature), addr(slot.pool)});
+        return status != BM_SUCCESS ? status : top.launch(handles[h], {addr(slot.prob), addr(slot.index), addr(slot.feature)});
+    }));
+    if (ret == 0) {
+        std::cout << (decode ? "decode" : "upload") << " [" << shape_str(net.normalize) << "] -> conv [" << shape_str(net.conv)
+                  << "] -> pool [" << shape_str(net.pool) << "] -> head [" << shape_str(net.top) << "], " << slots
+                  << " batches in flight, queues of " << depth << std::endl;
+        stages_result_t result;
+        ret = stages_run(stages, slots, depth, batches, result);
+        if (ret == 0) {
+            stages_print(stages, result, net.batch);
+            ret = network_check(handle, net, slot_bufs[0], kernel.data());
+        }
+    }
+    if (kernel_dev.size != 0)
+        bm_free_device(handle, kernel_dev);
+    for (int s = 0; s < slots; ++s)
+        slot_free(handle, slot_bufs[s]);
+    for (size_t i = 0; i < handles.size(); ++i)
+        bm_dev_free(handles[i]);
+    return ret;
+}
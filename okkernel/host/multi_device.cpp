@@ -0,0 +1,104 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_multi.h"
+#ifdef USING_CMODEL
+#define WARMUP (0)
+#define MAXIT (1)
+#else
+#define WARMUP (5)
+#define MAXIT (20)
+#endif
+// Splits the batch of every case of the conv2d, depthwise and softmax
+// contest kernels and of the pool kernels over all chips (OKK_DEVICES=n
+// uses the first n), checks the gathered outputs against chip 0 running
+// the whole batch, and reports the speedup and the scaling efficiency
+// (speedup per chip) of each case.
+//
+// Usage: multi_device [--warmup N] [--iters N] [--filter pattern]...
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--warmup N] [--iters N] [--filter pattern]..." << std::endl;
+    std::cout << "  pattern is a glob over kernel_name/case_index, e.g. 'conv2d_*/3' or 'softmax_contest/*'" << std::endl;
+}
+
+typedef struct {
+    int cases;
+    int failed;
+    double efficiency_sum;
+} summary_t;
+
+template<class P>
+static inline void run_cases(const multi_devices_t &devices, const char *kernel_name, const P *cases, int num, const bench_options_t &options, summary_t &summary) {
+    for (int i = 0; i < num; ++i) {
+        if (!bench_selected(options, kernel_name, i))
+            continue;
+        multi_result_t result = multi_case(devices, kernel_name, cases[i], options.warmup, options.iterations);
+        std::cout << kernel_name << " case " << i << " [" << shape_str(cases[i]) << "]: ";
+        ++summary.cases;
+        if (!result.pass) {
+            std::cout << "fail" << std::endl;
+            ++summary.failed;
+            continue;
+        }
+        std::cout << result.devices << " chips, single " << result.single.median << " us, multi "
+                  << result.multi.median << " us, speedup " << result.speedup << ", efficiency "
+                  << result.efficiency * 100 << "%" << std::endl;
+        summary.efficiency_sum += result.efficiency;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    options.warmup = WARMUP;
+    options.iterations = MAXIT;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        if (arg == "--warmup")
+            options.warmup = atoi(argv[++i]);
+        else if (arg == "--iters")
+            options.iterations = atoi(argv[++i]);
+        else if (arg == "--filter")
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (options.warmup < 0 || options.iterations <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    // initialize
+    multi_devices_t devices;
+    if (multi_open(devices) != 0)
+        return -1;
+    std::cout << devices.handles.size() << " chips" << std::endl;
+    param_span_t<pool_t> params;
+    if (param_map("./param/pool.dat", params) != 0) {
+        multi_close(devices);
+        return -1;
+    }
+    std::vector<max_pool_param_t> max_pool_params = max_pool_cases(params);
+    std::vector<avg_pool_param_t> avg_pool_params = avg_pool_cases(params);
+    param_unmap(params);
+    summary_t summary = {0, 0, 0};
+    run_cases(devices, "conv2d_contest", conv2d_contest_cases, CASE_NUM(conv2d_contest_cases), options, summary);
+    run_cases(devices, "depthwise_contest", depthwise_contest_cases, CASE_NUM(depthwise_contest_cases), options, summary);
+    run_cases(devices, "softmax_contest", softmax_contest_cases, CASE_NUM(softmax_contest_cases), options, summary);
+    run_cases(devices, "max_pool_0", max_pool_params.data(), max_pool_params.size(), options, summary);
+    run_cases(devices, "avg_pool_0", avg_pool_params.data(), avg_pool_params.size(), options, summary);
+    const int passed = summary.cases - summary.failed;
+    std::cout << passed << " of " << summary.cases << " cases pass, mean efficiency "
+              << (passed > 0 ? summary.efficiency_sum / passed * 100 : 0) << "%" << std::endl;
+    // deinitialize
+    multi_close(devices);
+    return summary.failed > 0 ? -1 : 0;
+}
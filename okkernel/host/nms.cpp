@@ -0,0 +1,153 @@
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#ifdef OKK_ENABLE_BMCV
+#include "bmcv_api_ext.h"
+#endif
+#include "okk_bench.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "nms"
+typedef nms_param_t param_t;
+// Suppresses clustered detections with the kernel nms, checks the kept
+// indices against the host reference and reports the time of the kernel
+// and of the download of its output against the time of the reference and
+// of the download of all the boxes it needs, the host path it replaces.
+// With BMCV=1 it also times bmcv_nms on the same boxes, which keeps every
+// score and has no output limit.
+//
+// Usage: nms [--filter pattern]...
+//   pattern  a glob over nms/case_index
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--filter pattern]..." << std::endl;
+}
+
+// Boxes of num / 16 objects across a 1280x720 frame, each detected by boxes
+// jittered by up to 8 pixels around it with scores in [0, 1).
+static void random_detections(float *input, const param_t &param) {
+    const int objects = std::max(param.num / 16, 1);
+    std::vector<float> object(objects * 4), jitter((long long)param.num * 5);
+    random_uniform(object.data(), object.size(), 0.f, 1.f, golden_seed(), 1);
+    random_uniform(jitter.data(), jitter.size(), 0.f, 1.f, golden_seed(), 2);
+    for (int i = 0; i < param.num; ++i) {
+        const float *o = &object[(i % objects) * 4], *r = &jitter[(long long)i * 5];
+        const float x = o[0] * 1280 + (r[0] - 0.5f) * 16, y = o[1] * 720 + (r[1] - 0.5f) * 16;
+        const float w = 16 + o[2] * 240 + (r[2] - 0.5f) * 16, h = 16 + o[3] * 240 + (r[3] - 0.5f) * 16;
+        float *box = input + (long long)i * 5;
+        box[0] = x;
+        box[1] = y;
+        box[2] = x + w;
+        box[3] = y + h;
+        box[4] = r[4];
+    }
+}
+
+#ifdef OKK_ENABLE_BMCV
+// Mean time of bmcv_nms on the boxes of input, -1 if it fails.
+static double bmcv_nms_us(bm_handle_t handle, const param_t &param, bm_device_mem_t input, int &kept) {
+    bm_device_mem_t output;
+    if (bm_malloc_device_byte(handle, &output, sizeof(nms_proposal_t)) != BM_SUCCESS)
+        return -1;
+    double us = -1;
+    const double start_time = bench_now_us();
+    int it = 0;
+    while (it < MAXIT && bmcv_nms(handle, input, param.num, param.iou_threshold, output) == BM_SUCCESS)
+        ++it;
+    if (it == MAXIT && bm_memcpy_d2s_partial(handle, &kept, output, sizeof(int)) == BM_SUCCESS)
+        us = (bench_now_us() - start_time) / MAXIT;
+    bm_free_device(handle, output);
+    return us;
+}
+#endif
+
+// Returns false if the case fails.
+static bool nms(bm_handle_t handle, int index, param_t param) {
+    const std::vector<long long> lens = tensor_lens(param);
+    std::vector<float> input(lens[1]), boxes(lens[1]);
+    std::vector<int> output(lens[0]);
+    random_detections(input.data(), param);
+    double start_time = bench_now_us();
+    const std::vector<int> keep_ref = nms_reference(input.data(), param);
+    const double host_us = bench_now_us() - start_time;
+    std::cout << KERNEL_NAME << " case " << index << " [" << shape_str(param) << "]: ";
+    device_tensors_t tensors;
+    bool pass = false;
+    bench_stats_t stats = bench_stats_none();
+    double output_us = 0, boxes_us = 0;
+    const long long output_bytes = lens[0] * sizeof(int), boxes_bytes = lens[1] * sizeof(float);
+    if (device_tensors_malloc(handle, param, tensors) == BM_SUCCESS &&
+        bm_memcpy_s2d(handle, tensors.devs[1], input.data()) == BM_SUCCESS) {
+        stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), 0, MAXIT);
+        start_time = bench_now_us();
+        bm_status_t ret = bm_memcpy_d2s_partial(handle, output.data(), tensors.devs[0], output_bytes);
+        output_us = bench_now_us() - start_time;
+        // what the host path downloads before its NMS
+        start_time = bench_now_us();
+        if (ret == BM_SUCCESS)
+            ret = bm_memcpy_d2s(handle, boxes.data(), tensors.devs[1]);
+        boxes_us = bench_now_us() - start_time;
+        if (stats.iterations == MAXIT && ret == BM_SUCCESS) {
+            const int kept = output[0];
+            pass = kept == (int)keep_ref.size() && std::equal(keep_ref.begin(), keep_ref.end(), output.begin() + 1);
+            if (!pass)
+                std::cout << "kept " << kept << " boxes, expected " << keep_ref.size() << ", ";
+        }
+    }
+    if (pass) {
+        std::cout << keep_ref.size() << " kept, device " << std::round(stats.mean) << " us (median " << stats.median << ") + "
+                  << std::round(output_us) << " us for " << output_bytes << " B, host " << std::round(host_us) << " us + "
+                  << std::round(boxes_us) << " us for " << boxes_bytes << " B";
+#ifdef OKK_ENABLE_BMCV
+        int bmcv_kept = 0;
+        const double bmcv_us = bmcv_nms_us(handle, param, tensors.devs[1], bmcv_kept);
+        if (bmcv_us < 0)
+            std::cout << ", bmcv_nms failed";
+        else
+            std::cout << ", bmcv_nms " << std::round(bmcv_us) << " us (" << bmcv_kept << " kept)";
+#endif
+        std::cout << std::endl;
+    } else
+        std::cout << "fail" << std::endl;
+    device_tensors_free(handle, tensors);
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(nms_cases); ++i) {
+        if (!bench_selected(options, KERNEL_NAME, i))
+            continue;
+        ++cases;
+        failed += !nms(handle, i, nms_cases[i]);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,469 @@
+#ifndef OKK_BENCH_H
+#define OKK_BENCH_H
+#include <assert.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_cases.h"
+#include "okk_kernel_id.h"
+#include "okk_random.h"
+#include "okk_tune.h"
+////////////////////////////////////////////////////////////////////////
+/// TIMING
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    int iterations;
+    double min, median, p99, mean, max;
+} bench_stats_t;
+
+static inline double bench_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+// The stats of no samples, a failed or skipped run.
+static inline bench_stats_t bench_stats_none() {
+    bench_stats_t stats = {0, -1, -1, -1, -1, -1};
+    return stats;
+}
+
+static inline bench_stats_t bench_stats(std::vector<double> samples) {
+    if (samples.empty())
+        return bench_stats_none();
+    bench_stats_t stats = {(int)samples.size(), -1, -1, -1, -1, -1};
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += samples[i];
+    stats.min = samples[0];
+    stats.max = samples[n - 1];
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    // nearest rank
+    stats.p99 = samples[std::min(n - 1, (size_t)std::ceil(0.99 * n) - 1)];
+    stats.mean = sum / n;
+    return stats;
+}
+
+// Times okkernel_launch_sync of a kernel after some warmup launches, the
+// stats are all -1 if a launch fails. The kernel is launched by its ID.
+template<class P>
+static inline bench_stats_t bench_launch(bm_handle_t handle, const char *kernel_name, const P &param, const tune_t &tune, int warmup, int iterations) {
+    const unsigned int id = okk_kernel_id(kernel_name);
+    std::vector<double> samples;
+    for (int i = 0; i < warmup; ++i) {
+        if (okkernel_launch_tuned_id_sync(handle, id, param, tune) != BM_SUCCESS)
+            return bench_stats_none();
+    }
+    for (int i = 0; i < iterations; ++i) {
+        double start_time = bench_now_us();
+        bm_status_t ret = okkernel_launch_tuned_id_sync(handle, id, param, tune);
+        double end_time = bench_now_us();
+        if (ret != BM_SUCCESS)
+            return bench_stats_none();
+        samples.push_back(end_time - start_time);
+    }
+    return bench_stats(samples);
+}
+
+static inline void bench_print(const bench_stats_t &stats) {
+    std::cout << "elapsed time: " << std::round(stats.mean) << "(us)"
+              << " min: " << stats.min << " median: " << stats.median << " p99: " << stats.p99 << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// WORKLOAD
+/// Floating point operations and bytes of global memory touched by a case.
+/// ////////////////////////////////////////////////////////////////////
+static inline double bench_flops(const conv2d_param_t &param) {
+    int output_h, output_w;
+    conv2d_output_hw(param, output_h, output_w);
+    return 2.0 * param.N * param.OC * output_h * output_w * param.IC * param.kernel_h * param.kernel_w;
+}
+
+static inline double bench_flops(const conv2d_group_param_t &param) {
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    return 2.0 * param.N * param.OC * output_h * output_w * (param.IC / param.group) * param.kernel_h * param.kernel_w;
+}
+
+static inline double bench_flops(const depthwise_param_t &param) {
+    int output_h, output_w;
+    depthwise_output_hw(param, output_h, output_w);
+    return 2.0 * param.N * param.C * output_h * output_w * param.kernel_h * param.kernel_w;
+}
+
+static inline double bench_flops(const matmul_param_t &param) {
+    return 2.0 * param.left_rows * param.left_cols * param.right_cols;
+}
+
+// max, subtract, exp, sum and divide per element
+static inline double bench_flops(const softmax_param_t &param) {
+    return 5.0 * param.N * param.C * param.H * param.W;
+}
+
+template<class P>
+static inline double bench_pool_flops(const P &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    return 1.0 * param.N * param.C * output_h * output_w * param.kernel_h * param.kernel_w;
+}
+
+static inline double bench_flops(const max_pool_param_t &param) {
+    return bench_pool_flops(param);
+}
+
+static inline double bench_flops(const avg_pool_param_t &param) {
+    return bench_pool_flops(param);
+}
+
+// multiply and add per output element
+static inline double bench_flops(const preprocess_param_t &param) {
+    return 2.0 * param.N * param.C * param.H * param.W;
+}
+
+// the softmax over the rows if softmax, the sort is not counted
+static inline double bench_flops(const topk_param_t &param) {
+    return param.softmax ? 5.0 * param.N * param.C : 0;
+}
+
+template<class P>
+static inline double bench_bytes(const P &param) {
+    std::vector<long long> lens = tensor_lens(param);
+    double bytes = 0;
+    for (size_t i = 0; i < lens.size(); ++i)
+        bytes += lens[i] * sizeof(float);
+    return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// DEVICE TENSORS
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    std::vector<long long> lens;
+    std::vector<bm_device_mem_t> devs;
+} device_tensors_t;
+
+// Allocates the device tensors of a case and binds their addresses to the
+// param.
+template<class P>
+static inline bm_status_t device_tensors_malloc(bm_handle_t handle, P &param, device_tensors_t &tensors) {
+    tensors.lens = tensor_lens(param);
+    tensors.devs.resize(tensors.lens.size());
+    std::vector<unsigned long long> addrs(tensors.lens.size(), 0);
+    for (size_t i = 0; i < tensors.lens.size(); ++i) {
+        if (tensors.lens[i] == 0)
+            continue;
+        bm_status_t ret = bm_malloc_device_byte(handle, &tensors.devs[i], tensors.lens[i] * sizeof(float));
+        if (ret != BM_SUCCESS) {
+            tensors.lens.resize(i);
+            return ret;
+        }
+        addrs[i] = bm_mem_get_device_addr(tensors.devs[i]);
+    }
+    bind_addrs(param, addrs);
+    return BM_SUCCESS;
+}
+
+// Allocates the device tensors of a case, binds their addresses to the param
+// and fills the inputs with random values in [-1, 1).
+template<class P>
+static inline bm_status_t device_tensors_alloc(bm_handle_t handle, P &param, device_tensors_t &tensors, unsigned long long seed = 1) {
+    bm_status_t ret = device_tensors_malloc(handle, param, tensors);
+    if (ret != BM_SUCCESS)
+        return ret;
+    for (size_t i = 1; i < tensors.lens.size(); ++i) {
+        if (tensors.lens[i] == 0)
+            continue;
+        std::vector<float> input_host(tensors.lens[i]);
+        random_uniform(input_host.data(), tensors.lens[i], -1.f, 1.f, seed, i);
+        ret = bm_memcpy_s2d(handle, tensors.devs[i], input_host.data());
+        if (ret != BM_SUCCESS)
+            return ret;
+    }
+    return BM_SUCCESS;
+}
+
+static inline void device_tensors_free(bm_handle_t handle, device_tensors_t &tensors) {
+    for (size_t i = 0; i < tensors.lens.size(); ++i)
+        if (tensors.lens[i] != 0)
+            bm_free_device(handle, tensors.devs[i]);
+    tensors.lens.clear();
+    tensors.devs.clear();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// OPTIONS AND REPORT
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    int warmup;
+    int iterations;
+    std::vector<std::string> filters;
+    std::string format;
+    std::string output;
+    // Chrome trace of the GDMA and BDC timelines, empty if not profiling
+    std::string profile;
+    // print the region timer breakdown of each case
+    bool timers;
+} bench_options_t;
+
+typedef struct {
+    std::string kernel_name;
+    int case_index;
+    std::string shape;
+    bench_stats_t stats;
+    double gflops;
+    double gbps;
+} bench_record_t;
+
+static inline void bench_usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--warmup N] [--iters N] [--filter pattern]... [--format text|csv|json] [--output path] [--profile trace.json] [--timers]" << std::endl;
+    std::cout << "  pattern is a glob over kernel_name/case_index, e.g. 'conv2d_*/3' or 'matmul_contest/*'" << std::endl;
+}
+
+// Returns 0 on success, -1 on bad arguments.
+static inline int bench_parse_options(int argc, char *argv[], bench_options_t &options, int warmup, int iterations) {
+    options.warmup = warmup;
+    options.iterations = iterations;
+    options.filters.clear();
+    options.format = "text";
+    options.output.clear();
+    options.profile.clear();
+    options.timers = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--timers") {
+            options.timers = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return -1;
+        if (arg == "--warmup")
+            options.warmup = atoi(argv[++i]);
+        else if (arg == "--iters")
+            options.iterations = atoi(argv[++i]);
+        else if (arg == "--filter")
+            options.filters.push_back(argv[++i]);
+        else if (arg == "--format")
+            options.format = argv[++i];
+        else if (arg == "--output")
+            options.output = argv[++i];
+        else if (arg == "--profile")
+            options.profile = argv[++i];
+        else
+            return -1;
+    }
+    if (options.warmup < 0 || options.iterations <= 0)
+        return -1;
+    if (options.format != "text" && options.format != "csv" && options.format != "json")
+        return -1;
+    return 0;
+}
+
+static inline bool bench_selected(const bench_options_t &options, const std::string &kernel_name, int case_index) {
+    if (options.filters.empty())
+        return true;
+    std::string id = kernel_name + "/" + std::to_string(case_index);
+    for (size_t i = 0; i < options.filters.size(); ++i) {
+        const std::string &f = options.filters[i];
+        // a pattern without '/' matches all cases of the kernels
+        if (fnmatch(f.c_str(), id.c_str(), 0) == 0 || fnmatch(f.c_str(), kernel_name.c_str(), 0) == 0)
+            return true;
+    }
+    return false;
+}
+
+static inline std::string bench_json_escape(const std::string &s) {
+    std::string res;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' || s[i] == '\\')
+            res += '\\';
+        res += s[i];
+    }
+    return res;
+}
+
+static inline void bench_write(std::ostream &os, const std::vector<bench_record_t> &records, const std::string &format) {
+    if (format == "csv") {
+        os << "kernel,case,shape,iterations,min_us,median_us,p99_us,mean_us,max_us,gflops,gbps" << std::endl;
+        for (size_t i = 0; i < records.size(); ++i) {
+            const bench_record_t &r = records[i];
+            os << r.kernel_name << "," << r.case_index << ",\"" << r.shape << "\"," << r.stats.iterations << ","
+               << r.stats.min << "," << r.stats.median << "," << r.stats.p99 << "," << r.stats.mean << ","
+               << r.stats.max << "," << r.gflops << "," << r.gbps << std::endl;
+        }
+    } else if (format == "json") {
+        os << "[" << std::endl;
+        for (size_t i = 0; i < records.size(); ++i) {
+            const bench_record_t &r = records[i];
+            os << "  {\"kernel\": \"" << bench_json_escape(r.kernel_name) << "\", \"case\": " << r.case_index
+               << ", \"shape\": \"" << bench_json_escape(r.shape) << "\", \"iterations\": " << r.stats.iterations
+               << ", \"min_us\": " << r.stats.min << ", \"median_us\": " << r.stats.median
+               << ", \"p99_us\": " << r.stats.p99 << ", \"mean_us\": " << r.stats.mean
+               << ", \"max_us\": " << r.stats.max << ", \"gflops\": " << r.gflops << ", \"gbps\": " << r.gbps << "}"
+               << (i + 1 < records.size() ? "," : "") << std::endl;
+        }
+        os << "]" << std::endl;
+    } else {
+        for (size_t i = 0; i < records.size(); ++i) {
+            const bench_record_t &r = records[i];
+            os << r.kernel_name << " case " << r.case_index << " [" << r.shape << "]: ";
+            if (r.stats.iterations == 0) {
+                os << "failed" << std::endl;
+                continue;
+            }
+            os << "min " << r.stats.min << " median " << r.stats.median << " p99 " << r.stats.p99
+               << " (us), " << r.gflops << " GFLOP/s, " << r.gbps << " GB/s" << std::endl;
+        }
+    }
+}
+
+static inline int bench_report(const std::vector<bench_record_t> &records, const bench_options_t &options) {
+    if (options.output.empty()) {
+        bench_write(std::cout, records, options.format);
+        return 0;
+    }
+    std::ofstream f(options.output, std::ios::out | std::ios::trunc);
+    if (!f) {
+        std::cout << "Failed to create file " << options.output << std::endl;
+        return -1;
+    }
+    bench_write(f, records, options.format);
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// SHAPES
+/// ////////////////////////////////////////////////////////////////////
+static inline std::string shape_str(const conv2d_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " IC=" << p.IC << " OC=" << p.OC << " H=" << p.H << " W=" << p.W
+       << " k=" << p.kernel_h << "x" << p.kernel_w << " s=" << p.stride_h << "x" << p.stride_w
+       << " d=" << p.dilation_h << "x" << p.dilation_w;
+    return ss.str();
+}
+
+static inline std::string shape_str(const conv2d_group_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " IC=" << p.IC << " OC=" << p.OC << " H=" << p.H << " W=" << p.W
+       << " k=" << p.kernel_h << "x" << p.kernel_w << " s=" << p.stride_h << "x" << p.stride_w
+       << " d=" << p.dilation_h << "x" << p.dilation_w << " g=" << p.group << " bias=" << p.using_bias;
+    return ss.str();
+}
+
+static inline std::string shape_str(const depthwise_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " C=" << p.C << " H=" << p.H << " W=" << p.W
+       << " k=" << p.kernel_h << "x" << p.kernel_w << " s=" << p.stride_h << "x" << p.stride_w
+       << " d=" << p.dilation_h << "x" << p.dilation_w;
+    return ss.str();
+}
+
+static inline std::string shape_str(const matmul_param_t &p) {
+    std::ostringstream ss;
+    ss << "M=" << p.left_rows << " K=" << p.left_cols << " N=" << p.right_cols;
+    return ss.str();
+}
+
+static inline std::string shape_str(const softmax_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " C=" << p.C << " H=" << p.H << " W=" << p.W;
+    return ss.str();
+}
+
+template<class P>
+static inline std::string pool_shape_str(const P &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " C=" << p.C << " H=" << p.H << " W=" << p.W
+       << " k=" << p.kernel_h << "x" << p.kernel_w << " s=" << p.stride_h << "x" << p.stride_w
+       << " ceil=" << p.ceil_mode;
+    return ss.str();
+}
+
+static inline std::string shape_str(const max_pool_param_t &p) {
+    return pool_shape_str(p);
+}
+
+static inline std::string shape_str(const avg_pool_param_t &p) {
+    return pool_shape_str(p) + " count_include_pad=" + std::to_string(p.count_include_pad);
+}
+
+static inline std::string shape_str(const preprocess_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " H=" << p.H << " W=" << p.W << " C=" << p.C << " pitch=" << p.pitch << " reverse=" << p.reverse_channels;
+    return ss.str();
+}
+
+static inline std::string shape_str(const topk_param_t &p) {
+    std::ostringstream ss;
+    ss << "N=" << p.N << " C=" << p.C << " K=" << p.K << " softmax=" << p.softmax;
+    return ss.str();
+}
+
+static inline std::string shape_str(const embedding_param_t &p) {
+    static const char *poolings[] = {"none", "sum", "mean"};
+    std::ostringstream ss;
+    ss << "batch=" << p.batch << " bag=" << p.bag << " rows=" << p.rows << " dim=" << p.dim << " pooling=" << poolings[p.pooling];
+    return ss.str();
+}
+
+static inline std::string shape_str(const norm_param_t &p) {
+    static const char *modes[] = {"batch", "layer", "rms"};
+    std::ostringstream ss;
+    ss << "N=" << p.N << " C=" << p.C << " H=" << p.H << " W=" << p.W << " mode=" << modes[p.mode] << " left_cols=" << p.left_cols << " eps=" << p.eps;
+    return ss.str();
+}
+
+static inline std::string shape_str(const attention_param_t &p) {
+    std::ostringstream ss;
+    ss << "batch=" << p.batch << " heads=" << p.heads << " seq_q=" << p.seq_q << " seq_k=" << p.seq_k << " dim=" << p.dim << " causal=" << p.causal;
+    return ss.str();
+}
+
+static inline std::string shape_str(const nms_param_t &p) {
+    std::ostringstream ss;
+    ss << "num=" << p.num << " max_output=" << p.max_output << " iou=" << p.iou_threshold << " score=" << p.score_threshold;
+    return ss.str();
+}
+
+// Benchmarks one case with random inputs and its tuned config.
+template<class P>
+static inline bench_record_t bench_case(bm_handle_t handle, const char *kernel_name, int case_index, P param, const bench_options_t &options) {
+    bench_record_t record;
+    record.kernel_name = kernel_name;
+    record.case_index = case_index;
+    record.shape = shape_str(param);
+    record.stats = bench_stats_none();
+    record.gflops = record.gbps = 0;
+    device_tensors_t tensors;
+    if (device_tensors_alloc(handle, param, tensors) == BM_SUCCESS) {
+        record.stats = bench_launch(handle, kernel_name, param, tune_lookup(kernel_name, param), options.warmup, options.iterations);
+        if (record.stats.median > 0) {
+            record.gflops = bench_flops(param) / record.stats.median * 1e-3;
+            record.gbps = bench_bytes(param) / record.stats.median * 1e-3;
+        }
+    }
+    device_tensors_free(handle, tensors);
+    return record;
+}
+
+template<class P>
+static inline void bench_cases(bm_handle_t handle, const char *kernel_name, const P *cases, int num, const bench_options_t &options, std::vector<bench_record_t> &records) {
+    for (int i = 0; i < num; ++i) {
+        if (!bench_selected(options, kernel_name, i))
+            continue;
+        std::cerr << kernel_name << " case " << i << std::endl;
+        records.push_back(bench_case(handle, kernel_name, i, cases[i], options));
+    }
+}
+#endif
@@ -0,0 +1,675 @@
+#ifndef OKK_CASES_H
+#define OKK_CASES_H
+#include <vector>
+#include "okk_param.h"
+#ifndef DIV_UP
+#define DIV_UP(a, b) (((a) - 1) / (b) + 1)
+#endif
+// Parameters sent to the device kernels, the layouts must match the param_t
+// defined in the corresponding device/ok_device_*.c (tunable kernels append
+// tune_t, see okk_tune.h).
+typedef struct {
+    int N, IC, OC, H, W;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int dilation_h, dilation_w;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long kernel_addr;
+} __attribute__((packed)) conv2d_param_t;
+
+typedef struct {
+    int N, C, H, W;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int dilation_h, dilation_w;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long kernel_addr;
+} __attribute__((packed)) depthwise_param_t;
+
+typedef struct {
+    int left_rows, left_cols, right_cols;
+    unsigned long long output_addr;
+    unsigned long long left_addr;
+    unsigned long long right_addr;
+} __attribute__((packed)) matmul_param_t;
+
+typedef struct {
+    int N, C, H, W;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+} __attribute__((packed)) softmax_param_t;
+
+typedef struct {
+    unsigned long long output_addr;
+    unsigned long long index_addr;
+    unsigned long long input_addr;
+    int N, C, H, W;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int ceil_mode;
+} __attribute__((packed)) max_pool_param_t;
+
+typedef struct {
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    int N, C, H, W;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int ceil_mode;
+    int count_include_pad;
+} __attribute__((packed)) avg_pool_param_t;
+
+typedef struct {
+    int N, IC, OC, H, W;
+    int group;
+    int kernel_h, kernel_w;
+    int pad_top, pad_bottom, pad_left, pad_right;
+    int stride_h, stride_w;
+    int dilation_h, dilation_w;
+    int using_bias;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long kernel_addr;
+    unsigned long long bias_addr;
+} __attribute__((packed)) conv2d_group_param_t;
+
+// input is [N, H, W, C] uint8 with rows of pitch bytes (W * C if 0) and
+// output [N, C, H, W] fp32, mean and scale are in the order of the output
+// channels.
+typedef struct {
+    int N, H, W, C;
+    int pitch;
+    int reverse_channels;
+    float mean[4];
+    float scale[4];
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+} __attribute__((packed)) preprocess_param_t;
+
+// input is [num, 5] fp32 boxes (x1, y1, x2, y2, score), the face_rect_t of
+// bmcv, output [1 + max_output] int32, the number of kept boxes and their
+// indices by descending score.
+typedef struct {
+    int num;
+    int max_output;
+    float iou_threshold;
+    float score_threshold;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+} __attribute__((packed)) nms_param_t;
+
+// input is [N, C] fp32, output [N, K] fp32 the K largest values of each
+// row in descending order (their softmax over the row if softmax) and index
+// [N, K] int32 their columns.
+typedef struct {
+    int N, C, K;
+    int softmax;
+    unsigned long long output_addr;
+    unsigned long long index_addr;
+    unsigned long long input_addr;
+} __attribute__((packed)) topk_param_t;
+
+// table is [rows, dim] fp32 and index [batch, bag] int32 rows of it (out of
+// range for padding, which looks up zeros), output [batch, bag, dim] fp32
+// the looked up rows, or [batch, dim] their sum or mean per bag.
+typedef struct {
+    int batch, bag, rows, dim;
+    int pooling;
+    unsigned long long output_addr;
+    unsigned long long index_addr;
+    unsigned long long table_addr;
+} __attribute__((packed)) embedding_param_t;
+// pooling of embedding, as in device/ok_device_embedding.c
+#define EMBEDDING_NONE (0)
+#define EMBEDDING_SUM (1)
+#define EMBEDDING_MEAN (2)
+
+// input and output are [N, C, H, W] fp32, normalized per channel with
+// weight, bias, mean and var [C] (NORM_BATCH) or per row of W with weight
+// and bias [W] (NORM_LAYER, NORM_RMS without bias). With left_cols > 0,
+// input is [N * C * H, left_cols] and right [left_cols, W], the rows
+// normalized are those of their product.
+typedef struct {
+    int N, C, H, W;
+    int mode;
+    int left_cols;
+    float eps;
+    unsigned long long output_addr;
+    unsigned long long input_addr;
+    unsigned long long right_addr;
+    unsigned long long weight_addr;
+    unsigned long long bias_addr;
+    unsigned long long mean_addr;
+    unsigned long long var_addr;
+} __attribute__((packed)) norm_param_t;
+// mode of norm, as in device/ok_device_norm.c
+#define NORM_BATCH (0)
+#define NORM_LAYER (1)
+#define NORM_RMS (2)
+
+// query and output are [batch, heads, seq_q, dim] fp32, key and value
+// [batch, heads, seq_k, dim] fp32, output = softmax(scale * query x key^T)
+// x value per head. With causal, query i attends to the keys up to
+// i + seq_k - seq_q.
+typedef struct {
+    int batch, heads, seq_q, seq_k, dim;
+    int causal;
+    float scale;
+    unsigned long long output_addr;
+    unsigned long long query_addr;
+    unsigned long long key_addr;
+    unsigned long long value_addr;
+} __attribute__((packed)) attention_param_t;
+
+// boxes of nms beyond the best NMS_MAX_CANDIDATES by score are dropped, as
+// in device/ok_device_nms.c
+#define NMS_MAX_CANDIDATES (1024)
+
+////////////////////////////////////////////////////////////////////////
+/// CONTEST CASES
+/// ////////////////////////////////////////////////////////////////////
+static const conv2d_param_t conv2d_contest_cases[] = {
+    {.N = 4, .IC = 3,    .OC = 16,  .H = 640,  .W = 640,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1,  .pad_bottom = 1,  .pad_left = 1,  .pad_right = 1,  .stride_h = 2, .stride_w = 2, .dilation_h = 1,  .dilation_w = 1 }, // 0
+    {.N = 4, .IC = 3,    .OC = 16,  .H = 512,  .W = 960,  .kernel_h = 7,  .kernel_w = 7,  .pad_top = 3,  .pad_bottom = 3,  .pad_left = 3,  .pad_right = 3,  .stride_h = 1, .stride_w = 1, .dilation_h = 1,  .dilation_w = 1 }, // 1
+    {.N = 4, .IC = 3,    .OC = 16,  .H = 1080, .W = 1920, .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1,  .pad_bottom = 1,  .pad_left = 1,  .pad_right = 1,  .stride_h = 1, .stride_w = 1, .dilation_h = 1,  .dilation_w = 1 }, // 2
+    {.N = 4, .IC = 3,    .OC = 24,  .H = 384,  .W = 384,  .kernel_h = 7,  .kernel_w = 7,  .pad_top = 1,  .pad_bottom = 2,  .pad_left = 1,  .pad_right = 2,  .stride_h = 4, .stride_w = 4, .dilation_h = 1,  .dilation_w = 1 }, // 3
+    {.N = 4, .IC = 3,    .OC = 96,  .H = 227,  .W = 227,  .kernel_h = 11, .kernel_w = 11, .pad_top = 0,  .pad_bottom = 0,  .pad_left = 0,  .pad_right = 0,  .stride_h = 4, .stride_w = 4, .dilation_h = 1,  .dilation_w = 1 }, // 4
+    {.N = 4, .IC = 3,    .OC = 192, .H = 127,  .W = 127,  .kernel_h = 11, .kernel_w = 11, .pad_top = 0,  .pad_bottom = 0,  .pad_left = 0,  .pad_right = 0,  .stride_h = 2, .stride_w = 2, .dilation_h = 1,  .dilation_w = 1 }, // 5
+    {.N = 4, .IC = 18,   .OC = 36,  .H = 192,  .W = 256,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1,  .pad_bottom = 1,  .pad_left = 1,  .pad_right = 1,  .stride_h = 2, .stride_w = 2, .dilation_h = 1,  .dilation_w = 1 }, // 6
+    {.N = 4, .IC = 72,   .OC = 72,  .H = 160,  .W = 160,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1,  .pad_bottom = 1,  .pad_left = 1,  .pad_right = 1,  .stride_h = 2, .stride_w = 2, .dilation_h = 1,  .dilation_w = 1 }, // 7
+    {.N = 4, .IC = 128,  .OC = 256, .H = 50,   .W = 50,   .kernel_h = 3,  .kernel_w = 3,  .pad_top = 2,  .pad_bottom = 2,  .pad_left = 2,  .pad_right = 2,  .stride_h = 1, .stride_w = 1, .dilation_h = 2,  .dilation_w = 2 }, // 8
+    {.N = 4, .IC = 160,  .OC = 192, .H = 30,   .W = 30,   .kernel_h = 7,  .kernel_w = 1,  .pad_top = 3,  .pad_bottom = 3,  .pad_left = 0,  .pad_right = 0,  .stride_h = 1, .stride_w = 1, .dilation_h = 1,  .dilation_w = 1 }, // 9
+    {.N = 4, .IC = 256,  .OC = 512, .H = 128,  .W = 128,  .kernel_h = 1,  .kernel_w = 1,  .pad_top = 0,  .pad_bottom = 0,  .pad_left = 0,  .pad_right = 0,  .stride_h = 2, .stride_w = 2, .dilation_h = 1,  .dilation_w = 1 }, // 10
+    {.N = 4, .IC = 512,  .OC = 512, .H = 28,   .W = 28,   .kernel_h = 3,  .kernel_w = 3,  .pad_top = 4,  .pad_bottom = 4,  .pad_left = 4,  .pad_right = 4,  .stride_h = 1, .stride_w = 1, .dilation_h = 4,  .dilation_w = 4 }, // 11
+    {.N = 4, .IC = 1024, .OC = 546, .H = 10,   .W = 10,   .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1,  .pad_bottom = 1,  .pad_left = 1,  .pad_right = 1,  .stride_h = 1, .stride_w = 1, .dilation_h = 1,  .dilation_w = 1 }, // 12
+    {.N = 4, .IC = 2048, .OC = 256, .H = 28,   .W = 28,   .kernel_h = 3,  .kernel_w = 3,  .pad_top = 12, .pad_bottom = 12, .pad_left = 12, .pad_right = 12, .stride_h = 1, .stride_w = 1, .dilation_h = 12, .dilation_w = 12}, // 13
+    {.N = 4, .IC = 4032, .OC = 672, .H = 11,   .W = 11,   .kernel_h = 1,  .kernel_w = 1,  .pad_top = 0,  .pad_bottom = 0,  .pad_left = 0,  .pad_right = 0,  .stride_h = 1, .stride_w = 1, .dilation_h = 1,  .dilation_w = 1 }, // 14
+};
+
+static const depthwise_param_t depthwise_contest_cases[] = {
+    {.N = 4, .C = 3,    .H = 224, .W = 224, .kernel_h = 11, .kernel_w = 11, .pad_top = 2, .pad_bottom = 2, .pad_left = 2, .pad_right = 2, .stride_h = 4, .stride_w = 4, .dilation_h = 1, .dilation_w = 1}, // 0
+    {.N = 4, .C = 3,    .H = 256, .W = 256, .kernel_h = 7,  .kernel_w = 7,  .pad_top = 3, .pad_bottom = 3, .pad_left = 3, .pad_right = 3, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 1
+    {.N = 4, .C = 3,    .H = 640, .W = 640, .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 2
+    {.N = 4, .C = 96,   .H = 150, .W = 150, .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 3
+    {.N = 4, .C = 144,  .H = 75,  .W = 75,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 1, .stride_w = 1, .dilation_h = 1, .dilation_w = 1}, // 4
+    {.N = 4, .C = 192,  .H = 38,  .W = 38,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 1, .pad_bottom = 1, .pad_left = 1, .pad_right = 1, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 5
+    {.N = 4, .C = 336,  .H = 29,  .W = 29,  .kernel_h = 5,  .kernel_w = 5,  .pad_top = 2, .pad_bottom = 2, .pad_left = 2, .pad_right = 2, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 6
+    {.N = 4, .C = 512,  .H = 14,  .W = 14,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 0, .pad_bottom = 1, .pad_left = 0, .pad_right = 1, .stride_h = 2, .stride_w = 2, .dilation_h = 1, .dilation_w = 1}, // 7
+    {.N = 4, .C = 960,  .H = 28,  .W = 28,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 4, .pad_bottom = 4, .pad_left = 4, .pad_right = 4, .stride_h = 1, .stride_w = 1, .dilation_h = 4, .dilation_w = 4}, // 8
+    {.N = 4, .C = 2048, .H = 33,  .W = 33,  .kernel_h = 3,  .kernel_w = 3,  .pad_top = 6, .pad_bottom = 6, .pad_left = 6, .pad_right = 6, .stride_h = 1, .stride_w = 1, .dilation_h = 6, .dilation_w = 6}, // 9
+};
+
+static const matmul_param_t matmul_contest_cases[] = {
+    {.left_rows = 2,      .left_cols = 100352, .right_cols = 2048 }, // 0
+    {.left_rows = 2,      .left_cols = 1280,   .right_cols = 1000 }, // 1
+    {.left_rows = 2,      .left_cols = 25088,  .right_cols = 4096 }, // 2
+    {.left_rows = 4,      .left_cols = 1024,   .right_cols = 25088}, // 3
+    {.left_rows = 32,     .left_cols = 2048,   .right_cols = 36   }, // 4
+    {.left_rows = 64,     .left_cols = 9216,   .right_cols = 4096 }, // 5
+    {.left_rows = 79,     .left_cols = 256,    .right_cols = 4090 }, // 6
+    {.left_rows = 200,    .left_cols = 4096,   .right_cols = 324  }, // 7
+    {.left_rows = 256,    .left_cols = 768,    .right_cols = 3072 }, // 8
+    {.left_rows = 256,    .left_cols = 3072,   .right_cols = 768  }, // 9
+    {.left_rows = 300,    .left_cols = 2048,   .right_cols = 80   }, // 10
+    {.left_rows = 1024,   .left_cols = 1024,   .right_cols = 1024 }, // 11
+    {.left_rows = 2048,   .left_cols = 4,      .right_cols = 1024 }, // 12
+    {.left_rows = 12544,  .left_cols = 2,      .right_cols = 1024 }, // 13
+    {.left_rows = 100352, .left_cols = 1024,   .right_cols = 1    }, // 14
+};
+
+static const softmax_param_t softmax_contest_cases[] = {
+    {.N = 1,     .C = 370,  .H = 13,  .W = 13 }, // 0
+    {.N = 1,     .C = 1000, .H = 1,   .W = 1  }, // 1
+    {.N = 4,     .C = 2,    .H = 157, .W = 283}, // 2
+    {.N = 79,    .C = 4090, .H = 1,   .W = 1  }, // 3
+    {.N = 6132,  .C = 21,   .H = 1,   .W = 1  }, // 4
+};
+
+// BGR frames to the RGB input of classifiers and detectors, and frames of
+// other channel counts.
+static const preprocess_param_t preprocess_cases[] = {
+    {.N = 4, .H = 224,  .W = 224,  .C = 3, .reverse_channels = 1, .mean = {123.675f, 116.28f, 103.53f}, .scale = {1 / 58.395f, 1 / 57.12f, 1 / 57.375f}}, // 0 ImageNet
+    {.N = 8, .H = 640,  .W = 640,  .C = 3, .reverse_channels = 1, .mean = {0.f, 0.f, 0.f},               .scale = {1 / 255.f, 1 / 255.f, 1 / 255.f}},      // 1 YOLO
+    {.N = 4, .H = 1080, .W = 1920, .C = 3, .reverse_channels = 1, .mean = {0.f, 0.f, 0.f},               .scale = {1 / 255.f, 1 / 255.f, 1 / 255.f}},      // 2
+    {.N = 1, .H = 2160, .W = 3840, .C = 3, .reverse_channels = 0, .mean = {104.f, 117.f, 123.f},          .scale = {1.f, 1.f, 1.f}},                         // 3
+    {.N = 4, .H = 512,  .W = 512,  .C = 1, .reverse_channels = 0, .mean = {127.5f},                       .scale = {1 / 127.5f}},                            // 4
+    {.N = 2, .H = 300,  .W = 300,  .C = 4, .reverse_channels = 0, .mean = {127.5f, 127.5f, 127.5f, 0.f},  .scale = {1 / 127.5f, 1 / 127.5f, 1 / 127.5f, 1 / 255.f}}, // 5
+};
+
+// Detector outputs, from region proposals to the anchors of YOLO heads.
+static const nms_param_t nms_cases[] = {
+    {.num = 300,   .max_output = 100,  .iou_threshold = 0.7f,  .score_threshold = 0.f  }, // 0 Faster R-CNN proposals
+    {.num = 1000,  .max_output = 100,  .iou_threshold = 0.5f,  .score_threshold = 0.05f}, // 1 SSD
+    {.num = 5000,  .max_output = 1000, .iou_threshold = 0.3f,  .score_threshold = 0.01f}, // 2 crowded faces
+    {.num = 8400,  .max_output = 300,  .iou_threshold = 0.45f, .score_threshold = 0.25f}, // 3 YOLOv8 640
+    {.num = 16128, .max_output = 300,  .iou_threshold = 0.45f, .score_threshold = 0.25f}, // 4 YOLOv5 512
+};
+
+// Classifier heads, the logits of softmax_contest cases 1 and 3 among them.
+static const topk_param_t topk_cases[] = {
+    {.N = 1,    .C = 1000,  .K = 5,   .softmax = 1}, // 0 ImageNet
+    {.N = 32,   .C = 1000,  .K = 5,   .softmax = 1}, // 1
+    {.N = 79,   .C = 4090,  .K = 5,   .softmax = 1}, // 2
+    {.N = 79,   .C = 4090,  .K = 100, .softmax = 0}, // 3
+    {.N = 4,    .C = 21841, .K = 10,  .softmax = 1}, // 4 ImageNet-21k
+    {.N = 6132, .C = 21,    .K = 1,   .softmax = 1}, // 5 SSD anchors
+};
+
+// Sparse features of recommendation models and the token table of BERT.
+static const embedding_param_t embedding_cases[] = {
+    {.batch = 256,  .bag = 20, .rows = 100000,  .dim = 64,  .pooling = EMBEDDING_SUM }, // 0 multi-hot
+    {.batch = 256,  .bag = 20, .rows = 100000,  .dim = 64,  .pooling = EMBEDDING_MEAN}, // 1
+    {.batch = 2048, .bag = 1,  .rows = 1000000, .dim = 16,  .pooling = EMBEDDING_NONE}, // 2 one-hot
+    {.batch = 512,  .bag = 80, .rows = 200000,  .dim = 128, .pooling = EMBEDDING_MEAN}, // 3 history
+    {.batch = 16,   .bag = 128, .rows = 30522,  .dim = 768, .pooling = EMBEDDING_NONE}, // 4 BERT tokens
+    {.batch = 100,  .bag = 3,  .rows = 1000,    .dim = 40,  .pooling = EMBEDDING_MEAN}, // 5 padded bags, every fourth empty
+};
+
+// BatchNorm of ResNet-50, LayerNorm of BERT-base and RMSNorm of LLaMA-7B,
+// after the matmul that feeds them for the cases with left_cols.
+static const norm_param_t norm_cases[] = {
+    {.N = 4, .C = 256,  .H = 56,  .W = 56,     .mode = NORM_BATCH, .left_cols = 0,    .eps = 1e-5f }, // 0 ResNet-50 conv2
+    {.N = 4, .C = 2048, .H = 7,   .W = 7,      .mode = NORM_BATCH, .left_cols = 0,    .eps = 1e-5f }, // 1 ResNet-50 conv5
+    {.N = 8, .C = 1,    .H = 128, .W = 768,    .mode = NORM_LAYER, .left_cols = 0,    .eps = 1e-12f}, // 2 BERT-base
+    {.N = 8, .C = 1,    .H = 128, .W = 768,    .mode = NORM_LAYER, .left_cols = 3072, .eps = 1e-12f}, // 3 BERT-base FFN output
+    {.N = 1, .C = 1,    .H = 512, .W = 4096,   .mode = NORM_RMS,   .left_cols = 0,    .eps = 1e-6f }, // 4 LLaMA-7B
+    {.N = 1, .C = 1,    .H = 64,  .W = 4096,   .mode = NORM_RMS,   .left_cols = 4096, .eps = 1e-6f }, // 5 LLaMA-7B attention output
+    {.N = 1, .C = 1,    .H = 16,  .W = 100000, .mode = NORM_LAYER, .left_cols = 0,    .eps = 1e-5f }, // 6 rows longer than a tile
+    {.N = 2, .C = 100,  .H = 14,  .W = 14,     .mode = NORM_BATCH, .left_cols = 0,    .eps = 1e-5f }, // 7 channels not a multiple of the NPUs
+};
+
+// Self-attention of BERT-base, ViT-B/16 and GPT-2, a LLaMA-7B decoding step
+// against its KV cache and a long sequence, whose scores take 1 GB per
+// head.
+static const attention_param_t attention_cases[] = {
+    {.batch = 8, .heads = 12, .seq_q = 128,   .seq_k = 128,   .dim = 64,  .causal = 0, .scale = 0.125f     }, // 0 BERT-base
+    {.batch = 4, .heads = 12, .seq_q = 197,   .seq_k = 197,   .dim = 64,  .causal = 0, .scale = 0.125f     }, // 1 ViT-B/16
+    {.batch = 1, .heads = 12, .seq_q = 1024,  .seq_k = 1024,  .dim = 64,  .causal = 1, .scale = 0.125f     }, // 2 GPT-2
+    {.batch = 1, .heads = 32, .seq_q = 1,     .seq_k = 4096,  .dim = 128, .causal = 1, .scale = 0.0883883f }, // 3 LLaMA-7B decoding
+    {.batch = 1, .heads = 32, .seq_q = 16,    .seq_k = 4096,  .dim = 128, .causal = 1, .scale = 0.0883883f }, // 4 speculative decoding
+    {.batch = 1, .heads = 1,  .seq_q = 16384, .seq_k = 16384, .dim = 64,  .causal = 0, .scale = 0.125f     }, // 5 long sequence
+};
+
+#define CASE_NUM(cases) ((int)(sizeof(cases) / sizeof((cases)[0])))
+
+////////////////////////////////////////////////////////////////////////
+/// OUTPUT SHAPES
+/// ////////////////////////////////////////////////////////////////////
+static inline void conv2d_output_hw(const conv2d_param_t &param, int &output_h, int &output_w) {
+    const int kernel_h_ext = (param.kernel_h - 1) * param.dilation_h + 1;
+    const int kernel_w_ext = (param.kernel_w - 1) * param.dilation_w + 1;
+    output_h = (param.H + param.pad_top + param.pad_bottom - kernel_h_ext) / param.stride_h + 1;
+    output_w = (param.W + param.pad_left + param.pad_right - kernel_w_ext) / param.stride_w + 1;
+}
+
+static inline void depthwise_output_hw(const depthwise_param_t &param, int &output_h, int &output_w) {
+    const int kernel_h_ext = (param.kernel_h - 1) * param.dilation_h + 1;
+    const int kernel_w_ext = (param.kernel_w - 1) * param.dilation_w + 1;
+    output_h = (param.H + param.pad_top + param.pad_bottom - kernel_h_ext) / param.stride_h + 1;
+    output_w = (param.W + param.pad_left + param.pad_right - kernel_w_ext) / param.stride_w + 1;
+}
+
+static inline void conv2d_group_output_hw(const conv2d_group_param_t &param, int &output_h, int &output_w) {
+    const int kernel_h_ext = (param.kernel_h - 1) * param.dilation_h + 1;
+    const int kernel_w_ext = (param.kernel_w - 1) * param.dilation_w + 1;
+    output_h = (param.H + param.pad_top + param.pad_bottom - kernel_h_ext) / param.stride_h + 1;
+    output_w = (param.W + param.pad_left + param.pad_right - kernel_w_ext) / param.stride_w + 1;
+}
+
+template<class P>
+static inline void pool_output_hw(const P &param, int &output_h, int &output_w) {
+    output_h = param.H + param.pad_top + param.pad_bottom - param.kernel_h;
+    output_w = param.W + param.pad_left + param.pad_right - param.kernel_w;
+    if (param.ceil_mode) {
+        output_h = DIV_UP(output_h, param.stride_h) + 1;
+        output_w = DIV_UP(output_w, param.stride_w) + 1;
+    } else {
+        output_h = output_h / param.stride_h + 1;
+        output_w = output_w / param.stride_w + 1;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+/// DEVICE TENSORS
+/// The element counts of the device tensors of each kernel, in the order
+/// of the address fields of its param, and how to bind their addresses.
+/// ////////////////////////////////////////////////////////////////////
+static inline std::vector<long long> tensor_lens(const conv2d_param_t &param) {
+    int output_h, output_w;
+    conv2d_output_hw(param, output_h, output_w);
+    return {
+        (long long)param.N * param.OC * output_h * output_w,
+        (long long)param.N * param.IC * param.H * param.W,
+        (long long)param.OC * ((param.IC + 1) / 2) * 2 * param.kernel_h * param.kernel_w
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const depthwise_param_t &param) {
+    int output_h, output_w;
+    depthwise_output_hw(param, output_h, output_w);
+    return {
+        (long long)param.N * param.C * output_h * output_w,
+        (long long)param.N * param.C * param.H * param.W,
+        (long long)param.C * param.kernel_h * param.kernel_w
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const matmul_param_t &param) {
+    return {
+        (long long)param.left_rows * param.right_cols,
+        (long long)param.left_rows * param.left_cols,
+        (long long)param.left_cols * param.right_cols
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const softmax_param_t &param) {
+    long long len = (long long)param.N * param.C * param.H * param.W;
+    return {len, len};
+}
+
+static inline std::vector<long long> tensor_lens(const max_pool_param_t &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    // index_addr is not written by max_pool_0.
+    return {
+        (long long)param.N * param.C * output_h * output_w,
+        0,
+        (long long)param.N * param.C * param.H * param.W
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const avg_pool_param_t &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    return {
+        (long long)param.N * param.C * output_h * output_w,
+        (long long)param.N * param.C * param.H * param.W
+    };
+}
+
+// The kernel is the 2IC layout of each group, the bias is absent unless
+// using_bias.
+static inline std::vector<long long> tensor_lens(const conv2d_group_param_t &param) {
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    const int IC = param.IC / param.group;
+    return {
+        (long long)param.N * param.OC * output_h * output_w,
+        (long long)param.N * param.IC * param.H * param.W,
+        (long long)param.OC * ((IC + 1) / 2) * 2 * param.kernel_h * param.kernel_w,
+        param.using_bias ? (long long)param.OC : 0
+    };
+}
+
+// tensor_lens counts 32-bit elements, the uint8 input of N * H rows of
+// pitch bytes (W * C if 0) takes a quarter of its bytes rounded up.
+static inline std::vector<long long> tensor_lens(const preprocess_param_t &param) {
+    const long long len = (long long)param.N * param.C * param.H * param.W;
+    const long long pitch = param.pitch > 0 ? param.pitch : (long long)param.W * param.C;
+    return {len, DIV_UP((long long)param.N * param.H * pitch, 4)};
+}
+
+static inline std::vector<long long> tensor_lens(const topk_param_t &param) {
+    const long long len = (long long)param.N * param.K;
+    return {len, len, (long long)param.N * param.C};
+}
+
+static inline std::vector<long long> tensor_lens(const embedding_param_t &param) {
+    const long long lookups = (long long)param.batch * param.bag;
+    return {
+        (param.pooling == EMBEDDING_NONE ? lookups : param.batch) * param.dim,
+        lookups,
+        (long long)param.rows * param.dim
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const norm_param_t &param) {
+    const long long rows = (long long)param.N * param.C * param.H;
+    const long long channels = param.mode == NORM_BATCH ? param.C : param.W;
+    return {
+        rows * param.W,
+        rows * (param.left_cols > 0 ? param.left_cols : param.W),
+        (long long)param.left_cols * param.W,
+        channels,
+        param.mode == NORM_RMS ? 0 : channels,
+        param.mode == NORM_BATCH ? channels : 0,
+        param.mode == NORM_BATCH ? channels : 0
+    };
+}
+
+static inline std::vector<long long> tensor_lens(const attention_param_t &param) {
+    const long long heads = (long long)param.batch * param.heads;
+    const long long query_len = heads * param.seq_q * param.dim, key_len = heads * param.seq_k * param.dim;
+    return {query_len, query_len, key_len, key_len};
+}
+
+static inline std::vector<long long> tensor_lens(const nms_param_t &param) {
+    return {1 + (long long)param.max_output, (long long)param.num * 5};
+}
+
+// Whether each device tensor holds N images (the others, kernels and
+// biases, are shared by all images), in the order of tensor_lens.
+static inline std::vector<bool> tensor_batched(const conv2d_param_t &) {
+    return {true, true, false};
+}
+
+static inline std::vector<bool> tensor_batched(const conv2d_group_param_t &) {
+    return {true, true, false, false};
+}
+
+static inline std::vector<bool> tensor_batched(const depthwise_param_t &) {
+    return {true, true, false};
+}
+
+static inline std::vector<bool> tensor_batched(const softmax_param_t &) {
+    return {true, true};
+}
+
+static inline std::vector<bool> tensor_batched(const max_pool_param_t &) {
+    return {true, true, true};
+}
+
+static inline std::vector<bool> tensor_batched(const avg_pool_param_t &) {
+    return {true, true};
+}
+
+static inline std::vector<bool> tensor_batched(const preprocess_param_t &) {
+    return {true, true};
+}
+
+static inline std::vector<bool> tensor_batched(const topk_param_t &) {
+    return {true, true, true};
+}
+
+static inline std::vector<bool> tensor_batched(const embedding_param_t &) {
+    return {true, true, false};
+}
+
+static inline std::vector<bool> tensor_batched(const norm_param_t &) {
+    return {true, true, false, false, false, false, false};
+}
+
+static inline std::vector<bool> tensor_batched(const attention_param_t &) {
+    return {true, true, true, true};
+}
+
+// Device tensors written by the kernel, the first ones of tensor_lens.
+template<class P>
+static inline int tensor_outputs(const P &) {
+    return 1;
+}
+
+static inline int tensor_outputs(const topk_param_t &) {
+    return 2;
+}
+
+static inline void bind_addrs(conv2d_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+    param.kernel_addr = addrs[2];
+}
+
+static inline void bind_addrs(depthwise_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+    param.kernel_addr = addrs[2];
+}
+
+static inline void bind_addrs(matmul_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.left_addr = addrs[1];
+    param.right_addr = addrs[2];
+}
+
+static inline void bind_addrs(softmax_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+}
+
+static inline void bind_addrs(max_pool_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.index_addr = addrs[1];
+    param.input_addr = addrs[2];
+}
+
+static inline void bind_addrs(avg_pool_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+}
+
+static inline void bind_addrs(conv2d_group_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+    param.kernel_addr = addrs[2];
+    param.bias_addr = addrs[3];
+}
+
+static inline void bind_addrs(preprocess_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+}
+
+static inline void bind_addrs(topk_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.index_addr = addrs[1];
+    param.input_addr = addrs[2];
+}
+
+static inline void bind_addrs(embedding_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.index_addr = addrs[1];
+    param.table_addr = addrs[2];
+}
+
+static inline void bind_addrs(norm_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+    param.right_addr = addrs[2];
+    param.weight_addr = addrs[3];
+    param.bias_addr = addrs[4];
+    param.mean_addr = addrs[5];
+    param.var_addr = addrs[6];
+}
+
+static inline void bind_addrs(attention_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.query_addr = addrs[1];
+    param.key_addr = addrs[2];
+    param.value_addr = addrs[3];
+}
+
+static inline void bind_addrs(nms_param_t &param, const std::vector<unsigned long long> &addrs) {
+    param.output_addr = addrs[0];
+    param.input_addr = addrs[1];
+}
+
+// Clears the addresses, what remains is the shape of the case.
+template<class P>
+static inline P shape_of(const P &param) {
+    P shape = param;
+    bind_addrs(shape, std::vector<unsigned long long>(tensor_lens(param).size(), 0));
+    return shape;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// POOL.DAT
+/// ////////////////////////////////////////////////////////////////////
+template<class P>
+static inline void pool_param_from(P &param, const pool_t &pm) {
+    param.N = pm.N;
+    param.C = pm.C;
+    param.H = pm.H;
+    param.W = pm.W;
+    param.kernel_h = pm.kh;
+    param.kernel_w = pm.kw;
+    param.pad_top = pm.pad_up_h;
+    param.pad_bottom = pm.pad_down_h;
+    param.pad_left = pm.pad_left_w;
+    param.pad_right = pm.pad_right_w;
+    param.stride_h = pm.stride_h;
+    param.stride_w = pm.stride_w;
+    param.ceil_mode = pm.out_ceil_mode;
+}
+
+// Cases of max_pool_0 in pool.dat.
+static inline std::vector<max_pool_param_t> max_pool_cases(const param_span_t<pool_t> &params) {
+    std::vector<max_pool_param_t> cases;
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params[i].is_gloabl_pool != 0 || params[i].is_avgpool != 0)
+            continue;
+        max_pool_param_t param;
+        pool_param_from(param, params[i]);
+        cases.push_back(param);
+    }
+    return cases;
+}
+
+// Cases of avg_pool_0 in pool.dat, with N = 4 and both modes of count_include_pad.
+static inline std::vector<avg_pool_param_t> avg_pool_cases(const param_span_t<pool_t> &params) {
+    std::vector<avg_pool_param_t> cases;
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params[i].is_gloabl_pool != 0 || params[i].is_avgpool == 0)
+            continue;
+        avg_pool_param_t param;
+        pool_param_from(param, params[i]);
+        param.N = 4;
+        for (int count_include_pad = 0; count_include_pad < 2; ++count_include_pad) {
+            param.count_include_pad = count_include_pad;
+            cases.push_back(param);
+        }
+    }
+    return cases;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CONV.DAT
+/// C is the input channels of all groups, ic of one group and oc of all
+/// groups.
+/// ////////////////////////////////////////////////////////////////////
+static inline void conv2d_group_param_from(conv2d_group_param_t &param, const conv_t &pm) {
+    param.N = pm.N;
+    param.IC = pm.C;
+    param.OC = pm.oc;
+    param.H = pm.H;
+    param.W = pm.W;
+    param.group = pm.group;
+    param.kernel_h = pm.kh;
+    param.kernel_w = pm.kw;
+    param.pad_top = pm.pad_up_h;
+    param.pad_bottom = pm.pad_down_h;
+    param.pad_left = pm.pad_left_w;
+    param.pad_right = pm.pad_right_w;
+    param.stride_h = pm.stride_h;
+    param.stride_w = pm.stride_w;
+    param.dilation_h = pm.dh;
+    param.dilation_w = pm.dw;
+    param.using_bias = pm.have_bias;
+    param.output_addr = param.input_addr = param.kernel_addr = param.bias_addr = 0;
+}
+#endif
@@ -0,0 +1,214 @@
+#ifndef OKK_COMPARE_H
+#define OKK_COMPARE_H
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "okk_thread.h"
+////////////////////////////////////////////////////////////////////////
+/// COMPARE
+/// An output element passes if both it and the reference are not finite,
+/// or if |output - reference| < tolerance * max(|output|, |reference|, 1).
+/// compare_check first runs a pass/fail scan that stops at the first
+/// mismatch. It only gathers the statistics (max errors, ULP histogram,
+/// first mismatches with their coordinates) if the scan fails or if the
+/// environment variable OKK_COMPARE is "stats".
+/// ////////////////////////////////////////////////////////////////////
+// elements per task
+#define COMPARE_TASK_LEN (1 << 18)
+// elements per early exit check of the pass/fail scan
+#define COMPARE_BLOCK_LEN (4096)
+// bins of the ULP histogram: 0, 1, [2, 4), [4, 8), ..., [2^(BINS-2), inf)
+#define COMPARE_ULP_BINS (24)
+
+typedef struct {
+    double tolerance;
+    // shape of the output, for the coordinates of mismatches
+    int N, C, H, W;
+    // mismatches to report
+    int max_failures;
+    // gather the statistics even if the outputs pass
+    bool stats;
+} compare_options_t;
+
+typedef struct {
+    long long count;
+    long long mismatches;
+    double max_abs_err;
+    double max_rel_err;
+    long long max_abs_index;
+    long long ulp_hist[COMPARE_ULP_BINS];
+    // indices of the first mismatches, ascending
+    std::vector<long long> failures;
+} compare_stats_t;
+
+static inline compare_options_t compare_options(double tolerance, int N, int C, int H, int W) {
+    const char *mode = getenv("OKK_COMPARE");
+    compare_options_t options = {tolerance, N, C, H, W, 10, mode && strcmp(mode, "stats") == 0};
+    return options;
+}
+
+static inline bool compare_element(float output, float ref, double tolerance) {
+    if (!std::isfinite(output) && !std::isfinite(ref))
+        return true;
+    const float max_val = std::max(std::max(std::fabs(output), std::fabs(ref)), 1.f);
+    return std::fabs(output - ref) < tolerance * max_val;
+}
+
+// Distance in representable floats, saturated, for finite values.
+static inline int64_t compare_ulp(float a, float b) {
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    // map the sign-magnitude bits onto a monotonic integer line
+    const int64_t la = ia < 0 ? (int64_t)INT32_MIN - ia : ia;
+    const int64_t lb = ib < 0 ? (int64_t)INT32_MIN - ib : ib;
+    return la > lb ? la - lb : lb - la;
+}
+
+static inline int compare_ulp_bin(int64_t ulp) {
+    int bin = 0;
+    while (ulp > 0 && bin < COMPARE_ULP_BINS - 1) {
+        ulp >>= 1;
+        ++bin;
+    }
+    return bin;
+}
+
+// Nonzero if some element of [begin, end) may fail. Checks in float with
+// a slightly smaller tolerance so the loop vectorizes, elements it lets
+// pass pass the exact check too.
+static inline int compare_block_suspect(const float *__restrict__ output, const float *__restrict__ ref, long long begin, long long end, double tolerance_lo) {
+    int suspect = 0;
+    for (long long j = begin; j < end; ++j) {
+        const float abs_output = std::fabs(output[j]), abs_ref = std::fabs(ref[j]);
+        float max_val = abs_output > abs_ref ? abs_output : abs_ref;
+        max_val = max_val > 1.f ? max_val : 1.f;
+        const float bound = (float)tolerance_lo * max_val;
+        const float diff = std::fabs(output[j] - ref[j]);
+        const int ok = diff < bound;
+        const int both_not_finite = !(abs_output <= FLT_MAX) & !(abs_ref <= FLT_MAX);
+        suspect |= !ok & !both_not_finite;
+    }
+    return suspect;
+}
+
+// True if all elements pass, stops at the first block with a mismatch.
+static inline bool compare_pass(const float *output, const float *ref, long long len, double tolerance) {
+    const double tolerance_lo = tolerance * (1 - 1e-5);
+    const long long tasks = (len + COMPARE_TASK_LEN - 1) / COMPARE_TASK_LEN;
+    std::atomic<bool> failed(false);
+    parallel_for(tasks, [&](long long task) {
+        const long long end = std::min((task + 1) * COMPARE_TASK_LEN, len);
+        for (long long i = task * COMPARE_TASK_LEN; i < end && !failed.load(std::memory_order_relaxed); i += COMPARE_BLOCK_LEN) {
+            const long long block_end = std::min(i + COMPARE_BLOCK_LEN, end);
+            if (!compare_block_suspect(output, ref, i, block_end, tolerance_lo))
+                continue;
+            for (long long j = i; j < block_end; ++j) {
+                if (!compare_element(output[j], ref[j], tolerance)) {
+                    failed.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    });
+    return !failed.load();
+}
+
+static inline compare_stats_t compare_stats(const float *output, const float *ref, long long len, const compare_options_t &options) {
+    const long long tasks = (len + COMPARE_TASK_LEN - 1) / COMPARE_TASK_LEN;
+    std::vector<compare_stats_t> partial(tasks);
+    parallel_for(tasks, [&](long long task) {
+        compare_stats_t &s = partial[task];
+        s.count = s.mismatches = 0;
+        s.max_abs_err = s.max_rel_err = 0;
+        s.max_abs_index = -1;
+        memset(s.ulp_hist, 0, sizeof(s.ulp_hist));
+        const long long end = std::min((task + 1) * COMPARE_TASK_LEN, len);
+        for (long long i = task * COMPARE_TASK_LEN; i < end; ++i) {
+            ++s.count;
+            if (!compare_element(output[i], ref[i], options.tolerance)) {
+                if (s.mismatches++ < options.max_failures)
+                    s.failures.push_back(i);
+            }
+            if (!std::isfinite(output[i]) || !std::isfinite(ref[i]))
+                continue;
+            const double abs_err = std::fabs((double)output[i] - ref[i]);
+            const double rel_err = abs_err / std::max(std::fabs((double)ref[i]), (double)FLT_MIN);
+            if (abs_err > s.max_abs_err || s.max_abs_index < 0) {
+                s.max_abs_err = abs_err;
+                s.max_abs_index = i;
+            }
+            s.max_rel_err = std::max(s.max_rel_err, rel_err);
+            ++s.ulp_hist[compare_ulp_bin(compare_ulp(output[i], ref[i]))];
+        }
+    });
+    compare_stats_t stats;
+    stats.count = stats.mismatches = 0;
+    stats.max_abs_err = stats.max_rel_err = 0;
+    stats.max_abs_index = -1;
+    memset(stats.ulp_hist, 0, sizeof(stats.ulp_hist));
+    for (long long t = 0; t < tasks; ++t) {
+        const compare_stats_t &s = partial[t];
+        stats.count += s.count;
+        stats.mismatches += s.mismatches;
+        if (s.max_abs_index >= 0 && (s.max_abs_err > stats.max_abs_err || stats.max_abs_index < 0)) {
+            stats.max_abs_err = s.max_abs_err;
+            stats.max_abs_index = s.max_abs_index;
+        }
+        stats.max_rel_err = std::max(stats.max_rel_err, s.max_rel_err);
+        for (int b = 0; b < COMPARE_ULP_BINS; ++b)
+            stats.ulp_hist[b] += s.ulp_hist[b];
+        for (size_t f = 0; f < s.failures.size() && (int)stats.failures.size() < options.max_failures; ++f)
+            stats.failures.push_back(s.failures[f]);
+    }
+    return stats;
+}
+
+static inline void compare_print_index(long long index, const compare_options_t &options) {
+    const long long hw = (long long)options.H * options.W;
+    std::cout << index << " (n " << index / ((long long)options.C * hw) << ", c " << index / hw % options.C
+              << ", h " << index / options.W % options.H << ", w " << index % options.W << ")";
+}
+
+static inline void compare_print(const compare_stats_t &stats, const float *output, const float *ref, const compare_options_t &options) {
+    std::cout << "compare: " << stats.mismatches << " of " << stats.count << " mismatched, max abs err "
+              << stats.max_abs_err << ", max rel err " << stats.max_rel_err;
+    if (stats.max_abs_index >= 0) {
+        std::cout << " at ";
+        compare_print_index(stats.max_abs_index, options);
+    }
+    std::cout << std::endl << "  ulp:";
+    for (int b = 0; b < COMPARE_ULP_BINS; ++b) {
+        if (stats.ulp_hist[b] == 0)
+            continue;
+        if (b <= 1)
+            std::cout << " " << b;
+        else if (b < COMPARE_ULP_BINS - 1)
+            std::cout << " <" << (1LL << b);
+        else
+            std::cout << " >=" << (1LL << (b - 1));
+        std::cout << ":" << stats.ulp_hist[b];
+    }
+    std::cout << std::endl;
+    for (size_t f = 0; f < stats.failures.size(); ++f) {
+        std::cout << "  mismatch at ";
+        compare_print_index(stats.failures[f], options);
+        std::cout << ": " << output[stats.failures[f]] << " vs " << ref[stats.failures[f]] << std::endl;
+    }
+}
+
+// Compares an output with its reference, printing the statistics if it
+// fails or if options.stats is set.
+static inline bool compare_check(const float *output, const float *ref, long long len, const compare_options_t &options) {
+    const bool pass = compare_pass(output, ref, len, options.tolerance);
+    if (!pass || options.stats)
+        compare_print(compare_stats(output, ref, len, options), output, ref, options);
+    return pass;
+}
+#endif
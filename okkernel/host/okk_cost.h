@@ -0,0 +1,195 @@
+#ifndef OKK_COST_H
+#define OKK_COST_H
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////
+/// COST MODEL
+/// Estimates the cycles of a launch from the op trace written by
+/// device/okk_optrace.c. Cycles are TPU cycles of BM1684 (550MHz).
+///   GDMA op: overhead + bytes / COST_GDMA_BYTES_PER_CYCLE, rows narrower
+///            than COST_GDMA_MIN_BURST bytes cost a whole burst.
+///   BDC op:  overhead + n * ceil(c / NPU) * ceil(h * w / EU) * inner * factor,
+///            channels are spread over the NPUs and the EUs of an NPU
+///            share the h * w elements of a channel.
+/// Ops outside parallel regions are serial, a region costs the longer of
+/// its GDMA and BDC queues. The estimates are for comparing revisions of
+/// a kernel, not for predicting absolute time.
+/// ////////////////////////////////////////////////////////////////////
+#define COST_NPU_NUM (64)
+#define COST_EU_NUM (16)
+#define COST_CLOCK_MHZ (550.)
+#define COST_GDMA_BYTES_PER_CYCLE (56.)
+#define COST_GDMA_MIN_BURST (64)
+#define COST_GDMA_OVERHEAD (100.)
+#define COST_BDC_OVERHEAD (30.)
+#define COST_REGION_OVERHEAD (20.)
+
+typedef struct {
+    const char *func;
+    double factor;
+} cost_factor_t;
+
+// Cycles per element relative to an add, for the BDC functions that are
+// not a single pass of the EUs.
+static const cost_factor_t cost_bdc_factors[] = {
+    {"okk_bdc_div", 4},
+    {"okk_bdc_div_C", 4},
+    {"okk_bdc_C_div", 4},
+    {"okk_bdc_reciprocal", 4},
+    {"okk_bdc_rsqrt", 4},
+    {"okk_bdc_exp", 12},
+    {"okk_bdc_sigmoid", 16},
+    {"okk_bdc_tanh", 16},
+};
+
+typedef struct {
+    std::string func;
+    int region;
+    int n, c, h, w;
+    long long inner;
+    long long bytes;
+} cost_op_t;
+
+typedef struct {
+    std::string kernel_name;
+    std::vector<cost_op_t> ops;
+} cost_launch_t;
+
+typedef struct {
+    double cycles;
+    double gdma_cycles;
+    double bdc_cycles;
+    // cycles of the shorter queue of each region, hidden by the overlap
+    double hidden_cycles;
+    long long gdma_bytes;
+    long long bdc_work;
+} cost_estimate_t;
+
+static inline bool cost_is_gdma(const cost_op_t &op) {
+    return op.func.compare(0, 8, "okk_gdma") == 0;
+}
+
+static inline double cost_op_cycles(const cost_op_t &op) {
+    if (op.n <= 0 || op.c <= 0 || op.h <= 0 || op.w <= 0)
+        return 0;
+    if (cost_is_gdma(op)) {
+        long long rows = (long long)op.n * op.c * op.h;
+        double row_bytes = (double)op.bytes / rows;
+        return COST_GDMA_OVERHEAD + rows * std::max(row_bytes, (double)COST_GDMA_MIN_BURST) / COST_GDMA_BYTES_PER_CYCLE;
+    }
+    double factor = 1;
+    for (size_t i = 0; i < sizeof(cost_bdc_factors) / sizeof(cost_bdc_factors[0]); ++i)
+        if (op.func == cost_bdc_factors[i].func)
+            factor = cost_bdc_factors[i].factor;
+    double passes = (double)op.n * ((op.c + COST_NPU_NUM - 1) / COST_NPU_NUM) * (((long long)op.h * op.w + COST_EU_NUM - 1) / COST_EU_NUM);
+    return COST_BDC_OVERHEAD + passes * op.inner * factor;
+}
+
+static inline cost_estimate_t cost_estimate(const cost_launch_t &launch) {
+    cost_estimate_t estimate = {0, 0, 0, 0, 0, 0};
+    // gdma and bdc cycles of each region
+    std::map<int, std::pair<double, double> > regions;
+    for (size_t i = 0; i < launch.ops.size(); ++i) {
+        const cost_op_t &op = launch.ops[i];
+        double cycles = cost_op_cycles(op);
+        bool gdma = cost_is_gdma(op);
+        if (gdma) {
+            estimate.gdma_cycles += cycles;
+            estimate.gdma_bytes += op.bytes;
+        } else {
+            estimate.bdc_cycles += cycles;
+            estimate.bdc_work += (long long)op.n * op.c * op.h * op.w * op.inner;
+        }
+        if (op.region < 0)
+            estimate.cycles += cycles;
+        else if (gdma)
+            regions[op.region].first += cycles;
+        else
+            regions[op.region].second += cycles;
+    }
+    for (std::map<int, std::pair<double, double> >::const_iterator it = regions.begin(); it != regions.end(); ++it) {
+        estimate.cycles += COST_REGION_OVERHEAD + std::max(it->second.first, it->second.second);
+        estimate.hidden_cycles += std::min(it->second.first, it->second.second);
+    }
+    return estimate;
+}
+
+// Returns -1 if the file can not be read.
+static inline int cost_trace_load(const std::string &path, std::vector<cost_launch_t> &launches) {
+    std::ifstream f(path);
+    if (!f)
+        return -1;
+    std::string line;
+    while (std::getline(f, line)) {
+        std::istringstream ss(line);
+        std::string tag;
+        ss >> tag;
+        if (tag == "launch") {
+            cost_launch_t launch;
+            ss >> launch.kernel_name;
+            launches.push_back(launch);
+        } else if (tag == "op") {
+            cost_op_t op;
+            ss >> op.func >> op.region >> op.n >> op.c >> op.h >> op.w >> op.inner >> op.bytes;
+            if (!ss || launches.empty()) {
+                std::cout << "Skip malformed line of " << path << ": " << line << std::endl;
+                continue;
+            }
+            launches.back().ops.push_back(op);
+        }
+    }
+    return 0;
+}
+
+// Key of a launch in a baseline: kernel_name#k for the k-th launch of the kernel.
+static inline std::vector<std::string> cost_launch_keys(const std::vector<cost_launch_t> &launches) {
+    std::map<std::string, int> seen;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < launches.size(); ++i)
+        keys.push_back(launches[i].kernel_name + "#" + std::to_string(seen[launches[i].kernel_name]++));
+    return keys;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// BASELINE
+/// One line per launch: key cycles
+/// ////////////////////////////////////////////////////////////////////
+typedef std::map<std::string, double> cost_baseline_t;
+
+static inline int cost_baseline_load(const std::string &path, cost_baseline_t &baseline) {
+    std::ifstream f(path);
+    if (!f)
+        return -1;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        std::string key;
+        double cycles;
+        if (ss >> key >> cycles)
+            baseline[key] = cycles;
+    }
+    return 0;
+}
+
+static inline int cost_baseline_save(const std::string &path, const cost_baseline_t &baseline) {
+    std::ofstream f(path, std::ios::out | std::ios::trunc);
+    if (!f) {
+        std::cout << "Failed to create file " << path << std::endl;
+        return -1;
+    }
+    f << "# kernel_name#launch estimated_cycles" << std::endl;
+    f << std::fixed << std::setprecision(1);
+    for (cost_baseline_t::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+        f << it->first << " " << it->second << std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,200 @@
+#ifndef OKK_GOLDEN_H
+#define OKK_GOLDEN_H
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "okk_cases.h"
+#include "okk_tune.h"
+////////////////////////////////////////////////////////////////////////
+/// GOLDEN CACHE
+/// The device tensors of a case, with the inputs as they are uploaded and
+/// the expected output in place of the output, generated from a seed.
+/// If the environment variable OKK_GOLDEN_DIR is set they are stored in
+/// DIR/kernel_name.shape_hash.seed.golden and later runs map the file
+/// instead of generating them again. Uploads and the comparison of the
+/// outputs read the mapping directly.
+///   file: golden_header_t, then the tensors in the order of tensor_lens,
+///         each starting at a multiple of GOLDEN_ALIGN.
+/// ////////////////////////////////////////////////////////////////////
+#define GOLDEN_MAGIC "OKKGLD03"
+#define GOLDEN_ALIGN (4096)
+#define GOLDEN_MAX_TENSORS (8)
+#define GOLDEN_MAX_PARAM (256)
+
+typedef struct {
+    char magic[8];
+    unsigned long long seed;
+    unsigned long long shape_hash;
+    int tensor_num;
+    int param_size;
+    long long lens[GOLDEN_MAX_TENSORS];
+    // param with the addresses cleared
+    unsigned char shape[GOLDEN_MAX_PARAM];
+} golden_header_t;
+
+typedef struct {
+    void *base;
+    size_t size;
+    // tensors[0] is the expected output
+    std::vector<float *> tensors;
+    // mapped from an existing file, the tensors are read-only
+    bool cached;
+} golden_t;
+
+// The seed of the inputs, the environment variable OKK_SEED overrides 1.
+static inline unsigned long long golden_seed() {
+    const char *seed = getenv("OKK_SEED");
+    return seed ? strtoull(seed, nullptr, 0) : 1ULL;
+}
+
+static inline size_t golden_align(size_t size) {
+    return (size + GOLDEN_ALIGN - 1) / GOLDEN_ALIGN * GOLDEN_ALIGN;
+}
+
+static inline size_t golden_layout(const std::vector<long long> &lens, std::vector<size_t> &offsets) {
+    size_t size = golden_align(sizeof(golden_header_t));
+    offsets.clear();
+    for (size_t i = 0; i < lens.size(); ++i) {
+        offsets.push_back(size);
+        size += golden_align(lens[i] * sizeof(float));
+    }
+    return size;
+}
+
+template<class P>
+static inline golden_header_t golden_header(const char *kernel_name, const P &param, unsigned long long seed) {
+    static_assert(sizeof(P) <= GOLDEN_MAX_PARAM, "param_t is too large for golden_header_t");
+    const std::vector<long long> lens = tensor_lens(param);
+    assert(lens.size() <= GOLDEN_MAX_TENSORS);
+    const P shape = shape_of(param);
+    golden_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GOLDEN_MAGIC, sizeof(header.magic));
+    header.seed = seed;
+    header.shape_hash = tune_shape_hash(kernel_name, param);
+    header.tensor_num = lens.size();
+    header.param_size = sizeof(P);
+    for (size_t i = 0; i < lens.size(); ++i)
+        header.lens[i] = lens[i];
+    memcpy(header.shape, &shape, sizeof(P));
+    return header;
+}
+
+// Empty if OKK_GOLDEN_DIR is not set.
+static inline std::string golden_path(const char *kernel_name, const golden_header_t &header) {
+    const char *dir = getenv("OKK_GOLDEN_DIR");
+    if (!dir)
+        return std::string();
+    std::ostringstream ss;
+    ss << dir << "/" << kernel_name << "." << std::hex << header.shape_hash << std::dec << "." << header.seed << ".golden";
+    return ss.str();
+}
+
+static inline void golden_bind(golden_t &golden, void *base, size_t size, const std::vector<size_t> &offsets, bool cached) {
+    golden.base = base;
+    golden.size = size;
+    golden.cached = cached;
+    golden.tensors.clear();
+    for (size_t i = 0; i < offsets.size(); ++i)
+        golden.tensors.push_back((float *)((char *)base + offsets[i]));
+}
+
+// Maps an existing golden file, returns -1 if it is missing or stale.
+static inline int golden_map(golden_t &golden, const std::string &path, const golden_header_t &header, size_t size, const std::vector<size_t> &offsets) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size)
+        base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+    if (memcmp(base, &header, sizeof(header)) != 0) {
+        munmap(base, size);
+        return -1;
+    }
+    golden_bind(golden, base, size, offsets, true);
+    return 0;
+}
+
+// Creates the golden file and maps it writable, the header is written by
+// golden_commit once the tensors are generated.
+static inline int golden_create(golden_t &golden, const std::string &tmp_path, size_t size, const std::vector<size_t> &offsets) {
+    int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        unlink(tmp_path.c_str());
+        return -1;
+    }
+    golden_bind(golden, base, size, offsets, false);
+    return 0;
+}
+
+static inline int golden_commit(const golden_t &golden, const std::string &tmp_path, const std::string &path, const golden_header_t &header) {
+    memcpy(golden.base, &header, sizeof(header));
+    // Publish atomically, concurrent runs see either no file or a whole one.
+    if (msync(golden.base, golden.size, MS_SYNC) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cout << "Failed to write file " << path << std::endl;
+        unlink(tmp_path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// Maps the golden tensors of a case, calling generate(tensors) to fill them
+// if they are not cached. generate must be deterministic in the seed.
+template<class P, class G>
+static inline int golden_load(golden_t &golden, const char *kernel_name, const P &param, unsigned long long seed, const G &generate) {
+    const golden_header_t header = golden_header(kernel_name, param, seed);
+    std::vector<size_t> offsets;
+    const size_t size = golden_layout(tensor_lens(param), offsets);
+    const std::string path = golden_path(kernel_name, header);
+    if (!path.empty() && golden_map(golden, path, header, size, offsets) == 0)
+        return 0;
+    std::string tmp_path;
+    if (!path.empty()) {
+        mkdir(getenv("OKK_GOLDEN_DIR"), 0755);
+        tmp_path = path + ".tmp." + std::to_string(getpid());
+        if (golden_create(golden, tmp_path, size, offsets) != 0) {
+            std::cout << "Failed to create file " << tmp_path << ", " << strerror(errno) << std::endl;
+            tmp_path.clear();
+        }
+    }
+    if (tmp_path.empty()) {
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            std::cout << "Failed to map " << size << " bytes for the golden tensors of " << kernel_name << std::endl;
+            return -1;
+        }
+        golden_bind(golden, base, size, offsets, false);
+    }
+    generate(golden.tensors.data());
+    if (!tmp_path.empty())
+        golden_commit(golden, tmp_path, path, header);
+    return 0;
+}
+
+static inline void golden_free(golden_t &golden) {
+    if (golden.base)
+        munmap(golden.base, golden.size);
+    golden.base = nullptr;
+    golden.tensors.clear();
+}
+#endif
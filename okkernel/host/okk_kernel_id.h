@@ -0,0 +1,65 @@
+#ifndef OKK_KERNEL_ID_H
+#define OKK_KERNEL_ID_H
+#include <string.h>
+#include "bmlib_runtime.h"
+#include "okk_tune.h"
+////////////////////////////////////////////////////////////////////////
+/// KERNEL ID
+/// Kernels registered with OKKERNEL_FUNC_REGISTER_ID (see
+/// device/okk_kernel_id.h) can be launched by a numeric ID instead of their
+/// name. okk_kernel_id resolves a name once, the launches of the ID go
+/// through the dispatcher kernel okk_id, which looks the ID up in a hash
+/// table instead of the firmware matching the kernel name.
+/// ////////////////////////////////////////////////////////////////////
+#define OKK_KERNEL_ID_DISPATCHER "okk_id"
+
+// Layout must match okk_kernel_id_header_t in device/okk_kernel_id.h.
+typedef struct {
+    unsigned int id;
+    unsigned int reserved;
+} __attribute__((packed)) okk_kernel_id_header_t;
+
+// 32-bit FNV-1a of the name, never 0.
+static inline unsigned int okk_kernel_id(const char *kernel_name) {
+    unsigned int hash = 2166136261U;
+    for (const char *p = kernel_name; *p; ++p) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619U;
+    }
+    return hash ? hash : 1;
+}
+
+template<class P>
+static inline bm_status_t okkernel_launch_id_sync(bm_handle_t handle, unsigned int id, const P &param) {
+    struct {
+        okk_kernel_id_header_t header;
+        P param;
+    } __attribute__((packed)) args = {{id, 0}, param};
+    return okkernel_launch_sync(handle, OKK_KERNEL_ID_DISPATCHER, &args, sizeof(args));
+}
+
+// okkernel_launch_tuned_sync by ID.
+template<class P>
+static inline bm_status_t okkernel_launch_tuned_id_sync(bm_handle_t handle, unsigned int id, const P &param, const tune_t &tune, unsigned long long timer_addr = 0) {
+    struct {
+        okk_kernel_id_header_t header;
+        P param;
+        tune_t tune;
+        unsigned long long timer_addr;
+    } __attribute__((packed)) args = {{id, 0}, param, tune, timer_addr};
+    return okkernel_launch_sync(handle, OKK_KERNEL_ID_DISPATCHER, &args, sizeof(args));
+}
+
+// okkernel_launch_tuned_id_sync that returns once the launch is queued,
+// bm_thread_sync waits for it. The args are copied by the call.
+template<class P>
+static inline bm_status_t okkernel_launch_tuned_id_async(bm_handle_t handle, unsigned int id, const P &param, const tune_t &tune, unsigned long long timer_addr = 0) {
+    struct {
+        okk_kernel_id_header_t header;
+        P param;
+        tune_t tune;
+        unsigned long long timer_addr;
+    } __attribute__((packed)) args = {{id, 0}, param, tune, timer_addr};
+    return okkernel_launch_async(handle, OKK_KERNEL_ID_DISPATCHER, &args, sizeof(args));
+}
+#endif
@@ -0,0 +1,205 @@
+#ifndef OKK_MULTI_H
+#define OKK_MULTI_H
+#include <stdlib.h>
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+////////////////////////////////////////////////////////////////////////
+/// MULTI DEVICE
+/// Data parallelism over the chips of a box. One handle and one worker
+/// thread per chip, the batch N of a case is split into contiguous parts
+/// of at most one image more than each other, part d runs on chip d and
+/// the outputs of the parts are gathered on the host. OKK_DEVICES=n uses
+/// the first n chips. In C-Model mode it may exceed bm_dev_getcount, the
+/// extra handles are further simulated instances of device 0.
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    std::vector<bm_handle_t> handles;
+} multi_devices_t;
+
+typedef struct {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int count;
+    int waiting;
+    long long generation;
+} multi_barrier_t;
+
+typedef struct {
+    // chips the batch was split over
+    int devices;
+    // launch time of the whole batch on chip 0 and of the split batch
+    bench_stats_t single, multi;
+    // single.median / multi.median, and the speedup per chip
+    double speedup, efficiency;
+    // the gathered output matches the output of chip 0
+    bool pass;
+} multi_result_t;
+
+static inline void multi_close(multi_devices_t &devices) {
+    for (size_t i = 0; i < devices.handles.size(); ++i)
+        bm_dev_free(devices.handles[i]);
+    devices.handles.clear();
+}
+
+// Returns -1 if there is no device or a handle can not be created.
+static inline int multi_open(multi_devices_t &devices) {
+    devices.handles.clear();
+    int count = 0;
+    if (bm_dev_getcount(&count) != BM_SUCCESS || count <= 0) {
+        std::cout << "Failed to get the device count" << std::endl;
+        return -1;
+    }
+    int num = count;
+    const char *env = getenv("OKK_DEVICES");
+    if (env && atoi(env) > 0) {
+#ifdef USING_CMODEL
+        num = atoi(env);
+#else
+        num = std::min(atoi(env), count);
+#endif
+    }
+    for (int i = 0; i < num; ++i) {
+        bm_handle_t handle;
+        if (bm_dev_request(&handle, i < count ? i : 0) != BM_SUCCESS) {
+            std::cout << "Failed to request device " << i << std::endl;
+            multi_close(devices);
+            return -1;
+        }
+        devices.handles.push_back(handle);
+    }
+    return 0;
+}
+
+static inline void multi_barrier_init(multi_barrier_t &barrier, int count) {
+    barrier.count = count;
+    barrier.waiting = 0;
+    barrier.generation = 0;
+}
+
+// Blocks until count threads wait, then releases them all.
+static inline void multi_barrier_wait(multi_barrier_t &barrier) {
+    std::unique_lock<std::mutex> lock(barrier.mutex);
+    const long long generation = barrier.generation;
+    if (++barrier.waiting == barrier.count) {
+        barrier.waiting = 0;
+        ++barrier.generation;
+        barrier.cv.notify_all();
+        return;
+    }
+    barrier.cv.wait(lock, [&]() { return barrier.generation != generation; });
+}
+
+// Calls worker(d, handle) for the first num devices, each on its own
+// thread, and waits for all of them.
+template<class F>
+static inline void multi_run(const multi_devices_t &devices, int num, const F &worker) {
+    std::vector<std::thread> threads;
+    for (int d = 1; d < num; ++d)
+        threads.push_back(std::thread([&worker, &devices, d]() { worker(d, devices.handles[d]); }));
+    worker(0, devices.handles[0]);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+// First image of part d of N images split into num parts.
+static inline int multi_part_begin(int N, int num, int d) {
+    return (int)((long long)N * d / num);
+}
+
+// Allocates the tensors of a part of the batch and uploads the images of
+// the part from the whole batch on the host, shared tensors are uploaded
+// whole. Tensor 0 is the output and is not uploaded.
+template<class P>
+static inline bm_status_t multi_upload(bm_handle_t handle, P &part, device_tensors_t &tensors, const std::vector<std::vector<float> > &host, const std::vector<bool> &batched, int first_image) {
+    bm_status_t ret = device_tensors_malloc(handle, part, tensors);
+    for (size_t i = 1; i < tensors.lens.size() && ret == BM_SUCCESS; ++i) {
+        if (tensors.lens[i] == 0)
+            continue;
+        const long long offset = batched[i] ? first_image * tensors.lens[i] / part.N : 0;
+        ret = bm_memcpy_s2d(handle, tensors.devs[i], (void *)(host[i].data() + offset));
+    }
+    return ret;
+}
+
+// Runs a case on chip 0 with the whole batch, then on all chips with the
+// batch split, and compares the gathered output with the one of chip 0.
+// Launch times are per launch, the multi-chip ones from the first chip
+// starting to the last one finishing.
+template<class P>
+static inline multi_result_t multi_case(const multi_devices_t &devices, const char *kernel_name, const P &param, int warmup, int iterations) {
+    multi_result_t result;
+    result.devices = std::max(1, std::min((int)devices.handles.size(), param.N));
+    result.single = result.multi = bench_stats_none();
+    result.speedup = result.efficiency = 0;
+    result.pass = false;
+    const int num = result.devices;
+    const std::vector<long long> lens = tensor_lens(param);
+    const std::vector<bool> batched = tensor_batched(param);
+    const unsigned long long seed = golden_seed();
+    std::vector<std::vector<float> > host(lens.size());
+    for (size_t i = 0; i < lens.size(); ++i) {
+        host[i].resize(lens[i]);
+        if (i > 0)
+            random_uniform(host[i].data(), lens[i], -1.f, 1.f, seed, i);
+    }
+    // whole batch on chip 0
+    std::vector<float> single_output(lens[0]);
+    {
+        P whole = param;
+        device_tensors_t tensors;
+        if (multi_upload(devices.handles[0], whole, tensors, host, batched, 0) == BM_SUCCESS) {
+            result.single = bench_launch(devices.handles[0], kernel_name, whole, tune_lookup(kernel_name, whole), warmup, iterations);
+            if (result.single.iterations > 0 && bm_memcpy_d2s(devices.handles[0], single_output.data(), tensors.devs[0]) != BM_SUCCESS)
+                result.single = bench_stats_none();
+        }
+        device_tensors_free(devices.handles[0], tensors);
+    }
+    // split batch on all chips
+    std::vector<P> parts(num, param);
+    std::vector<device_tensors_t> tensors(num);
+    std::vector<int> ok(num, 0);
+    std::vector<double> samples;
+    multi_barrier_t barrier;
+    multi_barrier_init(barrier, num);
+    multi_run(devices, num, [&](int d, bm_handle_t handle) {
+        const int first = multi_part_begin(param.N, num, d);
+        parts[d].N = multi_part_begin(param.N, num, d + 1) - first;
+        ok[d] = multi_upload(handle, parts[d], tensors[d], host, batched, first) == BM_SUCCESS;
+        const tune_t tune = tune_lookup(kernel_name, parts[d]);
+        const unsigned int id = okk_kernel_id(kernel_name);
+        for (int i = 0; i < warmup && ok[d]; ++i)
+            ok[d] = okkernel_launch_tuned_id_sync(handle, id, parts[d], tune) == BM_SUCCESS;
+        // every chip joins every launch so a failure can not deadlock the others
+        for (int i = 0; i < iterations; ++i) {
+            multi_barrier_wait(barrier);
+            const double start_time = bench_now_us();
+            if (ok[d])
+                ok[d] = okkernel_launch_tuned_id_sync(handle, id, parts[d], tune) == BM_SUCCESS;
+            multi_barrier_wait(barrier);
+            if (d == 0)
+                samples.push_back(bench_now_us() - start_time);
+        }
+        if (ok[d])
+            ok[d] = bm_memcpy_d2s(handle, host[0].data() + first * lens[0] / param.N, tensors[d].devs[0]) == BM_SUCCESS;
+        device_tensors_free(handle, tensors[d]);
+    });
+    if (std::count(ok.begin(), ok.end(), 0) > 0)
+        return result;
+    result.multi = bench_stats(samples);
+    if (result.single.iterations == 0)
+        return result;
+    result.speedup = result.single.median / result.multi.median;
+    result.efficiency = result.speedup / num;
+    result.pass = compare_check(host[0].data(), single_output.data(), lens[0], compare_options(1e-6, param.N, 1, 1, lens[0] / param.N));
+    return result;
+}
+#endif
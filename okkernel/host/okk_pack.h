@@ -0,0 +1,181 @@
+#ifndef OKK_PACK_H
+#define OKK_PACK_H
+#include <string.h>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_kernel_id.h"
+////////////////////////////////////////////////////////////////////////
+/// WEIGHT PACKING
+/// Conv weights [OC, IC / group, kernel_h, kernel_w] are uploaded as they
+/// are and packed on the device by the kernel weight_pack, to
+/// [group, DIV_UP(IC / group, lanes), OC / group, kernel_h, kernel_w, lanes]
+/// (see device/ok_device_weight_pack.c). pack_layout_2IC is the layout of
+/// the conv kernels, pack_layout_4N the one of int8 weights, which
+/// weight_pack cannot interleave and is packed on the host.
+/// ////////////////////////////////////////////////////////////////////
+#define PACK_KERNEL_NAME "weight_pack"
+
+typedef struct {
+    int OC, IC, kernel_h, kernel_w;
+    int group;
+    int lanes;
+    // bytes per element, 4 or 1
+    int bytes;
+} pack_layout_t;
+
+// Layout must match param_t in device/ok_device_weight_pack.c.
+typedef struct {
+    pack_layout_t layout;
+    unsigned long long dst_addr;
+    unsigned long long src_addr;
+} __attribute__((packed)) pack_param_t;
+
+static inline pack_layout_t pack_layout_2IC(int OC, int IC, int kernel_h, int kernel_w, int group = 1) {
+    pack_layout_t layout = {OC, IC, kernel_h, kernel_w, group, 2, (int)sizeof(float)};
+    return layout;
+}
+
+static inline pack_layout_t pack_layout_4N(int OC, int IC, int kernel_h, int kernel_w, int group = 1) {
+    pack_layout_t layout = {OC, IC, kernel_h, kernel_w, group, 4, 1};
+    return layout;
+}
+
+// Bytes of the weights as they are uploaded.
+static inline long long pack_src_bytes(const pack_layout_t &layout) {
+    return (long long)layout.OC * (layout.IC / layout.group) * layout.kernel_h * layout.kernel_w * layout.bytes;
+}
+
+// Bytes of the packed weights, with the padding lanes.
+static inline long long pack_dst_bytes(const pack_layout_t &layout) {
+    const int rows = (layout.IC / layout.group + layout.lanes - 1) / layout.lanes;
+    return (long long)layout.group * rows * (layout.OC / layout.group) * layout.kernel_h * layout.kernel_w * layout.lanes * layout.bytes;
+}
+
+// The packing of weight_pack on the host, for offline conversions (see
+// host/okk_weights.h). src and dst have the element size of the layout.
+static inline void pack_weights_host(const pack_layout_t &layout, const void *src, void *dst) {
+    const int group_IC = layout.IC / layout.group, group_OC = layout.OC / layout.group;
+    const int IC_new = (group_IC + layout.lanes - 1) / layout.lanes;
+    const int kernel_len = layout.kernel_h * layout.kernel_w;
+    memset(dst, 0, pack_dst_bytes(layout));
+    for (int oc = 0; oc < layout.OC; ++oc) {
+        const int g = oc / group_OC, group_oc = oc % group_OC;
+        for (int ic = 0; ic < group_IC; ++ic) {
+            for (int k = 0; k < kernel_len; ++k) {
+                const long long dst_index = ((((long long)g * IC_new + ic / layout.lanes) * group_OC + group_oc) * kernel_len + k) * layout.lanes + ic % layout.lanes;
+                const long long src_index = ((long long)oc * group_IC + ic) * kernel_len + k;
+                memcpy((char *)dst + dst_index * layout.bytes, (const char *)src + src_index * layout.bytes, layout.bytes);
+            }
+        }
+    }
+}
+
+// Uploads the weights of src and packs them to dst, which holds
+// pack_dst_bytes(layout). Layouts of 1-byte elements are packed on the host.
+static inline bm_status_t pack_weights(bm_handle_t handle, const pack_layout_t &layout, const void *src, bm_device_mem_t dst) {
+    if (layout.bytes != (int)sizeof(float)) {
+        std::vector<char> packed(pack_dst_bytes(layout));
+        pack_weights_host(layout, src, packed.data());
+        return bm_memcpy_s2d(handle, dst, packed.data());
+    }
+    bm_device_mem_t src_dev;
+    bm_status_t ret = bm_malloc_device_byte(handle, &src_dev, pack_src_bytes(layout));
+    if (ret != BM_SUCCESS) {
+        std::cout << "Failed to allocate " << pack_src_bytes(layout) << " bytes to pack weights" << std::endl;
+        return ret;
+    }
+    ret = bm_memcpy_s2d(handle, src_dev, (void *)src);
+    if (ret == BM_SUCCESS) {
+        static const unsigned int id = okk_kernel_id(PACK_KERNEL_NAME);
+        const pack_param_t param = {layout, bm_mem_get_device_addr(dst), bm_mem_get_device_addr(src_dev)};
+        ret = okkernel_launch_id_sync(handle, id, param);
+    }
+    bm_free_device(handle, src_dev);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// PACKED WEIGHT CACHE
+/// Packed weights on the device keyed by the handle, a weight ID chosen by
+/// the caller and the layout, so the weights of a model are packed once
+/// when it is loaded and later launches only bind the address. The host
+/// buffer is only read on a miss and may be freed after pack_cache_get;
+/// call pack_cache_release when the weights of an ID change. Not
+/// thread-safe, use one cache per thread.
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    bm_handle_t handle;
+    unsigned long long id;
+    pack_layout_t layout;
+} pack_key_t;
+
+struct pack_key_less {
+    bool operator()(const pack_key_t &a, const pack_key_t &b) const {
+        if (a.handle != b.handle)
+            return a.handle < b.handle;
+        if (a.id != b.id)
+            return a.id < b.id;
+        return memcmp(&a.layout, &b.layout, sizeof(pack_layout_t)) < 0;
+    }
+};
+
+typedef struct {
+    std::map<pack_key_t, bm_device_mem_t, pack_key_less> entries;
+    long long hits, misses;
+} pack_cache_t;
+
+static inline void pack_cache_init(pack_cache_t &cache) {
+    cache.entries.clear();
+    cache.hits = cache.misses = 0;
+}
+
+// Device address of the packed weights id, packed from src on the first
+// call.
+static inline bm_status_t pack_cache_get(bm_handle_t handle, pack_cache_t &cache, unsigned long long id, const void *src, const pack_layout_t &layout, unsigned long long &addr) {
+    pack_key_t key;
+    memset(&key, 0, sizeof(key));
+    key.handle = handle;
+    key.id = id;
+    key.layout = layout;
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) {
+        ++cache.hits;
+        addr = bm_mem_get_device_addr(it->second);
+        return BM_SUCCESS;
+    }
+    ++cache.misses;
+    bm_device_mem_t dst;
+    bm_status_t ret = bm_malloc_device_byte(handle, &dst, pack_dst_bytes(layout));
+    if (ret != BM_SUCCESS) {
+        std::cout << "Failed to allocate " << pack_dst_bytes(layout) << " bytes for packed weights" << std::endl;
+        return ret;
+    }
+    ret = pack_weights(handle, layout, src, dst);
+    if (ret != BM_SUCCESS) {
+        bm_free_device(handle, dst);
+        return ret;
+    }
+    cache.entries[key] = dst;
+    addr = bm_mem_get_device_addr(dst);
+    return BM_SUCCESS;
+}
+
+// Frees the packed weights id on a handle, in all layouts.
+static inline void pack_cache_release(bm_handle_t handle, pack_cache_t &cache, unsigned long long id) {
+    for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+        if (it->first.handle == handle && it->first.id == id) {
+            bm_free_device(handle, it->second);
+            it = cache.entries.erase(it);
+        } else
+            ++it;
+    }
+}
+
+static inline void pack_cache_free(pack_cache_t &cache) {
+    for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it)
+        bm_free_device(it->first.handle, it->second);
+    cache.entries.clear();
+}
+#endif
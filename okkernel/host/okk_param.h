@@ -1,5 +1,16 @@
+#ifndef OKK_PARAM_H
+#define OKK_PARAM_H
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <vector>
-#include <fstream>
+#include <iostream>
+#include <string>
 typedef struct {
     int N;
     int C;
@@ -40,22 +51,123 @@ typedef struct {
     int have_bias;
 } __attribute__((packed)) conv_t;
 
+////////////////////////////////////////////////////////////////////////
+/// PARAM FILES
+/// conv.dat and pool.dat are arrays of packed conv_t / pool_t records.
+/// param_map maps a file read-only and exposes the records in place,
+/// param_slice / param_shard take contiguous parts of a span and
+/// param_select the indices of the records matching a predicate.
+/// ////////////////////////////////////////////////////////////////////
 template<class M>
-int read_param(const std::string &dir, std::vector<M> &param) {
-    std::ifstream f(dir, std::ios::binary | std::ios::in);
-    if (!f) {
-        std::cout << "Failed to open " << &dir << std::endl;
-        exit(-1);
+struct param_span_t {
+    const M *data;
+    size_t len;
+    // the mapping, shared by the spans taken from it
+    void *base;
+    size_t map_size;
+    const M *begin() const { return data; }
+    const M *end() const { return data + len; }
+    size_t size() const { return len; }
+    const M &operator[](size_t i) const { return data[i]; }
+};
+
+// Returns -1 if the file can not be mapped or is not an array of M.
+template<class M>
+int param_map(const std::string &path, param_span_t<M> &span) {
+    span.data = nullptr;
+    span.len = 0;
+    span.base = nullptr;
+    span.map_size = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Failed to open " << path << std::endl;
+        return -1;
     }
-    f.seekg(0, std::ios::end);
-    int file_size = f.tellg();
-    int param_len = file_size / (sizeof(M));
-    M buffer;
-    f.seekg(0, std::ios::beg);
-    for (int i = 0; i < param_len; ++i) {
-        f.read(reinterpret_cast<char*>(&buffer), sizeof(M));
-        param.push_back(buffer);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size % sizeof(M) != 0) {
+        std::cout << "Failed to load " << path << ", its size is not a multiple of " << sizeof(M) << " bytes" << std::endl;
+        close(fd);
+        return -1;
     }
-    f.close();
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    // the fields are read as int
+    if (base == MAP_FAILED || (uintptr_t)base % alignof(int) != 0) {
+        std::cout << "Failed to map " << path << std::endl;
+        if (base != MAP_FAILED)
+            munmap(base, st.st_size);
+        return -1;
+    }
+    span.data = (const M *)base;
+    span.len = st.st_size / sizeof(M);
+    span.base = base;
+    span.map_size = st.st_size;
+    return 0;
+}
+
+// Unmaps the file of a span, the spans taken from it become invalid.
+template<class M>
+void param_unmap(param_span_t<M> &span) {
+    if (span.base)
+        munmap(span.base, span.map_size);
+    span.data = nullptr;
+    span.len = 0;
+    span.base = nullptr;
+}
+
+// Records [first, first + count) of a span, clamped to its size.
+template<class M>
+param_span_t<M> param_slice(const param_span_t<M> &span, size_t first, size_t count) {
+    param_span_t<M> slice = span;
+    first = std::min(first, span.len);
+    slice.data = span.data + first;
+    slice.len = std::min(count, span.len - first);
+    return slice;
+}
+
+// The index-th of shard_num contiguous shards of nearly equal size.
+template<class M>
+param_span_t<M> param_shard(const param_span_t<M> &span, int index, int shard_num) {
+    const size_t first = span.len * index / shard_num;
+    const size_t last = span.len * (index + 1) / shard_num;
+    return param_slice(span, first, last - first);
+}
+
+// The shard selected by the environment variable OKK_SHARD=index/shard_num,
+// the whole span if it is not set.
+template<class M>
+param_span_t<M> param_shard_env(const param_span_t<M> &span) {
+    const char *shard = getenv("OKK_SHARD");
+    int index, shard_num;
+    if (!shard || sscanf(shard, "%d/%d", &index, &shard_num) != 2 || shard_num <= 0 || index < 0 || index >= shard_num) {
+        if (shard)
+            std::cout << "Ignore OKK_SHARD=" << shard << ", expected index/shard_num" << std::endl;
+        return span;
+    }
+    return param_shard(span, index, shard_num);
+}
+
+template<class M, class F>
+std::vector<size_t> param_select(const param_span_t<M> &span, const F &pred) {
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < span.len; ++i)
+        if (pred(span[i]))
+            indices.push_back(i);
+    return indices;
+}
+
+// Copies the records of a file to param, exits if it can not be loaded.
+template<class M>
+int read_param(const std::string &dir, std::vector<M> &param) {
+    param_span_t<M> span;
+    if (param_map(dir, span) != 0)
+        exit(-1);
+    param.insert(param.end(), span.begin(), span.end());
+    param_unmap(span);
     return 0;
 }
+#endif
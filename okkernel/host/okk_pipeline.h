@@ -0,0 +1,306 @@
+#ifndef OKK_PIPELINE_H
+#define OKK_PIPELINE_H
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_multi.h"
+#include "okk_random.h"
+////////////////////////////////////////////////////////////////////////
+/// PIPELINE
+/// Layer pipelining over the chips of a box. Consecutive layers form the
+/// stages, stage s runs on chip s % chips on its own thread, and the
+/// output of a stage is copied to an input slot of the next one with
+/// bm_memcpy_c2c, with bm_memcpy_d2d_byte if both are on the same chip,
+/// or through the host if host_copy is set (one chip, or C-Model mode
+/// where the chips are simulated). Each stage has PIPELINE_DEPTH input
+/// slots, so a stage works on micro-batch m while the previous one works
+/// on m + 1 and the next one on m - 1.
+/// ////////////////////////////////////////////////////////////////////
+#define PIPELINE_DEPTH (2)
+
+typedef struct {
+    std::string kernel_name;
+    std::string shape;
+    // device tensors for one micro-batch, in the order of tensor_lens
+    std::vector<long long> lens;
+    // the tensor holding the activation input, the outputs come before it
+    // and the one fed to the next layer is tensor 0
+    int input_index;
+    double flops;
+    // launches the layer on the tensors at addrs
+    std::function<bm_status_t(bm_handle_t, const std::vector<unsigned long long> &)> launch;
+} pipeline_layer_t;
+
+typedef struct {
+    // layers [first, last)
+    int first, last;
+    int device;
+    // tensors of the layers, the activation inputs are not allocated
+    std::vector<std::vector<bm_device_mem_t> > devs;
+    std::vector<std::vector<unsigned long long> > addrs;
+    // input slots of the first layer
+    bm_device_mem_t inputs[PIPELINE_DEPTH];
+    // time spent in launches, in copies and waiting for the neighbours
+    double busy_us, copy_us, wait_us;
+    bool ok;
+} pipeline_stage_t;
+
+typedef struct {
+    std::mutex mutex;
+    std::condition_variable cv;
+    // micro-batches copied into the input slots of the consumer, and
+    // micro-batches whose slot the consumer is done with
+    long long produced, consumed;
+} pipeline_channel_t;
+
+// A layer of a kernel with param.N images per micro-batch, the param is
+// launched with its tuned config.
+template<class P>
+static inline pipeline_layer_t pipeline_layer(const char *kernel_name, const P &param) {
+    pipeline_layer_t layer;
+    layer.kernel_name = kernel_name;
+    layer.shape = shape_str(param);
+    layer.lens = tensor_lens(param);
+    layer.flops = bench_flops(param);
+    // the first batched input that the kernel reads
+    const std::vector<bool> batched = tensor_batched(param);
+    layer.input_index = -1;
+    for (size_t i = tensor_outputs(param); i < layer.lens.size() && layer.input_index < 0; ++i)
+        if (batched[i] && layer.lens[i] > 0)
+            layer.input_index = i;
+    assert(layer.input_index > 0);
+    const unsigned int id = okk_kernel_id(kernel_name);
+    const tune_t tune = tune_lookup(kernel_name, param);
+    layer.launch = [id, param, tune](bm_handle_t handle, const std::vector<unsigned long long> &addrs) {
+        P bound = param;
+        bind_addrs(bound, addrs);
+        return okkernel_launch_tuned_id_sync(handle, id, bound, tune);
+    };
+    return layer;
+}
+
+// Returns -1 if the output of a layer is not the size of the input of the next one.
+static inline int pipeline_check(const std::vector<pipeline_layer_t> &layers) {
+    for (size_t l = 1; l < layers.size(); ++l) {
+        if (layers[l].lens[layers[l].input_index] != layers[l - 1].lens[0]) {
+            std::cout << "Failed to chain layer " << l - 1 << " (" << layers[l - 1].lens[0] << " outputs) to layer "
+                      << l << " (" << layers[l].lens[layers[l].input_index] << " inputs)" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Splits the layers into stages of counts[s] layers, or if counts is
+// empty into num stages of about the same FLOPs. Returns -1 if the counts
+// do not cover the layers.
+static inline int pipeline_partition(const std::vector<pipeline_layer_t> &layers, int num, const std::vector<int> &counts, int chips, std::vector<pipeline_stage_t> &stages) {
+    std::vector<int> bounds(1, 0);
+    if (!counts.empty()) {
+        for (size_t s = 0; s < counts.size(); ++s) {
+            if (counts[s] <= 0)
+                return -1;
+            bounds.push_back(bounds.back() + counts[s]);
+        }
+        if (bounds.back() != (int)layers.size())
+            return -1;
+    } else {
+        num = std::max(1, std::min(num, (int)layers.size()));
+        double total = 0, done = 0;
+        for (size_t l = 0; l < layers.size(); ++l)
+            total += layers[l].flops;
+        for (int l = 0; l < (int)layers.size(); ++l) {
+            const double target = total * bounds.size() / num, flops = layers[l].flops;
+            const int stages_left = num - (int)bounds.size();
+            // close the stage before layer l if that is nearer its share of the
+            // FLOPs than closing it after, or to keep a layer for each later stage
+            if (stages_left > 0 && l > bounds.back() &&
+                ((int)layers.size() - l == stages_left || (done + flops > target && done + flops - target > target - done)))
+                bounds.push_back(l);
+            done += flops;
+        }
+        bounds.push_back(layers.size());
+    }
+    stages.clear();
+    for (size_t s = 0; s + 1 < bounds.size(); ++s) {
+        pipeline_stage_t stage = pipeline_stage_t();
+        stage.first = bounds[s];
+        stage.last = bounds[s + 1];
+        stage.device = s % chips;
+        stage.busy_us = stage.copy_us = stage.wait_us = 0;
+        stage.ok = true;
+        stages.push_back(stage);
+    }
+    return 0;
+}
+
+// Allocates the tensors of a stage and fills the weights of layer l with
+// random values of the streams (l << 8) + i, the same in every partition.
+static inline bm_status_t pipeline_alloc(bm_handle_t handle, const std::vector<pipeline_layer_t> &layers, pipeline_stage_t &stage, unsigned long long seed) {
+    const int count = stage.last - stage.first;
+    stage.devs.assign(count, std::vector<bm_device_mem_t>());
+    stage.addrs.assign(count, std::vector<unsigned long long>());
+    for (int s = 0; s < PIPELINE_DEPTH; ++s)
+        stage.inputs[s].size = 0;
+    for (int j = 0; j < count; ++j) {
+        const pipeline_layer_t &layer = layers[stage.first + j];
+        stage.devs[j].resize(layer.lens.size());
+        stage.addrs[j].assign(layer.lens.size(), 0);
+        for (size_t i = 0; i < layer.lens.size(); ++i) {
+            stage.devs[j][i].size = 0;
+            if (layer.lens[i] == 0 || (int)i == layer.input_index)
+                continue;
+            bm_status_t ret = bm_malloc_device_byte(handle, &stage.devs[j][i], layer.lens[i] * sizeof(float));
+            if (ret != BM_SUCCESS)
+                return ret;
+            stage.addrs[j][i] = bm_mem_get_device_addr(stage.devs[j][i]);
+            if ((int)i < layer.input_index)
+                continue;
+            std::vector<float> weight_host(layer.lens[i]);
+            random_uniform(weight_host.data(), layer.lens[i], -1.f, 1.f, seed, ((stage.first + j) << 8) + i);
+            ret = bm_memcpy_s2d(handle, stage.devs[j][i], weight_host.data());
+            if (ret != BM_SUCCESS)
+                return ret;
+        }
+    }
+    const pipeline_layer_t &first = layers[stage.first];
+    for (int s = 0; s < PIPELINE_DEPTH; ++s) {
+        bm_status_t ret = bm_malloc_device_byte(handle, &stage.inputs[s], first.lens[first.input_index] * sizeof(float));
+        if (ret != BM_SUCCESS) {
+            stage.inputs[s].size = 0;
+            return ret;
+        }
+    }
+    return BM_SUCCESS;
+}
+
+static inline void pipeline_free(bm_handle_t handle, pipeline_stage_t &stage) {
+    for (size_t j = 0; j < stage.devs.size(); ++j)
+        for (size_t i = 0; i < stage.devs[j].size(); ++i)
+            if (stage.devs[j][i].size != 0)
+                bm_free_device(handle, stage.devs[j][i]);
+    for (int s = 0; s < PIPELINE_DEPTH; ++s)
+        if (stage.inputs[s].size != 0)
+            bm_free_device(handle, stage.inputs[s]);
+    stage.devs.clear();
+    stage.addrs.clear();
+}
+
+static inline bm_status_t pipeline_forward(bm_handle_t src_handle, bm_device_mem_t src, bm_handle_t dst_handle, bm_device_mem_t dst, bool host_copy, std::vector<float> &staging) {
+    if (host_copy) {
+        staging.resize(src.size / sizeof(float));
+        bm_status_t ret = bm_memcpy_d2s(src_handle, staging.data(), src);
+        return ret != BM_SUCCESS ? ret : bm_memcpy_s2d(dst_handle, dst, staging.data());
+    }
+    if (src_handle == dst_handle)
+        return bm_memcpy_d2d_byte(src_handle, dst, 0, src, 0, src.size);
+    return bm_memcpy_c2c(src_handle, dst_handle, src, dst, false);
+}
+
+// Runs micro_batches micro-batches through the stages, each allocated
+// on its chip. input holds the activation inputs of the first layer and
+// output receives the outputs of the last one, micro-batch after
+// micro-batch. Returns the wall time in us, or -1 if a stage fails.
+static inline double pipeline_run(const multi_devices_t &devices, const std::vector<pipeline_layer_t> &layers, std::vector<pipeline_stage_t> &stages, const float *input, float *output, int micro_batches, bool host_copy) {
+    const int num = stages.size();
+    const long long input_len = layers.front().lens[layers.front().input_index];
+    const long long output_len = layers.back().lens[0];
+    // channel s feeds stage s + 1
+    std::vector<pipeline_channel_t> channels(num);
+    for (int s = 0; s < num; ++s) {
+        channels[s].produced = channels[s].consumed = 0;
+        stages[s].busy_us = stages[s].copy_us = stages[s].wait_us = 0;
+        stages[s].ok = true;
+    }
+    // a failed stage still releases its neighbours, with no data
+    auto wait_until = [](pipeline_channel_t &channel, const std::function<bool()> &ready) {
+        std::unique_lock<std::mutex> lock(channel.mutex);
+        channel.cv.wait(lock, ready);
+    };
+    auto advance = [](pipeline_channel_t &channel, long long &counter, long long value) {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        counter = value;
+        channel.cv.notify_all();
+    };
+    const double start_time = bench_now_us();
+    std::vector<std::thread> threads;
+    for (int s = 0; s < num; ++s) {
+        threads.push_back(std::thread([&, s]() {
+            pipeline_stage_t &stage = stages[s];
+            bm_handle_t handle = devices.handles[stage.device];
+            std::vector<float> staging;
+            for (long long m = 0; m < micro_batches; ++m) {
+                const int slot = m % PIPELINE_DEPTH;
+                double t = bench_now_us();
+                if (s == 0) {
+                    if (stage.ok)
+                        stage.ok = bm_memcpy_s2d(handle, stage.inputs[slot], (void *)(input + m * input_len)) == BM_SUCCESS;
+                    stage.copy_us += bench_now_us() - t;
+                } else {
+                    pipeline_channel_t &in = channels[s - 1];
+                    wait_until(in, [&]() { return in.produced > m; });
+                    stage.wait_us += bench_now_us() - t;
+                }
+                t = bench_now_us();
+                for (int j = 0; j < stage.last - stage.first && stage.ok; ++j) {
+                    const pipeline_layer_t &layer = layers[stage.first + j];
+                    std::vector<unsigned long long> addrs = stage.addrs[j];
+                    addrs[layer.input_index] = j == 0 ? bm_mem_get_device_addr(stage.inputs[slot]) : stage.addrs[j - 1][0];
+                    stage.ok = layer.launch(handle, addrs) == BM_SUCCESS;
+                }
+                stage.busy_us += bench_now_us() - t;
+                if (s > 0)
+                    advance(channels[s - 1], channels[s - 1].consumed, m + 1);
+                const bm_device_mem_t &result = stage.devs.back()[0];
+                t = bench_now_us();
+                if (s == num - 1) {
+                    if (stage.ok)
+                        stage.ok = bm_memcpy_d2s(handle, output + m * output_len, result) == BM_SUCCESS;
+                    stage.copy_us += bench_now_us() - t;
+                    continue;
+                }
+                // the slot is free once the next stage is done with micro-batch m - PIPELINE_DEPTH
+                pipeline_channel_t &out = channels[s];
+                wait_until(out, [&]() { return out.consumed > m - PIPELINE_DEPTH; });
+                stage.wait_us += bench_now_us() - t;
+                t = bench_now_us();
+                pipeline_stage_t &next = stages[s + 1];
+                if (stage.ok)
+                    stage.ok = pipeline_forward(handle, result, devices.handles[next.device], next.inputs[slot], host_copy, staging) == BM_SUCCESS;
+                stage.copy_us += bench_now_us() - t;
+                advance(out, out.produced, m + 1);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    const double wall_us = bench_now_us() - start_time;
+    for (int s = 0; s < num; ++s)
+        if (!stages[s].ok)
+            return -1;
+    return wall_us;
+}
+
+// Per stage: its layers and chip, the share of the wall time spent in
+// launches (utilization), in copies and waiting. The stage with the
+// highest utilization bounds the throughput, moving layers out of it
+// balances the pipeline.
+static inline void pipeline_print(const std::vector<pipeline_layer_t> &layers, const std::vector<pipeline_stage_t> &stages, double wall_us, int micro_batches) {
+    for (size_t s = 0; s < stages.size(); ++s) {
+        const pipeline_stage_t &stage = stages[s];
+        double flops = 0;
+        for (int l = stage.first; l < stage.last; ++l)
+            flops += layers[l].flops;
+        std::cout << "stage " << s << " chip " << stage.device << " layers [" << stage.first << ", " << stage.last << "): "
+                  << stage.busy_us / micro_batches << " us per micro-batch, utilization " << stage.busy_us / wall_us * 100
+                  << "%, copy " << stage.copy_us / wall_us * 100 << "%, wait " << stage.wait_us / wall_us * 100
+                  << "%, " << flops * 1e-9 << " GFLOP" << std::endl;
+    }
+}
+#endif
@@ -0,0 +1,299 @@
+#ifndef OKK_PROFILE_H
+#define OKK_PROFILE_H
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+////////////////////////////////////////////////////////////////////////
+/// PERF MONITOR RECORDS
+/// The GDMA and TPU (BDC) monitors of BM1684 append one record per
+/// instruction to their buffers, the unused tail of a buffer stays zero.
+/// Only the leading timestamps and instruction id of a record are decoded.
+/// Timestamps are 32-bit cycle counters of the engine clock, counted from
+/// the enabling of the monitor.
+/// ////////////////////////////////////////////////////////////////////
+#define PROFILE_GDMA_RECORD_SIZE (256)
+#define PROFILE_BDC_RECORD_SIZE (32)
+#define PROFILE_GDMA_CLOCK_MHZ (1000.)
+#define PROFILE_BDC_CLOCK_MHZ (550.)
+#define PROFILE_BUFFER_SIZE (4 << 20)
+
+typedef struct {
+    unsigned int inst_start_time;
+    unsigned int inst_end_time;
+    unsigned int inst_id : 16;
+    unsigned int reserved : 16;
+} __attribute__((packed)) profile_record_head_t;
+
+typedef struct {
+    PERF_MONITOR_ID engine;
+    unsigned int inst_id;
+    // relative to the earliest record of the launch
+    double start_us, end_us;
+} profile_event_t;
+
+static inline const char *profile_engine_name(PERF_MONITOR_ID engine) {
+    return engine == PERF_MONITOR_GDMA ? "GDMA" : "BDC";
+}
+
+// Appends the events of a monitor buffer, returns false if the buffer is full.
+static inline bool profile_decode(PERF_MONITOR_ID engine, const unsigned char *buffer, size_t size, std::vector<profile_event_t> &events) {
+    const size_t record_size = engine == PERF_MONITOR_GDMA ? PROFILE_GDMA_RECORD_SIZE : PROFILE_BDC_RECORD_SIZE;
+    const double clock_mhz = engine == PERF_MONITOR_GDMA ? PROFILE_GDMA_CLOCK_MHZ : PROFILE_BDC_CLOCK_MHZ;
+    unsigned long long wraps = 0;
+    unsigned int last = 0;
+    for (size_t offset = 0; offset + record_size <= size; offset += record_size) {
+        profile_record_head_t head;
+        memcpy(&head, buffer + offset, sizeof(head));
+        if (head.inst_start_time == 0 && head.inst_end_time == 0)
+            return true;
+        // the counters wrap in a few seconds, records are in issue order
+        if (head.inst_start_time < last)
+            wraps += 1ULL << 32;
+        last = head.inst_start_time;
+        unsigned long long start = wraps + head.inst_start_time;
+        unsigned long long end = wraps + head.inst_end_time;
+        if (head.inst_end_time < head.inst_start_time)
+            end += 1ULL << 32;
+        profile_event_t event = {engine, head.inst_id, start / clock_mhz, end / clock_mhz};
+        events.push_back(event);
+    }
+    return false;
+}
+
+static inline void profile_rebase(std::vector<profile_event_t> &events) {
+    if (events.empty())
+        return;
+    double origin = events[0].start_us;
+    for (size_t i = 1; i < events.size(); ++i)
+        origin = std::min(origin, events[i].start_us);
+    for (size_t i = 0; i < events.size(); ++i) {
+        events[i].start_us -= origin;
+        events[i].end_us -= origin;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CAPTURE
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    bm_device_mem_t bufs[2];
+    bm_perf_monitor_t monitors[2];
+} profile_session_t;
+
+static inline bm_status_t profile_begin(bm_handle_t handle, profile_session_t &session) {
+    const PERF_MONITOR_ID engines[2] = {PERF_MONITOR_GDMA, PERF_MONITOR_TPU};
+    for (int i = 0; i < 2; ++i) {
+        bm_status_t ret = bm_malloc_device_byte(handle, &session.bufs[i], PROFILE_BUFFER_SIZE);
+        if (ret == BM_SUCCESS)
+            ret = bm_memset_device(handle, 0, session.bufs[i]);
+        if (ret != BM_SUCCESS) {
+            for (int j = 0; j <= i; ++j)
+                bm_free_device(handle, session.bufs[j]);
+            return ret;
+        }
+        session.monitors[i].buffer_start_addr = bm_mem_get_device_addr(session.bufs[i]);
+        session.monitors[i].buffer_size = PROFILE_BUFFER_SIZE;
+        session.monitors[i].monitor_id = engines[i];
+    }
+    for (int i = 0; i < 2; ++i) {
+        bm_status_t ret = bm_enable_perf_monitor(handle, &session.monitors[i]);
+        if (ret != BM_SUCCESS) {
+            for (int j = 0; j < i; ++j)
+                bm_disable_perf_monitor(handle, &session.monitors[j]);
+            for (int j = 0; j < 2; ++j)
+                bm_free_device(handle, session.bufs[j]);
+            return ret;
+        }
+    }
+    return BM_SUCCESS;
+}
+
+static inline bm_status_t profile_end(bm_handle_t handle, profile_session_t &session, std::vector<profile_event_t> &events) {
+    bm_status_t res = BM_SUCCESS;
+    for (int i = 0; i < 2; ++i) {
+        bm_status_t ret = bm_disable_perf_monitor(handle, &session.monitors[i]);
+        if (ret != BM_SUCCESS)
+            res = ret;
+    }
+    std::vector<unsigned char> buffer(PROFILE_BUFFER_SIZE);
+    for (int i = 0; i < 2 && res == BM_SUCCESS; ++i) {
+        res = bm_memcpy_d2s(handle, buffer.data(), session.bufs[i]);
+        if (res == BM_SUCCESS && !profile_decode(session.monitors[i].monitor_id, buffer.data(), buffer.size(), events))
+            std::cerr << "perf buffer of " << profile_engine_name(session.monitors[i].monitor_id) << " is full, the trace is truncated" << std::endl;
+    }
+    for (int i = 0; i < 2; ++i)
+        bm_free_device(handle, session.bufs[i]);
+    profile_rebase(events);
+    return res;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// SYNTHETIC RECORDS
+/// The cmodel has no perf monitor. The workload of a case is split into
+/// tiles of half the local memory, loaded and computed in the ping-pong
+/// order of okk_parallel_start() at nominal BM1684 rates, so that the
+/// trace tooling can be exercised off the board.
+/// ////////////////////////////////////////////////////////////////////
+#define PROFILE_SYNTHETIC_TILE_BYTES (64 * 256 * 1024)
+#define PROFILE_SYNTHETIC_GDMA_BYTES_PER_US (16e3)
+#define PROFILE_SYNTHETIC_BDC_FLOPS_PER_US (2.2e6)
+
+template<class P>
+static inline void profile_synthesize(const P &param, std::vector<profile_event_t> &events) {
+    const double bytes = bench_bytes(param), flops = bench_flops(param);
+    const int tiles = std::max(1, (int)ceil(bytes / PROFILE_SYNTHETIC_TILE_BYTES));
+    const double load_us = bytes / tiles / PROFILE_SYNTHETIC_GDMA_BYTES_PER_US;
+    const double compute_us = flops / tiles / PROFILE_SYNTHETIC_BDC_FLOPS_PER_US;
+    std::vector<double> compute_ends;
+    double load_end = 0, compute_end = 0;
+    for (int i = 0; i < tiles; ++i) {
+        // tile i reuses the buffer of tile i - 2 once it has been computed
+        double load_start = i < 2 ? load_end : std::max(load_end, compute_ends[i - 2]);
+        profile_event_t load = {PERF_MONITOR_GDMA, (unsigned int)i, load_start, load_start + load_us};
+        load_end = load.end_us;
+        double compute_start = std::max(load_end, compute_end);
+        profile_event_t compute = {PERF_MONITOR_TPU, (unsigned int)i, compute_start, compute_start + compute_us};
+        compute_end = compute.end_us;
+        compute_ends.push_back(compute_end);
+        events.push_back(load);
+        events.push_back(compute);
+    }
+}
+
+// Launches a kernel once with the monitors enabled.
+template<class P>
+static inline bm_status_t profile_launch(bm_handle_t handle, const char *kernel_name, const P &param, const tune_t &tune, std::vector<profile_event_t> &events) {
+#ifdef USING_CMODEL
+    bm_status_t ret = okkernel_launch_tuned_sync(handle, kernel_name, param, tune);
+    if (ret == BM_SUCCESS)
+        profile_synthesize(param, events);
+    return ret;
+#else
+    profile_session_t session;
+    bm_status_t ret = profile_begin(handle, session);
+    if (ret != BM_SUCCESS)
+        return ret;
+    ret = okkernel_launch_tuned_sync(handle, kernel_name, param, tune);
+    bm_status_t end_ret = profile_end(handle, session, events);
+    return ret != BM_SUCCESS ? ret : end_ret;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////
+/// OVERLAP
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    double span_us;
+    double gdma_busy_us;
+    double bdc_busy_us;
+    // time both engines are busy
+    double overlap_us;
+} profile_summary_t;
+
+static inline std::vector<std::pair<double, double> > profile_busy(const std::vector<profile_event_t> &events, PERF_MONITOR_ID engine) {
+    std::vector<std::pair<double, double> > intervals, merged;
+    for (size_t i = 0; i < events.size(); ++i)
+        if (events[i].engine == engine)
+            intervals.push_back(std::make_pair(events[i].start_us, events[i].end_us));
+    std::sort(intervals.begin(), intervals.end());
+    for (size_t i = 0; i < intervals.size(); ++i) {
+        if (!merged.empty() && intervals[i].first <= merged.back().second)
+            merged.back().second = std::max(merged.back().second, intervals[i].second);
+        else
+            merged.push_back(intervals[i]);
+    }
+    return merged;
+}
+
+static inline profile_summary_t profile_summarize(const std::vector<profile_event_t> &events) {
+    profile_summary_t summary = {0, 0, 0, 0};
+    std::vector<std::pair<double, double> > gdma = profile_busy(events, PERF_MONITOR_GDMA);
+    std::vector<std::pair<double, double> > bdc = profile_busy(events, PERF_MONITOR_TPU);
+    for (size_t i = 0; i < gdma.size(); ++i)
+        summary.gdma_busy_us += gdma[i].second - gdma[i].first;
+    for (size_t i = 0; i < bdc.size(); ++i)
+        summary.bdc_busy_us += bdc[i].second - bdc[i].first;
+    for (size_t i = 0, j = 0; i < gdma.size() && j < bdc.size();) {
+        double start = std::max(gdma[i].first, bdc[j].first);
+        double end = std::min(gdma[i].second, bdc[j].second);
+        if (end > start)
+            summary.overlap_us += end - start;
+        if (gdma[i].second < bdc[j].second)
+            ++i;
+        else
+            ++j;
+    }
+    for (size_t i = 0; i < events.size(); ++i)
+        summary.span_us = std::max(summary.span_us, events[i].end_us);
+    return summary;
+}
+
+static inline void profile_print(const profile_summary_t &summary) {
+    std::cerr << "  span: " << summary.span_us << "(us) GDMA busy: " << summary.gdma_busy_us
+              << "(us) BDC busy: " << summary.bdc_busy_us << "(us) overlap: " << summary.overlap_us << "(us)";
+    if (summary.gdma_busy_us > 0)
+        std::cerr << ", " << 100. * summary.overlap_us / summary.gdma_busy_us << "% of GDMA hidden";
+    std::cerr << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CHROME TRACE
+/// One process per profiled case, one thread per engine, loadable by
+/// chrome://tracing and Perfetto.
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    std::vector<std::string> names;
+    std::vector<std::vector<profile_event_t> > events;
+} profile_trace_t;
+
+template<class P>
+static inline void profile_case(bm_handle_t handle, const char *kernel_name, int case_index, P param, profile_trace_t &trace) {
+    device_tensors_t tensors;
+    std::vector<profile_event_t> events;
+    bm_status_t ret = device_tensors_alloc(handle, param, tensors);
+    if (ret == BM_SUCCESS)
+        ret = profile_launch(handle, kernel_name, param, tune_lookup(kernel_name, param), events);
+    device_tensors_free(handle, tensors);
+    if (ret != BM_SUCCESS) {
+        std::cerr << "Failed to profile " << kernel_name << " case " << case_index << std::endl;
+        return;
+    }
+    profile_print(profile_summarize(events));
+    trace.names.push_back(std::string(kernel_name) + "/" + std::to_string(case_index));
+    trace.events.push_back(events);
+}
+
+static inline int profile_trace_write(const std::string &path, const profile_trace_t &trace) {
+    std::ofstream f(path, std::ios::out | std::ios::trunc);
+    if (!f) {
+        std::cout << "Failed to create file " << path << std::endl;
+        return -1;
+    }
+    f << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl;
+    bool first = true;
+    for (size_t pid = 0; pid < trace.names.size(); ++pid) {
+        f << (first ? "" : ",\n") << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+          << ", \"args\": {\"name\": \"" << bench_json_escape(trace.names[pid]) << "\"}}";
+        first = false;
+        for (int tid = 0; tid < 2; ++tid)
+            f << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << tid
+              << ", \"args\": {\"name\": \"" << profile_engine_name((PERF_MONITOR_ID)tid) << "\"}}";
+        const std::vector<profile_event_t> &events = trace.events[pid];
+        for (size_t i = 0; i < events.size(); ++i) {
+            const profile_event_t &e = events[i];
+            f << ",\n{\"name\": \"" << profile_engine_name(e.engine) << " " << e.inst_id << "\", \"cat\": \""
+              << profile_engine_name(e.engine) << "\", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << (int)e.engine
+              << ", \"ts\": " << e.start_us << ", \"dur\": " << e.end_us - e.start_us
+              << ", \"args\": {\"inst_id\": " << e.inst_id << "}}";
+        }
+    }
+    f << std::endl << "]}" << std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,104 @@
+#ifndef OKK_RANDOM_H
+#define OKK_RANDOM_H
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include "okk_thread.h"
+////////////////////////////////////////////////////////////////////////
+/// RANDOM
+/// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as
+/// 1, 2, 3"). Element i of a tensor is a function of (seed, stream, i)
+/// only, so the tensor can be filled by any number of threads, in any
+/// order, with the same values. Different streams of a seed are
+/// independent, each tensor of a case takes its own stream.
+/// ////////////////////////////////////////////////////////////////////
+#define RANDOM_PHILOX_M0 (0xD2511F53U)
+#define RANDOM_PHILOX_M1 (0xCD9E8D57U)
+#define RANDOM_PHILOX_W0 (0x9E3779B9U)
+#define RANDOM_PHILOX_W1 (0xBB67AE85U)
+#define RANDOM_PHILOX_ROUNDS (10)
+// counters per batch, the rounds of a batch are vectorized across counters
+#define RANDOM_BATCH (64)
+// elements per task of random_uniform
+#define RANDOM_TASK_LEN (1 << 16)
+
+// 4 * RANDOM_BATCH random words of the counters {c0 + j, c1, stream, 0},
+// stored in out[4 * j .. 4 * j + 3].
+static inline void random_philox_batch(uint32_t *out, uint64_t seed, uint32_t stream, uint64_t counter) {
+    uint32_t x0[RANDOM_BATCH], x1[RANDOM_BATCH], x2[RANDOM_BATCH], x3[RANDOM_BATCH];
+    for (int j = 0; j < RANDOM_BATCH; ++j) {
+        const uint64_t c = counter + j;
+        x0[j] = (uint32_t)c;
+        x1[j] = (uint32_t)(c >> 32);
+        x2[j] = stream;
+        x3[j] = 0;
+    }
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    for (int r = 0; r < RANDOM_PHILOX_ROUNDS; ++r) {
+        for (int j = 0; j < RANDOM_BATCH; ++j) {
+            const uint64_t p0 = (uint64_t)RANDOM_PHILOX_M0 * x0[j];
+            const uint64_t p1 = (uint64_t)RANDOM_PHILOX_M1 * x2[j];
+            const uint32_t y0 = (uint32_t)(p1 >> 32) ^ x1[j] ^ k0;
+            const uint32_t y1 = (uint32_t)p1;
+            const uint32_t y2 = (uint32_t)(p0 >> 32) ^ x3[j] ^ k1;
+            const uint32_t y3 = (uint32_t)p0;
+            x0[j] = y0;
+            x1[j] = y1;
+            x2[j] = y2;
+            x3[j] = y3;
+        }
+        k0 += RANDOM_PHILOX_W0;
+        k1 += RANDOM_PHILOX_W1;
+    }
+    for (int j = 0; j < RANDOM_BATCH; ++j) {
+        out[4 * j] = x0[j];
+        out[4 * j + 1] = x1[j];
+        out[4 * j + 2] = x2[j];
+        out[4 * j + 3] = x3[j];
+    }
+}
+
+// Fills data[begin, end) of a tensor with values uniform in [lo, hi).
+static inline void random_uniform_range(float *data, long long begin, long long end, float lo, float hi, uint64_t seed, uint32_t stream) {
+    const int batch_len = 4 * RANDOM_BATCH;
+    uint32_t words[4 * RANDOM_BATCH];
+    // lo + (hi - lo) * u may round up to hi
+    const float max = std::nextafter(hi, lo);
+    long long i = begin - begin % batch_len;
+    for (; i < end; i += batch_len) {
+        random_philox_batch(words, seed, stream, (uint64_t)i / 4);
+        const long long first = std::max(i, begin), last = std::min(i + batch_len, end);
+        for (long long j = first; j < last; ++j) {
+            // the top 24 bits, exact in float
+            const float u = (float)(words[j - i] >> 8) * (1.f / 16777216.f);
+            data[j] = std::min(lo + (hi - lo) * u, max);
+        }
+    }
+}
+
+// Fills data[0, len) with values uniform in [lo, hi), in parallel.
+static inline void random_uniform(float *data, long long len, float lo, float hi, uint64_t seed, uint32_t stream) {
+    const long long tasks = (len + RANDOM_TASK_LEN - 1) / RANDOM_TASK_LEN;
+    parallel_for(tasks, [&](long long task) {
+        const long long begin = task * RANDOM_TASK_LEN;
+        random_uniform_range(data, begin, std::min(begin + RANDOM_TASK_LEN, len), lo, hi, seed, stream);
+    });
+}
+
+// Fills data[0, len) with uniform bytes, the top 8 bits of the words of
+// random_uniform, in parallel.
+static inline void random_bytes(unsigned char *data, long long len, uint64_t seed, uint32_t stream) {
+    const long long tasks = (len + RANDOM_TASK_LEN - 1) / RANDOM_TASK_LEN;
+    parallel_for(tasks, [&](long long task) {
+        const int batch_len = 4 * RANDOM_BATCH;
+        uint32_t words[4 * RANDOM_BATCH];
+        const long long begin = task * RANDOM_TASK_LEN, end = std::min(begin + RANDOM_TASK_LEN, len);
+        // RANDOM_TASK_LEN is a multiple of batch_len
+        for (long long i = begin; i < end; i += batch_len) {
+            random_philox_batch(words, seed, stream, (uint64_t)i / 4);
+            for (long long j = i; j < std::min(i + batch_len, end); ++j)
+                data[j] = words[j - i] >> 24;
+        }
+    });
+}
+#endif
@@ -0,0 +1,432 @@
+#ifndef OKK_REFERENCE_H
+#define OKK_REFERENCE_H
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "okk_cases.h"
+#include "okk_thread.h"
+////////////////////////////////////////////////////////////////////////
+/// HOST REFERENCES
+/// Multithreaded and cache blocked. Every output element is accumulated in
+/// the same order as the plain loops (kh, kw, then ic innermost for conv2d,
+/// k for matmul), so the results match them up to the sign of zeros. The
+/// innermost loops run over contiguous outputs and are vectorized by the
+/// compiler.
+/// ////////////////////////////////////////////////////////////////////
+#define REFERENCE_BLOCK_M (64)
+#define REFERENCE_BLOCK_N (256)
+#define REFERENCE_BLOCK_K (256)
+
+// C[M x N] (+)= A[M x K] * B[K x N], row major with leading dimensions.
+// Four rows of C are updated per pass over a row of B.
+static inline void reference_gemm_block(float *C, int ldc, const float *A, int lda, const float *B, int ldb, int M, int N, int K, bool accumulate) {
+    if (!accumulate)
+        for (int m = 0; m < M; ++m)
+            memset(C + (long long)m * ldc, 0, N * sizeof(float));
+    if (N < 8) {
+        // too narrow to vectorize over n, a dot product per element
+        for (int m = 0; m < M; ++m)
+            for (int n = 0; n < N; ++n) {
+                float acc = C[(long long)m * ldc + n];
+                for (int k = 0; k < K; ++k)
+                    acc += A[(long long)m * lda + k] * B[(long long)k * ldb + n];
+                C[(long long)m * ldc + n] = acc;
+            }
+        return;
+    }
+    int m = 0;
+    for (; m + 4 <= M; m += 4) {
+        float *__restrict__ c0 = C + (long long)m * ldc;
+        float *__restrict__ c1 = c0 + ldc;
+        float *__restrict__ c2 = c1 + ldc;
+        float *__restrict__ c3 = c2 + ldc;
+        const float *a = A + (long long)m * lda;
+        for (int k = 0; k < K; ++k) {
+            const float a0 = a[k], a1 = a[lda + k], a2 = a[2 * lda + k], a3 = a[3 * lda + k];
+            const float *__restrict__ b = B + (long long)k * ldb;
+            for (int n = 0; n < N; ++n) {
+                c0[n] += a0 * b[n];
+                c1[n] += a1 * b[n];
+                c2[n] += a2 * b[n];
+                c3[n] += a3 * b[n];
+            }
+        }
+    }
+    for (; m < M; ++m) {
+        float *__restrict__ c = C + (long long)m * ldc;
+        for (int k = 0; k < K; ++k) {
+            const float a = A[(long long)m * lda + k];
+            const float *__restrict__ b = B + (long long)k * ldb;
+            for (int n = 0; n < N; ++n)
+                c[n] += a * b[n];
+        }
+    }
+}
+
+// C[M x N] = A[M x K] * B[K x N], row major and contiguous.
+static inline void reference_gemm(float *C, const float *A, const float *B, int M, int N, int K) {
+    const int blocks_m = (M + REFERENCE_BLOCK_M - 1) / REFERENCE_BLOCK_M;
+    const int blocks_n = (N + REFERENCE_BLOCK_N - 1) / REFERENCE_BLOCK_N;
+    parallel_for((long long)blocks_m * blocks_n, [&](long long task) {
+        const int m0 = task / blocks_n * REFERENCE_BLOCK_M, n0 = task % blocks_n * REFERENCE_BLOCK_N;
+        const int bm = std::min(REFERENCE_BLOCK_M, M - m0), bn = std::min(REFERENCE_BLOCK_N, N - n0);
+        float *c = C + (long long)m0 * N + n0;
+        if (K == 0)
+            reference_gemm_block(c, N, A, K, B, N, bm, bn, 0, false);
+        for (int k0 = 0; k0 < K; k0 += REFERENCE_BLOCK_K)
+            reference_gemm_block(c, N, A + (long long)m0 * K + k0, K, B + (long long)k0 * N + n0, N,
+                                 bm, bn, std::min(REFERENCE_BLOCK_K, K - k0), k0 > 0);
+    });
+}
+
+static inline void matmul_reference(float *output, const float *left, const float *right, const matmul_param_t &param) {
+    reference_gemm(output, left, right, param.left_rows, param.right_cols, param.left_cols);
+}
+
+// im2col over a block of output positions and reduction indices of IC
+// input channels, k is (kh * kernel_w + kw) * IC + ic, taps in the padding
+// are 0.
+template<class P>
+static inline void conv2d_im2col_block(float *col, const float *input, const P &param, int IC, int output_w, int p0, int bp, int k0, int bk) {
+    for (int k = k0; k < k0 + bk; ++k) {
+        const int ic = k % IC, kw = k / IC % param.kernel_w, kh = k / IC / param.kernel_w;
+        const float *plane = input + (long long)ic * param.H * param.W;
+        float *row = col + (long long)(k - k0) * bp;
+        int oh = p0 / output_w, ow = p0 % output_w;
+        for (int p = 0; p < bp; ++p) {
+            const int ih = oh * param.stride_h + kh * param.dilation_h - param.pad_top;
+            const int iw = ow * param.stride_w + kw * param.dilation_w - param.pad_left;
+            row[p] = ih >= 0 && ih < param.H && iw >= 0 && iw < param.W ? plane[(long long)ih * param.W + iw] : 0.f;
+            if (++ow == output_w) {
+                ow = 0;
+                ++oh;
+            }
+        }
+    }
+}
+
+// Convolution of group independent slices of the channels, kernel is
+// [OC, IC / group, kh, kw].
+template<class P>
+static inline void conv2d_reference_groups(float *output, const float *input, const float *kernel, const P &param, int group, int output_h, int output_w) {
+    const int P_len = output_h * output_w;
+    const int IC = param.IC / group, OC = param.OC / group;
+    const int K = IC * param.kernel_h * param.kernel_w;
+    // kernel [OC, IC, kh, kw] to [OC, K]
+    std::vector<float> weight((long long)param.OC * K);
+    for (int oc = 0; oc < param.OC; ++oc)
+        for (int ic = 0; ic < IC; ++ic)
+            for (int kh = 0; kh < param.kernel_h; ++kh)
+                for (int kw = 0; kw < param.kernel_w; ++kw)
+                    weight[(long long)oc * K + (kh * param.kernel_w + kw) * IC + ic] =
+                        kernel[(((long long)oc * IC + ic) * param.kernel_h + kh) * param.kernel_w + kw];
+    // one task per (n, group, block of output channels, block of output positions)
+    const int blocks_oc = (OC + REFERENCE_BLOCK_M - 1) / REFERENCE_BLOCK_M;
+    const int blocks_p = (P_len + REFERENCE_BLOCK_N - 1) / REFERENCE_BLOCK_N;
+    parallel_for((long long)param.N * group * blocks_oc * blocks_p, [&](long long task) {
+        const long long image = task / ((long long)blocks_oc * blocks_p);
+        const int n = image / group, g = image % group;
+        const int oc0 = g * OC + task / blocks_p % blocks_oc * REFERENCE_BLOCK_M, p0 = task % blocks_p * REFERENCE_BLOCK_N;
+        const int boc = std::min(REFERENCE_BLOCK_M, (g + 1) * OC - oc0), bp = std::min(REFERENCE_BLOCK_N, P_len - p0);
+        const float *in = input + ((long long)n * param.IC + g * IC) * param.H * param.W;
+        float *out = output + ((long long)n * param.OC + oc0) * P_len + p0;
+        std::vector<float> col((long long)REFERENCE_BLOCK_K * bp);
+        if (K == 0)
+            reference_gemm_block(out, P_len, weight.data(), K, col.data(), bp, boc, bp, 0, false);
+        for (int k0 = 0; k0 < K; k0 += REFERENCE_BLOCK_K) {
+            const int bk = std::min(REFERENCE_BLOCK_K, K - k0);
+            conv2d_im2col_block(col.data(), in, param, IC, output_w, p0, bp, k0, bk);
+            reference_gemm_block(out, P_len, weight.data() + (long long)oc0 * K + k0, K, col.data(), bp, boc, bp, bk, k0 > 0);
+        }
+    });
+}
+
+static inline void conv2d_reference(float *output, const float *input, const float *kernel, const conv2d_param_t &param) {
+    int output_h, output_w;
+    conv2d_output_hw(param, output_h, output_w);
+    conv2d_reference_groups(output, input, kernel, param, 1, output_h, output_w);
+}
+
+// kernel is [OC, IC / group, kh, kw], the bias [OC] is added to the sums
+// if param.using_bias.
+static inline void conv2d_group_reference(float *output, const float *input, const float *kernel, const float *bias, const conv2d_group_param_t &param) {
+    int output_h, output_w;
+    conv2d_group_output_hw(param, output_h, output_w);
+    conv2d_reference_groups(output, input, kernel, param, param.group, output_h, output_w);
+    if (!param.using_bias)
+        return;
+    const long long P_len = (long long)output_h * output_w;
+    parallel_for((long long)param.N * param.OC, [&](long long task) {
+        const float b = bias[task % param.OC];
+        float *__restrict__ out = output + task * P_len;
+        for (long long p = 0; p < P_len; ++p)
+            out[p] += b;
+    });
+}
+
+// One task per (n, c) plane, each output row is accumulated tap by tap
+// over the range of columns whose input is not in the padding.
+static inline void depthwise_reference(float *output, const float *input, const float *kernel, const depthwise_param_t &param) {
+    int output_h, output_w;
+    depthwise_output_hw(param, output_h, output_w);
+    parallel_for((long long)param.N * param.C, [&](long long task) {
+        const int c = task % param.C;
+        const float *plane = input + task * param.H * param.W;
+        const float *k = kernel + (long long)c * param.kernel_h * param.kernel_w;
+        for (int oh = 0; oh < output_h; ++oh) {
+            float *__restrict__ out = output + (task * output_h + oh) * output_w;
+            memset(out, 0, output_w * sizeof(float));
+            for (int kh = 0; kh < param.kernel_h; ++kh) {
+                const int ih = oh * param.stride_h + kh * param.dilation_h - param.pad_top;
+                if (ih < 0 || ih >= param.H)
+                    continue;
+                const float *__restrict__ row = plane + (long long)ih * param.W;
+                for (int kw = 0; kw < param.kernel_w; ++kw) {
+                    const float kval = k[kh * param.kernel_w + kw];
+                    // ow such that 0 <= ow * stride_w + offset < W
+                    const int offset = kw * param.dilation_w - param.pad_left;
+                    const int ow_begin = offset >= 0 ? 0 : (-offset + param.stride_w - 1) / param.stride_w;
+                    const int ow_end = std::min(output_w, param.W - offset <= 0 ? 0 : (param.W - offset - 1) / param.stride_w + 1);
+                    if (param.stride_w == 1) {
+                        for (int ow = ow_begin; ow < ow_end; ++ow)
+                            out[ow] += row[ow + offset] * kval;
+                    } else {
+                        for (int ow = ow_begin; ow < ow_end; ++ow)
+                            out[ow] += row[ow * param.stride_w + offset] * kval;
+                    }
+                }
+            }
+        }
+    });
+}
+
+// One task per (n, c) plane, the window of each output clipped to the
+// input, padding never wins.
+static inline void max_pool_reference(float *output, const float *input, const max_pool_param_t &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    parallel_for((long long)param.N * param.C, [&](long long task) {
+        const float *plane = input + task * param.H * param.W;
+        float *__restrict__ out = output + task * output_h * output_w;
+        for (int oh = 0; oh < output_h; ++oh) {
+            const int h0 = oh * param.stride_h - param.pad_top;
+            const int h_begin = std::max(h0, 0), h_end = std::min(h0 + param.kernel_h, param.H);
+            for (int ow = 0; ow < output_w; ++ow) {
+                const int w0 = ow * param.stride_w - param.pad_left;
+                const int w_begin = std::max(w0, 0), w_end = std::min(w0 + param.kernel_w, param.W);
+                float m = -INFINITY;
+                for (int h = h_begin; h < h_end; ++h)
+                    for (int w = w_begin; w < w_end; ++w)
+                        m = std::max(m, plane[h * param.W + w]);
+                out[oh * output_w + ow] = m;
+            }
+        }
+    });
+}
+
+// One task per (n, c) plane, the sum of the window clipped to the input
+// over its size, with the padding if count_include_pad (up to the padded
+// input in ceil mode).
+static inline void avg_pool_reference(float *output, const float *input, const avg_pool_param_t &param) {
+    int output_h, output_w;
+    pool_output_hw(param, output_h, output_w);
+    parallel_for((long long)param.N * param.C, [&](long long task) {
+        const float *plane = input + task * param.H * param.W;
+        float *__restrict__ out = output + task * output_h * output_w;
+        for (int oh = 0; oh < output_h; ++oh) {
+            const int h0 = oh * param.stride_h - param.pad_top;
+            const int h1 = std::min(h0 + param.kernel_h, param.H + param.pad_bottom);
+            const int h_begin = std::max(h0, 0), h_end = std::min(h1, param.H);
+            for (int ow = 0; ow < output_w; ++ow) {
+                const int w0 = ow * param.stride_w - param.pad_left;
+                const int w1 = std::min(w0 + param.kernel_w, param.W + param.pad_right);
+                const int w_begin = std::max(w0, 0), w_end = std::min(w1, param.W);
+                float sum = 0;
+                for (int h = h_begin; h < h_end; ++h)
+                    for (int w = w_begin; w < w_end; ++w)
+                        sum += plane[h * param.W + w];
+                const int count = param.count_include_pad ? (h1 - h0) * (w1 - w0) : (h_end - h_begin) * (w_end - w_begin);
+                out[oh * output_w + ow] = sum / count;
+            }
+        }
+    });
+}
+
+// One task per (n, c) plane, each output row reads every C-th byte of an
+// input row of pitch bytes.
+static inline void preprocess_reference(float *output, const unsigned char *input, const preprocess_param_t &param) {
+    const long long pitch = param.pitch > 0 ? param.pitch : (long long)param.W * param.C;
+    parallel_for((long long)param.N * param.C, [&](long long task) {
+        const int n = task / param.C, c = task % param.C;
+        const int x = param.reverse_channels ? param.C - 1 - c : c;
+        const float scale = param.scale[c], bias = -param.mean[c] * scale;
+        const unsigned char *image = input + n * param.H * pitch;
+        for (int h = 0; h < param.H; ++h) {
+            float *__restrict__ out = output + (task * param.H + h) * param.W;
+            const unsigned char *__restrict__ row = image + h * pitch + x;
+            for (int w = 0; w < param.W; ++w)
+                out[w] = row[w * param.C] * scale + bias;
+        }
+    });
+}
+
+// One task per row, the K largest values by a partial sort of the columns
+// (ties by column), the softmax over the row from its max.
+static inline void topk_reference(float *output, int *index, const float *input, const topk_param_t &param) {
+    parallel_for(param.N, [&](long long n) {
+        const float *row = input + n * param.C;
+        std::vector<int> order(param.C);
+        for (int c = 0; c < param.C; ++c)
+            order[c] = c;
+        std::partial_sort(order.begin(), order.begin() + param.K, order.end(), [&](int a, int b) {
+            return row[a] > row[b] || (row[a] == row[b] && a < b);
+        });
+        float scale = 1.f;
+        if (param.softmax) {
+            double sum = 0;
+            for (int c = 0; c < param.C; ++c)
+                sum += std::exp((double)row[c] - row[order[0]]);
+            scale = 1 / sum;
+        }
+        for (int k = 0; k < param.K; ++k) {
+            const float x = row[order[k]];
+            output[n * param.K + k] = param.softmax ? std::exp(x - row[order[0]]) * scale : x;
+            index[n * param.K + k] = order[k];
+        }
+    });
+}
+
+// One task per bag, the rows copied or accumulated in lookup order.
+static inline void embedding_reference(float *output, const int *index, const float *table, const embedding_param_t &param) {
+    parallel_for(param.batch, [&](long long b) {
+        const int *bag = index + b * param.bag;
+        if (param.pooling == EMBEDDING_NONE) {
+            for (int l = 0; l < param.bag; ++l) {
+                float *out = output + (b * param.bag + l) * param.dim;
+                if (bag[l] >= 0 && bag[l] < param.rows)
+                    memcpy(out, table + (long long)bag[l] * param.dim, param.dim * sizeof(float));
+                else
+                    memset(out, 0, param.dim * sizeof(float));
+            }
+            return;
+        }
+        float *__restrict__ out = output + b * param.dim;
+        memset(out, 0, param.dim * sizeof(float));
+        int count = 0;
+        for (int l = 0; l < param.bag; ++l) {
+            if (bag[l] < 0 || bag[l] >= param.rows)
+                continue;
+            const float *__restrict__ row = table + (long long)bag[l] * param.dim;
+            for (int d = 0; d < param.dim; ++d)
+                out[d] += row[d];
+            ++count;
+        }
+        // the mean over the rows in range, padding does not count
+        if (param.pooling == EMBEDDING_MEAN && count > 0)
+            for (int d = 0; d < param.dim; ++d)
+                out[d] *= 1.f / count;
+    });
+}
+
+// The product of input and right first if left_cols > 0, then one task per
+// plane of a channel (NORM_BATCH) or per row, two passes for the statistics.
+static inline void norm_reference(float *output, const float *input, const float *right, const float *weight, const float *bias,
+                                  const float *mean, const float *var, const norm_param_t &param) {
+    const long long rows = (long long)param.N * param.C * param.H;
+    std::vector<float> product;
+    if (param.left_cols > 0) {
+        product.resize(rows * param.W);
+        reference_gemm(product.data(), input, right, rows, param.W, param.left_cols);
+        input = product.data();
+    }
+    if (param.mode == NORM_BATCH) {
+        const long long plane = (long long)param.H * param.W;
+        parallel_for((long long)param.N * param.C, [&](long long nc) {
+            const int c = nc % param.C;
+            const float scale = (weight ? weight[c] : 1.f) / std::sqrt(var[c] + param.eps);
+            const float shift = (bias ? bias[c] : 0.f) - mean[c] * scale;
+            for (long long i = nc * plane; i < (nc + 1) * plane; ++i)
+                output[i] = input[i] * scale + shift;
+        });
+        return;
+    }
+    parallel_for(rows, [&](long long r) {
+        const float *x = input + r * param.W;
+        float *y = output + r * param.W;
+        double row_mean = 0, row_var = 0;
+        if (param.mode == NORM_LAYER) {
+            for (int w = 0; w < param.W; ++w)
+                row_mean += x[w];
+            row_mean /= param.W;
+        }
+        for (int w = 0; w < param.W; ++w)
+            row_var += (x[w] - row_mean) * (x[w] - row_mean);
+        const double rstd = 1 / std::sqrt(row_var / param.W + param.eps);
+        for (int w = 0; w < param.W; ++w) {
+            const double z = (x[w] - row_mean) * rstd * (weight ? weight[w] : 1.f);
+            y[w] = param.mode == NORM_LAYER && bias ? z + bias[w] : z;
+        }
+    });
+}
+
+// One task per query row, the scores of the row in double.
+static inline void attention_reference(float *output, const float *query, const float *key, const float *value, const attention_param_t &param) {
+    const long long rows = (long long)param.batch * param.heads * param.seq_q;
+    parallel_for(rows, [&](long long r) {
+        const long long head = r / param.seq_q;
+        const int i = r % param.seq_q;
+        const int keys = param.causal ? i + param.seq_k - param.seq_q + 1 : param.seq_k;
+        const float *q = query + r * param.dim;
+        const float *k = key + head * param.seq_k * param.dim;
+        const float *v = value + head * param.seq_k * param.dim;
+        std::vector<double> score(keys), out(param.dim, 0.);
+        double max = -INFINITY, sum = 0;
+        for (int j = 0; j < keys; ++j) {
+            double dot = 0;
+            for (int d = 0; d < param.dim; ++d)
+                dot += (double)q[d] * k[(long long)j * param.dim + d];
+            score[j] = dot * param.scale;
+            max = std::max(max, score[j]);
+        }
+        for (int j = 0; j < keys; ++j) {
+            const double p = std::exp(score[j] - max);
+            sum += p;
+            for (int d = 0; d < param.dim; ++d)
+                out[d] += p * v[(long long)j * param.dim + d];
+        }
+        for (int d = 0; d < param.dim; ++d)
+            output[r * param.dim + d] = out[d] / sum;
+    });
+}
+
+// Greedy NMS over the best NMS_MAX_CANDIDATES boxes by score (ties by
+// index) above score_threshold, IoU compared without division as on the
+// device so that borderline pairs go the same way.
+static inline std::vector<int> nms_reference(const float *input, const nms_param_t &param) {
+    std::vector<int> order(param.num);
+    for (int i = 0; i < param.num; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return input[a * 5 + 4] > input[b * 5 + 4]; });
+    int boxes = 0;
+    while (boxes < std::min(param.num, NMS_MAX_CANDIDATES) && input[order[boxes] * 5 + 4] > param.score_threshold)
+        ++boxes;
+    std::vector<int> keep;
+    std::vector<char> removed(boxes, 0);
+    for (int i = 0; i < boxes && (int)keep.size() < param.max_output; ++i) {
+        if (removed[i])
+            continue;
+        keep.push_back(order[i]);
+        const float *a = input + order[i] * 5;
+        for (int j = i + 1; j < boxes; ++j) {
+            const float *b = input + order[j] * 5;
+            const float w = std::max(std::min(a[2], b[2]) - std::max(a[0], b[0]), 0.f);
+            const float h = std::max(std::min(a[3], b[3]) - std::max(a[1], b[1]), 0.f);
+            const float areas = (a[2] - a[0]) * (a[3] - a[1]) + (b[2] - b[0]) * (b[3] - b[1]);
+            if (w * h * (1.f + param.iou_threshold) > areas * param.iou_threshold)
+                removed[j] = 1;
+        }
+    }
+    return keep;
+}
+#endif
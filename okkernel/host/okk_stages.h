@@ -0,0 +1,174 @@
+#ifndef OKK_STAGES_H
+#define OKK_STAGES_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+////////////////////////////////////////////////////////////////////////
+/// BOUNDED QUEUE
+/// ////////////////////////////////////////////////////////////////////
+template<class T>
+struct queue_t {
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+template<class T>
+static inline void queue_init(queue_t<T> &queue, size_t capacity) {
+    queue.items.clear();
+    queue.capacity = capacity;
+    queue.closed = false;
+}
+
+// Blocks while the queue is full.
+template<class T>
+static inline void queue_push(queue_t<T> &queue, const T &item) {
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.not_full.wait(lock, [&]() { return queue.items.size() < queue.capacity; });
+    queue.items.push_back(item);
+    queue.not_empty.notify_one();
+}
+
+// Blocks while the queue is empty and open, returns false once it is
+// closed and drained.
+template<class T>
+static inline bool queue_pop(queue_t<T> &queue, T &item) {
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    queue.not_empty.wait(lock, [&]() { return !queue.items.empty() || queue.closed; });
+    if (queue.items.empty())
+        return false;
+    item = queue.items.front();
+    queue.items.pop_front();
+    queue.not_full.notify_one();
+    return true;
+}
+
+template<class T>
+static inline void queue_close(queue_t<T> &queue) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+    queue.not_empty.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// STAGES
+/// A chain of stages, each on its own thread, linked by bounded queues of
+/// slot indices. A slot holds the buffers of one batch through all the
+/// stages, the last stage returns it to the free queue the first one
+/// takes from, so at most slots batches are in flight and a slow stage
+/// blocks the ones before it on full queues. A stage that waits on its
+/// input is starved by the previous ones, one that waits on its output is
+/// blocked by the next ones, the stage that does neither bounds the
+/// throughput.
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    std::string name;
+    // processes the batch of a slot, on the thread of the stage
+    std::function<bm_status_t(int slot)> run;
+    // service time of each batch
+    std::vector<double> samples;
+    double busy_us, input_wait_us, output_wait_us;
+} stage_t;
+
+typedef struct {
+    long long batches;
+    double wall_us;
+    // from the first stage taking a slot to the last one returning it
+    std::vector<double> latencies;
+} stages_result_t;
+
+static inline stage_t stage_make(const std::string &name, const std::function<bm_status_t(int)> &run) {
+    stage_t stage;
+    stage.name = name;
+    stage.run = run;
+    stage.busy_us = stage.input_wait_us = stage.output_wait_us = 0;
+    return stage;
+}
+
+// Runs batches batches through the stages with slots slots and queues of
+// depth batches between the stages. Returns -1 if a stage fails, the
+// others then pass the slots on without work until the chain drains.
+static inline int stages_run(std::vector<stage_t> &stages, int slots, int depth, long long batches, stages_result_t &result) {
+    const int num = stages.size();
+    queue_t<int> free_slots;
+    std::vector<queue_t<int> > queues(num);
+    queue_init(free_slots, slots);
+    for (int s = 0; s < num; ++s)
+        queue_init(queues[s], depth);
+    for (int slot = 0; slot < slots; ++slot)
+        queue_push(free_slots, slot);
+    std::vector<double> slot_start(slots, 0);
+    std::atomic<bool> failed(false);
+    result.batches = batches;
+    result.latencies.clear();
+    const double start_time = bench_now_us();
+    std::vector<std::thread> threads;
+    for (int s = 0; s < num; ++s) {
+        threads.push_back(std::thread([&, s]() {
+            stage_t &stage = stages[s];
+            stage.samples.clear();
+            stage.busy_us = stage.input_wait_us = stage.output_wait_us = 0;
+            for (long long produced = 0;; ++produced) {
+                int slot = 0;
+                double t = bench_now_us();
+                if (s == 0) {
+                    if (produced == batches || failed)
+                        break;
+                    queue_pop(free_slots, slot);
+                    slot_start[slot] = bench_now_us();
+                } else if (!queue_pop(queues[s - 1], slot))
+                    break;
+                stage.input_wait_us += bench_now_us() - t;
+                t = bench_now_us();
+                if (!failed && stage.run(slot) != BM_SUCCESS) {
+                    std::cout << "Failed to run stage " << stage.name << std::endl;
+                    failed = true;
+                }
+                const double service = bench_now_us() - t;
+                stage.samples.push_back(service);
+                stage.busy_us += service;
+                t = bench_now_us();
+                if (s == num - 1) {
+                    result.latencies.push_back(bench_now_us() - slot_start[slot]);
+                    queue_push(free_slots, slot);
+                } else
+                    queue_push(queues[s], slot);
+                stage.output_wait_us += bench_now_us() - t;
+            }
+            queue_close(queues[s]);
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    result.wall_us = bench_now_us() - start_time;
+    return failed ? -1 : 0;
+}
+
+// Per stage: the service time per batch, the images per second it would
+// sustain alone, and the shares of the wall time it was busy, starved and
+// blocked. Then the end to end latency and throughput.
+static inline void stages_print(const std::vector<stage_t> &stages, const stages_result_t &result, int images_per_batch) {
+    for (size_t s = 0; s < stages.size(); ++s) {
+        const stage_t &stage = stages[s];
+        const bench_stats_t stats = bench_stats(stage.samples);
+        std::cout << "stage " << stage.name << ": median " << stats.median << " us p99 " << stats.p99 << " us per batch, "
+                  << images_per_batch / stats.mean * 1e6 << " images/s alone, busy " << stage.busy_us / result.wall_us * 100
+                  << "%, starved " << stage.input_wait_us / result.wall_us * 100 << "%, blocked "
+                  << stage.output_wait_us / result.wall_us * 100 << "%" << std::endl;
+    }
+    const bench_stats_t latency = bench_stats(result.latencies);
+    std::cout << "end to end: " << result.batches << " batches of " << images_per_batch << " images, latency median "
+              << latency.median << " us p99 " << latency.p99 << " us, " << result.batches * images_per_batch / result.wall_us * 1e6
+              << " images/s" << std::endl;
+}
+#endif
@@ -0,0 +1,163 @@
+#ifndef OKK_STRIPE_H
+#define OKK_STRIPE_H
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_kernel_id.h"
+////////////////////////////////////////////////////////////////////////
+/// STRIPE CONV
+/// Convolution of images larger than the device buffers. The output is
+/// split into stripes of output rows, each computed by one launch of the
+/// conv kernel on the input rows it reads, which overlap the rows of the
+/// previous stripe by kernel_h_ext - stride_h (the halo). The pads of the
+/// image are the top pad of the first stripe and the bottom pad of the
+/// last one. Stripes go through two input and two output slots on the
+/// device: while stripe s runs, stripe s + 1 is uploaded with
+/// bm_memcpy_s2d_partial_offset and stripe s - 1 downloaded, so device
+/// memory only depends on the width and the rows per stripe.
+/// ////////////////////////////////////////////////////////////////////
+// input bytes of a slot when the rows per stripe are not given
+#define STRIPE_BUDGET (16 << 20)
+
+typedef struct {
+    // output rows per stripe (the last may have fewer)
+    int rows;
+    int stripes;
+    // device bytes of the input and output slots
+    long long device_bytes;
+    // host time of the streamed convolution
+    double us;
+} stripe_result_t;
+
+static inline void stripe_output_hw(const conv2d_param_t &param, int &output_h, int &output_w) {
+    conv2d_output_hw(param, output_h, output_w);
+}
+
+static inline void stripe_output_hw(const conv2d_group_param_t &param, int &output_h, int &output_w) {
+    conv2d_group_output_hw(param, output_h, output_w);
+}
+
+template<class P>
+static inline int stripe_kernel_h_ext(const P &param) {
+    return (param.kernel_h - 1) * param.dilation_h + 1;
+}
+
+// Output rows per stripe whose input rows fit budget bytes, at least 1.
+template<class P>
+static inline int stripe_rows(const P &param, long long budget) {
+    int output_h, output_w;
+    stripe_output_hw(param, output_h, output_w);
+    const long long row_bytes = (long long)param.N * param.IC * param.W * sizeof(float);
+    const long long input_rows = budget / row_bytes;
+    const long long rows = (input_rows - stripe_kernel_h_ext(param)) / param.stride_h + 1;
+    return (int)std::max(1LL, std::min(rows, (long long)output_h));
+}
+
+// The param of the stripe of output rows [output_first, output_first +
+// rows), input_first is its first input row. Its H is 0 if the stripe
+// reads only padding.
+template<class P>
+static inline P stripe_param(const P &param, int output_first, int rows, int &input_first) {
+    const int first = output_first * param.stride_h - param.pad_top;
+    const int end = (output_first + rows - 1) * param.stride_h + stripe_kernel_h_ext(param) - param.pad_top;
+    P stripe = param;
+    input_first = std::max(first, 0);
+    stripe.H = std::max(0, std::min(end, param.H) - input_first);
+    stripe.pad_top = std::max(0, -first);
+    stripe.pad_bottom = std::max(0, end - param.H);
+    return stripe;
+}
+
+// Copies rows [first, first + rows) of each plane of [planes, H, W] to or
+// from [planes, rows, W].
+static inline void stripe_gather(float *dst, const float *src, int planes, int H, int W, int first, int rows) {
+    for (int p = 0; p < planes; ++p)
+        memcpy(dst + (long long)p * rows * W, src + ((long long)p * H + first) * W, (long long)rows * W * sizeof(float));
+}
+
+static inline void stripe_scatter(float *dst, const float *src, int planes, int H, int W, int first, int rows) {
+    for (int p = 0; p < planes; ++p)
+        memcpy(dst + ((long long)p * H + first) * W, src + (long long)p * rows * W, (long long)rows * W * sizeof(float));
+}
+
+// Convolves input [N, IC, H, W] on the host to output [N, OC, output_h,
+// output_w] on the host with the kernel (and bias) already on the device
+// at the addresses of param. rows is the output rows per stripe, 0 picks
+// them from STRIPE_BUDGET.
+template<class P>
+static inline bm_status_t stripe_conv(bm_handle_t handle, const char *kernel_name, const P &param, const float *input, float *output, int rows, stripe_result_t &result) {
+    int output_h, output_w;
+    stripe_output_hw(param, output_h, output_w);
+    result.rows = rows > 0 ? std::min(rows, output_h) : stripe_rows(param, STRIPE_BUDGET);
+    result.stripes = (output_h + result.rows - 1) / result.rows;
+    result.us = 0;
+    const int input_rows = (result.rows - 1) * param.stride_h + stripe_kernel_h_ext(param);
+    const long long input_slot = (long long)param.N * param.IC * std::min(input_rows, param.H) * param.W * sizeof(float);
+    const long long output_slot = (long long)param.N * param.OC * result.rows * output_w * sizeof(float);
+    // one slot if the image is one stripe
+    const int slots = std::min(result.stripes, 2);
+    result.device_bytes = slots * (input_slot + output_slot);
+    if (slots * std::max(input_slot, output_slot) > UINT_MAX) {
+        std::cout << "Failed to stream " << kernel_name << ", a stripe of " << result.rows << " rows exceeds the 32-bit offsets of the copies" << std::endl;
+        return BM_ERR_PARAM;
+    }
+    bm_device_mem_t input_dev, output_dev;
+    bm_status_t ret = bm_malloc_device_byte(handle, &input_dev, slots * input_slot);
+    if (ret != BM_SUCCESS)
+        return ret;
+    ret = bm_malloc_device_byte(handle, &output_dev, slots * output_slot);
+    if (ret != BM_SUCCESS) {
+        bm_free_device(handle, input_dev);
+        return ret;
+    }
+    const unsigned int id = okk_kernel_id(kernel_name);
+    std::vector<float> staging(std::max(input_slot, output_slot) / sizeof(float));
+    std::vector<P> stripes(result.stripes);
+    // uploads stripe s to its input slot
+    auto upload = [&](int s) -> bm_status_t {
+        int input_first;
+        const int output_first = s * result.rows;
+        stripes[s] = stripe_param(param, output_first, std::min(result.rows, output_h - output_first), input_first);
+        if (stripes[s].H <= 0) {
+            std::cout << "Failed to stream " << kernel_name << ", stripe " << s << " reads only padding" << std::endl;
+            return BM_ERR_PARAM;
+        }
+        stripe_gather(staging.data(), input, param.N * param.IC, param.H, param.W, input_first, stripes[s].H);
+        const long long bytes = (long long)param.N * param.IC * stripes[s].H * param.W * sizeof(float);
+        stripes[s].input_addr = bm_mem_get_device_addr(input_dev) + (s % 2) * input_slot;
+        stripes[s].output_addr = bm_mem_get_device_addr(output_dev) + (s % 2) * output_slot;
+        return bm_memcpy_s2d_partial_offset(handle, input_dev, staging.data(), bytes, (s % 2) * input_slot);
+    };
+    // downloads the output of stripe s from its output slot
+    auto download = [&](int s) -> bm_status_t {
+        const int output_first = s * result.rows, count = std::min(result.rows, output_h - output_first);
+        const long long bytes = (long long)param.N * param.OC * count * output_w * sizeof(float);
+        const bm_status_t status = bm_memcpy_d2s_partial_offset(handle, staging.data(), output_dev, bytes, (s % 2) * output_slot);
+        if (status == BM_SUCCESS)
+            stripe_scatter(output, staging.data(), param.N * param.OC, output_h, output_w, output_first, count);
+        return status;
+    };
+    const double start_time = bench_now_us();
+    ret = upload(0);
+    for (int s = 0; s < result.stripes && ret == BM_SUCCESS; ++s) {
+        ret = okkernel_launch_tuned_id_async(handle, id, stripes[s], tune_lookup(kernel_name, stripes[s]));
+        // the slots of stripe s + 1 were used by stripe s - 1, which is done
+        if (ret == BM_SUCCESS && s + 1 < result.stripes)
+            ret = upload(s + 1);
+        if (ret == BM_SUCCESS && s > 0)
+            ret = download(s - 1);
+        const bm_status_t sync = bm_thread_sync(handle);
+        ret = ret == BM_SUCCESS ? sync : ret;
+    }
+    if (ret == BM_SUCCESS)
+        ret = download(result.stripes - 1);
+    result.us = bench_now_us() - start_time;
+    bm_free_device(handle, input_dev);
+    bm_free_device(handle, output_dev);
+    return ret;
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef OKK_THREAD_H
+#define OKK_THREAD_H
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+// Number of host worker threads, the environment variable OKK_THREADS
+// overrides the number of hardware threads.
+static inline int okk_thread_num() {
+    const char *env = getenv("OKK_THREADS");
+    int num = env ? atoi(env) : (int)std::thread::hardware_concurrency();
+    return std::max(num, 1);
+}
+
+// Calls task(i) for i in [0, num_tasks) on the worker threads. Tasks are
+// handed out one at a time, so they may differ in cost. Results must not
+// depend on the thread a task runs on.
+template<class F>
+static inline void parallel_for(long long num_tasks, const F &task) {
+    const int thread_num = (int)std::min<long long>(okk_thread_num(), num_tasks);
+    if (thread_num <= 1) {
+        for (long long i = 0; i < num_tasks; ++i)
+            task(i);
+        return;
+    }
+    std::atomic<long long> next(0);
+    auto worker = [&]() {
+        for (long long i = next++; i < num_tasks; i = next++)
+            task(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < thread_num; ++t)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+#endif
@@ -0,0 +1,126 @@
+#ifndef OKK_TIMER_H
+#define OKK_TIMER_H
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+////////////////////////////////////////////////////////////////////////
+/// REGION TIMERS
+/// Decoder of the markers recorded by the OKK_TIMER_* macros of
+/// device/okk_timer.h. The kernels only record them when the firmware is
+/// built with OKK_TIMER=1, the layouts below must match that header.
+/// ////////////////////////////////////////////////////////////////////
+typedef enum {
+    TIMER_KERNEL_BEGIN = 0,
+    TIMER_KERNEL_FINISH = 1,
+    TIMER_REGION_BEGIN = 2,
+    TIMER_REGION_FINISH = 3,
+    TIMER_TILE_BEGIN = 4
+} timer_kind_t;
+
+typedef struct {
+    unsigned short kind;
+    unsigned short stage;
+    unsigned int index;
+    unsigned long long time_ns;
+} __attribute__((packed)) timer_record_t;
+
+#define TIMER_MAX_RECORDS 1024
+
+typedef struct {
+    unsigned int count;
+    unsigned int dropped;
+    timer_record_t records[TIMER_MAX_RECORDS];
+} __attribute__((packed)) timer_buffer_t;
+
+// Launches a kernel once with a timer buffer and reads the markers back.
+template<class P>
+static inline bm_status_t timer_launch(bm_handle_t handle, const char *kernel_name, const P &param, const tune_t &tune, std::vector<timer_record_t> &records, unsigned int &dropped) {
+    bm_device_mem_t buffer_dev;
+    bm_status_t ret = bm_malloc_device_byte(handle, &buffer_dev, sizeof(timer_buffer_t));
+    if (ret != BM_SUCCESS)
+        return ret;
+    ret = bm_memset_device(handle, 0, buffer_dev);
+    if (ret == BM_SUCCESS)
+        ret = okkernel_launch_tuned_sync(handle, kernel_name, param, tune, bm_mem_get_device_addr(buffer_dev));
+    std::vector<timer_buffer_t> buffer(1);
+    if (ret == BM_SUCCESS)
+        ret = bm_memcpy_d2s(handle, buffer.data(), buffer_dev);
+    bm_free_device(handle, buffer_dev);
+    if (ret != BM_SUCCESS)
+        return ret;
+    unsigned int count = std::min<unsigned int>(buffer[0].count, TIMER_MAX_RECORDS);
+    records.assign(buffer[0].records, buffer[0].records + count);
+    dropped = buffer[0].dropped;
+    return BM_SUCCESS;
+}
+
+// Name of the interval that starts at a marker.
+static inline std::string timer_interval_name(const timer_record_t &record) {
+    std::ostringstream ss;
+    switch (record.kind) {
+    case TIMER_KERNEL_BEGIN: ss << "prologue"; break;
+    case TIMER_REGION_BEGIN: ss << "parallel " << record.stage; break;
+    case TIMER_REGION_FINISH: ss << "serial after parallel " << record.stage; break;
+    case TIMER_TILE_BEGIN: ss << "stage " << record.stage; break;
+    default: ss << "kind " << record.kind; break;
+    }
+    return ss.str();
+}
+
+typedef struct {
+    int count;
+    double total_us;
+    double max_us;
+} timer_interval_t;
+
+// Prints the time from each marker to the next one, grouped by the stage of the marker.
+static inline void timer_print(const std::vector<timer_record_t> &records, unsigned int dropped) {
+    if (records.size() < 2) {
+        std::cerr << "  no timer records, build the firmware with OKK_TIMER=1" << std::endl;
+        return;
+    }
+    std::map<std::string, timer_interval_t> intervals;
+    for (size_t i = 0; i + 1 < records.size(); ++i) {
+        double us = (records[i + 1].time_ns - records[i].time_ns) * 1e-3;
+        timer_interval_t &interval = intervals[timer_interval_name(records[i])];
+        interval.count += 1;
+        interval.total_us += us;
+        interval.max_us = std::max(interval.max_us, us);
+    }
+    double total_us = (records.back().time_ns - records.front().time_ns) * 1e-3;
+    std::cerr << "  kernel: " << total_us << "(us), " << records.size() << " markers";
+    if (dropped > 0)
+        std::cerr << ", " << dropped << " dropped, the breakdown is partial";
+    std::cerr << std::endl;
+    for (std::map<std::string, timer_interval_t>::const_iterator it = intervals.begin(); it != intervals.end(); ++it) {
+        const timer_interval_t &interval = it->second;
+        std::cerr << "  " << it->first << ": count " << interval.count << " total " << interval.total_us
+                  << "(us) mean " << interval.total_us / interval.count << "(us) max " << interval.max_us << "(us)";
+        if (total_us > 0)
+            std::cerr << " " << 100. * interval.total_us / total_us << "%";
+        std::cerr << std::endl;
+    }
+}
+
+template<class P>
+static inline void timer_case(bm_handle_t handle, const char *kernel_name, int case_index, P param) {
+    device_tensors_t tensors;
+    std::vector<timer_record_t> records;
+    unsigned int dropped = 0;
+    bm_status_t ret = device_tensors_alloc(handle, param, tensors);
+    if (ret == BM_SUCCESS)
+        ret = timer_launch(handle, kernel_name, param, tune_lookup(kernel_name, param), records, dropped);
+    device_tensors_free(handle, tensors);
+    if (ret != BM_SUCCESS) {
+        std::cerr << "Failed to time " << kernel_name << " case " << case_index << std::endl;
+        return;
+    }
+    timer_print(records, dropped);
+}
+#endif
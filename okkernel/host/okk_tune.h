@@ -0,0 +1,171 @@
+#ifndef OKK_TUNE_H
+#define OKK_TUNE_H
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_cases.h"
+// Tile configuration appended to the param of a kernel, the layout must match
+// tune_t in device/okk_tune.h. A field of 0 leaves the choice to the kernel.
+typedef struct {
+    int tile_n, tile_c, tile_h, tile_w;
+} __attribute__((packed)) tune_t;
+
+static const tune_t TUNE_AUTO = {0, 0, 0, 0};
+
+static inline bool tune_equal(const tune_t &a, const tune_t &b) {
+    return memcmp(&a, &b, sizeof(tune_t)) == 0;
+}
+
+// The cache file can be redirected by the environment variable OKK_TUNE_CACHE.
+static inline std::string tune_cache_path() {
+    const char *path = getenv("OKK_TUNE_CACHE");
+    return path ? std::string(path) : std::string("./okk_tune.cache");
+}
+
+// 64-bit FNV-1a.
+static inline unsigned long long tune_hash(const void *data, size_t size, unsigned long long hash = 14695981039346656037ULL) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hash of the kernel name and the shape of the param, addresses excluded.
+template<class P>
+static inline unsigned long long tune_shape_hash(const char *kernel_name, const P &param) {
+    P shape = shape_of(param);
+    return tune_hash(&shape, sizeof(shape), tune_hash(kernel_name, strlen(kernel_name)));
+}
+
+////////////////////////////////////////////////////////////////////////
+/// TUNING CACHE
+/// One line per entry: kernel_name shape_hash tile_n tile_c tile_h tile_w
+/// elapsed_time(us)
+/// ////////////////////////////////////////////////////////////////////
+typedef struct {
+    tune_t tune;
+    double elapsed_us;
+} tune_entry_t;
+
+typedef std::map<std::pair<std::string, unsigned long long>, tune_entry_t> tune_cache_t;
+
+static inline int tune_cache_load(const std::string &path, tune_cache_t &cache) {
+    std::ifstream f(path);
+    if (!f)
+        return -1;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        std::string name;
+        unsigned long long hash;
+        int v[4];
+        tune_entry_t entry;
+        ss >> name >> std::hex >> hash >> std::dec
+           >> v[0] >> v[1] >> v[2] >> v[3] >> entry.elapsed_us >> std::ws;
+        if (!ss || !ss.eof()) {
+            std::cout << "Skip malformed line of " << path << ": " << line << std::endl;
+            continue;
+        }
+        tune_t tune = {v[0], v[1], v[2], v[3]};
+        entry.tune = tune;
+        cache[std::make_pair(name, hash)] = entry;
+    }
+    return 0;
+}
+
+static inline int tune_cache_save(const std::string &path, const tune_cache_t &cache) {
+    std::string tmp_path = path + ".tmp";
+    std::ofstream f(tmp_path, std::ios::out | std::ios::trunc);
+    if (!f) {
+        std::cout << "Failed to create file " << tmp_path << std::endl;
+        return -1;
+    }
+    f << "# kernel_name shape_hash tile_n tile_c tile_h tile_w elapsed_time(us)" << std::endl;
+    for (tune_cache_t::const_iterator it = cache.begin(); it != cache.end(); ++it) {
+        const tune_t &t = it->second.tune;
+        f << it->first.first << " " << std::hex << it->first.second << std::dec << " "
+          << t.tile_n << " " << t.tile_c << " " << t.tile_h << " " << t.tile_w << " "
+          << it->second.elapsed_us << std::endl;
+    }
+    f.close();
+    // Replace the cache atomically, concurrent readers see either version.
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cout << "Failed to write file " << path << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+template<class P>
+static inline bool tune_cache_lookup(const tune_cache_t &cache, const char *kernel_name, const P &param, tune_t &tune) {
+    tune_cache_t::const_iterator it = cache.find(std::make_pair(std::string(kernel_name), tune_shape_hash(kernel_name, param)));
+    if (it == cache.end())
+        return false;
+    tune = it->second.tune;
+    return true;
+}
+
+template<class P>
+static inline void tune_cache_store(tune_cache_t &cache, const char *kernel_name, const P &param, const tune_t &tune, double elapsed_us) {
+    tune_entry_t entry = {tune, elapsed_us};
+    cache[std::make_pair(std::string(kernel_name), tune_shape_hash(kernel_name, param))] = entry;
+}
+
+// Tuned config of a case from the default cache, TUNE_AUTO if it is not tuned.
+template<class P>
+static inline tune_t tune_lookup(const char *kernel_name, const P &param) {
+    static tune_cache_t cache;
+    static bool loaded = false;
+    if (!loaded) {
+        tune_cache_load(tune_cache_path(), cache);
+        loaded = true;
+    }
+    tune_t tune = TUNE_AUTO;
+    tune_cache_lookup(cache, kernel_name, param, tune);
+    return tune;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// LAUNCH
+/// The tune_t and the address of the region timer buffer (0 if none, see
+/// host/okk_timer.h) are appended to the param. Kernels that are not tunable
+/// only read the leading param and ignore them.
+/// ////////////////////////////////////////////////////////////////////
+template<class P>
+static inline bm_status_t okkernel_launch_tuned_sync(bm_handle_t handle, const char *kernel_name, const P &param, const tune_t &tune, unsigned long long timer_addr = 0) {
+    struct {
+        P param;
+        tune_t tune;
+        unsigned long long timer_addr;
+    } __attribute__((packed)) args = {param, tune, timer_addr};
+    return okkernel_launch_sync(handle, kernel_name, &args, sizeof(args));
+}
+
+// Cartesian product of the candidate values of each field.
+static inline std::vector<tune_t> tune_candidates(
+    const std::vector<int> &tile_n,
+    const std::vector<int> &tile_c,
+    const std::vector<int> &tile_h,
+    const std::vector<int> &tile_w) {
+    std::vector<tune_t> candidates;
+    for (size_t a = 0; a < tile_n.size(); ++a)
+        for (size_t b = 0; b < tile_c.size(); ++b)
+            for (size_t c = 0; c < tile_h.size(); ++c)
+                for (size_t d = 0; d < tile_w.size(); ++d) {
+                    tune_t t = {tile_n[a], tile_c[b], tile_h[c], tile_w[d]};
+                    candidates.push_back(t);
+                }
+    return candidates;
+}
+#endif
@@ -0,0 +1,335 @@
+#ifndef OKK_WEIGHTS_H
+#define OKK_WEIGHTS_H
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_pack.h"
+////////////////////////////////////////////////////////////////////////
+/// WEIGHT FILE
+/// The weights of a model in the layouts the kernels read, so loading a
+/// model is a mapping of the file and a copy to the device, without any
+/// conversion on the host or the device.
+///   file: weights_header_t, the data from WEIGHTS_ALIGN, then the index,
+///         header.count weights_entry_t. Each tensor starts at a multiple
+///         of WEIGHTS_TENSOR_ALIGN of the data.
+/// The writer streams the tensors to the file as they are added. The loader
+/// maps the file and copies the data to device buffers of at most
+/// WEIGHTS_SEGMENT bytes (split between tensors, the offsets of
+/// bm_memcpy_s2d_partial_offset are 32-bit) in WEIGHTS_CHUNK pieces,
+/// asking the kernel to read the next piece from disk while the current one
+/// is copied, so loading is bounded by the disk and PCIe bandwidth.
+/// ////////////////////////////////////////////////////////////////////
+#define WEIGHTS_MAGIC "OKKWGT01"
+#define WEIGHTS_ALIGN (4096)
+#define WEIGHTS_TENSOR_ALIGN (256)
+#define WEIGHTS_CHUNK (64 << 20)
+#define WEIGHTS_SEGMENT (1LL << 30)
+#define WEIGHTS_NAME_LEN (48)
+
+typedef enum {
+    // fp32 as given, e.g. biases, dims len
+    WEIGHTS_RAW = 0,
+    // [group, (IC / group + 1) / 2, OC / group, kh, kw, 2] of conv2d_group
+    // (conv2d_demo and conv2d_contest with group 1), dims OC, IC, kh, kw
+    WEIGHTS_CONV_2IC = 1,
+    // [C, kh, kw] of depthwise_contest, dims C, kh, kw
+    WEIGHTS_DEPTHWISE = 2,
+    // right matrix [left_cols, right_cols] of matmul_contest, dims rows, cols
+    WEIGHTS_MATMUL_RIGHT = 3,
+} weights_layout_t;
+
+typedef struct {
+    char magic[8];
+    int count;
+    int reserved;
+    long long data_bytes;
+    long long index_offset;
+} weights_header_t;
+
+typedef struct {
+    char name[WEIGHTS_NAME_LEN];
+    int layout;
+    int dims[4];
+    int group;
+    // offset in the data and bytes
+    long long offset;
+    long long bytes;
+} weights_entry_t;
+
+static_assert(sizeof(weights_header_t) == 32, "weights_header_t is part of the file format");
+static_assert(sizeof(weights_entry_t) == 88, "weights_entry_t is part of the file format");
+
+typedef struct {
+    int fd;
+    std::string path, tmp_path;
+    std::vector<weights_entry_t> entries;
+    long long data_bytes;
+    // an add failed, weights_finish discards the file
+    bool failed;
+    // packing buffer
+    std::vector<char> scratch;
+} weights_writer_t;
+
+typedef struct {
+    void *base;
+    size_t size;
+    const weights_header_t *header;
+    const weights_entry_t *entries;
+    const char *data;
+} weights_file_t;
+
+typedef struct {
+    bm_device_mem_t mem;
+    // range of the data
+    long long offset, bytes;
+} weights_segment_t;
+
+typedef struct {
+    std::vector<weights_segment_t> segments;
+    // device address of each entry
+    std::vector<unsigned long long> addrs;
+    long long bytes;
+} device_weights_t;
+
+static inline long long weights_align(long long size, long long align) {
+    return (size + align - 1) / align * align;
+}
+
+static inline bool weights_pwrite_all(int fd, const void *buffer, long long bytes, long long offset) {
+    for (long long done = 0; done < bytes;) {
+        const ssize_t n = pwrite(fd, (const char *)buffer + done, std::min(bytes - done, (long long)WEIGHTS_CHUNK), offset + done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static inline int weights_create(weights_writer_t &writer, const std::string &path) {
+    writer.path = path;
+    writer.tmp_path = path + ".tmp." + std::to_string(getpid());
+    writer.entries.clear();
+    writer.data_bytes = 0;
+    writer.failed = false;
+    writer.fd = open(writer.tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer.fd < 0) {
+        std::cout << "Failed to create file " << writer.tmp_path << ", " << strerror(errno) << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Appends a tensor, returns -1 if the name is too long or already used or
+// the write fails.
+static inline int weights_add(weights_writer_t &writer, const std::string &name, weights_layout_t layout, const int (&dims)[4], int group, const void *data, long long bytes) {
+    if (name.size() >= WEIGHTS_NAME_LEN) {
+        std::cout << "Failed to add weights " << name << ", the name is longer than " << WEIGHTS_NAME_LEN - 1 << std::endl;
+        writer.failed = true;
+        return -1;
+    }
+    for (size_t i = 0; i < writer.entries.size(); ++i) {
+        if (name == writer.entries[i].name) {
+            std::cout << "Failed to add weights " << name << ", the name is used" << std::endl;
+            writer.failed = true;
+            return -1;
+        }
+    }
+    weights_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.name, name.c_str());
+    entry.layout = layout;
+    memcpy(entry.dims, dims, sizeof(entry.dims));
+    entry.group = group;
+    entry.offset = weights_align(writer.data_bytes, WEIGHTS_TENSOR_ALIGN);
+    entry.bytes = bytes;
+    if (!weights_pwrite_all(writer.fd, data, bytes, WEIGHTS_ALIGN + entry.offset)) {
+        std::cout << "Failed to write weights " << name << " to " << writer.tmp_path << ", " << strerror(errno) << std::endl;
+        writer.failed = true;
+        return -1;
+    }
+    writer.entries.push_back(entry);
+    writer.data_bytes = entry.offset + bytes;
+    return 0;
+}
+
+// kernel [OC, IC / group, kh, kw], packed to the 2IC layout of each group.
+static inline int weights_add_conv(weights_writer_t &writer, const std::string &name, const float *kernel, int OC, int IC, int kernel_h, int kernel_w, int group = 1) {
+    const pack_layout_t layout = pack_layout_2IC(OC, IC, kernel_h, kernel_w, group);
+    writer.scratch.resize(pack_dst_bytes(layout));
+    pack_weights_host(layout, kernel, writer.scratch.data());
+    const int dims[4] = {OC, IC, kernel_h, kernel_w};
+    return weights_add(writer, name, WEIGHTS_CONV_2IC, dims, group, writer.scratch.data(), writer.scratch.size());
+}
+
+static inline int weights_add_depthwise(weights_writer_t &writer, const std::string &name, const float *kernel, int C, int kernel_h, int kernel_w) {
+    const int dims[4] = {C, kernel_h, kernel_w, 0};
+    return weights_add(writer, name, WEIGHTS_DEPTHWISE, dims, 1, kernel, (long long)C * kernel_h * kernel_w * sizeof(float));
+}
+
+static inline int weights_add_matmul_right(weights_writer_t &writer, const std::string &name, const float *right, int rows, int cols) {
+    const int dims[4] = {rows, cols, 0, 0};
+    return weights_add(writer, name, WEIGHTS_MATMUL_RIGHT, dims, 1, right, (long long)rows * cols * sizeof(float));
+}
+
+static inline int weights_add_raw(weights_writer_t &writer, const std::string &name, const float *values, int len) {
+    const int dims[4] = {len, 0, 0, 0};
+    return weights_add(writer, name, WEIGHTS_RAW, dims, 1, values, (long long)len * sizeof(float));
+}
+
+// Writes the index and the header and publishes the file atomically,
+// readers see either no file or a whole one. The file is discarded if an
+// add failed.
+static inline int weights_finish(weights_writer_t &writer) {
+    weights_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WEIGHTS_MAGIC, sizeof(header.magic));
+    header.count = writer.entries.size();
+    header.data_bytes = weights_align(writer.data_bytes, WEIGHTS_TENSOR_ALIGN);
+    header.index_offset = WEIGHTS_ALIGN + header.data_bytes;
+    bool ok = !writer.failed &&
+              weights_pwrite_all(writer.fd, writer.entries.data(), writer.entries.size() * sizeof(weights_entry_t), header.index_offset) &&
+              weights_pwrite_all(writer.fd, &header, sizeof(header), 0);
+    ok = ok && fsync(writer.fd) == 0;
+    ok = close(writer.fd) == 0 && ok;
+    writer.fd = -1;
+    if (!ok || rename(writer.tmp_path.c_str(), writer.path.c_str()) != 0) {
+        std::cout << "Failed to write file " << writer.path << std::endl;
+        unlink(writer.tmp_path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static inline void weights_unmap(weights_file_t &file) {
+    if (file.base)
+        munmap(file.base, file.size);
+    file.base = nullptr;
+    file.size = 0;
+}
+
+// Maps a weight file read-only, returns -1 if it is missing or malformed.
+static inline int weights_map(const std::string &path, weights_file_t &file) {
+    file.base = nullptr;
+    file.size = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Failed to open file " << path << ", " << strerror(errno) << std::endl;
+        return -1;
+    }
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= WEIGHTS_ALIGN)
+        base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cout << "Failed to map file " << path << std::endl;
+        return -1;
+    }
+    file.base = base;
+    file.size = st.st_size;
+    file.header = (const weights_header_t *)base;
+    file.data = (const char *)base + WEIGHTS_ALIGN;
+    const weights_header_t &header = *file.header;
+    bool valid = memcmp(header.magic, WEIGHTS_MAGIC, sizeof(header.magic)) == 0 && header.count >= 0 &&
+                 header.data_bytes >= 0 && header.index_offset == WEIGHTS_ALIGN + header.data_bytes &&
+                 header.index_offset + header.count * (long long)sizeof(weights_entry_t) == (long long)file.size;
+    file.entries = (const weights_entry_t *)((const char *)base + (valid ? header.index_offset : 0));
+    // tensors in the order of their offsets, each in the data
+    for (int i = 0; i < header.count && valid; ++i) {
+        const weights_entry_t &entry = file.entries[i];
+        valid = memchr(entry.name, 0, WEIGHTS_NAME_LEN) && entry.bytes >= 0 &&
+                entry.offset >= (i > 0 ? file.entries[i - 1].offset + file.entries[i - 1].bytes : 0) &&
+                entry.offset + entry.bytes <= header.data_bytes;
+    }
+    if (!valid) {
+        std::cout << "Failed to read file " << path << ", it is not a weight file of this version" << std::endl;
+        weights_unmap(file);
+        return -1;
+    }
+    return 0;
+}
+
+// -1 if there is no tensor of the name.
+static inline int weights_find(const weights_file_t &file, const char *name) {
+    for (int i = 0; i < file.header->count; ++i)
+        if (strcmp(file.entries[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+static inline void weights_free(bm_handle_t handle, device_weights_t &device) {
+    for (size_t s = 0; s < device.segments.size(); ++s)
+        bm_free_device(handle, device.segments[s].mem);
+    device.segments.clear();
+    device.addrs.clear();
+    device.bytes = 0;
+}
+
+// madvise of data bytes [offset, offset + bytes), widened to whole pages.
+static inline void weights_advise(const weights_file_t &file, long long offset, long long bytes, int advice) {
+    const long long begin = offset / WEIGHTS_ALIGN * WEIGHTS_ALIGN;
+    madvise((void *)(file.data + begin), offset + bytes - begin, advice);
+}
+
+static inline bm_status_t weights_upload_segment(bm_handle_t handle, const weights_file_t &file, const weights_segment_t &segment) {
+    bm_status_t ret = BM_SUCCESS;
+    const char *data = file.data + segment.offset;
+    for (long long offset = 0; offset < segment.bytes && ret == BM_SUCCESS; offset += WEIGHTS_CHUNK) {
+        const long long bytes = std::min(segment.bytes - offset, (long long)WEIGHTS_CHUNK);
+        // read ahead the next chunk while this one is copied
+        if (segment.offset + offset + bytes < file.header->data_bytes)
+            weights_advise(file, segment.offset + offset + bytes, std::min(file.header->data_bytes - segment.offset - offset - bytes, (long long)WEIGHTS_CHUNK), MADV_WILLNEED);
+        ret = bm_memcpy_s2d_partial_offset(handle, segment.mem, (void *)(data + offset), bytes, offset);
+    }
+    return ret;
+}
+
+// Copies the tensors of a mapped file to the device, addrs[i] is the
+// device address of entry i.
+static inline bm_status_t weights_upload(bm_handle_t handle, const weights_file_t &file, device_weights_t &device) {
+    device.segments.clear();
+    device.addrs.assign(file.header->count, 0);
+    device.bytes = 0;
+    weights_advise(file, 0, file.header->data_bytes, MADV_SEQUENTIAL);
+    bm_status_t ret = BM_SUCCESS;
+    for (int first = 0, last; first < file.header->count && ret == BM_SUCCESS; first = last) {
+        // tensors [first, last) fit a segment
+        weights_segment_t segment;
+        segment.offset = file.entries[first].offset;
+        for (last = first + 1; last < file.header->count; ++last)
+            if (file.entries[last].offset + file.entries[last].bytes - segment.offset > WEIGHTS_SEGMENT)
+                break;
+        segment.bytes = file.entries[last - 1].offset + file.entries[last - 1].bytes - segment.offset;
+        if (segment.bytes > UINT_MAX) {
+            std::cout << "Failed to upload weights " << file.entries[first].name << ", " << segment.bytes << " bytes exceed the 32-bit offsets of bm_memcpy_s2d_partial_offset" << std::endl;
+            ret = BM_ERR_PARAM;
+            break;
+        }
+        ret = bm_malloc_device_byte(handle, &segment.mem, std::max(segment.bytes, (long long)WEIGHTS_TENSOR_ALIGN));
+        if (ret != BM_SUCCESS) {
+            std::cout << "Failed to allocate " << segment.bytes << " bytes of weights" << std::endl;
+            break;
+        }
+        device.segments.push_back(segment);
+        device.bytes += segment.bytes;
+        for (int i = first; i < last; ++i)
+            device.addrs[i] = bm_mem_get_device_addr(segment.mem) + file.entries[i].offset - segment.offset;
+        ret = weights_upload_segment(handle, file, segment);
+        if (ret != BM_SUCCESS)
+            std::cout << "Failed to copy the weights to the device" << std::endl;
+    }
+    if (ret != BM_SUCCESS)
+        weights_free(handle, device);
+    return ret;
+}
+#endif
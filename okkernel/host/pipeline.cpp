@@ -0,0 +1,207 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_pipeline.h"
+#include "okk_random.h"
+#ifdef USING_CMODEL
+#define MICRO_BATCHES (4)
+#else
+#define MICRO_BATCHES (32)
+#endif
+// Runs a small classification network (convolutions with groups and bias,
+// pools and the top 5 of the softmax) as a pipeline over the chips, checks
+// its outputs against the network run on chip 0 without pipelining, and
+// reports the speedup and the utilization of each stage.
+//
+// Usage: pipeline [--micro N] [--batches M] [--stages S] [--split n0,n1,...] [--host-copy]
+//   --micro     images per micro-batch (1)
+//   --batches   micro-batches (32, 4 in C-Model mode)
+//   --stages    stages of about the same FLOPs (one per chip)
+//   --split     layers of each stage, instead of --stages
+//   --host-copy copy activations through the host instead of bm_memcpy_c2c
+//               (always in C-Model mode)
+
+typedef struct {
+    // shape of the activation
+    int N, C, H, W;
+    std::vector<pipeline_layer_t> layers;
+} model_t;
+
+static inline void add_conv(model_t &model, int OC, int kernel, int stride, int pad, int group) {
+    conv2d_group_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.N = model.N;
+    param.IC = model.C;
+    param.OC = OC;
+    param.H = model.H;
+    param.W = model.W;
+    param.group = group;
+    param.kernel_h = param.kernel_w = kernel;
+    param.pad_top = param.pad_bottom = param.pad_left = param.pad_right = pad;
+    param.stride_h = param.stride_w = stride;
+    param.dilation_h = param.dilation_w = 1;
+    param.using_bias = 1;
+    model.layers.push_back(pipeline_layer("conv2d_group", param));
+    model.C = OC;
+    conv2d_group_output_hw(param, model.H, model.W);
+}
+
+template<class P>
+static inline void set_pool(P &param, const model_t &model, int kernel, int stride) {
+    memset(&param, 0, sizeof(param));
+    param.N = model.N;
+    param.C = model.C;
+    param.H = model.H;
+    param.W = model.W;
+    param.kernel_h = param.kernel_w = kernel;
+    param.stride_h = param.stride_w = stride;
+}
+
+static inline void add_max_pool(model_t &model, int kernel, int stride) {
+    max_pool_param_t param;
+    set_pool(param, model, kernel, stride);
+    model.layers.push_back(pipeline_layer("max_pool_0", param));
+    pool_output_hw(param, model.H, model.W);
+}
+
+static inline void add_avg_pool(model_t &model, int kernel, int stride) {
+    avg_pool_param_t param;
+    set_pool(param, model, kernel, stride);
+    param.count_include_pad = 1;
+    model.layers.push_back(pipeline_layer("avg_pool_0", param));
+    pool_output_hw(param, model.H, model.W);
+}
+
+// The K most probable classes of the softmax, their probabilities are the
+// activation and their indices a second output.
+static inline void add_top_k(model_t &model, int K) {
+    topk_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.N = model.N;
+    param.C = model.C * model.H * model.W;
+    param.K = K;
+    param.softmax = 1;
+    model.layers.push_back(pipeline_layer("topk", param));
+    model.C = K;
+    model.H = model.W = 1;
+}
+
+// MobileNet-like: 224x224 RGB to the probabilities of the 5 most probable
+// of 1000 classes.
+static inline model_t build_model(int N) {
+    model_t model = {N, 3, 224, 224, std::vector<pipeline_layer_t>()};
+    add_conv(model, 32, 3, 2, 1, 1);     // 112
+    add_conv(model, 32, 3, 1, 1, 32);
+    add_conv(model, 64, 1, 1, 0, 1);
+    add_max_pool(model, 2, 2);           // 56
+    add_conv(model, 128, 3, 1, 1, 1);
+    add_conv(model, 128, 3, 2, 1, 128);  // 28
+    add_conv(model, 256, 1, 1, 0, 1);
+    add_max_pool(model, 2, 2);           // 14
+    add_conv(model, 256, 3, 1, 1, 8);
+    add_conv(model, 512, 1, 1, 0, 1);
+    add_avg_pool(model, 14, 14);         // 1
+    add_conv(model, 1000, 1, 1, 0, 1);
+    add_top_k(model, 5);
+    return model;
+}
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--micro N] [--batches M] [--stages S] [--split n0,n1,...] [--host-copy]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int micro = 1, micro_batches = MICRO_BATCHES, num_stages = 0;
+    std::vector<int> split;
+#ifdef USING_CMODEL
+    bool host_copy = true;
+#else
+    bool host_copy = false;
+#endif
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--host-copy") {
+            host_copy = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        if (arg == "--micro")
+            micro = atoi(argv[++i]);
+        else if (arg == "--batches")
+            micro_batches = atoi(argv[++i]);
+        else if (arg == "--stages")
+            num_stages = atoi(argv[++i]);
+        else if (arg == "--split") {
+            for (char *p = argv[++i]; *p; ++p) {
+                split.push_back(strtol(p, &p, 10));
+                if (*p != ',')
+                    break;
+            }
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (micro <= 0 || micro_batches <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    // initialize
+    multi_devices_t devices;
+    if (multi_open(devices) != 0)
+        return -1;
+    const int chips = devices.handles.size();
+    model_t model = build_model(micro);
+    std::vector<pipeline_stage_t> stages, sequential;
+    if (pipeline_check(model.layers) != 0 ||
+        pipeline_partition(model.layers, num_stages > 0 ? num_stages : chips, split, chips, stages) != 0 ||
+        pipeline_partition(model.layers, 1, std::vector<int>(), 1, sequential) != 0) {
+        if (!split.empty())
+            std::cout << "Failed to split " << model.layers.size() << " layers as --split says" << std::endl;
+        multi_close(devices);
+        return -1;
+    }
+    for (size_t l = 0; l < model.layers.size(); ++l)
+        std::cout << "layer " << l << " " << model.layers[l].kernel_name << " [" << model.layers[l].shape << "]" << std::endl;
+    const pipeline_layer_t &first = model.layers.front();
+    const long long input_len = first.lens[first.input_index], output_len = model.layers.back().lens[0];
+    const unsigned long long seed = golden_seed();
+    std::vector<float> input((long long)micro_batches * input_len);
+    std::vector<float> output((long long)micro_batches * output_len), output_ref(output.size());
+    random_uniform(input.data(), input.size(), -1.f, 1.f, seed, 0);
+    // the network on chip 0 without pipelining
+    int ret = -1;
+    double sequential_us = -1, pipeline_us = -1;
+    if (pipeline_alloc(devices.handles[0], model.layers, sequential[0], seed) == BM_SUCCESS)
+        sequential_us = pipeline_run(devices, model.layers, sequential, input.data(), output_ref.data(), micro_batches, host_copy);
+    pipeline_free(devices.handles[0], sequential[0]);
+    bool allocated = true;
+    for (size_t s = 0; s < stages.size(); ++s)
+        allocated = allocated && pipeline_alloc(devices.handles[stages[s].device], model.layers, stages[s], seed) == BM_SUCCESS;
+    if (allocated)
+        pipeline_us = pipeline_run(devices, model.layers, stages, input.data(), output.data(), micro_batches, host_copy);
+    for (size_t s = 0; s < stages.size(); ++s)
+        pipeline_free(devices.handles[stages[s].device], stages[s]);
+    if (sequential_us < 0 || pipeline_us < 0) {
+        std::cout << "Failed to run the network" << (sequential_us < 0 ? " on chip 0" : " as a pipeline") << std::endl;
+    } else if (compare_check(output.data(), output_ref.data(), output.size(), compare_options(1e-6, micro_batches * micro, model.C, model.H, model.W))) {
+        pipeline_print(model.layers, stages, pipeline_us, micro_batches);
+        std::cout << micro_batches << " micro-batches of " << micro << " on " << stages.size() << " stages, "
+                  << chips << " chips" << (host_copy ? " (host copies)" : "") << ": sequential " << sequential_us
+                  << " us, pipeline " << pipeline_us << " us, speedup " << sequential_us / pipeline_us << std::endl;
+        ret = 0;
+    } else
+        std::cout << "pipeline fail" << std::endl;
+    // deinitialize
+    multi_close(devices);
+    return ret;
+}
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <iostream>
 #include <random>
+#include "okk_random.h"
+#include "okk_timer.h"
 #define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
 
 typedef struct {
@@ -18,7 +20,6 @@ int main() {
     param_t param;
     std::mt19937 rng;
     rng.seed(std::random_device()());
-    std::uniform_real_distribution<float> dist_value;
     std::uniform_int_distribution<int> dist_n(1, 16);
     std::uniform_int_distribution<int> dist_c(1, 128);
     std::uniform_int_distribution<int> dist_h(1, 64);
@@ -37,8 +38,7 @@ int main() {
     param.input_addr = bm_mem_get_device_addr(input_dev);
     output_host = new float[length];
     input_host = new float[length];
-    for (int i = 0; i < length; ++i)
-        input_host[i] = dist_value(rng);
+    random_uniform(input_host, length, 0.f, 1.f, rng(), 1);
     BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, input_dev, input_host));
     // Launch kernel plus_one_0.
     BMLIB_SAFE_CALL(okkernel_launch_sync(handle, "plus_one_0", &param, sizeof(param)));
@@ -54,12 +54,15 @@ int main() {
             assert(std::fabs(output_host[i] - (input_host[i] + 1.f)) < 1e-5);
         std::cout << "plus_one_1 succeeded." << std::endl;
     }
-    // Launch kernel plus_one_2.
-    BMLIB_SAFE_CALL(okkernel_launch_sync(handle, "plus_one_2", &param, sizeof(param)));
+    // Launch kernel plus_one_2 with a timer buffer for its regions.
+    std::vector<timer_record_t> records;
+    unsigned int dropped = 0;
+    BMLIB_SAFE_CALL(timer_launch(handle, "plus_one_2", param, TUNE_AUTO, records, dropped));
     BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host, output_dev));
     for (int i = 0; i < length; ++i)
         assert(std::fabs(output_host[i] - (input_host[i] + 1.f)) < 1e-5);
     std::cout << "plus_one_2 succeeded." << std::endl;
+    timer_print(records, dropped);
     // Launch kernel plus_one_3.
     BMLIB_SAFE_CALL(okkernel_launch_sync(handle, "plus_one_3", &param, sizeof(param)));
     BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host, output_dev));
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "preprocess"
+typedef preprocess_param_t param_t;
+// Converts batches of packed uint8 frames to normalized [N, C, H, W] fp32
+// with the kernel preprocess, checks the outputs against the host reference
+// and reports the time of the kernel against the one of the reference, the
+// CPU stage it replaces.
+//
+// Usage: preprocess [--filter pattern]...
+//   pattern  a glob over preprocess/case_index
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--filter pattern]..." << std::endl;
+}
+
+// Returns false if the case fails.
+static bool preprocess(bm_handle_t handle, int index, param_t param) {
+    const std::vector<long long> lens = tensor_lens(param);
+    const long long pitch = param.pitch > 0 ? param.pitch : (long long)param.W * param.C;
+    const long long input_bytes = param.N * param.H * pitch;
+    std::vector<unsigned char> input(input_bytes);
+    std::vector<float> output(lens[0]), output_ref(lens[0]);
+    random_bytes(input.data(), input_bytes, golden_seed(), 1);
+    const double start_time = bench_now_us();
+    preprocess_reference(output_ref.data(), input.data(), param);
+    const double host_us = bench_now_us() - start_time;
+    std::cout << KERNEL_NAME << " case " << index << " [" << shape_str(param) << "]: ";
+    device_tensors_t tensors;
+    bool pass = false;
+    bench_stats_t stats = bench_stats_none();
+    if (device_tensors_malloc(handle, param, tensors) == BM_SUCCESS &&
+        bm_memcpy_s2d_partial(handle, tensors.devs[1], input.data(), input_bytes) == BM_SUCCESS) {
+        stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), 0, MAXIT);
+        if (stats.iterations == MAXIT && bm_memcpy_d2s(handle, output.data(), tensors.devs[0]) == BM_SUCCESS)
+            pass = compare_check(output.data(), output_ref.data(), lens[0], compare_options(1e-5, param.N, param.C, param.H, param.W));
+    }
+    device_tensors_free(handle, tensors);
+    if (pass)
+        std::cout << "device " << std::round(stats.mean) << " us (median " << stats.median << "), host " << std::round(host_us) << " us" << std::endl;
+    else
+        std::cout << "fail" << std::endl;
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(preprocess_cases); ++i) {
+        if (!bench_selected(options, KERNEL_NAME, i))
+            continue;
+        ++cases;
+        failed += !preprocess(handle, i, preprocess_cases[i]);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
@@ -1,8 +1,10 @@
 #include <assert.h>
 #include <iostream>
-#include <random>
-#include <sys/time.h>
 #include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
 #define BMLIB_SAFE_CALL(cmd) assert(cmd == BM_SUCCESS)
 #define DIV_UP(a, b) (((a) - 1) / (b) + 1)
 #ifdef USING_CMODEL
@@ -10,11 +12,7 @@
 #else
 #define MAXIT (100)
 #endif
-typedef struct {
-    int N, C, H, W;
-    unsigned long long output_addr;
-    unsigned long long input_addr;
-} __attribute__((packed)) param_t;
+typedef softmax_param_t param_t;
 
 static inline void softmax_reference(float *output, const float *input, const param_t &param) {
     for (int n = 0; n < param.N; ++n) {
@@ -36,11 +34,19 @@ static inline void softmax_reference(float *output, const float *input, const pa
 }
 
 int softmax(bm_handle_t &handle, param_t &param, const char *device_func_name) {
-    std::mt19937 rng;
-    rng.seed(std::random_device()());
-    std::uniform_real_distribution<float> dist_value{-5.f, 5.f};
-    float *output_host = nullptr, *input_host = nullptr, *output_ref = nullptr;
+    float *output_host = nullptr;
     long long len = (long long)param.N * param.C * param.H * param.W;
+    // input and reference output, from the golden cache or generated
+    const unsigned long long seed = golden_seed();
+    golden_t golden;
+    if (golden_load(golden, device_func_name, param, seed, [&](float *const *tensors) {
+        // random input values
+        random_uniform(tensors[1], len, -5.f, 5.f, seed, 1);
+        // reference
+        softmax_reference(tensors[0], tensors[1], param);
+    }) != 0)
+        return -1;
+    const float *output_ref = golden.tensors[0];
     // alloc device memory
     bm_device_mem_t output_dev, input_dev;
     BMLIB_SAFE_CALL(bm_malloc_device_byte(handle, &output_dev, len * sizeof(float)));
@@ -49,47 +55,25 @@ int softmax(bm_handle_t &handle, param_t &param, const char *device_func_name) {
     param.input_addr = bm_mem_get_device_addr(input_dev);
     // alloc host memory
     output_host = new float[len];
-    output_ref = new float[len];
-    input_host = new float[len];
-    // random input and kernel values
-    for (int i = 0; i < len; ++i)
-        input_host[i] = dist_value(rng);
-    // reference
-    softmax_reference(output_ref, input_host, param);
     // copy input from host to device
-    BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, input_dev, input_host));
+    BMLIB_SAFE_CALL(bm_memcpy_s2d(handle, input_dev, golden.tensors[1]));
     // launch kernel function
-    struct timeval start_time, end_time;
-    long long elapsed_time = 0;
-    for (int i = 0; i < MAXIT; ++i) {
-        gettimeofday(&start_time, NULL);
-        BMLIB_SAFE_CALL(okkernel_launch_sync(handle, device_func_name, &param, sizeof(param)));
-        gettimeofday(&end_time, NULL);
-        elapsed_time += (end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec);
-    }
+    const tune_t tune = tune_lookup(device_func_name, param);
+    bench_stats_t stats = bench_launch(handle, device_func_name, param, tune, 0, MAXIT);
+    assert(stats.iterations == MAXIT);
     // copy output from device to host
     BMLIB_SAFE_CALL(bm_memcpy_d2s(handle, output_host, output_dev));
-    bool pass = true;
-    for (long long i = 0; i < len; ++i) {
-        if (!std::isfinite(output_host[i]) && !std::isfinite(output_ref[i]))
-            continue;
-        float max_val = std::max(std::fabs(output_host[i]), std::fabs(output_ref[i]));
-        if (!(std::fabs(output_host[i] - output_ref[i]) < 1e-3 * std::max(max_val, 1.f))) {
-            pass = false;
-            break;
-        }
-    }
+    const bool pass = compare_check(output_host, output_ref, len, compare_options(1e-3, param.N, param.C, param.H, param.W));
     int res = -1;
     if (pass) {
-        res = std::round(elapsed_time / (double)MAXIT);
-        std::cout << "elapsed time: " << res << "(us)" << std::endl;
+        res = std::round(stats.mean);
+        bench_print(stats);
     }
     // free
     bm_free_device(handle, output_dev);
     bm_free_device(handle, input_dev);
     delete [] output_host;
-    delete [] output_ref;
-    delete [] input_host;
+    golden_free(golden);
     return res;
 }
 
@@ -100,16 +84,10 @@ int main() {
     ////////////////////////////////////////////////////////////////////////
     /// CONTEST CASES
     /// ////////////////////////////////////////////////////////////////////
-    param_t params[] = {
-        {.N = 1,     .C = 370,  .H = 13,  .W = 13 }, // 0
-        {.N = 1,     .C = 1000, .H = 1,   .W = 1  }, // 1
-        {.N = 4,     .C = 2,    .H = 157, .W = 283}, // 2
-        {.N = 79,    .C = 4090, .H = 1,   .W = 1  }, // 3
-        {.N = 6132,  .C = 21,   .H = 1,   .W = 1  }, // 4
-    };
-    int results[sizeof(params) / sizeof(param_t)];
-    for (unsigned int i = 0; i < sizeof(params) / sizeof(param_t); ++i) {
-        int res = softmax(handle, params[i], "softmax_contest");
+    int results[CASE_NUM(softmax_contest_cases)];
+    for (int i = 0; i < CASE_NUM(softmax_contest_cases); ++i) {
+        param_t param = softmax_contest_cases[i];
+        int res = softmax(handle, param, "softmax_contest");
         if (res >= 0)
             std::cout << "case " << i << " pass" << std::endl;
         else
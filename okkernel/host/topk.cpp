@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_compare.h"
+#include "okk_golden.h"
+#include "okk_random.h"
+#include "okk_reference.h"
+#ifdef USING_CMODEL
+#define MAXIT (1)
+#else
+#define MAXIT (100)
+#endif
+#define KERNEL_NAME "topk"
+typedef topk_param_t param_t;
+// Takes the top k of rows of random logits, of their softmax for the cases
+// with softmax, with the kernel topk, checks the values and indices against
+// the host reference and reports the time of the kernel and of the download
+// of the [N, K] values and indices against the time of the reference and
+// of the download of the [N, C] rows it needs, the host path it replaces.
+//
+// Usage: topk [--filter pattern]...
+//   pattern  a glob over topk/case_index
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--filter pattern]..." << std::endl;
+}
+
+// True if every index matches the reference or points to the same value
+// in its row, the order of ties is up to the sort.
+static bool index_check(const int *index, const int *index_ref, const float *input, const param_t &param) {
+    for (long long i = 0; i < (long long)param.N * param.K; ++i) {
+        const float *row = input + i / param.K * param.C;
+        if (index[i] != index_ref[i] && (index[i] < 0 || index[i] >= param.C || row[index[i]] != row[index_ref[i]])) {
+            std::cout << "index (" << i / param.K << ", " << i % param.K << ") is " << index[i] << ", expected " << index_ref[i] << ", ";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false if the case fails.
+static bool topk(bm_handle_t handle, int index, param_t param) {
+    const std::vector<long long> lens = tensor_lens(param);
+    std::vector<float> input(lens[2]), output(lens[0]), output_ref(lens[0]);
+    std::vector<int> indices(lens[1]), indices_ref(lens[1]);
+    random_uniform(input.data(), lens[2], -8.f, 8.f, golden_seed(), 1);
+    double start_time = bench_now_us();
+    topk_reference(output_ref.data(), indices_ref.data(), input.data(), param);
+    const double host_us = bench_now_us() - start_time;
+    std::cout << KERNEL_NAME << " case " << index << " [" << shape_str(param) << "]: ";
+    device_tensors_t tensors;
+    bool pass = false;
+    bench_stats_t stats = bench_stats_none();
+    double output_us = 0, input_us = 0;
+    if (device_tensors_malloc(handle, param, tensors) == BM_SUCCESS &&
+        bm_memcpy_s2d(handle, tensors.devs[2], input.data()) == BM_SUCCESS) {
+        stats = bench_launch(handle, KERNEL_NAME, param, tune_lookup(KERNEL_NAME, param), 0, MAXIT);
+        start_time = bench_now_us();
+        bm_status_t ret = bm_memcpy_d2s(handle, output.data(), tensors.devs[0]);
+        if (ret == BM_SUCCESS)
+            ret = bm_memcpy_d2s(handle, indices.data(), tensors.devs[1]);
+        output_us = bench_now_us() - start_time;
+        // what the host path downloads before its top k
+        start_time = bench_now_us();
+        if (ret == BM_SUCCESS)
+            ret = bm_memcpy_d2s(handle, input.data(), tensors.devs[2]);
+        input_us = bench_now_us() - start_time;
+        if (stats.iterations == MAXIT && ret == BM_SUCCESS)
+            pass = index_check(indices.data(), indices_ref.data(), input.data(), param) &&
+                   compare_check(output.data(), output_ref.data(), lens[0], compare_options(1e-5, param.N, param.K, 1, 1));
+    }
+    device_tensors_free(handle, tensors);
+    if (pass)
+        std::cout << "device " << std::round(stats.mean) << " us (median " << stats.median << ") + " << std::round(output_us)
+                  << " us for " << (lens[0] + lens[1]) * 4 << " B, host " << std::round(host_us) << " us + "
+                  << std::round(input_us) << " us for " << lens[2] * 4 << " B" << std::endl;
+    else
+        std::cout << "fail" << std::endl;
+    return pass;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.filters.push_back(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    bm_handle_t handle;
+    // initialize
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    int cases = 0, failed = 0;
+    for (int i = 0; i < CASE_NUM(topk_cases); ++i) {
+        if (!bench_selected(options, KERNEL_NAME, i))
+            continue;
+        ++cases;
+        failed += !topk(handle, i, topk_cases[i]);
+    }
+    std::cout << cases - failed << " of " << cases << " cases pass" << std::endl;
+    // deinitialize
+    bm_dev_free(handle);
+    return failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmlib_runtime.h"
+#include "okk_bench.h"
+#include "okk_golden.h"
+#include "okk_param.h"
+#include "okk_random.h"
+#include "okk_weights.h"
+// Writes a weight file (see host/okk_weights.h) with random weights of the
+// layers of param/conv.dat and of the depthwise and matmul contest cases,
+// or loads one to chip 0 and reports the time and bandwidth of the load.
+//
+// Usage: weight_file write PATH [--layers N]
+//        weight_file load PATH [--check]
+//   --layers the first N layers of conv.dat (all)
+//   --check  read the weights back and compare them with the file
+
+static inline void usage(const char *prog) {
+    std::cout << "Usage: " << prog << " write PATH [--layers N]" << std::endl;
+    std::cout << "       " << prog << " load PATH [--check]" << std::endl;
+}
+
+static inline int write_file(const std::string &path, size_t layers) {
+    param_span_t<conv_t> params;
+    if (param_map("./param/conv.dat", params) != 0)
+        return -1;
+    const unsigned long long seed = golden_seed();
+    weights_writer_t writer;
+    if (weights_create(writer, path) != 0) {
+        param_unmap(params);
+        return -1;
+    }
+    int ret = 0;
+    uint32_t stream = 0;
+    for (size_t i = 0; i < std::min(layers, params.len) && ret == 0; ++i) {
+        const conv_t &conv = params[i];
+        std::vector<float> kernel((long long)conv.oc * (conv.ic / conv.group) * conv.kh * conv.kw);
+        random_uniform(kernel.data(), kernel.size(), -1.f, 1.f, seed, ++stream);
+        const std::string name = "conv" + std::to_string(i);
+        ret = weights_add_conv(writer, name + ".kernel", kernel.data(), conv.oc, conv.ic, conv.kh, conv.kw, conv.group);
+        if (ret == 0 && conv.have_bias) {
+            std::vector<float> bias(conv.oc);
+            random_uniform(bias.data(), bias.size(), -1.f, 1.f, seed, ++stream);
+            ret = weights_add_raw(writer, name + ".bias", bias.data(), bias.size());
+        }
+    }
+    param_unmap(params);
+    for (int i = 0; i < CASE_NUM(depthwise_contest_cases) && ret == 0; ++i) {
+        const depthwise_param_t &param = depthwise_contest_cases[i];
+        std::vector<float> kernel((long long)param.C * param.kernel_h * param.kernel_w);
+        random_uniform(kernel.data(), kernel.size(), -1.f, 1.f, seed, ++stream);
+        ret = weights_add_depthwise(writer, "depthwise" + std::to_string(i) + ".kernel", kernel.data(), param.C, param.kernel_h, param.kernel_w);
+    }
+    for (int i = 0; i < CASE_NUM(matmul_contest_cases) && ret == 0; ++i) {
+        const matmul_param_t &param = matmul_contest_cases[i];
+        std::vector<float> right((long long)param.left_cols * param.right_cols);
+        random_uniform(right.data(), right.size(), -1.f, 1.f, seed, ++stream);
+        ret = weights_add_matmul_right(writer, "matmul" + std::to_string(i) + ".right", right.data(), param.left_cols, param.right_cols);
+    }
+    if (weights_finish(writer) != 0)
+        return -1;
+    std::cout << "wrote " << writer.entries.size() << " tensors, " << writer.data_bytes / 1048576.0 << " MiB to " << path << std::endl;
+    return 0;
+}
+
+// Compares the device copy of the weights with the file, one chunk at a time.
+static inline bool check_upload(bm_handle_t handle, const weights_file_t &file, const device_weights_t &device) {
+    std::vector<char> chunk(WEIGHTS_CHUNK);
+    for (size_t s = 0; s < device.segments.size(); ++s) {
+        const weights_segment_t &segment = device.segments[s];
+        for (long long offset = 0; offset < segment.bytes; offset += WEIGHTS_CHUNK) {
+            const long long bytes = std::min(segment.bytes - offset, (long long)WEIGHTS_CHUNK);
+            if (bm_memcpy_d2s_partial_offset(handle, chunk.data(), segment.mem, bytes, offset) != BM_SUCCESS ||
+                memcmp(chunk.data(), file.data + segment.offset + offset, bytes) != 0) {
+                std::cout << "weights mismatch in bytes [" << segment.offset + offset << ", " << segment.offset + offset + bytes << ")" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static inline int load_file(const std::string &path, bool check) {
+    bm_handle_t handle;
+    if (bm_dev_request(&handle, 0) != BM_SUCCESS) {
+        std::cout << "Failed to request device 0" << std::endl;
+        return -1;
+    }
+    const double start_time = bench_now_us();
+    weights_file_t file;
+    device_weights_t device;
+    int ret = -1;
+    if (weights_map(path, file) == 0 && weights_upload(handle, file, device) == BM_SUCCESS) {
+        const double elapsed = bench_now_us() - start_time;
+        std::cout << "loaded " << file.header->count << " tensors, " << device.bytes / 1048576.0 << " MiB in "
+                  << device.segments.size() << " buffers in "
+                  << elapsed * 1e-3 << " ms, " << device.bytes / elapsed * 1e-3 << " GB/s" << std::endl;
+        ret = check && !check_upload(handle, file, device) ? -1 : 0;
+        weights_free(handle, device);
+    }
+    weights_unmap(file);
+    bm_dev_free(handle);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return -1;
+    }
+    const std::string command = argv[1], path = argv[2];
+    size_t layers = (size_t)-1;
+    bool check = false;
+    for (int i = 3; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--check")
+            check = true;
+        else if (arg == "--layers" && i + 1 < argc)
+            layers = atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (command == "write")
+        return write_file(path, layers);
+    if (command == "load")
+        return load_file(path, check);
+    usage(argv[0]);
+    return -1;
+}